@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+
+#include "contactcache.h"
+
+#include "contactid_p.h"
+
+#include <QContactRelationship>
+
+#include <QSet>
+
+#include <algorithm>
+
+ContactCache::ContactCache(int maximumSize)
+    : m_contacts(maximumSize)
+    , m_generation(0)
+{
+}
+
+ContactCache::~ContactCache()
+{
+}
+
+QByteArray ContactCache::hintKey(const QContactFetchHint &fetchHint)
+{
+    // A count limit truncates the result rather than selecting content
+    if (fetchHint.maxCountHint() > 0)
+        return QByteArray();
+
+    QList<int> types;
+    foreach (QContactDetail::DetailType type, fetchHint.detailTypesHint()) {
+        types.append(static_cast<int>(type));
+    }
+    std::sort(types.begin(), types.end());
+
+    QByteArray key(QByteArray::number(static_cast<int>(fetchHint.optimizationHints())));
+    key.append(':');
+    foreach (int type, types) {
+        key.append(QByteArray::number(type));
+        key.append(',');
+    }
+    return key;
+}
+
+quint64 ContactCache::generation() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_generation;
+}
+
+bool ContactCache::find(quint32 contactId, const QByteArray &hintKey, QContact *contact)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (Variants *variants = m_contacts.object(contactId)) {
+        Variants::const_iterator it = variants->constFind(hintKey);
+        if (it != variants->constEnd()) {
+            *contact = *it;
+            ++m_statistics.hits;
+            return true;
+        }
+    }
+
+    ++m_statistics.misses;
+    return false;
+}
+
+void ContactCache::insert(quint32 contactId, const QByteArray &hintKey, const QContact &contact, quint64 generation)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (generation != m_generation) {
+        // This contact may have been modified after it was read
+        return;
+    }
+
+    Variants *variants = m_contacts.take(contactId);
+    if (!variants) {
+        variants = new Variants;
+    }
+    variants->insert(hintKey, contact);
+
+    // Each variant counts towards the size limit
+    m_contacts.insert(contactId, variants, variants->count());
+}
+
+void ContactCache::recordUncacheable()
+{
+    QMutexLocker locker(&m_mutex);
+    ++m_statistics.uncacheable;
+}
+
+void ContactCache::remove(const QList<quint32> &contactIds)
+{
+    QMutexLocker locker(&m_mutex);
+
+    ++m_generation;
+    foreach (quint32 contactId, contactIds) {
+        if (m_contacts.remove(contactId)) {
+            ++m_statistics.invalidations;
+        }
+    }
+}
+
+void ContactCache::removeReferenced(const QList<quint32> &contactIds)
+{
+    QMutexLocker locker(&m_mutex);
+
+    ++m_generation;
+
+    const QSet<quint32> removedIds(contactIds.toSet());
+    QList<quint32> referringIds;
+    foreach (quint32 cachedId, m_contacts.keys()) {
+        if (removedIds.contains(cachedId)) {
+            referringIds.append(cachedId);
+            continue;
+        }
+
+        const Variants *variants = m_contacts.object(cachedId);
+        bool referring = false;
+        for (Variants::const_iterator it = variants->constBegin(); !referring && it != variants->constEnd(); ++it) {
+            foreach (const QContactRelationship &relationship, it->relationships()) {
+                if (removedIds.contains(ContactId::databaseId(relationship.first()))
+                        || removedIds.contains(ContactId::databaseId(relationship.second()))) {
+                    referring = true;
+                    break;
+                }
+            }
+        }
+        if (referring) {
+            referringIds.append(cachedId);
+        }
+    }
+
+    foreach (quint32 cachedId, referringIds) {
+        m_contacts.remove(cachedId);
+        ++m_statistics.invalidations;
+    }
+}
+
+void ContactCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+
+    ++m_generation;
+    m_statistics.invalidations += m_contacts.count();
+    m_contacts.clear();
+}
+
+ContactCache::Statistics ContactCache::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    Statistics statistics(m_statistics);
+    statistics.entries = m_contacts.totalCost();
+    return statistics;
+}
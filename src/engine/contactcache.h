@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+
+#ifndef QTCONTACTSSQLITE_CONTACTCACHE
+#define QTCONTACTSSQLITE_CONTACTCACHE
+
+#include <QContact>
+#include <QContactFetchHint>
+
+#include <QByteArray>
+#include <QCache>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+
+QTCONTACTS_USE_NAMESPACE
+
+// A bounded cache of fully-built contacts, keyed by database id and by the content selected
+// by the fetch hint.  The cache is shared between the reader threads of an engine; entries
+// are invalidated when the notifier reports a change, or when a local write is committed.
+class ContactCache
+{
+public:
+    struct Statistics {
+        Statistics() : hits(0), misses(0), uncacheable(0), invalidations(0), entries(0) {}
+
+        qint64 hits;
+        qint64 misses;
+        qint64 uncacheable;
+        qint64 invalidations;
+        qint64 entries;
+    };
+
+    explicit ContactCache(int maximumSize);
+    ~ContactCache();
+
+    // Returns an empty key if contacts fetched with this hint should not be cached
+    static QByteArray hintKey(const QContactFetchHint &fetchHint);
+
+    // Any invalidation advances the generation; a contact read from the database may
+    // only be inserted if no invalidation has occurred since the read began
+    quint64 generation() const;
+
+    bool find(quint32 contactId, const QByteArray &hintKey, QContact *contact);
+    void insert(quint32 contactId, const QByteArray &hintKey, const QContact &contact, quint64 generation);
+    void recordUncacheable();
+
+    void remove(const QList<quint32> &contactIds);
+    // Also removes any contact whose relationships refer to the removed contacts
+    void removeReferenced(const QList<quint32> &contactIds);
+    void clear();
+
+    Statistics statistics() const;
+
+private:
+    typedef QHash<QByteArray, QContact> Variants;
+
+    mutable QMutex m_mutex;
+    QCache<quint32, Variants> m_contacts;
+    quint64 m_generation;
+    Statistics m_statistics;
+
+    Q_DISABLE_COPY(ContactCache)
+};
+
+#endif
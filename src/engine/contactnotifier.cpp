@@ -215,6 +215,13 @@ void ContactNotifier::displayLabelGroupsChanged()
     sendMessage(message);
 }
 
+void ContactNotifier::upgradeProgress(const QString &task, int completed, int total)
+{
+    QDBusMessage message = createSignal("upgradeProgress", m_nonprivileged);
+    message.setArguments(QVariantList() << QVariant(task) << QVariant(completed) << QVariant(total));
+    sendMessage(message);
+}
+
 bool ContactNotifier::connect(const char *name, const char *signature, QObject *receiver, const char *slot)
 {
     static QDBusConnection connection(QDBusConnection::sessionBus());
@@ -63,6 +63,7 @@ public:
     void relationshipsAdded(const QSet<QContactId> &contactIds);
     void relationshipsRemoved(const QSet<QContactId> &contactIds);
     void displayLabelGroupsChanged();
+    void upgradeProgress(const QString &task, int completed, int total);
 
     bool connect(const char *name, const char *signature, QObject *receiver, const char *slot);
 
@@ -1546,9 +1546,93 @@ typedef QString (*BuildFilterPart)(
         bool *transientModifiedRequired,
         bool *globalPresenceRequired);
 
+namespace {
+bool filterShape(const QContactDetailFilter &filter, QString *key, QVariantList *bindings, bool *equality);
+}
+
+// Returns the table of a detail filter which may be tested together with others
+// on the same table, or null if the filter must be tested independently
+static const char *mergeableTable(const QContactFilter &filter, bool queryContacts, QContactDetail::DetailType detailType)
+{
+    if (filter.type() != QContactFilter::ContactDetailFilter)
+        return nullptr;
+
+    const QContactDetailFilter &detailFilter(static_cast<const QContactDetailFilter &>(filter));
+    if (!queryContacts && detailFilter.detailType() != detailType)
+        return nullptr;
+    if (detailFilter.matchFlags() & QContactFilter::MatchKeypadCollation)
+        return nullptr;
+
+    const DetailInfo &detail(detailInformation(detailFilter.detailType()));
+    if (detail.detailType == QContactDetail::TypeUndefined || !detail.table || detailFilter.detailField() == invalidField)
+        return nullptr;
+    if (fieldInformation(detail, detailFilter.detailField()).field == invalidField)
+        return nullptr;
+
+    // Presence state is tested against transient state, in its own subquery
+    if (filterOnField<QContactGlobalPresence>(detailFilter, QContactGlobalPresence::FieldPresenceState))
+        return nullptr;
+
+    return detail.table;
+}
+
+// A term of a union filter: either a single filter tested independently, or the
+// detail filters on one table, tested in a single subquery.  Each condition of the
+// subquery tests either one filter, or several equality filters on the same column.
+struct UnionTerm
+{
+    const char *table;
+    QList<QList<int> > conditions;
+    QStringList equalityKeys;
+};
+
+static QList<UnionTerm> planUnion(const QList<QContactFilter> &filters, bool queryContacts, QContactDetail::DetailType detailType)
+{
+    QList<UnionTerm> terms;
+
+    for (int i = 0; i < filters.count(); ++i) {
+        const char *table = mergeableTable(filters.at(i), queryContacts, detailType);
+        if (!table) {
+            UnionTerm term = { nullptr, QList<QList<int> >() << (QList<int>() << i), QStringList() << QString() };
+            terms.append(term);
+            continue;
+        }
+
+        int termIndex = 0;
+        for ( ; termIndex < terms.count(); ++termIndex) {
+            if (terms.at(termIndex).table == table)
+                break;
+        }
+        if (termIndex == terms.count()) {
+            UnionTerm term = { table, QList<QList<int> >(), QStringList() };
+            terms.append(term);
+        }
+        UnionTerm &term(terms[termIndex]);
+
+        QString key;
+        QVariantList values;
+        bool equality = false;
+        if (filterShape(static_cast<const QContactDetailFilter &>(filters.at(i)), &key, &values, &equality) && equality) {
+            const int conditionIndex = term.equalityKeys.indexOf(key);
+            if (conditionIndex != -1) {
+                term.conditions[conditionIndex].append(i);
+                continue;
+            }
+        } else {
+            key.clear();
+        }
+
+        term.conditions.append(QList<int>() << i);
+        term.equalityKeys.append(key);
+    }
+
+    return terms;
+}
+
 static QString buildWhere(
         BuildFilterPart buildWhere,
         const QContactUnionFilter &filter,
+        bool queryContacts,
         ContactsDatabase &db,
         const QString &table,
         QContactDetail::DetailType detailType,
@@ -1561,17 +1645,69 @@ static QString buildWhere(
     if (filters.isEmpty())
         return QString();
 
+    // Rather than a separate subquery for each detail filter, test all those on the
+    // same table in one subquery, and combine equality tests of a column into IN lists
     QStringList fragments;
-    foreach (const QContactFilter &filter, filters) {
-        const QString fragment = buildWhere(filter, db, table, detailType, bindings, failed, transientModifiedRequired, globalPresenceRequired);
-        if (!*failed && !fragment.isEmpty()) {
-            fragments.append(fragment);
+    foreach (const UnionTerm &term, planUnion(filters, queryContacts, detailType)) {
+        if (!term.table) {
+            const QString fragment = buildWhere(filters.at(term.conditions.first().first()), db, table, detailType, bindings, failed, transientModifiedRequired, globalPresenceRequired);
+            if (!*failed && !fragment.isEmpty()) {
+                fragments.append(fragment);
+            }
+            continue;
+        }
+
+        QStringList conditions;
+        foreach (const QList<int> &indices, term.conditions) {
+            QStringList tests;
+            foreach (int index, indices) {
+                tests.append(::buildWhere(static_cast<const QContactDetailFilter &>(filters.at(index)), false, bindings, failed, transientModifiedRequired, globalPresenceRequired));
+            }
+
+            static const QString equalityTest(QStringLiteral(" = ?"));
+            if (tests.count() > 1 && tests.first().endsWith(equalityTest)) {
+                QString test(tests.first());
+                test.chop(equalityTest.length());
+                test.append(QStringLiteral(" IN (?"));
+                for (int i = 1; i < tests.count(); ++i) {
+                    test.append(QStringLiteral(",?"));
+                }
+                conditions.append(test + QStringLiteral(")"));
+            } else {
+                conditions.append(tests);
+            }
         }
+
+        if (*failed) {
+            continue;
+        }
+        const QString condition(conditions.count() > 1
+                ? QStringLiteral("(%1)").arg(conditions.join(QStringLiteral(" OR ")))
+                : conditions.first());
+        fragments.append(queryContacts
+                ? QStringLiteral("Contacts.contactId IN (SELECT contactId FROM %1 WHERE %2)").arg(QLatin1String(term.table)).arg(condition)
+                : condition);
     }
 
     return QStringLiteral("( %1 )").arg(fragments.join(QStringLiteral(" OR ")));
 }
 
+// Returns the filters of an intersection with any id or collection filters first, as
+// these constraints are the most selective and cheapest to test
+static QList<QContactFilter> hoistedFilters(const QList<QContactFilter> &filters)
+{
+    QList<QContactFilter> constraints;
+    QList<QContactFilter> others;
+    foreach (const QContactFilter &filter, filters) {
+        if (filter.type() == QContactFilter::IdFilter || filter.type() == QContactFilter::CollectionFilter) {
+            constraints.append(filter);
+        } else {
+            others.append(filter);
+        }
+    }
+    return constraints + others;
+}
+
 static QString buildWhere(
         BuildFilterPart buildWhere,
         const QContactIntersectionFilter &filter,
@@ -1583,7 +1719,7 @@ static QString buildWhere(
         bool *transientModifiedRequired,
         bool *globalPresenceRequired)
 {
-    const QList<QContactFilter> filters  = filter.filters();
+    const QList<QContactFilter> filters  = hoistedFilters(filter.filters());
     if (filters.isEmpty())
         return QString();
 
@@ -1620,7 +1756,7 @@ static QString buildContactWhere(const QContactFilter &filter, ContactsDatabase
     case QContactFilter::IntersectionFilter:
         return buildWhere(buildContactWhere, static_cast<const QContactIntersectionFilter &>(filter), db, table, detailType, bindings, failed, transientModifiedRequired, globalPresenceRequired);
     case QContactFilter::UnionFilter:
-        return buildWhere(buildContactWhere, static_cast<const QContactUnionFilter &>(filter), db, table, detailType, bindings, failed, transientModifiedRequired, globalPresenceRequired);
+        return buildWhere(buildContactWhere, static_cast<const QContactUnionFilter &>(filter), true, db, table, detailType, bindings, failed, transientModifiedRequired, globalPresenceRequired);
     case QContactFilter::IdFilter:
         return buildWhere(static_cast<const QContactIdFilter &>(filter), db, table, bindings, failed);
     case QContactFilter::CollectionFilter:
@@ -1692,6 +1828,7 @@ static QString buildDetailWhere(
         return buildWhere(
                     buildDetailWhere,
                     static_cast<const QContactUnionFilter &>(filter),
+                    false,
                     db,
                     table,
                     detailType,
@@ -1713,13 +1850,22 @@ static QString buildDetailWhere(
 }
 
 
+// A term of the sort order, as needed to select the rows following a given row
+struct SortKey
+{
+    QString expression;
+    QString collation;
+    bool ascending;
+};
+
 static QString buildOrderBy(
         const QContactSortOrder &order,
         QContactDetail::DetailType detailType,
         QStringList *joins,
         bool *transientModifiedRequired,
         bool *globalPresenceRequired,
-        bool useLocale )
+        bool useLocale,
+        QList<SortKey> *keys = nullptr)
 {
     Q_ASSERT(joins);
     Q_ASSERT(transientModifiedRequired);
@@ -1736,7 +1882,11 @@ static QString buildOrderBy(
 
     if (order.detailField() == invalidField) {
         // If there is no field, we're simply sorting by the existence or otherwise of the detail
-        return detail.orderByExistence(order.direction() == Qt::AscendingOrder);
+        const QString existence(detail.orderByExistence(order.direction() == Qt::AscendingOrder));
+        if (keys && !existence.isEmpty()) {
+            keys->append(SortKey { existence, QString(), true });
+        }
+        return existence;
     }
 
     const bool joinToSort = detail.joinToSort && detailType == QContactDetail::TypeUndefined;
@@ -1790,25 +1940,35 @@ static QString buildOrderBy(
     }
 
     QString result;
+    QList<SortKey> orderKeys;
 
     if (sortBlanks) {
         QString blanksLocation = (order.blankPolicy() == QContactSortOrder::BlanksLast)
-                ? QStringLiteral("CASE WHEN COALESCE(%1, '') = '' THEN 1 ELSE 0 END, ")
-                : QStringLiteral("CASE WHEN COALESCE(%1, '') = '' THEN 0 ELSE 1 END, ");
+                ? QStringLiteral("CASE WHEN COALESCE(%1, '') = '' THEN 1 ELSE 0 END")
+                : QStringLiteral("CASE WHEN COALESCE(%1, '') = '' THEN 0 ELSE 1 END");
         result = blanksLocation.arg(sortExpression);
+        orderKeys.append(SortKey { result, QString(), true });
+        result.append(QStringLiteral(", "));
     }
 
     result.append(sortExpression);
 
+    QString collation;
     if (!isDisplayLabelGroup && collate) {
         if (localized && useLocale) {
-            result.append(QStringLiteral(" COLLATE localeCollation"));
+            collation = QStringLiteral(" COLLATE localeCollation");
         } else {
-            result.append((order.caseSensitivity() == Qt::CaseSensitive) ? QStringLiteral(" COLLATE RTRIM") : QStringLiteral(" COLLATE NOCASE"));
+            collation = (order.caseSensitivity() == Qt::CaseSensitive) ? QStringLiteral(" COLLATE RTRIM") : QStringLiteral(" COLLATE NOCASE");
         }
+        result.append(collation);
     }
 
     result.append((order.direction() == Qt::AscendingOrder) ? QStringLiteral(" ASC") : QStringLiteral(" DESC"));
+    orderKeys.append(SortKey { sortExpression, collation, order.direction() == Qt::AscendingOrder });
+
+    if (keys && (joinToSort || !detail.table || detailType != QContactDetail::TypeUndefined)) {
+        keys->append(orderKeys);
+    }
 
     if (joinToSort ) {
         QString join = QStringLiteral(
@@ -1862,6 +2022,65 @@ static QString buildOrderBy(
     return fragments.join(QStringLiteral(", "));
 }
 
+// Returns the terms of the sort order of a contact query, ending with the contact ID
+static QList<SortKey> buildSortKeys(const QList<QContactSortOrder> &order, bool useLocale)
+{
+    QList<SortKey> keys;
+    QStringList joins;
+    bool transientModifiedRequired = false;
+    bool globalPresenceRequired = false;
+    foreach (const QContactSortOrder &sort, order) {
+        buildOrderBy(sort, QContactDetail::TypeUndefined, &joins, &transientModifiedRequired, &globalPresenceRequired, useLocale, &keys);
+    }
+
+    keys.append(SortKey { QStringLiteral("Contacts.contactId"), QString(), true });
+    return keys;
+}
+
+// Selects the rows which follow the row having the given values for the sort keys.
+// SQLite orders NULL before any other value, so NULL values need explicit tests.
+static QString buildKeysetWhere(const QList<SortKey> &keys, const QVariantList &values, QVariantList *bindings)
+{
+    QStringList alternatives;
+    QStringList equalities;
+    QVariantList equalityBindings;
+
+    for (int i = 0; i < keys.count(); ++i) {
+        const SortKey &key(keys.at(i));
+        const QVariant &value(values.at(i));
+        const QString term(key.expression + key.collation);
+
+        // Rows whose preceding keys are equal, and whose value for this key follows
+        QString following;
+        if (key.ascending) {
+            following = value.isNull() ? QStringLiteral("%1 IS NOT NULL").arg(term)
+                                       : QStringLiteral("%1 > ?").arg(term);
+        } else if (!value.isNull()) {
+            following = QStringLiteral("(%1 < ? OR %1 IS NULL)").arg(term);
+        }
+
+        if (!following.isEmpty()) {
+            QStringList conditions(equalities);
+            conditions.append(following);
+            alternatives.append(QStringLiteral("(%1)").arg(conditions.join(QStringLiteral(" AND "))));
+
+            bindings->append(equalityBindings);
+            if (!value.isNull()) {
+                bindings->append(value);
+            }
+        }
+
+        if (value.isNull()) {
+            equalities.append(QStringLiteral("%1 IS NULL").arg(term));
+        } else {
+            equalities.append(QStringLiteral("%1 = ?").arg(term));
+            equalityBindings.append(value);
+        }
+    }
+
+    return QStringLiteral("(%1)").arg(alternatives.join(QStringLiteral(" OR ")));
+}
+
 static void debugFilterExpansion(const QString &description, const QString &query, const QVariantList &bindings)
 {
     static const bool debugFilters = !qgetenv("QTCONTACTS_SQLITE_DEBUG_FILTERS").isEmpty();
@@ -1872,7 +2091,7 @@ static void debugFilterExpansion(const QString &description, const QString &quer
 }
 
 ContactReader::ContactReader(ContactsDatabase &database, const QString &managerUri)
-    : m_database(database), m_managerUri(managerUri)
+    : m_database(database), m_managerUri(managerUri), m_contactCache(nullptr)
 {
 }
 
@@ -1880,6 +2099,11 @@ ContactReader::~ContactReader()
 {
 }
 
+void ContactReader::setContactCache(ContactCache *cache)
+{
+    m_contactCache = cache;
+}
+
 struct Table
 {
     QSqlQuery *query;
@@ -2099,6 +2323,25 @@ bool includesDeactivated(const QContactFilter &filter)
     }
 }
 
+// Returns true if this filter requires an exact match of all status flags, which
+// already determines whether deactivated contacts are matched
+bool matchesExactStatusFlags(const QContactFilter &filter)
+{
+    if (filter.type() == QContactFilter::ContactDetailFilter) {
+        const QContactDetailFilter &detailFilter(static_cast<const QContactDetailFilter &>(filter));
+        return filterOnField<QContactStatusFlags>(detailFilter, QContactStatusFlags::FieldFlags)
+                && detailFilter.matchFlags() == QContactFilter::MatchExactly
+                && detailFilter.value().isValid();
+    } else if (filter.type() == QContactFilter::IntersectionFilter) {
+        foreach (const QContactFilter &partialFilter, static_cast<const QContactIntersectionFilter &>(filter).filters()) {
+            if (matchesExactStatusFlags(partialFilter)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 bool includesIdFilter(const QContactFilter &filter);
 
 // Returns true if this filter includes a filter for specific IDs
@@ -2188,8 +2431,9 @@ QString expandWhere(const QString &where, const QContactFilter &filter, const bo
             }
         }
 
-        // exclude deactivated unless they're explicitly included
-        if (!includesDeactivated(filter)) {
+        // exclude deactivated unless they're explicitly included, or the filter
+        // matches the isDeactivated flag itself
+        if (!includesDeactivated(filter) && !matchesExactStatusFlags(filter)) {
             constraints.append("Contacts.isDeactivated = 0 ");
         }
 
@@ -2219,11 +2463,392 @@ QString expandWhere(const QString &where, const QContactFilter &filter, const bo
             whereClause += QStringLiteral("AND ");
         }
     }
-    if (!emptyFilter) {
-        whereClause += where;
-    }
+    if (!emptyFilter) {
+        whereClause += where;
+    }
+
+    return whereClause;
+}
+
+bool filterShape(const QContactFilter &filter, QContactDetail::DetailType detailType, QString *key, QVariantList *bindings);
+
+// Describes the structure of the filter in key, and collects the values that the
+// SQL generated for it by buildContactWhere() (or buildDetailWhere(), if detailType
+// is defined) would bind.  Returns false if the SQL depends upon the filter values
+// in a way that the key does not describe.
+bool filterShape(const QContactIntersectionFilter &filter, QContactDetail::DetailType detailType, QString *key, QVariantList *bindings)
+{
+    key->append(QStringLiteral("I("));
+    foreach (const QContactFilter &partialFilter, hoistedFilters(filter.filters())) {
+        if (!filterShape(partialFilter, detailType, key, bindings)) {
+            return false;
+        }
+    }
+    key->append(QLatin1Char(')'));
+    return true;
+}
+bool filterShape(const QContactUnionFilter &filter, QContactDetail::DetailType detailType, QString *key, QVariantList *bindings)
+{
+    // The values are bound in the order of the terms built for the union
+    const QList<QContactFilter> filters = filter.filters();
+    key->append(QStringLiteral("U("));
+    foreach (const UnionTerm &term, planUnion(filters, detailType == QContactDetail::TypeUndefined, detailType)) {
+        key->append(term.table ? QLatin1Char('{') : QLatin1Char('<'));
+        foreach (const QList<int> &indices, term.conditions) {
+            key->append(QLatin1Char('['));
+            foreach (int index, indices) {
+                if (!filterShape(filters.at(index), detailType, key, bindings)) {
+                    return false;
+                }
+            }
+            key->append(QLatin1Char(']'));
+        }
+        key->append(term.table ? QLatin1Char('}') : QLatin1Char('>'));
+    }
+    key->append(QLatin1Char(')'));
+    return true;
+}
+bool filterShape(const QContactDetailFilter &filter, QString *key, QVariantList *bindings, bool *equality)
+{
+    // True if the filter is tested by comparing its column to a single bound value
+    *equality = false;
+
+    const DetailInfo &detail(detailInformation(filter.detailType()));
+    if (detail.detailType == QContactDetail::TypeUndefined
+            || (filter.matchFlags() & QContactFilter::MatchKeypadCollation)) {
+        return false;
+    }
+
+    key->append(QStringLiteral("d%1.%2.%3").arg(filter.detailType()).arg(filter.detailField()).arg(int(filter.matchFlags())));
+
+    if (filter.detailField() == invalidField) {
+        key->append(QLatin1Char(';'));
+        return true;
+    }
+
+    const FieldInfo &field(fieldInformation(detail, filter.detailField()));
+    if (field.field == invalidField) {
+        return false;
+    }
+
+    if (!filter.value().isValid()
+        || (filterOnField<QContactSyncTarget>(filter, QContactSyncTarget::FieldSyncTarget) &&
+            filter.value().toString().isEmpty())) {
+        key->append(QStringLiteral("n;"));
+        return true;
+    }
+
+    if (filterOnField<QContactStatusFlags>(filter, QContactStatusFlags::FieldFlags)) {
+        // The flag values are embedded in the generated SQL
+        key->append(QStringLiteral("f%1;").arg(filter.value().value<quint64>()));
+        return true;
+    }
+
+    // The remainder must produce the same values as buildWhere()
+    bool dateField = field.fieldType == DateField;
+    bool stringField = field.fieldType == StringField || field.fieldType == StringListField ||
+                       field.fieldType == LocalizedField || field.fieldType == LocalizedListField;
+    bool phoneNumberMatch = filter.matchFlags() & QContactFilter::MatchPhoneNumber;
+    bool fixedString = filter.matchFlags() & QContactFilter::MatchFixedString;
+    bool useNormalizedNumber = false;
+    int globValue = filter.matchFlags() & 7;
+    if (field.fieldType == StringListField || field.fieldType == LocalizedListField) {
+        globValue = QContactFilter::MatchContains;
+    }
+    bool caseInsensitive = stringField && fixedString && ((filter.matchFlags() & QContactFilter::MatchCaseSensitive) == 0);
+
+    QString stringValue = filter.value().toString();
+    QString bindValue;
+
+    if (phoneNumberMatch) {
+        useNormalizedNumber = (filterOnField<QContactPhoneNumber>(filter, QContactPhoneNumber::FieldNumber) &&
+                               globValue != QContactFilter::MatchStartsWith &&
+                               globValue != QContactFilter::MatchContains &&
+                               globValue != QContactFilter::MatchEndsWith);
+        if (useNormalizedNumber) {
+            bindValue = ContactsEngine::normalizedPhoneNumber(stringValue);
+            if (bindValue.isEmpty()) {
+                return false;
+            }
+            if (caseInsensitive) {
+                bindValue = bindValue.toLower();
+            }
+        } else {
+            QString tempValue = caseInsensitive ? stringValue.toLower() : stringValue;
+            for (int i = 0; i < tempValue.size(); ++i) {
+                QChar current = tempValue.at(i).toLower();
+                if (current.isDigit()) {
+                    bindValue.append(current);
+                }
+            }
+        }
+    } else {
+        const QVariant &v(filter.value());
+        if (dateField) {
+            bindValue = dateString(detail, v.toDateTime());
+        } else if (!stringField && (v.type() == QVariant::Bool)) {
+            bindValue = QString::number(v.toBool() ? 1 : 0);
+        } else {
+            stringValue = convertFilterValueToString(filter, stringValue);
+            bindValue = caseInsensitive ? stringValue.toLower() : stringValue;
+        }
+    }
+
+    if (stringField || fixedString) {
+        if (globValue == QContactFilter::MatchStartsWith) {
+            bindings->append(bindValue + QStringLiteral("*"));
+        } else if (globValue == QContactFilter::MatchContains) {
+            bindings->append(QStringLiteral("*") + bindValue + QStringLiteral("*"));
+        } else if (globValue == QContactFilter::MatchEndsWith) {
+            bindings->append(QStringLiteral("*") + bindValue);
+        } else if (bindValue.isEmpty()) {
+            // Matched without a bound value
+            key->append(QLatin1Char('e'));
+        } else {
+            bindings->append(bindValue);
+            *equality = true;
+        }
+    } else if (phoneNumberMatch && !useNormalizedNumber) {
+        bindings->append(QStringLiteral("*") + bindValue);
+    } else {
+        bindings->append(bindValue);
+        *equality = true;
+    }
+
+    key->append(QLatin1Char(';'));
+    return true;
+}
+bool filterShape(const QContactDetailRangeFilter &filter, QString *key, QVariantList *bindings)
+{
+    const DetailInfo &detail(detailInformation(filter.detailType()));
+    if (detail.detailType == QContactDetail::TypeUndefined) {
+        return false;
+    }
+
+    key->append(QStringLiteral("r%1.%2.%3.%4").arg(filter.detailType()).arg(filter.detailField())
+                                             .arg(int(filter.matchFlags())).arg(int(filter.rangeFlags())));
+
+    if (filter.detailField() == invalidField) {
+        key->append(QLatin1Char(';'));
+        return true;
+    }
+
+    const FieldInfo &field(fieldInformation(detail, filter.detailField()));
+    if (field.field == invalidField) {
+        return false;
+    }
+
+    const bool dateField = field.fieldType == DateField;
+    if (filter.minValue().isValid()) {
+        key->append(QLatin1Char('l'));
+        bindings->append(dateField ? QVariant(dateString(detail, filter.minValue().toDateTime())) : filter.minValue());
+    }
+    if (filter.maxValue().isValid()) {
+        key->append(QLatin1Char('u'));
+        bindings->append(dateField ? QVariant(dateString(detail, filter.maxValue().toDateTime())) : filter.maxValue());
+    }
+
+    key->append(QLatin1Char(';'));
+    return true;
+}
+bool filterShape(const QContactChangeLogFilter &filter, QString *key, QVariantList *bindings)
+{
+    if (filter.eventType() != QContactChangeLogFilter::EventAdded
+            && filter.eventType() != QContactChangeLogFilter::EventChanged) {
+        return false;
+    }
+
+    key->append(QStringLiteral("l%1;").arg(int(filter.eventType())));
+    bindings->append(ContactsDatabase::dateTimeString(filter.since().toUTC()));
+    return true;
+}
+bool filterShape(const QContactRelationshipFilter &filter, QString *key, QVariantList *bindings)
+{
+    const QContactId rci = filter.relatedContactId();
+    if (!rci.managerUri().isEmpty() && !rci.managerUri().startsWith(QStringLiteral("qtcontacts:org.nemomobile.contacts.sqlite"))) {
+        return false;
+    }
+
+    const QContactRelationship::Role rcr = filter.relatedContactRole();
+    const QString rt = filter.relationshipType();
+    const quint32 dbId = ContactId::databaseId(rci);
+    const bool needsId = dbId != 0;
+    const bool needsType = !rt.isEmpty();
+
+    key->append(QStringLiteral("p%1.%2%3;").arg(int(rcr)).arg(needsId ? 1 : 0).arg(needsType ? 1 : 0));
+
+    // One set of values for each direction matched
+    const int directions = (rcr == QContactRelationship::First || rcr == QContactRelationship::Second) ? 1 : 2;
+    for (int i = 0; i < directions; ++i) {
+        if (needsId) {
+            bindings->append(dbId);
+        }
+        if (needsType) {
+            bindings->append(rt);
+        }
+    }
+    return true;
+}
+bool filterShape(const QContactIdFilter &filter, QString *key, QVariantList *bindings)
+{
+    // Large lists are selected from a transient table rather than bound
+    const QList<QContactId> &filterIds(filter.ids());
+    if (filterIds.isEmpty() || filterIds.count() > 800) {
+        return false;
+    }
+
+    key->append(QStringLiteral("i%1.%2;").arg(filterIds.count()).arg(includesSelfId(filter) ? 1 : 0));
+    foreach (const QContactId &id, filterIds) {
+        bindings->append(ContactId::databaseId(id));
+    }
+    return true;
+}
+bool filterShape(const QContactCollectionFilter &filter, QString *key, QVariantList *bindings)
+{
+    const QSet<QContactCollectionId> &filterIds(filter.collectionIds());
+    if (filterIds.count() >= 800) {
+        return false;
+    }
+
+    key->append(QStringLiteral("c%1;").arg(filterIds.count()));
+    foreach (const QContactCollectionId &id, filterIds) {
+        bindings->append(ContactCollectionId::databaseId(id));
+    }
+    return true;
+}
+bool filterShape(const QContactFilter &filter, QContactDetail::DetailType detailType, QString *key, QVariantList *bindings)
+{
+    bool equality;
+
+    switch (filter.type()) {
+    case QContactFilter::DefaultFilter:
+        key->append(QStringLiteral("-;"));
+        return true;
+    case QContactFilter::ContactDetailFilter:
+        return filterShape(static_cast<const QContactDetailFilter &>(filter), key, bindings, &equality);
+    case QContactFilter::ContactDetailRangeFilter:
+        return filterShape(static_cast<const QContactDetailRangeFilter &>(filter), key, bindings);
+    case QContactFilter::ChangeLogFilter:
+        return filterShape(static_cast<const QContactChangeLogFilter &>(filter), key, bindings);
+    case QContactFilter::RelationshipFilter:
+        return filterShape(static_cast<const QContactRelationshipFilter &>(filter), key, bindings);
+    case QContactFilter::IdFilter:
+        return filterShape(static_cast<const QContactIdFilter &>(filter), key, bindings);
+    case QContactFilter::CollectionFilter:
+        return filterShape(static_cast<const QContactCollectionFilter &>(filter), key, bindings);
+    case QContactFilter::IntersectionFilter:
+        return filterShape(static_cast<const QContactIntersectionFilter &>(filter), detailType, key, bindings);
+    case QContactFilter::UnionFilter:
+        return filterShape(static_cast<const QContactUnionFilter &>(filter), detailType, key, bindings);
+    default:
+        return false;
+    }
+}
+
+void sortOrderShape(const QList<QContactSortOrder> &order, QString *key)
+{
+    foreach (const QContactSortOrder &sort, order) {
+        key->append(QStringLiteral("s%1.%2.%3.%4.%5;").arg(sort.detailType()).arg(sort.detailField())
+                                                      .arg(int(sort.direction())).arg(int(sort.blankPolicy()))
+                                                      .arg(int(sort.caseSensitivity())));
+    }
+}
+
+// Produces the SQL for the filter and sort order, reusing that previously generated
+// for any filter of the same shape.  If detailType is defined, the SQL selects from
+// that detail's table rather than from Contacts.
+bool compileFilter(
+        ContactsDatabase &db,
+        const QString &table,
+        const QContactFilter &filter,
+        const QList<QContactSortOrder> &order,
+        QContactDetail::DetailType detailType,
+        ContactsDatabase::CompiledFilter *compiled,
+        QVariantList *bindings)
+{
+    QVariantList shapeBindings;
+    QString key;
+    if (filterShape(filter, detailType, &key, &shapeBindings)) {
+        sortOrderShape(order, &key);
+        key.prepend(QStringLiteral("%1:%2%3:").arg(detailType).arg(db.localized() ? 1 : 0).arg(db.aggregating() ? 1 : 0));
+    } else {
+        key.clear();
+    }
+
+    if (db.findCompiledFilter(key, compiled)) {
+        *bindings = shapeBindings;
+        return true;
+    }
+
+    bool failed = false;
+    if (detailType == QContactDetail::TypeUndefined) {
+        compiled->orderBy = buildOrderBy(order, &compiled->join, &compiled->transientModifiedRequired, &compiled->globalPresenceRequired, db.localized());
+        compiled->where = buildContactWhere(filter, db, table, detailType, bindings, &failed, &compiled->transientModifiedRequired, &compiled->globalPresenceRequired);
+        if (!failed) {
+            compiled->where = expandWhere(compiled->where, filter, db.aggregating());
+        }
+    } else {
+        compiled->orderBy = buildOrderBy(order, &compiled->join, &compiled->transientModifiedRequired, &compiled->globalPresenceRequired, db.localized(), detailType, QString());
+        compiled->where = buildDetailWhere(filter, db, table, detailType, bindings, &failed, &compiled->transientModifiedRequired, &compiled->globalPresenceRequired);
+    }
+    if (failed) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to create WHERE expression: invalid filter specification"));
+        return false;
+    }
+
+    if (!key.isEmpty()) {
+        if (*bindings == shapeBindings) {
+            db.insertCompiledFilter(key, *compiled);
+        } else {
+            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Filter values do not match the generated SQL; not caching: %1").arg(key));
+        }
+    }
+    return true;
+}
+
+// Joins the transient state required by the compiled filter, after populating it
+bool joinTransientState(ContactsDatabase &db, const ContactsDatabase::CompiledFilter &compiled, QString *join)
+{
+    if (compiled.transientModifiedRequired || compiled.globalPresenceRequired) {
+        // Provide the temporary transient state information to filter/sort on
+        if (!db.populateTemporaryTransientState(compiled.transientModifiedRequired, compiled.globalPresenceRequired)) {
+            return false;
+        }
+
+        if (compiled.transientModifiedRequired) {
+            join->append(QStringLiteral(" LEFT JOIN temp.Timestamps ON Contacts.contactId = temp.Timestamps.contactId"));
+        }
+        if (compiled.globalPresenceRequired) {
+            join->append(QStringLiteral(" LEFT JOIN temp.GlobalPresenceStates ON Contacts.contactId = temp.GlobalPresenceStates.contactId"));
+        }
+    }
+    return true;
+}
 
-    return whereClause;
+// A page cursor holds the sort key values of the last row of the page, along with
+// the shape of the sort order they were produced for
+const quint8 pageCursorVersion = 1;
+
+QByteArray encodePageCursor(const QString &orderShape, const QVariantList &values)
+{
+    QByteArray cursor;
+    QDataStream stream(&cursor, QIODevice::WriteOnly);
+    stream << pageCursorVersion << orderShape << values;
+    return cursor;
+}
+
+bool decodePageCursor(const QByteArray &cursor, const QString &orderShape, int keyCount, QVariantList *values)
+{
+    quint8 version = 0;
+    QString shape;
+
+    QDataStream stream(cursor);
+    stream >> version;
+    if (version != pageCursorVersion) {
+        return false;
+    }
+    stream >> shape >> *values;
+    return stream.status() == QDataStream::Ok && shape == orderShape && values->count() == keyCount;
 }
 
 }
@@ -2232,8 +2857,18 @@ QContactManager::Error ContactReader::fetchContacts(const QContactCollectionId &
                                                     QList<QContact> *addedContacts,
                                                     QList<QContact> *modifiedContacts,
                                                     QList<QContact> *deletedContacts,
-                                                    QList<QContact> *unmodifiedContacts)
-{
+                                                    QList<QContact> *unmodifiedContacts,
+                                                    QList<QContactId> *unmodifiedContactIds)
+{
+    if (unmodifiedContactIds && !unmodifiedContacts) {
+        // the caller only wants to know which contacts are unmodified;
+        // resolve their ids without materializing the contacts themselves.
+        const QContactManager::Error error = fetchContactIds(collectionId, nullptr, nullptr, nullptr, unmodifiedContactIds);
+        if (error != QContactManager::NoError) {
+            return error;
+        }
+    }
+
     QContactCollectionFilter collectionFilter;
     collectionFilter.setCollectionId(collectionId);
 
@@ -2280,12 +2915,98 @@ QContactManager::Error ContactReader::fetchContacts(const QContactCollectionId &
             if (unmodifiedContacts) {
                 unmodifiedContacts->append(*it);
             }
+            if (unmodifiedContactIds) {
+                unmodifiedContactIds->append(it->id());
+            }
         }
     }
 
     return error;
 }
 
+QContactManager::Error ContactReader::fetchContactIds(const QContactCollectionId &collectionId,
+                                                      QList<QContactId> *addedContactIds,
+                                                      QList<QContactId> *modifiedContactIds,
+                                                      QList<QContactId> *deletedContactIds,
+                                                      QList<QContactId> *unmodifiedContactIds)
+{
+    // classify the contacts of the collection by their change flags alone,
+    // matching the set of contacts which fetchContacts() would report.
+    const QString fetchContactIdsStatement(QStringLiteral(
+            "SELECT contactId, changeFlags "
+            "FROM Contacts "
+            "WHERE collectionId = :collectionId "
+            "AND contactId > 2 " // exclude the self contacts
+            "AND isDeactivated = 0 "
+            "ORDER BY contactId ASC"));
+
+    QMutexLocker locker(m_database.accessMutex());
+
+    QSqlQuery query(m_database);
+    if (!query.prepare(fetchContactIdsStatement)) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to prepare query for contact change ids:\n%1\nQuery:\n%2")
+                .arg(query.lastError().text())
+                .arg(fetchContactIdsStatement));
+        return QContactManager::UnspecifiedError;
+    }
+
+    query.bindValue(":collectionId", ContactCollectionId::databaseId(collectionId));
+    query.setForwardOnly(true);
+    if (!ContactsDatabase::execute(query)) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to execute query for contact change ids:\n%1\nQuery:\n%2")
+                .arg(query.lastError().text())
+                .arg(fetchContactIdsStatement));
+        return QContactManager::UnspecifiedError;
+    }
+
+    while (query.next()) {
+        const quint32 dbId = query.value(0).toUInt();
+        const int changeFlags = query.value(1).toInt();
+
+        QList<QContactId> *ids = nullptr;
+        if (changeFlags >= 4) { // ChangeFlags::IsDeleted
+            ids = deletedContactIds;
+        } else if (changeFlags & 1) { // ChangeFlags::IsAdded
+            ids = addedContactIds;
+        } else if (changeFlags & 2) { // ChangeFlags::IsModified
+            ids = modifiedContactIds;
+        } else {
+            ids = unmodifiedContactIds;
+        }
+
+        if (ids) {
+            ids->append(ContactId::apiId(dbId, m_managerUri));
+        }
+    }
+
+    return QContactManager::NoError;
+}
+
+QContactManager::Error ContactReader::fetchContacts(const QList<QContactId> &contactIds,
+                                                    QList<QContact> *contacts)
+{
+    QMutexLocker locker(m_database.accessMutex());
+
+    QVariantList boundIds;
+    boundIds.reserve(contactIds.size());
+    foreach (const QContactId &id, contactIds) {
+        boundIds.append(ContactId::databaseId(id));
+    }
+
+    const QString table(QStringLiteral("FetchContactIds"));
+    m_database.clearTemporaryContactIdsTable(table);
+
+    if (!m_database.createTemporaryContactIdsTable(table, boundIds, 0)) {
+        return QContactManager::UnspecifiedError;
+    }
+
+    // deleted contacts are included, and the change flags are retained
+    return queryContacts(table, contacts, QContactFetchHint(),
+                         false /* relax constraints */,
+                         false /* ignore deleted */,
+                         true /* keep change flags */);
+}
+
 QContactManager::Error ContactReader::readContacts(
         const QString &table,
         QList<QContact> *contacts,
@@ -2298,39 +3019,21 @@ QContactManager::Error ContactReader::readContacts(
 
     m_database.clearTemporaryContactIdsTable(table);
 
-    QString join;
-    bool transientModifiedRequired = false;
-    bool globalPresenceRequired = false;
-    const QString orderBy = buildOrderBy(order, &join, &transientModifiedRequired, &globalPresenceRequired, m_database.localized());
-
-    bool whereFailed = false;
+    ContactsDatabase::CompiledFilter compiled;
     QVariantList bindings;
-    QString where = buildContactWhere(filter, m_database, table, QContactDetail::TypeUndefined, &bindings, &whereFailed, &transientModifiedRequired, &globalPresenceRequired);
-    if (whereFailed) {
-        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to create WHERE expression: invalid filter specification"));
+    if (!compileFilter(m_database, table, filter, order, QContactDetail::TypeUndefined, &compiled, &bindings)) {
         return QContactManager::UnspecifiedError;
     }
 
-    where = expandWhere(where, filter, m_database.aggregating());
-
-    if (transientModifiedRequired || globalPresenceRequired) {
-        // Provide the temporary transient state information to filter/sort on
-        if (!m_database.populateTemporaryTransientState(transientModifiedRequired, globalPresenceRequired)) {
-            return QContactManager::UnspecifiedError;
-        }
-
-        if (transientModifiedRequired) {
-            join.append(QStringLiteral(" LEFT JOIN temp.Timestamps ON Contacts.contactId = temp.Timestamps.contactId"));
-        }
-        if (globalPresenceRequired) {
-            join.append(QStringLiteral(" LEFT JOIN temp.GlobalPresenceStates ON Contacts.contactId = temp.GlobalPresenceStates.contactId"));
-        }
+    QString join = compiled.join;
+    if (!joinTransientState(m_database, compiled, &join)) {
+        return QContactManager::UnspecifiedError;
     }
 
     const int maximumCount = fetchHint.maxCountHint();
 
     QContactManager::Error error = QContactManager::NoError;
-    if (!m_database.createTemporaryContactIdsTable(table, join, where, orderBy, bindings, maximumCount)) {
+    if (!m_database.createTemporaryContactIdsTable(table, join, compiled.where, compiled.orderBy, bindings, maximumCount)) {
         error = QContactManager::UnspecifiedError;
     } else {
         error = queryContacts(table, contacts, fetchHint,
@@ -2355,7 +3058,50 @@ QContactManager::Error ContactReader::readContacts(
         databaseIds.append(ContactId::databaseId(id));
     }
 
-    return readContacts(table, contacts, databaseIds, fetchHint);
+    if (!m_contactCache) {
+        return readContacts(table, contacts, databaseIds, fetchHint);
+    }
+
+    const QByteArray cacheKey(ContactCache::hintKey(fetchHint));
+    if (cacheKey.isEmpty()) {
+        m_contactCache->recordUncacheable();
+        return readContacts(table, contacts, databaseIds, fetchHint);
+    }
+
+    // Anything invalidated after this point must not be inserted from our read
+    const quint64 generation = m_contactCache->generation();
+
+    QList<QContact> results;
+    results.reserve(databaseIds.size());
+    QList<int> uncachedIndices;
+    QList<quint32> uncachedIds;
+    for (int i = 0; i < databaseIds.size(); ++i) {
+        QContact contact;
+        if (!m_contactCache->find(databaseIds.at(i), cacheKey, &contact)) {
+            uncachedIndices.append(i);
+            uncachedIds.append(databaseIds.at(i));
+        }
+        results.append(contact);
+    }
+
+    QContactManager::Error error = QContactManager::NoError;
+    if (!uncachedIds.isEmpty()) {
+        QList<QContact> fetched;
+        // Missing contacts are padded, so the fetched list corresponds to the uncached ids
+        error = readContacts(table, &fetched, uncachedIds, fetchHint);
+
+        for (int i = 0; i < uncachedIndices.size(); ++i) {
+            const QContact &contact(fetched.at(i));
+            results[uncachedIndices.at(i)] = contact;
+            if (uncachedIds.at(i) != 0 && ContactId::databaseId(contact.id()) == uncachedIds.at(i)) {
+                m_contactCache->insert(uncachedIds.at(i), cacheKey, contact, generation);
+            }
+        }
+    }
+
+    contacts->append(results);
+    contactsAvailable(*contacts);
+    return error;
 }
 
 QContactManager::Error ContactReader::readContacts(
@@ -2437,9 +3183,9 @@ QContactManager::Error ContactReader::queryContacts(
     const QString relationshipQueryStatement(QStringLiteral(
         "SELECT "
             "temp.%1.contactId AS contactId,"
-            "R1.type AS secondType,"
+            "T1.type AS secondType,"
             "R1.firstId AS firstId,"
-            "R2.type AS firstType,"
+            "T2.type AS firstType,"
             "R2.secondId AS secondId "
         "FROM temp.%1 "
          // Must join in this order to get correct query plan.
@@ -2447,8 +3193,12 @@ QContactManager::Error ContactReader::queryContacts(
          // TODO: if this performs poorly, instead do a separate SELECT query to get deleted contacts,
          // and manually filter out the results in-memory when adding the relationships to the contact,
          // in the queryContacts(..., relationshipQuery, ...) method.
-        "LEFT JOIN Relationships AS R1 ON R1.secondId = temp.%1.contactId AND R1.firstId NOT IN (SELECT contactId FROM Contacts WHERE changeFlags >= 4) "
-        "LEFT JOIN Relationships AS R2 ON R2.firstId = temp.%1.contactId AND R2.secondId NOT IN (SELECT contactId FROM Contacts WHERE changeFlags >= 4) "
+         // The edges are found via the covering (secondId, typeId, firstId) and (firstId, typeId, secondId)
+         // indexes, and the deleted contacts via ContactsChangeFlagsIndex.
+        "LEFT JOIN RelationshipEdges AS R1 ON R1.secondId = temp.%1.contactId AND R1.firstId NOT IN (SELECT contactId FROM Contacts WHERE changeFlags >= 4) "
+        "LEFT JOIN RelationshipTypes AS T1 ON T1.typeId = R1.typeId "
+        "LEFT JOIN RelationshipEdges AS R2 ON R2.firstId = temp.%1.contactId AND R2.secondId NOT IN (SELECT contactId FROM Contacts WHERE changeFlags >= 4) "
+        "LEFT JOIN RelationshipTypes AS T2 ON T2.typeId = R2.typeId "
         "ORDER BY contactId ASC").arg(tableName));
 
     QSqlQuery contactQuery(m_database);
@@ -2924,59 +3674,32 @@ QContactManager::Error ContactReader::readContactIds(
 
     m_database.clearTransientContactIdsTable(tableName);
 
-    QString join;
-    bool transientModifiedRequired = false;
-    bool globalPresenceRequired = false;
-    const QString orderBy = buildOrderBy(order, &join, &transientModifiedRequired, &globalPresenceRequired, m_database.localized());
-
-    bool failed = false;
+    ContactsDatabase::CompiledFilter compiled;
     QVariantList bindings;
-    QString where = buildContactWhere(filter, m_database, tableName, QContactDetail::TypeUndefined, &bindings, &failed, &transientModifiedRequired, &globalPresenceRequired);
-    if (failed) {
-        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to create WHERE expression: invalid filter specification"));
+    if (!compileFilter(m_database, tableName, filter, order, QContactDetail::TypeUndefined, &compiled, &bindings)) {
         return QContactManager::UnspecifiedError;
     }
 
-    where = expandWhere(where, filter, m_database.aggregating());
-
-    if (transientModifiedRequired || globalPresenceRequired) {
-        // Provide the temporary transient state information to filter/sort on
-        if (!m_database.populateTemporaryTransientState(transientModifiedRequired, globalPresenceRequired)) {
-            return QContactManager::UnspecifiedError;
-        }
-
-        if (transientModifiedRequired) {
-            join.append(QStringLiteral(" LEFT JOIN temp.Timestamps ON Contacts.contactId = temp.Timestamps.contactId"));
-        }
-        if (globalPresenceRequired) {
-            join.append(QStringLiteral(" LEFT JOIN temp.GlobalPresenceStates ON Contacts.contactId = temp.GlobalPresenceStates.contactId"));
-        }
+    QString join = compiled.join;
+    if (!joinTransientState(m_database, compiled, &join)) {
+        return QContactManager::UnspecifiedError;
     }
 
     QString queryString = QStringLiteral(
                 "\n SELECT DISTINCT Contacts.contactId"
                 "\n FROM Contacts %1"
-                "\n %2").arg(join).arg(where);
-    if (!orderBy.isEmpty()) {
-        queryString.append(QStringLiteral(" ORDER BY ") + orderBy);
-    }
-
-    QSqlQuery query(m_database);
-    query.setForwardOnly(true);
-    if (!query.prepare(queryString)) {
-        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to prepare contacts ids:\n%1\nQuery:\n%2")
-                .arg(query.lastError().text())
-                .arg(queryString));
-        return QContactManager::UnspecifiedError;
+                "\n %2").arg(join).arg(compiled.where);
+    if (!compiled.orderBy.isEmpty()) {
+        queryString.append(QStringLiteral(" ORDER BY ") + compiled.orderBy);
     }
 
+    // Statements for filters of the same shape are prepared only once
+    ContactsDatabase::Query query(m_database.prepare(queryString));
     for (int i = 0; i < bindings.count(); ++i)
         query.bindValue(i, bindings.at(i));
 
     if (!ContactsDatabase::execute(query)) {
-        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to query contacts ids\n%1\nQuery:\n%2")
-                .arg(query.lastError().text())
-                .arg(queryString));
+        query.reportError(QString::fromLatin1("Failed to query contacts ids\nQuery:\n%1").arg(queryString));
         return QContactManager::UnspecifiedError;
     } else {
         debugFilterExpansion("Contact IDs selection:", queryString, bindings);
@@ -2992,6 +3715,262 @@ QContactManager::Error ContactReader::readContactIds(
     return QContactManager::NoError;
 }
 
+QContactManager::Error ContactReader::readContactIds(
+        QList<QContactId> *contactIds,
+        const QContactFilter &filter,
+        const QList<QContactSortOrder> &order,
+        int pageSize,
+        const QByteArray &cursor,
+        QByteArray *nextCursor)
+{
+    QMutexLocker locker(m_database.accessMutex());
+
+    QList<quint32> databaseIds;
+    const QContactManager::Error error = readContactIdPage(&databaseIds, filter, order, pageSize, cursor, nextCursor);
+    if (error == QContactManager::NoError) {
+        contactIds->reserve(databaseIds.size());
+        foreach (quint32 id, databaseIds) {
+            contactIds->append(ContactId::apiId(id, m_managerUri));
+        }
+    }
+    return error;
+}
+
+QContactManager::Error ContactReader::readContacts(
+        const QString &table,
+        QList<QContact> *contacts,
+        const QContactFilter &filter,
+        const QList<QContactSortOrder> &order,
+        const QContactFetchHint &fetchHint,
+        int pageSize,
+        const QByteArray &cursor,
+        QByteArray *nextCursor)
+{
+    QMutexLocker locker(m_database.accessMutex());
+
+    QList<quint32> databaseIds;
+    QContactManager::Error error = readContactIdPage(&databaseIds, filter, order, pageSize, cursor, nextCursor);
+    if (error == QContactManager::NoError && !databaseIds.isEmpty()) {
+        // The contacts are read in the order of the page's ids
+        error = readContacts(table, contacts, databaseIds, fetchHint);
+    }
+    return error;
+}
+
+QContactManager::Error ContactReader::readContactIdPage(
+        QList<quint32> *databaseIds,
+        const QContactFilter &filter,
+        const QList<QContactSortOrder> &order,
+        int pageSize,
+        const QByteArray &cursor,
+        QByteArray *nextCursor)
+{
+    nextCursor->clear();
+
+    if (deletedContactFilter(filter)) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Paged fetch of deleted contacts is not supported"));
+        return QContactManager::NotSupportedError;
+    }
+
+    // Use a dummy table name to identify any temporary tables we create
+    const QString tableName(QStringLiteral("readContactIdPage"));
+
+    m_database.clearTransientContactIdsTable(tableName);
+
+    ContactsDatabase::CompiledFilter compiled;
+    QVariantList bindings;
+    if (!compileFilter(m_database, tableName, filter, order, QContactDetail::TypeUndefined, &compiled, &bindings)) {
+        return QContactManager::UnspecifiedError;
+    }
+
+    QString join = compiled.join;
+    if (!joinTransientState(m_database, compiled, &join)) {
+        return QContactManager::UnspecifiedError;
+    }
+
+    const QList<SortKey> keys(buildSortKeys(order, m_database.localized()));
+    QString orderShape;
+    sortOrderShape(order, &orderShape);
+
+    // A contact may have several values for a sort key (e.g. GUIDs), so the rows
+    // are grouped to one per contact, positioned by its first value in the sort direction.
+    // The sort keys are selected so that the position of the last row can be recorded.
+    QStringList columns;
+    QStringList orderTerms;
+    QList<SortKey> pageKeys;
+    for (int i = 0; i < keys.count(); ++i) {
+        const SortKey &key(keys.at(i));
+        const QString alias(QStringLiteral("sortKey%1").arg(i));
+        if (i == keys.count() - 1) {
+            // The contact ID is the grouping term
+            columns.append(QStringLiteral("%1 AS %2").arg(key.expression).arg(alias));
+        } else {
+            columns.append(QStringLiteral("%1(%2%3) AS %4")
+                    .arg(key.ascending ? QStringLiteral("MIN") : QStringLiteral("MAX"))
+                    .arg(key.expression).arg(key.collation).arg(alias));
+        }
+        orderTerms.append(alias + key.collation + (key.ascending ? QStringLiteral(" ASC") : QStringLiteral(" DESC")));
+        pageKeys.append(SortKey { alias, key.collation, key.ascending });
+    }
+
+    // Continue from the cursor position by selecting only the contacts which follow it
+    QString keyset;
+    if (!cursor.isEmpty()) {
+        QVariantList values;
+        if (!decodePageCursor(cursor, orderShape, keys.count(), &values)) {
+            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Invalid cursor for paged contact fetch"));
+            return QContactManager::BadArgumentError;
+        }
+
+        keyset = QStringLiteral("WHERE ") + buildKeysetWhere(pageKeys, values, &bindings);
+    }
+
+    QString queryString = QStringLiteral(
+                "\n SELECT * FROM ("
+                "\n  SELECT %1"
+                "\n  FROM Contacts %2"
+                "\n  %3"
+                "\n  GROUP BY Contacts.contactId)"
+                "\n %4"
+                "\n ORDER BY %5").arg(columns.join(QStringLiteral(", "))).arg(join).arg(compiled.where)
+                                  .arg(keyset).arg(orderTerms.join(QStringLiteral(", ")));
+    if (pageSize > 0) {
+        // Select one more row than required, to find whether there is a following page.
+        // The limit is bound so that every page size shares the prepared statement.
+        queryString.append(QStringLiteral(" LIMIT ?"));
+        bindings.append(pageSize + 1);
+    }
+
+    ContactsDatabase::Query query(m_database.prepare(queryString));
+    for (int i = 0; i < bindings.count(); ++i)
+        query.bindValue(i, bindings.at(i));
+
+    if (!ContactsDatabase::execute(query)) {
+        query.reportError(QString::fromLatin1("Failed to query contact ids page\nQuery:\n%1").arg(queryString));
+        return QContactManager::UnspecifiedError;
+    } else {
+        debugFilterExpansion("Contact IDs page selection:", queryString, bindings);
+    }
+
+    const int idColumn = keys.count() - 1;
+    QVariantList lastValues;
+    while (query.next()) {
+        if (pageSize > 0 && databaseIds->count() == pageSize) {
+            *nextCursor = encodePageCursor(orderShape, lastValues);
+            break;
+        }
+
+        lastValues.clear();
+        for (int i = 0; i < keys.count(); ++i) {
+            lastValues.append(query.value(i));
+        }
+        databaseIds->append(query.value(idColumn).toUInt());
+    }
+
+    return QContactManager::NoError;
+}
+
+QContactManager::Error ContactReader::readContactCount(
+        int *count,
+        const QContactFilter &filter)
+{
+    QMutexLocker locker(m_database.accessMutex());
+
+    if (deletedContactFilter(filter)) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Counting deleted contacts is not supported"));
+        return QContactManager::NotSupportedError;
+    }
+
+    // Use a dummy table name to identify any temporary tables we create
+    const QString tableName(QStringLiteral("readContactCount"));
+
+    m_database.clearTransientContactIdsTable(tableName);
+
+    ContactsDatabase::CompiledFilter compiled;
+    QVariantList bindings;
+    if (!compileFilter(m_database, tableName, filter, QList<QContactSortOrder>(), QContactDetail::TypeUndefined, &compiled, &bindings)) {
+        return QContactManager::UnspecifiedError;
+    }
+
+    QString join = compiled.join;
+    if (!joinTransientState(m_database, compiled, &join)) {
+        return QContactManager::UnspecifiedError;
+    }
+
+    const QString queryString = QStringLiteral(
+                "\n SELECT COUNT(*)"
+                "\n FROM Contacts %1"
+                "\n %2").arg(join).arg(compiled.where);
+
+    ContactsDatabase::Query query(m_database.prepare(queryString));
+    for (int i = 0; i < bindings.count(); ++i)
+        query.bindValue(i, bindings.at(i));
+
+    if (!ContactsDatabase::execute(query) || !query.next()) {
+        query.reportError(QString::fromLatin1("Failed to count contacts\nQuery:\n%1").arg(queryString));
+        return QContactManager::UnspecifiedError;
+    } else {
+        debugFilterExpansion("Contact count:", queryString, bindings);
+    }
+
+    *count = query.value<int>(0);
+    return QContactManager::NoError;
+}
+
+QContactManager::Error ContactReader::readDisplayLabelGroupCounts(
+        QList<QPair<QString, int> > *counts,
+        const QContactFilter &filter)
+{
+    QMutexLocker locker(m_database.accessMutex());
+
+    if (deletedContactFilter(filter)) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Counting deleted contacts is not supported"));
+        return QContactManager::NotSupportedError;
+    }
+
+    // Use a dummy table name to identify any temporary tables we create
+    const QString tableName(QStringLiteral("readDisplayLabelGroupCounts"));
+
+    m_database.clearTransientContactIdsTable(tableName);
+
+    ContactsDatabase::CompiledFilter compiled;
+    QVariantList bindings;
+    if (!compileFilter(m_database, tableName, filter, QList<QContactSortOrder>(), QContactDetail::TypeUndefined, &compiled, &bindings)) {
+        return QContactManager::UnspecifiedError;
+    }
+
+    QString join = compiled.join;
+    if (!joinTransientState(m_database, compiled, &join)) {
+        return QContactManager::UnspecifiedError;
+    }
+
+    // There is at most one display label per contact, so the join does not duplicate contacts
+    const QString queryString = QStringLiteral(
+                "\n SELECT DisplayLabels.displayLabelGroup, COUNT(*)"
+                "\n FROM Contacts"
+                "\n LEFT JOIN DisplayLabels ON Contacts.contactId = DisplayLabels.contactId %1"
+                "\n %2"
+                "\n GROUP BY DisplayLabels.displayLabelGroupSortOrder, DisplayLabels.displayLabelGroup"
+                "\n ORDER BY DisplayLabels.displayLabelGroupSortOrder, DisplayLabels.displayLabelGroup").arg(join).arg(compiled.where);
+
+    ContactsDatabase::Query query(m_database.prepare(queryString));
+    for (int i = 0; i < bindings.count(); ++i)
+        query.bindValue(i, bindings.at(i));
+
+    if (!ContactsDatabase::execute(query)) {
+        query.reportError(QString::fromLatin1("Failed to count contacts by display label group\nQuery:\n%1").arg(queryString));
+        return QContactManager::UnspecifiedError;
+    } else {
+        debugFilterExpansion("Display label group counts:", queryString, bindings);
+    }
+
+    while (query.next()) {
+        counts->append(qMakePair(query.value<QString>(0), query.value<int>(1)));
+    }
+
+    return QContactManager::NoError;
+}
+
 QContactManager::Error ContactReader::getIdentity(
         ContactsDatabase::Identity identity, QContactId *contactId)
 {
@@ -3115,33 +4094,13 @@ QContactManager::Error ContactReader::readDetails(
 
     QMutexLocker locker(m_database.accessMutex());
 
-    QString join;
-    bool transientModifiedRequired = false;
-    bool globalPresenceRequired = false;
-    const QString orderBy = buildOrderBy(
-                order,
-                &join,
-                &transientModifiedRequired,
-                &globalPresenceRequired,
-                m_database.localized(),
-                type,
-                QString());
-
-    bool whereFailed = false;
+    ContactsDatabase::CompiledFilter compiled;
     QVariantList bindings;
-    QString where = buildDetailWhere(
-                filter,
-                m_database,
-                QLatin1String(info.table),
-                type,
-                &bindings,
-                &whereFailed,
-                &transientModifiedRequired,
-                &globalPresenceRequired);
-    if (whereFailed) {
-        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to create WHERE expression: invalid filter specification"));
+    if (!compileFilter(m_database, QLatin1String(info.table), filter, order, type, &compiled, &bindings)) {
         return QContactManager::UnspecifiedError;
     }
+    const QString &where(compiled.where);
+    const QString &orderBy(compiled.orderBy);
 
     const int maximumCount = fetchHint.maxCountHint();
 
@@ -3167,25 +4126,18 @@ QContactManager::Error ContactReader::readDetails(
                 QLatin1String(info.table),
                 !where.isEmpty() ? QStringLiteral(" WHERE ") + where : QString(),
                 !orderBy.isEmpty() ? QStringLiteral(" ORDER BY ") + orderBy : QStringLiteral(" ORDER BY maxId DESC"), // If there's no sort order prioritize the most recent entries.
-                maximumCount > 0 ? QStringLiteral(" LIMIT %1").arg(maximumCount): QString());
-
-    QSqlQuery query(m_database);
-    query.setForwardOnly(true);
-    if (!query.prepare(statement)) {
-        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to prepare a unique details query: %1\n%2")
-                .arg(query.lastError().text())
-                .arg(statement));
-        return QContactManager::UnspecifiedError;
+                maximumCount > 0 ? QStringLiteral(" LIMIT ?") : QString());
+    if (maximumCount > 0) {
+        bindings.append(maximumCount);
     }
 
+    ContactsDatabase::Query query(m_database.prepare(statement));
     for (int i = 0; i < bindings.count(); ++i) {
         query.bindValue(i, bindings.at(i));
     }
 
     if (!ContactsDatabase::execute(query)) {
-        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to query unique details\n%1\nQuery:\n%2")
-                .arg(query.lastError().text())
-                .arg(statement));
+        query.reportError(QString::fromLatin1("Failed to query unique details\nQuery:\n%1").arg(statement));
         return QContactManager::UnspecifiedError;
     }
 
@@ -33,6 +33,7 @@
 #ifndef CONTACTREADER_H
 #define CONTACTREADER_H
 
+#include "contactcache.h"
 #include "contactid_p.h"
 #include "contactsdatabase.h"
 
@@ -50,6 +51,9 @@ public:
     ContactReader(ContactsDatabase &database, const QString &managerUri);
     virtual ~ContactReader();
 
+    // If set, contacts fetched by id are served from and retained in the cache
+    void setContactCache(ContactCache *cache);
+
     QContactManager::Error readContacts(
             const QString &table,
             QList<QContact> *contacts,
@@ -76,6 +80,35 @@ public:
             const QContactFilter &filter,
             const QList<QContactSortOrder> &order);
 
+    // Read a page of at most pageSize contacts, following the position identified by cursor.
+    // The cursor for the following page is stored to nextCursor, unless there is none.
+    QContactManager::Error readContactIds(
+            QList<QContactId> *contactIds,
+            const QContactFilter &filter,
+            const QList<QContactSortOrder> &order,
+            int pageSize,
+            const QByteArray &cursor,
+            QByteArray *nextCursor);
+
+    QContactManager::Error readContacts(
+            const QString &table,
+            QList<QContact> *contacts,
+            const QContactFilter &filter,
+            const QList<QContactSortOrder> &order,
+            const QContactFetchHint &fetchHint,
+            int pageSize,
+            const QByteArray &cursor,
+            QByteArray *nextCursor);
+
+    QContactManager::Error readContactCount(
+            int *count,
+            const QContactFilter &filter);
+
+    // Counts are reported in display label group sort order
+    QContactManager::Error readDisplayLabelGroupCounts(
+            QList<QPair<QString, int> > *counts,
+            const QContactFilter &filter);
+
     QContactManager::Error getIdentity(
             ContactsDatabase::Identity identity, QContactId *contactId);
 
@@ -114,7 +147,19 @@ public:
             QList<QContact> *addedContacts,
             QList<QContact> *modifiedContacts,
             QList<QContact> *deletedContacts,
-            QList<QContact> *unmodifiedContacts);
+            QList<QContact> *unmodifiedContacts,
+            QList<QContactId> *unmodifiedContactIds = nullptr);
+
+    QContactManager::Error fetchContactIds(
+            const QContactCollectionId &collectionId,
+            QList<QContactId> *addedContactIds,
+            QList<QContactId> *modifiedContactIds,
+            QList<QContactId> *deletedContactIds,
+            QList<QContactId> *unmodifiedContactIds);
+
+    QContactManager::Error fetchContacts(
+            const QList<QContactId> &contactIds,
+            QList<QContact> *contacts);
 
     QContactManager::Error recordUnhandledChangeFlags(
             const QContactCollectionId &collectionId,
@@ -129,6 +174,14 @@ protected:
             QList<QContactId> *contactIds,
             const QContactFilter &filter);
 
+    QContactManager::Error readContactIdPage(
+            QList<quint32> *databaseIds,
+            const QContactFilter &filter,
+            const QList<QContactSortOrder> &order,
+            int pageSize,
+            const QByteArray &cursor,
+            QByteArray *nextCursor);
+
     QContactManager::Error queryContacts(
             const QString &table,
             QList<QContact> *contacts,
@@ -153,6 +206,7 @@ protected:
 private:
     ContactsDatabase &m_database;
     QString m_managerUri;
+    ContactCache *m_contactCache;
 };
 
 #endif
@@ -32,27 +32,45 @@
 
 #include "contactsdatabase.h"
 #include "contactsengine.h"
+#include "contactnotifier.h"
+#include "contactid_p.h"
 #include "defaultdlggenerator.h"
 #include "conversion_p.h"
 #include "trace_p.h"
 
+#include "../extensions/qcontactdeactivated.h"
+
+#include <QContactAvatar>
+#include <QContactDisplayLabel>
+#include <QContactEmailAddress>
 #include <QContactGender>
+#include <QContactGlobalPresence>
 #include <QContactName>
-#include <QContactDisplayLabel>
+#include <QContactPhoneNumber>
 
 #include <QPluginLoader>
+#include <QDataStream>
+#include <QJsonArray>
+#include <QJsonObject>
 #include <QElapsedTimer>
 #include <QStandardPaths>
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
 #include <QLocale>
+#include <QSet>
 #include <QSqlDriver>
 #include <QSqlError>
 #include <QSqlQuery>
+#include <QThread>
 
 #include <QtDebug>
 
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
 #ifdef QTCONTACTS_SQLITE_LOAD_ICU
 #include <sqlite3.h>
 #endif
@@ -360,12 +378,50 @@ static const char *createIdentitiesTable =
         "\n identity INTEGER PRIMARY KEY,"
         "\n contactId INTEGER KEY);";
 
-static const char *createRelationshipsTable =
-        "\n CREATE Table Relationships ("
+// Relationship types are interned; the types used by the engine itself have fixed ids
+static const char *createRelationshipTypesTable =
+        "\n CREATE TABLE RelationshipTypes ("
+        "\n typeId INTEGER PRIMARY KEY ASC,"
+        "\n type TEXT NOT NULL UNIQUE);";
+
+static const char *createRelationshipTypes =
+        "\n INSERT INTO RelationshipTypes (typeId, type) VALUES"
+        "\n (1, 'Aggregates'),"
+        "\n (2, 'IsNot');";
+
+static const char *createRelationshipEdgesTable =
+        "\n CREATE TABLE RelationshipEdges ("
         "\n firstId INTEGER NOT NULL,"
+        "\n typeId INTEGER NOT NULL,"
         "\n secondId INTEGER NOT NULL,"
-        "\n type TEXT,"
-        "\n PRIMARY KEY (firstId, secondId, type));";
+        "\n UNIQUE (firstId, typeId, secondId));";
+
+// The relationships are still accessible in their original form, via a view
+static const char *createRelationshipsView =
+        "\n CREATE VIEW Relationships AS"
+        "\n SELECT RelationshipEdges.firstId AS firstId, RelationshipEdges.secondId AS secondId, RelationshipTypes.type AS type"
+        "\n FROM RelationshipEdges"
+        "\n JOIN RelationshipTypes ON RelationshipTypes.typeId = RelationshipEdges.typeId;";
+
+static const char *createInsertRelationshipTrigger =
+        "\n CREATE TRIGGER InsertRelationship"
+        "\n INSTEAD OF INSERT"
+        "\n ON Relationships"
+        "\n BEGIN"
+        "\n  INSERT OR IGNORE INTO RelationshipTypes (type) VALUES (new.type);"
+        "\n  INSERT INTO RelationshipEdges (firstId, typeId, secondId)"
+        "\n   SELECT new.firstId, typeId, new.secondId FROM RelationshipTypes WHERE type = new.type;"
+        "\n END;";
+
+static const char *createDeleteRelationshipTrigger =
+        "\n CREATE TRIGGER DeleteRelationship"
+        "\n INSTEAD OF DELETE"
+        "\n ON Relationships"
+        "\n BEGIN"
+        "\n  DELETE FROM RelationshipEdges"
+        "\n   WHERE firstId = old.firstId AND secondId = old.secondId"
+        "\n   AND typeId = (SELECT typeId FROM RelationshipTypes WHERE type = old.type);"
+        "\n END;";
 
 static const char *createDeletedContactsTable =
         "\n CREATE TABLE DeletedContacts ("
@@ -549,7 +605,44 @@ static const char *createRemoveTrigger_21 =
         "\n  DELETE FROM Relationships WHERE firstId = old.contactId OR secondId = old.contactId;"
         "\n END;";
 
-static const char *createRemoveTrigger = createRemoveTrigger_21;
+static const char *createRemoveTrigger_25 =
+        "\n CREATE TRIGGER RemoveContactDetails"
+        "\n BEFORE DELETE"
+        "\n ON Contacts"
+        "\n BEGIN"
+        "\n  DELETE FROM Addresses WHERE contactId = old.contactId;"
+        "\n  DELETE FROM Anniversaries WHERE contactId = old.contactId;"
+        "\n  DELETE FROM Avatars WHERE contactId = old.contactId;"
+        "\n  DELETE FROM Birthdays WHERE contactId = old.contactId;"
+        "\n  DELETE FROM DisplayLabels WHERE contactId = old.contactId;"
+        "\n  DELETE FROM EmailAddresses WHERE contactId = old.contactId;"
+        "\n  DELETE FROM Families WHERE contactId = old.contactId;"
+        "\n  DELETE FROM Favorites WHERE contactId = old.contactId;"
+        "\n  DELETE FROM Genders WHERE contactId = old.contactId;"
+        "\n  DELETE FROM GeoLocations WHERE contactId = old.contactId;"
+        "\n  DELETE FROM GlobalPresences WHERE contactId = old.contactId;"
+        "\n  DELETE FROM Guids WHERE contactId = old.contactId;"
+        "\n  DELETE FROM Hobbies WHERE contactId = old.contactId;"
+        "\n  DELETE FROM Names WHERE contactId = old.contactId;"
+        "\n  DELETE FROM Nicknames WHERE contactId = old.contactId;"
+        "\n  DELETE FROM Notes WHERE contactId = old.contactId;"
+        "\n  DELETE FROM OnlineAccounts WHERE contactId = old.contactId;"
+        "\n  DELETE FROM Organizations WHERE contactId = old.contactId;"
+        "\n  DELETE FROM PhoneNumbers WHERE contactId = old.contactId;"
+        "\n  DELETE FROM Presences WHERE contactId = old.contactId;"
+        "\n  DELETE FROM Ringtones WHERE contactId = old.contactId;"
+        "\n  DELETE FROM SyncTargets WHERE contactId = old.contactId;"
+        "\n  DELETE FROM Tags WHERE contactId = old.contactId;"
+        "\n  DELETE FROM Urls WHERE contactId = old.contactId;"
+        "\n  DELETE FROM OriginMetadata WHERE contactId = old.contactId;"
+        "\n  DELETE FROM ExtendedDetails WHERE contactId = old.contactId;"
+        "\n  DELETE FROM Details WHERE contactId = old.contactId;"
+        "\n  DELETE FROM Identities WHERE contactId = old.contactId;"
+        "\n  DELETE FROM RelationshipEdges WHERE firstId = old.contactId;"
+        "\n  DELETE FROM RelationshipEdges WHERE secondId = old.contactId;"
+        "\n END;";
+
+static const char *createRemoveTrigger = createRemoveTrigger_25;
 
 // better if we had used foreign key constraints with cascade delete...
 static const char *createRemoveDetailsTrigger_22 =
@@ -676,11 +769,21 @@ static const char *createContactsModifiedIndex =
 static const char *createContactsTypeIndex =
         "\n CREATE INDEX ContactsTypeIndex ON Contacts(type);";
 
-static const char *createRelationshipsFirstIdIndex =
-        "\n CREATE INDEX RelationshipsFirstIdIndex ON Relationships(firstId);";
+// The visibility constraints added to every contact query (see expandWhere() in
+// contactreader.cpp) can be answered from these partial indexes alone.  The
+// constrained columns are repeated in the index so that SQLite does not need to
+// visit the table to re-test them; the first index serves the aggregate listing,
+// the second the queries which are not restricted to the aggregate collection.
+static const char *createContactsVisibleAggregatesIndex =
+        "\n CREATE INDEX ContactsVisibleAggregatesIndex ON Contacts(collectionId, contactId, isDeactivated, changeFlags)"
+        "\n WHERE collectionId = 1 AND isDeactivated = 0 AND changeFlags < 4;";
+
+static const char *createContactsVisibleIndex =
+        "\n CREATE INDEX ContactsVisibleIndex ON Contacts(isDeactivated, changeFlags, collectionId, contactId)"
+        "\n WHERE isDeactivated = 0 AND changeFlags < 4;";
 
-static const char *createRelationshipsSecondIdIndex =
-        "\n CREATE INDEX RelationshipsSecondIdIndex ON Relationships(secondId);";
+static const char *createRelationshipEdgesSecondIdIndex =
+        "\n CREATE INDEX RelationshipEdgesSecondIdIndex ON RelationshipEdges(secondId, typeId, firstId);";
 
 static const char *createPhoneNumbersIndex =
         "\n CREATE INDEX PhoneNumbersIndex ON PhoneNumbers(normalizedNumber);";
@@ -717,6 +820,11 @@ static const char *createOriginMetadataGroupIdIndex =
 // The best way to get these numbers is to run ANALYZE on a
 // real database and scale the results to the numbers here
 // (5000 contacts and 25000 details).
+//
+// The seeded data is only a starting point: the table sizes recorded
+// here are compared against the real row counts from time to time (see
+// ContactsDatabase::updateStatistics()) and any table which has drifted
+// too far is re-analyzed.
 static const char *createAnalyzeData1 =
         // ANALYZE creates the sqlite_stat1 table; constrain it to sqlite_master
         // just to make sure it doesn't do needless work.
@@ -727,13 +835,15 @@ static const char *createAnalyzeData3 =
         "\n INSERT INTO sqlite_stat1 VALUES"
         "\n   ('DbSettings','sqlite_autoindex_DbSettings_1','2 1'),"
         "\n   ('Collections','','12'),"
-        "\n   ('Relationships','RelationshipsSecondIdIndex','3000 2'),"
-        "\n   ('Relationships','RelationshipsFirstIdIndex','3000 2'),"
-        "\n   ('Relationships','sqlite_autoindex_Relationships_1','3000 2 2 1'),"
+        "\n   ('RelationshipTypes','sqlite_autoindex_RelationshipTypes_1','2 1'),"
+        "\n   ('RelationshipEdges','RelationshipEdgesSecondIdIndex','3000 2 2 1'),"
+        "\n   ('RelationshipEdges','sqlite_autoindex_RelationshipEdges_1','3000 2 2 1'),"
         "\n   ('Contacts','ContactsTypeIndex','5000 5000'),"
         "\n   ('Contacts','ContactsModifiedIndex','5000 30'),"
         "\n   ('Contacts','ContactsChangeFlagsIndex','5000 200'),"
         "\n   ('Contacts','ContactsCollectionIdIndex','5000 500'),"
+        "\n   ('Contacts','ContactsVisibleAggregatesIndex','500 500 1 1 1'),"
+        "\n   ('Contacts','ContactsVisibleIndex','4500 4500 2250 450 1'),"
         "\n   ('Details', 'DetailsRemoveIndex', '25000 6 2'),"
         "\n   ('Details', 'DetailsContactIdIndex', '25000 6 2'),"
         "\n   ('Favorites','sqlite_autoindex_Favorites_1','100 2'),"
@@ -785,7 +895,12 @@ static const char *createStatements[] =
     createDetailsChangeFlagsIndex,
     createDetailsContactIdIndex,
     createIdentitiesTable,
-    createRelationshipsTable,
+    createRelationshipTypesTable,
+    createRelationshipTypes,
+    createRelationshipEdgesTable,
+    createRelationshipsView,
+    createInsertRelationshipTrigger,
+    createDeleteRelationshipTrigger,
     createOOBTable,
     createDbSettingsTable,
     createRemoveTrigger,
@@ -794,8 +909,7 @@ static const char *createStatements[] =
     createContactsChangeFlagsIndex,
     createFirstNameIndex,
     createLastNameIndex,
-    createRelationshipsFirstIdIndex,
-    createRelationshipsSecondIdIndex,
+    createRelationshipEdgesSecondIdIndex,
     createPhoneNumbersIndex,
     createEmailAddressesIndex,
     createOnlineAccountsIndex,
@@ -804,6 +918,8 @@ static const char *createStatements[] =
     createOriginMetadataGroupIdIndex,
     createContactsModifiedIndex,
     createContactsTypeIndex,
+    createContactsVisibleAggregatesIndex,
+    createContactsVisibleIndex,
     createAnalyzeData1,
     createAnalyzeData2,
     createAnalyzeData3,
@@ -1689,6 +1805,45 @@ static const char *upgradeVersion23[] = {
     "PRAGMA user_version=24",
     0 // NULL-terminated
 };
+static const char *upgradeVersion24[] = {
+    createRelationshipTypesTable,
+    createRelationshipTypes,
+    createRelationshipEdgesTable,
+    "\n INSERT OR IGNORE INTO RelationshipTypes (type)"
+    "\n SELECT DISTINCT type FROM Relationships WHERE type IS NOT NULL",
+    // Preserve the insertion order of the existing relationships
+    "\n INSERT OR IGNORE INTO RelationshipEdges (firstId, typeId, secondId)"
+    "\n SELECT Relationships.firstId, RelationshipTypes.typeId, Relationships.secondId"
+    "\n FROM Relationships"
+    "\n JOIN RelationshipTypes ON RelationshipTypes.type = Relationships.type"
+    "\n ORDER BY Relationships.rowid",
+    "DROP TABLE Relationships",
+    createRelationshipEdgesSecondIdIndex,
+    createRelationshipsView,
+    createInsertRelationshipTrigger,
+    createDeleteRelationshipTrigger,
+    "DROP TRIGGER RemoveContactDetails",
+    createRemoveTrigger_25,
+    createAnalyzeData1,
+    "\n DELETE FROM sqlite_stat1 WHERE tbl IN ('Relationships', 'RelationshipTypes', 'RelationshipEdges')",
+    "\n INSERT INTO sqlite_stat1 VALUES"
+    "\n   ('RelationshipTypes','sqlite_autoindex_RelationshipTypes_1','2 1'),"
+    "\n   ('RelationshipEdges','RelationshipEdgesSecondIdIndex','3000 2 2 1'),"
+    "\n   ('RelationshipEdges','sqlite_autoindex_RelationshipEdges_1','3000 2 2 1')",
+    "PRAGMA user_version=25",
+    0 // NULL-terminated
+};
+static const char *upgradeVersion25[] = {
+    createContactsVisibleAggregatesIndex,
+    createContactsVisibleIndex,
+    createAnalyzeData1,
+    "\n DELETE FROM sqlite_stat1 WHERE idx IN ('ContactsVisibleAggregatesIndex', 'ContactsVisibleIndex')",
+    "\n INSERT INTO sqlite_stat1 VALUES"
+    "\n   ('Contacts','ContactsVisibleAggregatesIndex','500 500 1 1 1'),"
+    "\n   ('Contacts','ContactsVisibleIndex','4500 4500 2250 450 1')",
+    "PRAGMA user_version=26",
+    0 // NULL-terminated
+};
 
 typedef bool (*UpgradeFunction)(QSqlDatabase &database);
 
@@ -2212,9 +2367,11 @@ static UpgradeOperation upgradeVersions[] = {
     { 0,                            upgradeVersion21 },
     { 0,                            upgradeVersion22 },
     { 0,                            upgradeVersion23 },
+    { 0,                            upgradeVersion24 },
+    { 0,                            upgradeVersion25 },
 };
 
-static const int currentSchemaVersion = 24;
+static const int currentSchemaVersion = 26;
 
 static bool execute(QSqlDatabase &database, const QString &statement)
 {
@@ -2259,7 +2416,235 @@ static bool finalizeTransaction(QSqlDatabase &database, bool success)
 template <typename T> static int lengthOf(T) { return 0; }
 template <typename T, int N> static int lengthOf(const T(&)[N]) { return N; }
 
-static bool executeDisplayLabelGroupLocalizationStatements(QSqlDatabase &database, ContactsDatabase *cdb, bool *changed = Q_NULLPTR)
+// The tables whose sizes most influence the query plans chosen for the
+// reader queries.  If the row count of any of these differs from the
+// size recorded in sqlite_stat1 by more than the drift factor (and by
+// at least the minimum number of rows), its statistics are refreshed.
+static const char *statisticsTables[] = {
+    "Contacts",
+    "Details",
+    "RelationshipEdges",
+    "Names",
+    "DisplayLabels",
+    "PhoneNumbers",
+    "EmailAddresses",
+    "OnlineAccounts",
+    "Nicknames",
+    "OriginMetadata",
+    "Favorites",
+};
+
+static const int statisticsDriftFactor = 2;
+static const int statisticsMinimumDrift = 1000;
+static const int statisticsAnalysisLimit = 1000;
+static const int transactionsPerStatisticsCheck = 100;
+
+// The number of distinct filter shapes whose SQL is retained for reuse
+static const int compiledFilterCacheSize = 256;
+
+// The number of distinct statements kept prepared; the least recently used are finalized
+static const int preparedQueryCacheSize = compiledFilterCacheSize;
+
+static bool findOutdatedStatistics(QSqlDatabase &database, QStringList *tables)
+{
+    // The first number of each sqlite_stat1 entry is the size of the table
+    // at the time it was analyzed (or seeded), except for partial indexes
+    // where it is the number of rows in the index; take the largest.
+    QHash<QString, qint64> recordedCounts;
+    {
+        QSqlQuery query(database);
+        query.setForwardOnly(true);
+        const QString statement = QStringLiteral("SELECT tbl, stat FROM sqlite_stat1");
+        if (!query.exec(statement)) {
+            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to select recorded statistics: %1\n%2")
+                    .arg(query.lastError().text())
+                    .arg(statement));
+            return false;
+        }
+        while (query.next()) {
+            const QString stat = query.value(1).toString();
+            const QString table = query.value(0).toString();
+            const qint64 recorded = stat.left(stat.indexOf(QChar(' '))).toLongLong();
+            if (recorded > recordedCounts.value(table, 0)) {
+                recordedCounts.insert(table, recorded);
+            }
+        }
+    }
+
+    for (int i = 0; i < lengthOf(statisticsTables); ++i) {
+        const QString table(QLatin1String(statisticsTables[i]));
+
+        QSqlQuery query(database);
+        query.setForwardOnly(true);
+        const QString statement = QStringLiteral("SELECT COUNT(*) FROM %1").arg(table);
+        if (!query.exec(statement) || !query.next()) {
+            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to count rows for statistics: %1\n%2")
+                    .arg(query.lastError().text())
+                    .arg(statement));
+            return false;
+        }
+
+        const qint64 count = query.value(0).toLongLong();
+        const qint64 recorded = recordedCounts.value(table, 0);
+        if (qAbs(count - recorded) >= statisticsMinimumDrift
+                && (count > recorded * statisticsDriftFactor || count * statisticsDriftFactor < recorded)) {
+            QTCONTACTS_SQLITE_DEBUG(QString::fromLatin1("Statistics for %1 are outdated: %2 rows recorded, %3 rows present")
+                    .arg(table).arg(recorded).arg(count));
+            tables->append(table);
+        }
+    }
+
+    return true;
+}
+
+static const QString integrityCheckTableSetting(QStringLiteral("IntegrityCheckTable"));
+static const QString integrityCheckStatusSetting(QStringLiteral("IntegrityCheckStatus"));
+static const QString displayLabelGroupRegenerationSetting(QStringLiteral("DisplayLabelGroupRegeneration"));
+
+static const int displayLabelGroupRegenerationChunkSize = 500;
+
+// PRAGMA analysis_limit requires SQLite 3.32.0
+static const int analysisLimitMinimumVersion = 3032000;
+
+// Table-scoped PRAGMA quick_check requires SQLite 3.33.0
+static const int tableQuickCheckMinimumVersion = 3033000;
+
+static int sqliteVersionNumber(QSqlDatabase &database)
+{
+    // Encoded as by SQLITE_VERSION_NUMBER, e.g. 3033000 for 3.33.0
+    QSqlQuery query(database);
+    query.setForwardOnly(true);
+    if (!query.exec(QStringLiteral("SELECT sqlite_version()")) || !query.next()) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to query SQLite version: %1")
+                .arg(query.lastError().text()));
+        return 0;
+    }
+
+    const QStringList components(query.value(0).toString().split(QChar('.')));
+    return components.value(0).toInt() * 1000000
+         + components.value(1).toInt() * 1000
+         + components.value(2).toInt();
+}
+
+static QString readSetting(QSqlDatabase &database, const QString &name)
+{
+    // DbSettings may not exist prior to upgrade, so failure is not reported
+    QSqlQuery query(database);
+    query.setForwardOnly(true);
+    if (query.prepare(QStringLiteral("SELECT Value FROM DbSettings WHERE Name = ?"))) {
+        query.addBindValue(name);
+        if (query.exec() && query.next()) {
+            return query.value(0).toString();
+        }
+    }
+    return QString();
+}
+
+static bool writeSetting(QSqlDatabase &database, const QString &name, const QString &value)
+{
+    QSqlQuery query(database);
+    const QString statement = QStringLiteral("INSERT OR REPLACE INTO DbSettings (Name, Value) VALUES (?, ?)");
+    if (!query.prepare(statement)) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to prepare setting update query: %1\n%2")
+                .arg(query.lastError().text())
+                .arg(statement));
+        return false;
+    }
+    query.addBindValue(name);
+    query.addBindValue(value);
+    if (!query.exec()) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to update setting %1: %2\n%3")
+                .arg(name)
+                .arg(query.lastError().text())
+                .arg(statement));
+        return false;
+    }
+    return true;
+}
+
+static bool regenerateDisplayLabelGroupsChunk(QSqlDatabase &database, ContactsDatabase *cdb, quint32 *lastContactId, int limit, bool *complete)
+{
+    // read the data required to generate the display label group data for the contacts
+    // following lastContactId, or for every remaining contact if no limit is specified.
+    bool emitDisplayLabelGroupChange = false;
+    QVariantList contactIds;
+    QVariantList displayLabelGroups;
+    QVariantList displayLabelGroupSortOrders;
+    {
+        QSqlQuery selectQuery(database);
+        selectQuery.setForwardOnly(true);
+        const QString statement = QStringLiteral(
+                " SELECT c.contactId, n.firstName, n.lastName, d.displayLabel"
+                " FROM Contacts c"
+                  " LEFT JOIN Names n ON c.contactId = n.contactId"
+                  " LEFT JOIN DisplayLabels d ON c.contactId = d.contactId"
+                " WHERE c.contactId > ?"
+                " ORDER BY c.contactId"
+                " LIMIT ?");
+        if (!selectQuery.prepare(statement)) {
+            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to prepare display label groups data selection query: %1\n%2")
+                    .arg(selectQuery.lastError().text())
+                    .arg(statement));
+            return false;
+        }
+        selectQuery.addBindValue(*lastContactId);
+        selectQuery.addBindValue(limit > 0 ? limit : -1);
+        if (!selectQuery.exec()) {
+            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to select display label groups data: %1\n%2")
+                    .arg(selectQuery.lastError().text())
+                    .arg(statement));
+            return false;
+        }
+        while (selectQuery.next()) {
+            const quint32 dbId = selectQuery.value(0).toUInt();
+            const QString firstName = selectQuery.value(1).toString();
+            const QString lastName = selectQuery.value(2).toString();
+            const QString displayLabel = selectQuery.value(3).toString();
+            contactIds.append(dbId);
+            *lastContactId = dbId;
+
+            const QString dlg = cdb->determineDisplayLabelGroup(firstName, lastName, displayLabel, &emitDisplayLabelGroupChange);
+            displayLabelGroups.append(dlg);
+            displayLabelGroupSortOrders.append(cdb->displayLabelGroupSortValue(dlg));
+        }
+        selectQuery.finish();
+    }
+
+    *complete = (limit <= 0 || contactIds.size() < limit);
+
+    // now write the generated data back to the database.
+    // do it in batches, otherwise it can fail if any single batch is too big.
+    {
+        for (int i = 0; i < displayLabelGroups.size(); i += 167) {
+            const QVariantList groups = displayLabelGroups.mid(i, qMin(displayLabelGroups.size() - i, 167));
+            const QVariantList sortorders = displayLabelGroupSortOrders.mid(i, qMin(displayLabelGroups.size() - i, 167));
+            const QVariantList ids = contactIds.mid(i, qMin(displayLabelGroups.size() - i, 167));
+
+            QSqlQuery updateQuery(database);
+            const QString statement = QStringLiteral("UPDATE DisplayLabels SET displayLabelGroup = ?, displayLabelGroupSortOrder = ? WHERE contactId = ?");
+            if (!updateQuery.prepare(statement)) {
+                QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to prepare update display label groups query: %1\n%2")
+                        .arg(updateQuery.lastError().text())
+                        .arg(statement));
+                return false;
+            }
+            updateQuery.addBindValue(groups);
+            updateQuery.addBindValue(sortorders);
+            updateQuery.addBindValue(ids);
+            if (!updateQuery.execBatch()) {
+                QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to update display label groups: %1\n%2")
+                        .arg(updateQuery.lastError().text())
+                        .arg(statement));
+                return false;
+            }
+            updateQuery.finish();
+        }
+    }
+
+    return true;
+}
+
+static bool executeDisplayLabelGroupLocalizationStatements(QSqlDatabase &database, ContactsDatabase *cdb, bool *changed = Q_NULLPTR, bool deferred = false)
 {
     // determine if the current system locale is equal to that used for the display label groups.
     // if not, update them all.
@@ -2373,87 +2758,29 @@ static bool executeDisplayLabelGroupLocalizationStatements(QSqlDatabase &databas
         if (changed) *changed = true;
     }
 
-    // for every single contact in our database, read the data required to generate the display label group data.
-    bool emitDisplayLabelGroupChange = false;
-    QVariantList contactIds;
-    QVariantList displayLabelGroups;
-    QVariantList displayLabelGroupSortOrders;
-    {
-        QSqlQuery selectQuery(database);
-        selectQuery.setForwardOnly(true);
-        const QString statement = QStringLiteral(
-                " SELECT c.contactId, n.firstName, n.lastName, d.displayLabel"
-                " FROM Contacts c"
-                  " LEFT JOIN Names n ON c.contactId = n.contactId"
-                  " LEFT JOIN DisplayLabels d ON c.contactId = d.contactId");
-        if (!selectQuery.prepare(statement)) {
-            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to prepare display label groups data selection query: %1\n%2")
-                    .arg(selectQuery.lastError().text())
-                    .arg(statement));
-            return false;
-        }
-        if (!selectQuery.exec()) {
-            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to select display label groups data: %1\n%2")
-                    .arg(selectQuery.lastError().text())
-                    .arg(statement));
-            return false;
-        }
-        while (selectQuery.next()) {
-            const quint32 dbId = selectQuery.value(0).toUInt();
-            const QString firstName = selectQuery.value(1).toString();
-            const QString lastName = selectQuery.value(2).toString();
-            const QString displayLabel = selectQuery.value(3).toString();
-            contactIds.append(dbId);
-
-            QContactName n;
-            n.setFirstName(firstName);
-            n.setLastName(lastName);
-            QContactDisplayLabel dl;
-            dl.setLabel(displayLabel);
-            QContact c;
-            c.saveDetail(&n);
-            c.saveDetail(&dl);
+    // the generators valid for the previous locale or property may no longer apply
+    cdb->invalidateDisplayLabelGroupGenerators();
 
-            const QString dlg = cdb->determineDisplayLabelGroup(c, &emitDisplayLabelGroupChange);
-            displayLabelGroups.append(dlg);
-            displayLabelGroupSortOrders.append(cdb->displayLabelGroupSortValue(dlg));
-        }
-        selectQuery.finish();
+    if (deferred) {
+        // regenerate the groups in chunks once the database is open, starting from the first contact
+        return writeSetting(database, displayLabelGroupRegenerationSetting, QStringLiteral("0"));
     }
 
-    // now write the generated data back to the database.
-    // do it in batches, otherwise it can fail if any single batch is too big.
-    {
-        for (int i = 0; i < displayLabelGroups.size(); i += 167) {
-            const QVariantList groups = displayLabelGroups.mid(i, qMin(displayLabelGroups.size() - i, 167));
-            const QVariantList sortorders = displayLabelGroupSortOrders.mid(i, qMin(displayLabelGroups.size() - i, 167));
-            const QVariantList ids = contactIds.mid(i, qMin(displayLabelGroups.size() - i, 167));
+    quint32 lastContactId = 0;
+    bool complete = false;
+    if (!regenerateDisplayLabelGroupsChunk(database, cdb, &lastContactId, 0, &complete)) {
+        return false;
+    }
 
-            QSqlQuery updateQuery(database);
-            const QString statement = QStringLiteral("UPDATE DisplayLabels SET displayLabelGroup = ?, displayLabelGroupSortOrder = ? WHERE contactId = ?");
-            if (!updateQuery.prepare(statement)) {
-                QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to prepare update display label groups query: %1\n%2")
-                        .arg(updateQuery.lastError().text())
-                        .arg(statement));
-                return false;
-            }
-            updateQuery.addBindValue(groups);
-            updateQuery.addBindValue(sortorders);
-            updateQuery.addBindValue(ids);
-            if (!updateQuery.execBatch()) {
-                QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to update display label groups: %1\n%2")
-                        .arg(updateQuery.lastError().text())
-                        .arg(statement));
-                return false;
-            }
-            updateQuery.finish();
-        }
+    // this supersedes any regeneration which was previously deferred
+    if (!readSetting(database, displayLabelGroupRegenerationSetting).isEmpty()) {
+        return writeSetting(database, displayLabelGroupRegenerationSetting, QString());
     }
 
     return true;
 }
 
-static bool executeUpgradeStatements(QSqlDatabase &database)
+static bool executeUpgradeStatements(QSqlDatabase &database, ContactNotifier *notifier)
 {
     // Check that the defined schema matches the array of upgrade scripts
     if (currentSchemaVersion != lengthOf(upgradeVersions)) {
@@ -2471,22 +2798,36 @@ static bool executeUpgradeStatements(QSqlDatabase &database)
     int schemaVersion = versionQuery.value(0).toInt();
     versionQuery.finish();
 
+    const int initialVersion = schemaVersion;
+    const QString progressTask(QStringLiteral("schema"));
+
     while (schemaVersion < currentSchemaVersion) {
         qWarning() << "Upgrading contacts database from schema version" << schemaVersion;
+        if (notifier) {
+            notifier->upgradeProgress(progressTask, schemaVersion - initialVersion, currentSchemaVersion - initialVersion);
+        }
+
+        // Each version is upgraded in a separate transaction, so that an interrupted
+        // upgrade resumes from the last completed version rather than from the start
+        if (!beginTransaction(database))
+            return false;
 
+        bool success = true;
         if (upgradeVersions[schemaVersion].fn) {
             if (!(*upgradeVersions[schemaVersion].fn)(database)) {
                 qWarning() << "Unable to update data for schema version" << schemaVersion;
-                return false;
+                success = false;
             }
         }
-        if (upgradeVersions[schemaVersion].statements) {
-            for (unsigned i = 0; upgradeVersions[schemaVersion].statements[i]; i++) {
-                if (!execute(database, QLatin1String(upgradeVersions[schemaVersion].statements[i])))
-                    return false;
+        if (success && upgradeVersions[schemaVersion].statements) {
+            for (unsigned i = 0; success && upgradeVersions[schemaVersion].statements[i]; i++) {
+                success = execute(database, QLatin1String(upgradeVersions[schemaVersion].statements[i]));
             }
         }
 
+        if (!finalizeTransaction(database, success))
+            return false;
+
         if (!versionQuery.exec() || !versionQuery.next()) {
             qWarning() << "User version query failed:" << versionQuery.lastError();
             return false;
@@ -2502,6 +2843,9 @@ static bool executeUpgradeStatements(QSqlDatabase &database)
             schemaVersion = version;
             if (schemaVersion == currentSchemaVersion) {
                 qWarning() << "Contacts database upgraded to version" << schemaVersion;
+                if (notifier) {
+                    notifier->upgradeProgress(progressTask, schemaVersion - initialVersion, schemaVersion - initialVersion);
+                }
             }
         }
     }
@@ -2529,15 +2873,30 @@ static bool checkDatabase(QSqlDatabase &database)
     return false;
 }
 
-static bool upgradeDatabase(QSqlDatabase &database, ContactsDatabase *cdb)
+static bool checkDatabaseHeader(QSqlDatabase &database)
+{
+    // Reading the schema requires a valid header and an intact sqlite_master;
+    // the remaining pages are verified by ContactsDatabase::checkIntegrity().
+    QSqlQuery query(database);
+    if (query.exec(QStringLiteral("SELECT COUNT(*) FROM sqlite_master")) && query.next()) {
+        return true;
+    }
+
+    qWarning() << "Integrity problem:" << query.lastError().text();
+    return false;
+}
+
+static bool upgradeDatabase(QSqlDatabase &database, ContactsDatabase *cdb, ContactNotifier *notifier)
 {
+    if (!executeUpgradeStatements(database, notifier))
+        return false;
+
     if (!beginTransaction(database))
         return false;
 
-    bool success = executeUpgradeStatements(database);
-    if (success) {
-        success = executeDisplayLabelGroupLocalizationStatements(database, cdb);
-    }
+    // Regenerating the display label groups of every contact is deferred until the
+    // database is open, so that it does not hold the write lock for its full duration
+    bool success = executeDisplayLabelGroupLocalizationStatements(database, cdb, Q_NULLPTR, true);
 
     return finalizeTransaction(database, success);
 }
@@ -3053,6 +3412,59 @@ void clearTemporaryValuesTable(ContactsDatabase &cdb, QSqlDatabase &db, const QS
     dropOrDeleteTable(cdb, db, table);
 }
 
+bool createTemporaryRelationshipsTable(ContactsDatabase &cdb, QSqlDatabase &, const QString &table, const QVariantList &firstIds, const QVariantList &types, const QVariantList &secondIds)
+{
+    static const QString createStatement(QStringLiteral("CREATE TABLE IF NOT EXISTS temp.%1 ("
+                                                            "position INTEGER PRIMARY KEY ASC,"
+                                                            "firstId INTEGER,"
+                                                            "type TEXT,"
+                                                            "secondId INTEGER"
+                                                        ")"));
+
+    // Create the temporary table (if we haven't already).
+    {
+        ContactsDatabase::Query tableQuery(cdb.prepare(createStatement.arg(table)));
+        if (!ContactsDatabase::execute(tableQuery)) {
+            tableQuery.reportError(QString::fromLatin1("Failed to create temporary relationships table %1").arg(table));
+            return false;
+        }
+    }
+
+    // insert into the temporary table, all of the relationships, recording their positions
+    const int total = firstIds.count();
+    for (int first = 0; first < total; ) {
+        // SQLite/QtSql limits the amount of data we can insert per individual query
+        const int count = std::min<int>(total - first, 125);
+
+        QString insertStatement = QStringLiteral("INSERT INTO temp.%1 (position, firstId, type, secondId) VALUES ").arg(table);
+        for (int i = 0; i < count; ++i) {
+            insertStatement.append(i == 0 ? QStringLiteral("(?,?,?,?)") : QStringLiteral(",(?,?,?,?)"));
+        }
+
+        ContactsDatabase::Query insertQuery(cdb.prepare(insertStatement));
+        for (int i = first; i < first + count; ++i) {
+            insertQuery.addBindValue(QVariant(i));
+            insertQuery.addBindValue(firstIds.at(i));
+            insertQuery.addBindValue(types.at(i));
+            insertQuery.addBindValue(secondIds.at(i));
+        }
+
+        if (!ContactsDatabase::execute(insertQuery)) {
+            insertQuery.reportError(QString::fromLatin1("Failed to insert temporary relationships into table %1").arg(table));
+            return false;
+        }
+
+        first += count;
+    }
+
+    return true;
+}
+
+void clearTemporaryRelationshipsTable(ContactsDatabase &cdb, QSqlDatabase &db, const QString &table)
+{
+    dropOrDeleteTable(cdb, db, table);
+}
+
 static bool createTransientContactIdsTable(ContactsDatabase &cdb, QSqlDatabase &db, const QString &table, const QVariantList &ids, QString *transientTableName)
 {
     static const QString createTableStatement(QStringLiteral("CREATE TABLE %1 (contactId INTEGER)"));
@@ -3107,9 +3519,37 @@ static size_t databaseOwnershipIndex = 0;
 static size_t databaseConnectionsIndex = 1;
 static size_t writeAccessIndex = 2;
 
-static QVector<QtContactsSqliteExtensions::DisplayLabelGroupGenerator*> initializeDisplayLabelGroupGenerators()
+namespace {
+
+struct DisplayLabelGroupGeneratorPlugin
+{
+    QString path;
+    QString name;
+    int priority;
+    QStringList locales; // if empty, the plugin may be valid for any locale
+    QtContactsSqliteExtensions::DisplayLabelGroupGenerator *generator;
+};
+
+}
+
+// Plugins are shared by all connections in the process, and are only loaded once needed
+static QMutex s_dlgPluginsMutex;
+static QVector<DisplayLabelGroupGeneratorPlugin> s_dlgPlugins;
+static bool s_dlgPluginsScanned = false;
+
+static QtContactsSqliteExtensions::DisplayLabelGroupGenerator *loadDisplayLabelGroupGenerator(const QString &path)
+{
+    QPluginLoader loader(path);
+    QtContactsSqliteExtensions::DisplayLabelGroupGenerator *generator = qobject_cast<QtContactsSqliteExtensions::DisplayLabelGroupGenerator *>(loader.instance());
+    if (!generator) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to load display label group generator plugin %1: %2")
+                .arg(path).arg(loader.errorString()));
+    }
+    return generator;
+}
+
+static void scanDisplayLabelGroupGeneratorPlugins()
 {
-    QVector<QtContactsSqliteExtensions::DisplayLabelGroupGenerator*> generators;
     QByteArray pluginsPathEnv = qgetenv("QTCONTACTS_SQLITE_PLUGIN_PATH");
     const QString pluginsPath = pluginsPathEnv.isEmpty() ?
         CONTACTS_DATABASE_PATH :
@@ -3118,25 +3558,76 @@ static QVector<QtContactsSqliteExtensions::DisplayLabelGroupGenerator*> initiali
     const QStringList pluginNames = pluginDir.entryList();
     for (const QString &plugin : pluginNames) {
         if (plugin.endsWith(QStringLiteral(".so"))) {
-            QPluginLoader loader(pluginsPath + plugin);
-            QtContactsSqliteExtensions::DisplayLabelGroupGenerator *generator = qobject_cast<QtContactsSqliteExtensions::DisplayLabelGroupGenerator *>(loader.instance());
-            bool inserted = false;
-            const int prio = generator->priority();
-            for (int i = 0; i < generators.size(); ++i) {
-                if (generators.at(i)->priority() < prio) {
-                    generators.insert(i, generator);
-                    inserted = true;
-                    break;
+            DisplayLabelGroupGeneratorPlugin entry;
+            entry.path = pluginsPath + plugin;
+            entry.priority = 0;
+            entry.generator = nullptr;
+
+            // The plugin metadata can be read without loading the plugin.  Plugins
+            // which do not describe themselves must be loaded to be interrogated.
+            const QJsonObject manifest = QPluginLoader(entry.path).metaData().value(QStringLiteral("MetaData")).toObject();
+            if (manifest.contains(QStringLiteral("name")) && manifest.contains(QStringLiteral("priority"))) {
+                entry.name = manifest.value(QStringLiteral("name")).toString();
+                entry.priority = manifest.value(QStringLiteral("priority")).toInt();
+                const QJsonArray locales = manifest.value(QStringLiteral("locales")).toArray();
+                for (const QJsonValue &locale : locales) {
+                    entry.locales.append(locale.toString());
                 }
+            } else {
+                entry.generator = loadDisplayLabelGroupGenerator(entry.path);
+                if (!entry.generator) {
+                    continue;
+                }
+                entry.name = entry.generator->name();
+                entry.priority = entry.generator->priority();
             }
-            if (!inserted) {
-                generators.append(generator);
-            }
+
+            s_dlgPlugins.append(entry);
+        }
+    }
+
+    // higher priority generators are used before lower priority generators
+    std::stable_sort(s_dlgPlugins.begin(), s_dlgPlugins.end(),
+                     [](const DisplayLabelGroupGeneratorPlugin &lhs, const DisplayLabelGroupGeneratorPlugin &rhs) {
+                         return lhs.priority > rhs.priority;
+                     });
+}
+
+static bool pluginMayBeValidForLocale(const DisplayLabelGroupGeneratorPlugin &plugin, const QLocale &locale)
+{
+    if (plugin.locales.isEmpty()) {
+        return true;
+    }
+
+    const QString name(locale.name());
+    const QString language(name.left(name.indexOf(QChar('_'))));
+    return plugin.locales.contains(name) || plugin.locales.contains(language);
+}
+
+static QVector<QtContactsSqliteExtensions::DisplayLabelGroupGenerator*> displayLabelGroupGenerators(const QLocale &locale, bool autoTest)
+{
+    QMutexLocker locker(&s_dlgPluginsMutex);
+
+    if (!s_dlgPluginsScanned) {
+        scanDisplayLabelGroupGeneratorPlugins();
+        s_dlgPluginsScanned = true;
+    }
+
+    QVector<QtContactsSqliteExtensions::DisplayLabelGroupGenerator*> generators;
+    for (DisplayLabelGroupGeneratorPlugin &plugin : s_dlgPlugins) {
+        if (plugin.name.contains(QStringLiteral("test")) != autoTest
+                || !pluginMayBeValidForLocale(plugin, locale)) {
+            continue;
+        }
+        if (!plugin.generator) {
+            plugin.generator = loadDisplayLabelGroupGenerator(plugin.path);
+        }
+        if (plugin.generator) {
+            generators.append(plugin.generator);
         }
     }
     return generators;
 }
-static QVector<QtContactsSqliteExtensions::DisplayLabelGroupGenerator*> s_dlgGenerators = initializeDisplayLabelGroupGenerators();
 
 static qint32 displayLabelGroupSortValue(const QString &group, const QMap<QString, int> &knownDisplayLabelGroups)
 {
@@ -3197,6 +3688,176 @@ static qint32 displayLabelGroupSortValue(const QString &group, const QMap<QStrin
     return retn;
 }
 
+namespace {
+
+// Shared by every connection to a database, so that the write lock can be
+// granted in the order in which it was requested.  The lock itself is still
+// the semaphore, which is released automatically if its holder terminates;
+// the queue only determines which waiter may attempt to take it next.
+struct WriteLockQueue
+{
+    enum { Version = 1, MaximumWaiters = 64 };
+
+    struct Waiter
+    {
+        qint32 pid;
+        quint32 ticket;
+    };
+
+    quint32 version;
+    quint32 nextTicket;
+    qint32 holderPid;
+    qint64 holderSince;
+    Waiter waiters[MaximumWaiters];
+};
+
+// The turn of the first waiter is checked in slices, so that its timeout can be honoured
+const int lockWaitSliceMs = 100;
+const int maximumPollIntervalMs = 4;
+
+bool processExists(qint32 pid)
+{
+    return ::kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+bool ticketPrecedes(quint32 lhs, quint32 rhs)
+{
+    // Tickets wrap around
+    return static_cast<qint32>(lhs - rhs) < 0;
+}
+
+WriteLockQueue *lockWriteQueue(QSharedMemory &region)
+{
+    if (!region.isAttached() || !region.lock()) {
+        return nullptr;
+    }
+
+    WriteLockQueue *queue = static_cast<WriteLockQueue *>(region.data());
+    if (queue->version != WriteLockQueue::Version) {
+        ::memset(queue, 0, sizeof(WriteLockQueue));
+        queue->version = WriteLockQueue::Version;
+    }
+    return queue;
+}
+
+enum EnqueueResult {
+    QueueUnavailable,   // the lock is contended for directly
+    QueueFull,          // the writer must wait for a slot, behind every queued writer
+    Enqueued
+};
+
+EnqueueResult enqueueWriter(QSharedMemory &region, quint32 *ticket)
+{
+    WriteLockQueue *queue = lockWriteQueue(region);
+    if (!queue) {
+        return QueueUnavailable;
+    }
+
+    EnqueueResult result = QueueFull;
+    for (WriteLockQueue::Waiter &waiter : queue->waiters) {
+        if (waiter.pid == 0 || !processExists(waiter.pid)) {
+            waiter.pid = ::getpid();
+            waiter.ticket = *ticket = queue->nextTicket++;
+            result = Enqueued;
+            break;
+        }
+    }
+
+    region.unlock();
+    return result;
+}
+
+bool isFirstWriter(QSharedMemory &region, quint32 ticket)
+{
+    WriteLockQueue *queue = lockWriteQueue(region);
+    if (!queue) {
+        return true;
+    }
+
+    bool first = true;
+    for (WriteLockQueue::Waiter &waiter : queue->waiters) {
+        if (waiter.pid != 0 && ticketPrecedes(waiter.ticket, ticket)) {
+            if (processExists(waiter.pid)) {
+                first = false;
+                break;
+            }
+            // This waiter terminated without leaving the queue
+            waiter.pid = 0;
+        }
+    }
+
+    region.unlock();
+    return first;
+}
+
+void dequeueWriter(QSharedMemory &region, quint32 ticket, bool acquired)
+{
+    WriteLockQueue *queue = lockWriteQueue(region);
+    if (!queue) {
+        return;
+    }
+
+    const qint32 pid = ::getpid();
+    for (WriteLockQueue::Waiter &waiter : queue->waiters) {
+        if (waiter.pid == pid && waiter.ticket == ticket) {
+            waiter.pid = 0;
+            break;
+        }
+    }
+    if (acquired) {
+        queue->holderPid = pid;
+        queue->holderSince = QDateTime::currentMSecsSinceEpoch();
+    }
+
+    region.unlock();
+}
+
+void releaseWriter(QSharedMemory &region)
+{
+    if (WriteLockQueue *queue = lockWriteQueue(region)) {
+        if (queue->holderPid == ::getpid()) {
+            queue->holderPid = 0;
+        }
+        region.unlock();
+    }
+}
+
+bool hasQueuedWriters(QSharedMemory &region)
+{
+    WriteLockQueue *queue = lockWriteQueue(region);
+    if (!queue) {
+        return false;
+    }
+
+    bool waiting = false;
+    for (const WriteLockQueue::Waiter &waiter : queue->waiters) {
+        if (waiter.pid != 0 && processExists(waiter.pid)) {
+            waiting = true;
+            break;
+        }
+    }
+
+    region.unlock();
+    return waiting;
+}
+
+QString writeLockHolder(QSharedMemory &region)
+{
+    QString holder(QStringLiteral("unknown process"));
+    if (WriteLockQueue *queue = lockWriteQueue(region)) {
+        if (queue->holderPid != 0) {
+            holder = QString::fromLatin1("process %1 (for %2 ms%3)")
+                    .arg(queue->holderPid)
+                    .arg(QDateTime::currentMSecsSinceEpoch() - queue->holderSince)
+                    .arg(processExists(queue->holderPid) ? QString() : QStringLiteral(", terminated"));
+        }
+        region.unlock();
+    }
+    return holder;
+}
+
+}
+
 // Adapted from the inter-process mutex in QMF
 // The first user creates the semaphore that all subsequent instances
 // attach to.  We rely on undo semantics to release locked semaphores
@@ -3204,7 +3865,16 @@ static qint32 displayLabelGroupSortValue(const QString &group, const QMap<QStrin
 ContactsDatabase::ProcessMutex::ProcessMutex(const QString &path)
     : m_semaphore(path.toLatin1(), 3, initialSemaphoreValues)
     , m_initialProcess(false)
+    , m_timedOut(false)
 {
+    m_queueRegion.setKey(QStringLiteral("qtcontacts-sqlite-write-queue:%1").arg(path));
+    if (!m_queueRegion.attach()
+            && !m_queueRegion.create(sizeof(WriteLockQueue))
+            && !m_queueRegion.attach()) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to attach write lock queue, writers will not be queued: %1")
+                .arg(m_queueRegion.errorString()));
+    }
+
     if (!m_semaphore.isValid()) {
         QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to create semaphore array!"));
     } else {
@@ -3222,13 +3892,134 @@ ContactsDatabase::ProcessMutex::ProcessMutex(const QString &path)
     }
 }
 
-bool ContactsDatabase::ProcessMutex::lock()
+const qint64 ContactsDatabase::lockHistogramBounds[] = {
+    100, 1000, 10000, 100000, 500000, 1000000, 5000000
+};
+
+static void recordLockDuration(quint64 *histogram, qint64 duration)
+{
+    int bucket = 0;
+    while (bucket < ContactsDatabase::LockHistogramBuckets - 1
+            && duration >= ContactsDatabase::lockHistogramBounds[bucket]) {
+        ++bucket;
+    }
+    ++histogram[bucket];
+}
+
+static int writeLockTimeout()
+{
+    // A transaction which cannot begin within this time fails, rather than waiting indefinitely
+    static const int timeout = qEnvironmentVariableIsSet("QTCONTACTS_SQLITE_WRITE_LOCK_TIMEOUT")
+            ? qEnvironmentVariableIntValue("QTCONTACTS_SQLITE_WRITE_LOCK_TIMEOUT")
+            : 60000;
+    return timeout > 0 ? timeout : -1;
+}
+
+static bool debugLocking()
+{
+    static const bool debug = !qgetenv("QTCONTACTS_SQLITE_DEBUG_LOCKING").isEmpty();
+    return debug;
+}
+
+bool ContactsDatabase::ProcessMutex::lock(int timeoutMs)
 {
-    return m_semaphore.decrement(writeAccessIndex);
+    QElapsedTimer waitTimer;
+    waitTimer.start();
+
+    m_timedOut = false;
+
+    quint32 ticket = 0;
+    EnqueueResult queueState = enqueueWriter(m_queueRegion, &ticket);
+    if (queueState == QueueFull) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Write lock queue is full, waiting for %1 queued writers")
+                .arg(static_cast<int>(WriteLockQueue::MaximumWaiters)));
+    }
+
+    bool locked = false;
+    int pollIntervalMs = 1;
+    while (true) {
+        const qint64 remainingMs = (timeoutMs < 0) ? lockWaitSliceMs : (timeoutMs - waitTimer.elapsed());
+        if (remainingMs <= 0) {
+            m_timedOut = true;
+            break;
+        }
+
+        if (queueState == QueueFull) {
+            // Contending directly would overtake every queued writer
+            queueState = enqueueWriter(m_queueRegion, &ticket);
+        }
+
+        if (queueState == QueueUnavailable
+                || (queueState == Enqueued && isFirstWriter(m_queueRegion, ticket))) {
+            // It is our turn; wait for the current holder to release the lock
+            if (m_semaphore.decrement(writeAccessIndex, true, qMin<qint64>(remainingMs, lockWaitSliceMs))) {
+                locked = true;
+                break;
+            } else if (errno != EAGAIN) {
+                break;
+            }
+        } else {
+            QThread::msleep(pollIntervalMs);
+            pollIntervalMs = qMin(pollIntervalMs * 2, maximumPollIntervalMs);
+        }
+    }
+
+    if (queueState == Enqueued) {
+        dequeueWriter(m_queueRegion, ticket, locked);
+    }
+
+    const qint64 wait = waitTimer.nsecsElapsed() / 1000;
+
+    {
+        QMutexLocker locker(&m_statisticsMutex);
+        if (locked) {
+            ++m_statistics.acquisitions;
+            m_statistics.totalWait += wait;
+            m_statistics.maximumWait = qMax(m_statistics.maximumWait, wait);
+            recordLockDuration(m_statistics.waitHistogram, wait);
+        } else {
+            ++m_statistics.failures;
+            if (m_timedOut) {
+                ++m_statistics.timeouts;
+            }
+        }
+    }
+
+    if (m_timedOut) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Timed out after %1 ms waiting for the database write lock, held by %2")
+                .arg(timeoutMs).arg(writeLockHolder(m_queueRegion)));
+    }
+
+    if (debugLocking()) {
+        qDebug().noquote() << QString::fromLatin1("Write lock %1 after waiting %2 us")
+                                  .arg(locked ? QStringLiteral("acquired") : QStringLiteral("failed")).arg(wait);
+    }
+
+    if (locked) {
+        m_holdTimer.start();
+    }
+    return locked;
 }
 
 bool ContactsDatabase::ProcessMutex::unlock()
 {
+    if (m_holdTimer.isValid()) {
+        const qint64 hold = m_holdTimer.nsecsElapsed() / 1000;
+        m_holdTimer.invalidate();
+
+        {
+            QMutexLocker locker(&m_statisticsMutex);
+            m_statistics.totalHold += hold;
+            m_statistics.maximumHold = qMax(m_statistics.maximumHold, hold);
+            recordLockDuration(m_statistics.holdHistogram, hold);
+        }
+
+        if (debugLocking()) {
+            qDebug().noquote() << QString::fromLatin1("Write lock released after holding %1 us").arg(hold);
+        }
+    }
+
+    releaseWriter(m_queueRegion);
     return m_semaphore.increment(writeAccessIndex);
 }
 
@@ -3242,6 +4033,22 @@ bool ContactsDatabase::ProcessMutex::isInitialProcess() const
     return m_initialProcess;
 }
 
+bool ContactsDatabase::ProcessMutex::timedOut() const
+{
+    return m_timedOut;
+}
+
+bool ContactsDatabase::ProcessMutex::hasWaiters()
+{
+    return hasQueuedWriters(m_queueRegion);
+}
+
+ContactsDatabase::LockStatistics ContactsDatabase::ProcessMutex::statistics() const
+{
+    QMutexLocker locker(&m_statisticsMutex);
+    return m_statistics;
+}
+
 ContactsDatabase::Query::Query(const QSqlQuery &query)
     : m_query(query)
 {
@@ -3260,10 +4067,22 @@ void ContactsDatabase::Query::reportError(const char *text) const
 
 ContactsDatabase::ContactsDatabase(ContactsEngine *engine)
     : m_engine(engine)
+    , m_snapshotMaintained(false)
     , m_mutex(QMutex::Recursive)
     , m_nonprivileged(false)
     , m_autoTest(false)
+    , m_statisticsUpdateDue(false)
+    , m_transactionsSinceStatisticsUpdate(0)
+    , m_integrityCheckDue(false)
+    , m_deferredUpgradeDue(false)
+    , m_deferredUpgradeTotal(-1)
+    , m_deferredUpgradeCompleted(0)
+    , m_sqliteVersion(0)
     , m_localeName(QLocale().name())
+    , m_preparedQueries(preparedQueryCacheSize)
+    , m_compiledFilters(compiledFilterCacheSize)
+    , m_dlgPreferredDetail(QContactName::Type)
+    , m_dlgPreferredField(QContactName::FieldFirstName)
     , m_defaultGenerator(new DefaultDlgGenerator)
 #ifdef HAS_MLITE
     , m_groupPropertyConf(QStringLiteral("/org/nemomobile/contacts/group_property"))
@@ -3271,6 +4090,7 @@ ContactsDatabase::ContactsDatabase(ContactsEngine *engine)
 {
 #ifdef HAS_MLITE
     QObject::connect(&m_groupPropertyConf, &MGConfItem::valueChanged, [this, engine] {
+        this->invalidateDisplayLabelGroupGenerators();
         this->regenerateDisplayLabelGroups();
         // expensive, but if we don't do it, in multi-process case some clients may not get updated...
         // if contacts backend were daemonised, this problem would go away...
@@ -3323,50 +4143,17 @@ bool ContactsDatabase::open(const QString &connectionName, bool nonprivileged, b
 {
     QMutexLocker locker(accessMutex());
 
-    m_autoTest = autoTest;
-    if (m_dlgGenerators.isEmpty()) {
-        for (auto generator : s_dlgGenerators) {
-            if (generator && (generator->name().contains(QStringLiteral("test")) == m_autoTest)) {
-                m_dlgGenerators.append(generator);
-            }
-        }
-        m_dlgGenerators.append(m_defaultGenerator.data());
-
-        // and build a "superlist" of known display label groups.
-        const QLocale locale;
-        QStringList knownDisplayLabelGroups;
-        for (auto generator : m_dlgGenerators) {
-            if (generator->validForLocale(locale)) {
-                const QStringList groups = generator->displayLabelGroups();
-                for (const QString &group : groups) {
-                    if (!knownDisplayLabelGroups.contains(group)) {
-                        knownDisplayLabelGroups.append(group);
-                    }
-                }
-            }
-        }
-        knownDisplayLabelGroups.removeAll(QStringLiteral("#"));
-        knownDisplayLabelGroups.append(QStringLiteral("#"));
-        knownDisplayLabelGroups.removeAll(QStringLiteral("?"));
-        knownDisplayLabelGroups.append(QStringLiteral("?"));
+    // Record the time spent in each phase of opening, for diagnosis of startup latency
+    QElapsedTimer phaseTimer;
+    phaseTimer.start();
+    m_openTimings.clear();
+    auto phaseCompleted = [this, &phaseTimer](const QString &phase) {
+        m_openTimings.append(qMakePair(phase, phaseTimer.nsecsElapsed() / 1000));
+        phaseTimer.restart();
+    };
 
-        // from that list, build a mapping from group to sort priority value,
-        // based upon the position of each group in the list,
-        // which defines a total sort ordering for known display label groups.
-        for (int i = 0; i < knownDisplayLabelGroups.size(); ++i) {
-            const QString &group(knownDisplayLabelGroups.at(i));
-            m_knownDisplayLabelGroupsSortValues.insert(
-                    group,
-                    (group == QStringLiteral("#") || group == QStringLiteral("?"))
-                            ? ::displayLabelGroupSortValue(group, m_knownDisplayLabelGroupsSortValues)
-                            : i);
-        }
+    m_autoTest = autoTest;
 
-        // XXX TODO: do we need to add groups which currently exist in the database,
-        // but which aren't currently included in the m_knownDisplayLabelGroupsSortValues?
-        // I don't think we do, since it only matters on write, and we will update
-        // the m_knownDisplayLabelGroupsSortValues in determineDisplayLabelGroup() during write...
-    }
 
     if (m_database.isOpen()) {
         QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to open database when already open: %1").arg(connectionName));
@@ -3414,6 +4201,8 @@ bool ContactsDatabase::open(const QString &connectionName, bool nonprivileged, b
         return false;
     }
 
+    phaseCompleted(QStringLiteral("openFile"));
+
     if (!databasePreexisting && !prepareDatabase(m_database, this, aggregating(), m_localeName)) {
         QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to prepare contacts database - removing: %1")
                 .arg(m_database.lastError().text()));
@@ -3426,6 +4215,10 @@ bool ContactsDatabase::open(const QString &connectionName, bool nonprivileged, b
         return false;
     }
 
+    phaseCompleted(databasePreexisting ? QStringLiteral("configure") : QStringLiteral("prepare"));
+
+    m_sqliteVersion = sqliteVersionNumber(m_database);
+
     // Get the process mutex for this database
     ProcessMutex *mutex(processMutex());
 
@@ -3435,8 +4228,10 @@ bool ContactsDatabase::open(const QString &connectionName, bool nonprivileged, b
     if (databasePreexisting && databaseOwner) {
         // Try to upgrade, if necessary
         if (mutex->lock()) {
-            // Perform an integrity check
-            if (!checkDatabase(m_database)) {
+            // Perform an integrity check.  Only the header and schema are verified here,
+            // unless the background check has previously found a problem.
+            const bool fullCheck = (readSetting(m_database, integrityCheckStatusSetting) == QStringLiteral("failed"));
+            if (!(fullCheck ? checkDatabase(m_database) : checkDatabaseHeader(m_database))) {
                 QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to check integrity of contacts database: %1")
                         .arg(m_database.lastError().text()));
                 m_database.close();
@@ -3444,7 +4239,10 @@ bool ContactsDatabase::open(const QString &connectionName, bool nonprivileged, b
                 return false;
             }
 
-            if (!upgradeDatabase(m_database, this)) {
+            phaseCompleted(QStringLiteral("integrityCheck"));
+
+            ContactNotifier notifier(m_nonprivileged);
+            if (!upgradeDatabase(m_database, this, &notifier)) {
                 QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to upgrade contacts database: %1")
                         .arg(m_database.lastError().text()));
                 m_database.close();
@@ -3452,7 +4250,25 @@ bool ContactsDatabase::open(const QString &connectionName, bool nonprivileged, b
                 return false;
             }
 
+            if (fullCheck) {
+                writeSetting(m_database, integrityCheckStatusSetting, QStringLiteral("ok"));
+                writeSetting(m_database, integrityCheckTableSetting, QString());
+            }
+
             mutex->unlock();
+
+            phaseCompleted(QStringLiteral("upgrade"));
+
+            // Compare the stored statistics against the real table sizes once
+            // the database is idle, rather than on the startup path.
+            m_statisticsUpdateDue = true;
+
+            // Likewise verify the content of the database, resuming any partial check.
+            m_integrityCheckDue = !fullCheck;
+
+            // Continue any data upgrade deferred by this or an earlier open.
+            m_deferredUpgradeDue = !readSetting(m_database, displayLabelGroupRegenerationSetting).isEmpty();
+            m_deferredUpgradeTotal = -1;
         } else {
             QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to lock mutex for contacts database: %1")
                     .arg(databaseFile));
@@ -3471,7 +4287,18 @@ bool ContactsDatabase::open(const QString &connectionName, bool nonprivileged, b
         }
 
         int schemaVersion = versionQuery.value(0).toInt();
-        if (schemaVersion != currentSchemaVersion) {
+        versionQuery.finish();
+
+        if (schemaVersion < currentSchemaVersion && mutex->lock(writeLockTimeout())) {
+            // The owning process may still be upgrading the schema, which it does while holding the lock
+            mutex->unlock();
+            if (versionQuery.exec() && versionQuery.next()) {
+                schemaVersion = versionQuery.value(0).toInt();
+                versionQuery.finish();
+            }
+        }
+
+        if (schemaVersion != currentSchemaVersion) {
             QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Existing database schema version is unexpected: %1 != %2. "
                                                           "Is a process preventing schema upgrade?")
                                                      .arg(schemaVersion).arg(currentSchemaVersion));
@@ -3480,6 +4307,8 @@ bool ContactsDatabase::open(const QString &connectionName, bool nonprivileged, b
         }
     }
 
+    phaseCompleted(QStringLiteral("schemaVersion"));
+
     // Attach to the transient store - any process can create it, but only the primary connection of each
     if (!m_transientStore.open(nonprivileged, !secondaryConnection, !databasePreexisting)) {
         QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to open contacts transient store"));
@@ -3487,10 +4316,67 @@ bool ContactsDatabase::open(const QString &connectionName, bool nonprivileged, b
         return false;
     }
 
+    phaseCompleted(QStringLiteral("transientStore"));
+
+    // The contact snapshot is optional, so failing to attach to it only disables it
+    if (!m_snapshotStore.open(nonprivileged, autoTest, !secondaryConnection)) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to open contact snapshot"));
+    } else if (databaseOwner) {
+        // Changes made since the database was last open have not been applied to any existing snapshot
+        m_snapshotStore.invalidate();
+    }
+
     QTCONTACTS_SQLITE_DEBUG(QString::fromLatin1("Opened contacts database: %1 Locale: %2").arg(databaseFile).arg(m_localeName));
     return true;
 }
 
+const ContactsDatabase::Timings &ContactsDatabase::openTimings() const
+{
+    return m_openTimings;
+}
+
+ContactsDatabase::LockStatistics ContactsDatabase::lockStatistics() const
+{
+    return m_processMutex ? m_processMutex->statistics() : LockStatistics();
+}
+
+bool ContactsDatabase::findCompiledFilter(const QString &key, CompiledFilter *compiled)
+{
+    QMutexLocker locker(accessMutex());
+
+    if (key.isEmpty()) {
+        ++m_filterCacheStatistics.uncacheable;
+        return false;
+    }
+
+    if (const CompiledFilter *cached = m_compiledFilters.object(key)) {
+        ++m_filterCacheStatistics.hits;
+        *compiled = *cached;
+        return true;
+    }
+
+    ++m_filterCacheStatistics.misses;
+    return false;
+}
+
+void ContactsDatabase::insertCompiledFilter(const QString &key, const CompiledFilter &compiled)
+{
+    QMutexLocker locker(accessMutex());
+
+    if (!key.isEmpty()) {
+        m_compiledFilters.insert(key, new CompiledFilter(compiled));
+    }
+}
+
+ContactsDatabase::FilterCacheStatistics ContactsDatabase::filterCacheStatistics() const
+{
+    QMutexLocker locker(accessMutex());
+
+    FilterCacheStatistics statistics(m_filterCacheStatistics);
+    statistics.entries = m_compiledFilters.count();
+    return statistics;
+}
+
 ContactsDatabase::operator QSqlDatabase &()
 {
     return m_database;
@@ -3535,9 +4421,12 @@ bool ContactsDatabase::beginTransaction()
     // to the DB at once.  Without external locking, SQLite will back off
     // on write contention, and the backed-off process may never get access
     // if other processes are performing regular writes.
-    if (mutex->lock()) {
-        if (::beginTransaction(m_database))
+    if (mutex->lock(writeLockTimeout())) {
+        if (::beginTransaction(m_database)) {
+            // The snapshot cannot be populated while we hold the write lock
+            m_snapshotMaintained = m_snapshotStore.isComplete();
             return true;
+        }
 
         mutex->unlock();
     }
@@ -3550,23 +4439,47 @@ bool ContactsDatabase::commitTransaction()
     ProcessMutex *mutex(processMutex());
 
     if (::commitTransaction(m_database)) {
+        // Publish the changes to the snapshot before any other writer can proceed
+        if (!m_stagedSnapshotEntries.isEmpty() || !m_stagedSnapshotRemovals.isEmpty()) {
+            ContactsSnapshotStore::Entries entries;
+            entries.reserve(m_stagedSnapshotEntries.count());
+            for (QMap<quint32, QByteArray>::const_iterator it = m_stagedSnapshotEntries.constBegin(); it != m_stagedSnapshotEntries.constEnd(); ++it) {
+                entries.append(qMakePair(it.key(), it.value()));
+            }
+            m_snapshotStore.update(entries, m_stagedSnapshotRemovals.toList());
+            m_stagedSnapshotEntries.clear();
+            m_stagedSnapshotRemovals.clear();
+        }
+        m_snapshotMaintained = false;
         if (mutex->isLocked()) {
             mutex->unlock();
         } else {
             QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Lock error: no lock held on commit"));
         }
+        if (++m_transactionsSinceStatisticsUpdate >= transactionsPerStatisticsCheck) {
+            m_statisticsUpdateDue = true;
+        }
         return true;
     }
 
     return false;
 }
 
+bool ContactsDatabase::writeLockTimedOut() const
+{
+    return m_processMutex && m_processMutex->timedOut();
+}
+
 bool ContactsDatabase::rollbackTransaction()
 {
     ProcessMutex *mutex(processMutex());
 
     const bool rv = ::rollbackTransaction(m_database);
 
+    m_stagedSnapshotEntries.clear();
+    m_stagedSnapshotRemovals.clear();
+    m_snapshotMaintained = false;
+
     if (mutex->isLocked()) {
         mutex->unlock();
     } else {
@@ -3576,6 +4489,257 @@ bool ContactsDatabase::rollbackTransaction()
     return rv;
 }
 
+bool ContactsDatabase::statisticsUpdateDue() const
+{
+    return m_statisticsUpdateDue;
+}
+
+bool ContactsDatabase::updateStatistics()
+{
+    QMutexLocker locker(accessMutex());
+
+    m_statisticsUpdateDue = false;
+    m_transactionsSinceStatisticsUpdate = 0;
+
+    QStringList tables;
+    if (!findOutdatedStatistics(m_database, &tables)) {
+        return false;
+    }
+    if (tables.isEmpty()) {
+        return true;
+    }
+
+    // Bound the number of rows examined per index, so that a large table
+    // doesn't hold the write lock for long.  The limit applies to the whole
+    // connection, so the previous value is restored afterwards; older SQLite
+    // versions do not support the limit, and analyze the tables fully.
+    int previousAnalysisLimit = -1;
+    if (m_sqliteVersion >= analysisLimitMinimumVersion) {
+        QSqlQuery query(m_database);
+        query.setForwardOnly(true);
+        if (!query.exec(QStringLiteral("PRAGMA analysis_limit")) || !query.next()) {
+            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to query analysis limit: %1")
+                    .arg(query.lastError().text()));
+            return false;
+        }
+        previousAnalysisLimit = query.value(0).toInt();
+        query.finish();
+
+        if (!::execute(m_database, QStringLiteral("PRAGMA analysis_limit = %1").arg(statisticsAnalysisLimit))) {
+            return false;
+        }
+    }
+
+    bool success = beginTransaction();
+    if (!success) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to begin transaction to update statistics"));
+    } else {
+        for (const QString &table : tables) {
+            if (!::execute(m_database, QStringLiteral("ANALYZE %1").arg(table))) {
+                success = false;
+                break;
+            }
+        }
+
+        if (!success) {
+            rollbackTransaction();
+        } else if (!commitTransaction()) {
+            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to commit statistics update"));
+            rollbackTransaction();
+            success = false;
+        }
+    }
+
+    if (previousAnalysisLimit >= 0) {
+        ::execute(m_database, QStringLiteral("PRAGMA analysis_limit = %1").arg(previousAnalysisLimit));
+    }
+
+    if (!success) {
+        return false;
+    }
+
+    QTCONTACTS_SQLITE_DEBUG(QString::fromLatin1("Updated statistics for: %1").arg(tables.join(QStringLiteral(", "))));
+    return true;
+}
+
+bool ContactsDatabase::integrityCheckDue() const
+{
+    return m_integrityCheckDue;
+}
+
+bool ContactsDatabase::checkIntegrity()
+{
+    QMutexLocker locker(accessMutex());
+
+    m_integrityCheckDue = false;
+
+    // Each call checks a single table (and its indexes), continuing from
+    // the table recorded by the previous call - possibly in an earlier process.
+    // Older SQLite versions ignore the table argument of quick_check, and would
+    // check the entire database for each table; they check it once instead.
+    const bool tableScoped = (m_sqliteVersion >= tableQuickCheckMinimumVersion);
+    const QString previousTable = readSetting(m_database, integrityCheckTableSetting);
+
+    QString table;
+    if (tableScoped) {
+        QSqlQuery query(m_database);
+        query.setForwardOnly(true);
+        const QString statement = QStringLiteral("SELECT name FROM sqlite_master WHERE type = 'table' AND name > ? ORDER BY name LIMIT 1");
+        if (!query.prepare(statement)) {
+            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to prepare integrity check table query: %1\n%2")
+                    .arg(query.lastError().text())
+                    .arg(statement));
+            return false;
+        }
+        query.addBindValue(previousTable);
+        if (!query.exec()) {
+            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to select integrity check table: %1\n%2")
+                    .arg(query.lastError().text())
+                    .arg(statement));
+            return false;
+        }
+        if (query.next()) {
+            table = query.value(0).toString();
+        }
+    }
+
+    bool intact = true;
+    if (!table.isEmpty() || !tableScoped) {
+        QSqlQuery query(m_database);
+        query.setForwardOnly(true);
+        const QString statement = tableScoped ? QStringLiteral("PRAGMA quick_check(%1)").arg(table)
+                                              : QStringLiteral("PRAGMA quick_check");
+        if (!query.exec(statement)) {
+            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to check integrity: %1\n%2")
+                    .arg(query.lastError().text())
+                    .arg(statement));
+            return false;
+        }
+        while (query.next()) {
+            const QString result(query.value(0).toString());
+            if (result != QStringLiteral("ok")) {
+                qWarning() << "Integrity problem:" << table << result;
+                intact = false;
+            }
+        }
+    }
+
+    if (!beginTransaction()) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to begin transaction to record integrity check progress"));
+        return false;
+    }
+
+    // An empty table name restarts the check from the beginning
+    const bool recorded = writeSetting(m_database, integrityCheckTableSetting, intact ? table : QString())
+            && writeSetting(m_database, integrityCheckStatusSetting, intact ? QStringLiteral("ok") : QStringLiteral("failed"));
+    if (!recorded) {
+        rollbackTransaction();
+        return false;
+    }
+
+    if (!commitTransaction()) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to commit integrity check progress"));
+        rollbackTransaction();
+        return false;
+    }
+
+    if (!intact) {
+        // The full check will be performed when the database is next opened
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Integrity check failed for table: %1").arg(table));
+        return false;
+    }
+
+    if (table.isEmpty()) {
+        QTCONTACTS_SQLITE_DEBUG(QString::fromLatin1("Integrity check completed"));
+    } else {
+        m_integrityCheckDue = true;
+    }
+    return true;
+}
+
+bool ContactsDatabase::deferredUpgradeDue() const
+{
+    return m_deferredUpgradeDue;
+}
+
+bool ContactsDatabase::performDeferredUpgrade(int *completed, int *total)
+{
+    QMutexLocker locker(accessMutex());
+
+    m_deferredUpgradeDue = false;
+
+    if (!beginTransaction()) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to begin transaction to continue deferred upgrade"));
+        return false;
+    }
+
+    // Each call regenerates the display label groups of a single chunk of contacts,
+    // continuing from the contact recorded by the previous call - possibly in an earlier process.
+    const QString position = readSetting(m_database, displayLabelGroupRegenerationSetting);
+    if (position.isEmpty()) {
+        // Another process has completed the upgrade
+        rollbackTransaction();
+        *completed = *total = 0;
+        return true;
+    }
+
+    quint32 lastContactId = position.toUInt();
+    if (m_deferredUpgradeTotal < 0) {
+        // Count the contacts once per connection; thereafter the progress advances by one chunk per call
+        QSqlQuery query(m_database);
+        query.setForwardOnly(true);
+        const QString statement = QStringLiteral("SELECT COUNT(*), SUM(contactId <= ?) FROM Contacts");
+        if (!query.prepare(statement)) {
+            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to prepare deferred upgrade progress query: %1\n%2")
+                    .arg(query.lastError().text())
+                    .arg(statement));
+            rollbackTransaction();
+            return false;
+        }
+        query.addBindValue(lastContactId);
+        if (!query.exec() || !query.next()) {
+            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to count deferred upgrade progress: %1\n%2")
+                    .arg(query.lastError().text())
+                    .arg(statement));
+            rollbackTransaction();
+            return false;
+        }
+        m_deferredUpgradeTotal = query.value(0).toInt();
+        m_deferredUpgradeCompleted = query.value(1).toInt();
+    }
+
+    bool complete = false;
+    const bool success = regenerateDisplayLabelGroupsChunk(m_database, this, &lastContactId, displayLabelGroupRegenerationChunkSize, &complete)
+            && writeSetting(m_database, displayLabelGroupRegenerationSetting, complete ? QString() : QString::number(lastContactId));
+
+    if (!success) {
+        rollbackTransaction();
+        return false;
+    }
+
+    // The snapshot must be repopulated with the regenerated groups
+    m_snapshotStore.invalidate();
+
+    if (!commitTransaction()) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to commit deferred upgrade progress"));
+        rollbackTransaction();
+        return false;
+    }
+
+    // Contacts may have been added or removed meanwhile, so the count is only approximate
+    *total = m_deferredUpgradeTotal;
+    if (complete) {
+        *completed = m_deferredUpgradeTotal;
+        m_deferredUpgradeTotal = -1;
+        QTCONTACTS_SQLITE_DEBUG(QString::fromLatin1("Display label group regeneration completed"));
+    } else {
+        m_deferredUpgradeCompleted = qMin(m_deferredUpgradeCompleted + displayLabelGroupRegenerationChunkSize, m_deferredUpgradeTotal);
+        *completed = m_deferredUpgradeCompleted;
+        m_deferredUpgradeDue = true;
+    }
+    return true;
+}
+
 ContactsDatabase::Query ContactsDatabase::prepare(const char *statement)
 {
     return prepare(QString::fromLatin1(statement));
@@ -3585,8 +4749,8 @@ ContactsDatabase::Query ContactsDatabase::prepare(const QString &statement)
 {
     QMutexLocker locker(accessMutex());
 
-    QHash<QString, QSqlQuery>::const_iterator it = m_preparedQueries.constFind(statement);
-    if (it == m_preparedQueries.constEnd()) {
+    QSqlQuery *cached = m_preparedQueries.object(statement);
+    if (!cached) {
         QSqlQuery query(m_database);
         query.setForwardOnly(true);
         if (!query.prepare(statement)) {
@@ -3595,10 +4759,11 @@ ContactsDatabase::Query ContactsDatabase::prepare(const QString &statement)
                     .arg(statement));
             return Query(QSqlQuery());
         }
-        it = m_preparedQueries.insert(statement, query);
+        cached = new QSqlQuery(query);
+        m_preparedQueries.insert(statement, cached);
     }
 
-    return Query(*it);
+    return Query(*cached);
 }
 
 bool ContactsDatabase::hasTransientDetails(quint32 contactId)
@@ -3626,9 +4791,371 @@ bool ContactsDatabase::removeTransientDetails(const QList<quint32> &contactIds)
     return m_transientStore.remove(contactIds);
 }
 
+// The summary of a contact held in the snapshot
+struct SnapshotSummary
+{
+    SnapshotSummary() : presenceState(0) {}
+
+    QString displayLabel;
+    QString displayLabelGroup;
+    QString firstName;
+    QString lastName;
+    QStringList phoneNumbers;
+    QStringList emailAddresses;
+    QString avatarUrl;
+    qint32 presenceState;
+};
+
+static QByteArray serializeSnapshotSummary(const SnapshotSummary &summary)
+{
+    QByteArray data;
+    QDataStream os(&data, QIODevice::WriteOnly);
+    os << summary.displayLabel
+       << summary.displayLabelGroup
+       << summary.firstName
+       << summary.lastName
+       << summary.phoneNumbers
+       << summary.emailAddresses
+       << summary.avatarUrl
+       << summary.presenceState;
+    return data;
+}
+
+static SnapshotSummary deserializeSnapshotSummary(const QByteArray &data)
+{
+    SnapshotSummary summary;
+    QDataStream is(data);
+    is >> summary.displayLabel
+       >> summary.displayLabelGroup
+       >> summary.firstName
+       >> summary.lastName
+       >> summary.phoneNumbers
+       >> summary.emailAddresses
+       >> summary.avatarUrl
+       >> summary.presenceState;
+    return summary;
+}
+
+// Replace the fields of the summary derived from the detail types written with this mask;
+// the values are normalized as they are when stored to the database
+static void updateSnapshotSummary(SnapshotSummary *summary, const QContact &contact, const QList<QContactDetail::DetailType> &definitionMask)
+{
+    const bool allTypes = definitionMask.isEmpty();
+
+    if (allTypes || definitionMask.contains(QContactDisplayLabel::Type)) {
+        const QContactDisplayLabel label(contact.detail<QContactDisplayLabel>());
+        summary->displayLabel = label.label();
+        summary->displayLabelGroup = label.value<QString>(QContactDisplayLabel__FieldLabelGroup);
+    }
+    if (allTypes || definitionMask.contains(QContactName::Type)) {
+        const QContactName name(contact.detail<QContactName>());
+        summary->firstName = name.value<QString>(QContactName::FieldFirstName).trimmed();
+        summary->lastName = name.value<QString>(QContactName::FieldLastName).trimmed();
+    }
+    if (allTypes || definitionMask.contains(QContactPhoneNumber::Type)) {
+        summary->phoneNumbers.clear();
+        foreach (const QContactPhoneNumber &phoneNumber, contact.details<QContactPhoneNumber>()) {
+            summary->phoneNumbers.append(phoneNumber.value<QString>(QContactPhoneNumber::FieldNumber).trimmed());
+        }
+    }
+    if (allTypes || definitionMask.contains(QContactEmailAddress::Type)) {
+        summary->emailAddresses.clear();
+        foreach (const QContactEmailAddress &emailAddress, contact.details<QContactEmailAddress>()) {
+            summary->emailAddresses.append(emailAddress.value<QString>(QContactEmailAddress::FieldEmailAddress).trimmed());
+        }
+    }
+    if (allTypes || definitionMask.contains(QContactAvatar::Type)) {
+        const QList<QContactAvatar> avatars(contact.details<QContactAvatar>());
+        summary->avatarUrl = avatars.isEmpty() ? QString() : avatars.first().value<QString>(QContactAvatar::FieldImageUrl).trimmed();
+    }
+    if (allTypes
+            || definitionMask.contains(QContactGlobalPresence::Type)
+            || definitionMask.contains(QContactPresence::Type)) {
+        const QList<QContactGlobalPresence> presences(contact.details<QContactGlobalPresence>());
+        summary->presenceState = presences.isEmpty() ? 0 : presences.first().value<int>(QContactGlobalPresence::FieldPresenceState);
+    }
+}
+
+bool ContactsDatabase::contactSnapshotComplete() const
+{
+    return m_snapshotStore.isComplete();
+}
+
+bool ContactsDatabase::contactSnapshot(QList<QtContactsSqliteExtensions::ContactSnapshot> *snapshots, const QString &managerUri) const
+{
+    ContactsSnapshotStore::Entries entries;
+    if (!m_snapshotStore.entries(&entries)) {
+        return false;
+    }
+
+    snapshots->reserve(entries.count());
+    typedef QPair<quint32, QByteArray> Entry;
+    foreach (const Entry &entry, entries) {
+        const SnapshotSummary summary(deserializeSnapshotSummary(entry.second));
+
+        QtContactsSqliteExtensions::ContactSnapshot snapshot;
+        snapshot.id = ContactId::apiId(entry.first, managerUri);
+        snapshot.displayLabel = summary.displayLabel;
+        snapshot.displayLabelGroup = summary.displayLabelGroup;
+        snapshot.firstName = summary.firstName;
+        snapshot.lastName = summary.lastName;
+        snapshot.phoneNumbers = summary.phoneNumbers;
+        snapshot.emailAddresses = summary.emailAddresses;
+        snapshot.avatarUrl = summary.avatarUrl;
+        snapshot.presenceState = static_cast<QContactPresence::PresenceState>(summary.presenceState);
+
+        snapshots->append(snapshot);
+    }
+    return true;
+}
+
+bool ContactsDatabase::populateContactSnapshot()
+{
+    QMutexLocker locker(accessMutex());
+
+    if (!m_snapshotStore.isOpen()) {
+        return false;
+    }
+
+    // Hold the write lock, so that no other writer can commit changes missing from the snapshot
+    if (!beginTransaction()) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to begin transaction to populate contact snapshot"));
+        return false;
+    }
+
+    ContactsSnapshotStore::Entries entries;
+    const bool success = readContactSnapshotEntries(nullptr, &entries)
+            && m_snapshotStore.reset(entries);
+
+    // Nothing has been written to the database
+    rollbackTransaction();
+    return success;
+}
+
+bool ContactsDatabase::stageContactSnapshotEntry(quint32 contactId, const QContact &contact, const QList<QContactDetail::DetailType> &definitionMask)
+{
+    if (!m_snapshotMaintained) {
+        // There is no snapshot to maintain
+        return true;
+    }
+
+    // Any summary staged earlier in this transaction is superseded
+    QByteArray existing(m_stagedSnapshotEntries.take(contactId));
+    const bool removed = m_stagedSnapshotRemovals.remove(contactId);
+
+    // Without the deactivated detail in the mask, the contact's visibility is unchanged
+    bool included = false;
+    if (definitionMask.isEmpty() || definitionMask.contains(QContactDeactivated::Type)) {
+        // The snapshot includes the contacts an unfiltered fetch would return
+        included = contactId > 2
+                && (!aggregating() || ContactCollectionId::databaseId(contact.collectionId()) == AggregateAddressbookCollectionId)
+                && contact.details<QContactDeactivated>().isEmpty();
+    } else {
+        included = !removed && (!existing.isEmpty() || m_snapshotStore.entry(contactId, &existing));
+    }
+
+    if (!included) {
+        m_stagedSnapshotRemovals.insert(contactId);
+        return true;
+    }
+
+    SnapshotSummary summary;
+    if (!definitionMask.isEmpty()) {
+        // The remaining fields are retained from the published summary
+        if (existing.isEmpty() && (removed || !m_snapshotStore.entry(contactId, &existing))) {
+            return false;
+        }
+        summary = deserializeSnapshotSummary(existing);
+    }
+
+    updateSnapshotSummary(&summary, contact, definitionMask);
+    m_stagedSnapshotEntries.insert(contactId, serializeSnapshotSummary(summary));
+    return true;
+}
+
+bool ContactsDatabase::stageContactSnapshotChanges(const QList<quint32> &changedIds, const QList<quint32> &removedIds)
+{
+    if (!m_snapshotMaintained) {
+        // There is no snapshot to maintain
+        return true;
+    }
+
+    foreach (quint32 contactId, removedIds) {
+        m_stagedSnapshotEntries.remove(contactId);
+        m_stagedSnapshotRemovals.insert(contactId);
+    }
+
+    // Only contacts changed without their details being written need to be read
+    QList<quint32> unstagedIds;
+    foreach (quint32 contactId, changedIds) {
+        if (!m_stagedSnapshotEntries.contains(contactId) && !m_stagedSnapshotRemovals.contains(contactId)) {
+            unstagedIds.append(contactId);
+        }
+    }
+    if (unstagedIds.isEmpty()) {
+        return true;
+    }
+
+    ContactsSnapshotStore::Entries entries;
+    if (!readContactSnapshotEntries(&unstagedIds, &entries)) {
+        // Without these changes the snapshot would be stale
+        m_snapshotStore.invalidate();
+        m_snapshotMaintained = false;
+        m_stagedSnapshotEntries.clear();
+        m_stagedSnapshotRemovals.clear();
+        return false;
+    }
+
+    // Changed contacts which are no longer visible are removed from the snapshot
+    typedef QPair<quint32, QByteArray> Entry;
+    foreach (const Entry &entry, entries) {
+        m_stagedSnapshotEntries.insert(entry.first, entry.second);
+    }
+    foreach (quint32 contactId, unstagedIds) {
+        if (!m_stagedSnapshotEntries.contains(contactId)) {
+            m_stagedSnapshotRemovals.insert(contactId);
+        }
+    }
+    return true;
+}
+
+bool ContactsDatabase::readContactSnapshotEntries(const QList<quint32> *contactIds, ContactsSnapshotStore::Entries *entries)
+{
+    QMutexLocker locker(accessMutex());
+
+    const QString snapshotIdsTable(QStringLiteral("SnapshotIds"));
+    if (contactIds) {
+        QVariantList boundIds;
+        boundIds.reserve(contactIds->count());
+        foreach (quint32 contactId, *contactIds) {
+            boundIds.append(contactId);
+        }
+
+        clearTemporaryContactIdsTable(snapshotIdsTable);
+        if (!createTemporaryContactIdsTable(snapshotIdsTable, boundIds)) {
+            return false;
+        }
+    }
+
+    // The snapshot includes the contacts an unfiltered fetch would return
+    const QString constraints(QStringLiteral(
+        "Contacts.contactId > 2 "
+        "AND Contacts.isDeactivated = 0 "
+        "AND Contacts.changeFlags < 4" // ChangeFlags::IsDeleted
+        "%1%2")
+            .arg(aggregating() ? QStringLiteral(" AND Contacts.collectionId = 1") : QString()) // AggregateAddressbookCollectionId
+            .arg(contactIds ? QStringLiteral(" AND Contacts.contactId IN (SELECT contactId FROM temp.SnapshotIds)") : QString()));
+
+    const QString summaryStatement(QStringLiteral(
+        "SELECT Contacts.contactId, DisplayLabels.displayLabel, DisplayLabels.displayLabelGroup, Names.firstName, Names.lastName,"
+        " (SELECT imageUrl FROM Avatars WHERE Avatars.contactId = Contacts.contactId ORDER BY detailId LIMIT 1),"
+        " (SELECT presenceState FROM GlobalPresences WHERE GlobalPresences.contactId = Contacts.contactId LIMIT 1)"
+        " FROM Contacts"
+        " LEFT JOIN DisplayLabels ON DisplayLabels.contactId = Contacts.contactId"
+        " LEFT JOIN Names ON Names.contactId = Contacts.contactId"
+        " WHERE %1").arg(constraints));
+    const QString phoneNumbersStatement(QStringLiteral(
+        "SELECT PhoneNumbers.contactId, PhoneNumbers.phoneNumber FROM PhoneNumbers"
+        " JOIN Contacts ON Contacts.contactId = PhoneNumbers.contactId"
+        " WHERE %1"
+        " ORDER BY PhoneNumbers.contactId, PhoneNumbers.detailId").arg(constraints));
+    const QString emailAddressesStatement(QStringLiteral(
+        "SELECT EmailAddresses.contactId, EmailAddresses.emailAddress FROM EmailAddresses"
+        " JOIN Contacts ON Contacts.contactId = EmailAddresses.contactId"
+        " WHERE %1"
+        " ORDER BY EmailAddresses.contactId, EmailAddresses.detailId").arg(constraints));
+
+    QMap<quint32, SnapshotSummary> summaries;
+
+    {
+        Query query(prepare(summaryStatement));
+        if (!execute(query)) {
+            query.reportError("Failed to query contact snapshot summaries");
+            return false;
+        }
+        while (query.next()) {
+            SnapshotSummary &summary(summaries[query.value<quint32>(0)]);
+            summary.displayLabel = query.value<QString>(1);
+            summary.displayLabelGroup = query.value<QString>(2);
+            summary.firstName = query.value<QString>(3);
+            summary.lastName = query.value<QString>(4);
+            summary.avatarUrl = query.value<QString>(5);
+            summary.presenceState = query.value<qint32>(6);
+        }
+    }
+    {
+        Query query(prepare(phoneNumbersStatement));
+        if (!execute(query)) {
+            query.reportError("Failed to query contact snapshot phone numbers");
+            return false;
+        }
+        while (query.next()) {
+            summaries[query.value<quint32>(0)].phoneNumbers.append(query.value<QString>(1));
+        }
+    }
+    {
+        Query query(prepare(emailAddressesStatement));
+        if (!execute(query)) {
+            query.reportError("Failed to query contact snapshot email addresses");
+            return false;
+        }
+        while (query.next()) {
+            summaries[query.value<quint32>(0)].emailAddresses.append(query.value<QString>(1));
+        }
+    }
+
+    if (contactIds) {
+        clearTemporaryContactIdsTable(snapshotIdsTable);
+    }
+
+    // Presence updates may be held only in the transient store
+    if (contactIds) {
+        for (QMap<quint32, SnapshotSummary>::iterator it = summaries.begin(); it != summaries.end(); ++it) {
+            const QPair<QDateTime, QList<QContactDetail> > details(m_transientStore.contactDetails(it.key()));
+            foreach (const QContactDetail &detail, details.second) {
+                if (detail.type() == QContactGlobalPresence::Type) {
+                    it->presenceState = detail.value<int>(QContactGlobalPresence::FieldPresenceState);
+                    break;
+                }
+            }
+        }
+    } else {
+        ContactsTransientStore::DataLock lock(m_transientStore.dataLock());
+        ContactsTransientStore::const_iterator it = m_transientStore.constBegin(lock), end = m_transientStore.constEnd(lock);
+        for ( ; it != end; ++it) {
+            QMap<quint32, SnapshotSummary>::iterator summary = summaries.find(it.key());
+            if (summary == summaries.end())
+                continue;
+
+            const QPair<QDateTime, QList<QContactDetail> > details(it.value());
+            foreach (const QContactDetail &detail, details.second) {
+                if (detail.type() == QContactGlobalPresence::Type) {
+                    summary->presenceState = detail.value<int>(QContactGlobalPresence::FieldPresenceState);
+                    break;
+                }
+            }
+        }
+    }
+
+    entries->reserve(entries->count() + summaries.count());
+    for (QMap<quint32, SnapshotSummary>::const_iterator it = summaries.constBegin(); it != summaries.constEnd(); ++it) {
+        entries->append(qMakePair(it.key(), serializeSnapshotSummary(*it)));
+    }
+    return true;
+}
+
 bool ContactsDatabase::execute(QSqlQuery &query)
 {
     static const bool debugSql = !qgetenv("QTCONTACTS_SQLITE_DEBUG_SQL").isEmpty();
+    static const bool debugQueryPlans = !qgetenv("QTCONTACTS_SQLITE_DEBUG_QUERY_PLANS").isEmpty();
+
+    if (debugQueryPlans && query.lastQuery().contains(QStringLiteral("SELECT"), Qt::CaseInsensitive)) {
+        const QStringList plan(queryPlan(query));
+        qDebug().nospace() << "Query plan for: " << qPrintable(query.lastQuery());
+        for (const QString &step : plan) {
+            qDebug().nospace() << "    " << qPrintable(step);
+        }
+    }
 
     QElapsedTimer t;
     t.start();
@@ -3662,6 +5189,42 @@ bool ContactsDatabase::executeBatch(QSqlQuery &query, QSqlQuery::BatchExecutionM
     return rv;
 }
 
+QStringList ContactsDatabase::queryPlan(const QSqlQuery &query)
+{
+    QStringList plan;
+
+    // Explain the statement with the same bindings, via a separate result on the same connection
+    QSqlQuery planQuery(query.driver()->createResult());
+    planQuery.setForwardOnly(true);
+    if (!planQuery.prepare(QStringLiteral("EXPLAIN QUERY PLAN ") + query.lastQuery())) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to prepare query plan: %1\n%2")
+                .arg(planQuery.lastError().text())
+                .arg(query.lastQuery()));
+        return plan;
+    }
+    const int boundValueCount = query.boundValues().count();
+    for (int i = 0; i < boundValueCount; ++i) {
+        planQuery.bindValue(i, query.boundValue(i));
+    }
+    if (!planQuery.exec()) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to query plan: %1\n%2")
+                .arg(planQuery.lastError().text())
+                .arg(query.lastQuery()));
+        return plan;
+    }
+
+    // Each row is (id, parent, unused, detail); indent nested steps under their parent
+    QHash<int, int> depths;
+    while (planQuery.next()) {
+        const int id = planQuery.value(0).toInt();
+        const int depth = depths.value(planQuery.value(1).toInt(), -1) + 1;
+        depths.insert(id, depth);
+        plan.append(QString(depth * 2, QChar(' ')) + planQuery.value(3).toString());
+    }
+
+    return plan;
+}
+
 QString ContactsDatabase::expandQuery(const QString &queryString, const QVariantList &bindings)
 {
     QString query(queryString);
@@ -3759,6 +5322,18 @@ void ContactsDatabase::clearTemporaryValuesTable(const QString &table)
     ::clearTemporaryValuesTable(*this, m_database, table);
 }
 
+bool ContactsDatabase::createTemporaryRelationshipsTable(const QString &table, const QVariantList &firstIds, const QVariantList &types, const QVariantList &secondIds)
+{
+    QMutexLocker locker(accessMutex());
+    return ::createTemporaryRelationshipsTable(*this, m_database, table, firstIds, types, secondIds);
+}
+
+void ContactsDatabase::clearTemporaryRelationshipsTable(const QString &table)
+{
+    QMutexLocker locker(accessMutex());
+    ::clearTemporaryRelationshipsTable(*this, m_database, table);
+}
+
 bool ContactsDatabase::createTransientContactIdsTable(const QString &table, const QVariantList &ids, QString *transientTableName)
 {
     QMutexLocker locker(accessMutex());
@@ -3875,6 +5450,9 @@ void ContactsDatabase::regenerateDisplayLabelGroups()
         bool changed = false;
         bool success = executeDisplayLabelGroupLocalizationStatements(m_database, this, &changed);
         if (success) {
+            if (changed) {
+                m_snapshotStore.invalidate();
+            }
             if (!commitTransaction()) {
                 qWarning() << "Failed to commit regenerated display label groups";
                 rollbackTransaction();
@@ -3891,6 +5469,78 @@ void ContactsDatabase::regenerateDisplayLabelGroups()
     }
 }
 
+void ContactsDatabase::invalidateDisplayLabelGroupGenerators()
+{
+    QMutexLocker locker(accessMutex());
+    m_dlgGenerators.clear();
+    m_validDlgGenerators.clear();
+    m_knownDisplayLabelGroupsSortValues.clear();
+}
+
+void ContactsDatabase::initializeDisplayLabelGroupGenerators() const
+{
+    // The generators are resolved on first use, so that processes which never
+    // need display label groups do not load the generator plugins.  The result
+    // is retained until invalidateDisplayLabelGroupGenerators() is called, when
+    // the display label groups are regenerated for a new locale or preferred property.
+    if (!m_dlgGenerators.isEmpty()) {
+        return;
+    }
+
+    const QLocale locale;
+    m_dlgGenerators = displayLabelGroupGenerators(locale, m_autoTest);
+    m_dlgGenerators.append(m_defaultGenerator.data());
+    for (auto generator : m_dlgGenerators) {
+        if (generator->validForLocale(locale)) {
+            m_validDlgGenerators.append(generator);
+        }
+    }
+
+    // Read system setting to determine whether display label group
+    // should be generated from last name, first name, or display label.
+    const QString prefDlgProp = displayLabelGroupPreferredProperty();
+    m_dlgPreferredDetail = prefDlgProp.startsWith("QContactName")
+            ? QContactName::Type
+            : QContactDisplayLabel::Type;
+    m_dlgPreferredField = prefDlgProp.endsWith("FieldLastName")
+            ? QContactName::FieldLastName
+            : QContactName::FieldFirstName;
+
+    if (m_knownDisplayLabelGroupsSortValues.isEmpty()) {
+        // build a "superlist" of known display label groups.
+        QStringList knownDisplayLabelGroups;
+        for (auto generator : m_validDlgGenerators) {
+            const QStringList groups = generator->displayLabelGroups();
+            for (const QString &group : groups) {
+                if (!knownDisplayLabelGroups.contains(group)) {
+                    knownDisplayLabelGroups.append(group);
+                }
+            }
+        }
+        knownDisplayLabelGroups.removeAll(QStringLiteral("#"));
+        knownDisplayLabelGroups.append(QStringLiteral("#"));
+        knownDisplayLabelGroups.removeAll(QStringLiteral("?"));
+        knownDisplayLabelGroups.append(QStringLiteral("?"));
+
+        // from that list, build a mapping from group to sort priority value,
+        // based upon the position of each group in the list,
+        // which defines a total sort ordering for known display label groups.
+        for (int i = 0; i < knownDisplayLabelGroups.size(); ++i) {
+            const QString &group(knownDisplayLabelGroups.at(i));
+            m_knownDisplayLabelGroupsSortValues.insert(
+                    group,
+                    (group == QStringLiteral("#") || group == QStringLiteral("?"))
+                            ? ::displayLabelGroupSortValue(group, m_knownDisplayLabelGroupsSortValues)
+                            : i);
+        }
+
+        // XXX TODO: do we need to add groups which currently exist in the database,
+        // but which aren't currently included in the m_knownDisplayLabelGroupsSortValues?
+        // I don't think we do, since it only matters on write, and we will update
+        // the m_knownDisplayLabelGroupsSortValues in determineDisplayLabelGroup() during write...
+    }
+}
+
 QString ContactsDatabase::displayLabelGroupPreferredProperty() const
 {
     QString retn(QStringLiteral("QContactName::FieldFirstName"));
@@ -3912,60 +5562,56 @@ QString ContactsDatabase::displayLabelGroupPreferredProperty() const
 
 QString ContactsDatabase::determineDisplayLabelGroup(const QContact &c, bool *emitDisplayLabelGroupChange)
 {
-    // Read system setting to determine whether display label group
-    // should be generated from last name, first name, or display label.
-    const QString prefDlgProp = displayLabelGroupPreferredProperty();
-    const int preferredDetail = prefDlgProp.startsWith("QContactName")
-            ? QContactName::Type
-            : QContactDisplayLabel::Type;
-    const int preferredField = prefDlgProp.endsWith("FieldLastName")
-            ? QContactName::FieldLastName
-            : QContactName::FieldFirstName;
+    const QContactName name(c.detail<QContactName>());
+    return determineDisplayLabelGroup(name.firstName(), name.lastName(), c.detail<QContactDisplayLabel>().label(), emitDisplayLabelGroupChange);
+}
+
+QString ContactsDatabase::determineDisplayLabelGroup(const QString &firstName, const QString &lastName, const QString &displayLabel, bool *emitDisplayLabelGroupChange)
+{
+    QMutexLocker locker(accessMutex());
+    initializeDisplayLabelGroupGenerators();
 
     QString data;
-    if (preferredDetail == QContactName::Type) {
+    if (m_dlgPreferredDetail == QContactName::Type) {
         // try to use the preferred field data.
-        if (preferredField == QContactName::FieldLastName) {
-            data = c.detail<QContactName>().lastName();
-        } else if (preferredField == QContactName::FieldFirstName) {
-            data = c.detail<QContactName>().firstName();
+        if (m_dlgPreferredField == QContactName::FieldLastName) {
+            data = lastName;
+        } else if (m_dlgPreferredField == QContactName::FieldFirstName) {
+            data = firstName;
         }
 
         // preferred field is empty?  try to use the other.
         if (data.isEmpty()) {
-            if (preferredField == QContactName::FieldLastName) {
-                data = c.detail<QContactName>().firstName();
+            if (m_dlgPreferredField == QContactName::FieldLastName) {
+                data = firstName;
             } else {
-                data = c.detail<QContactName>().lastName();
+                data = lastName;
             }
         }
 
         // fall back to using display label data
         if (data.isEmpty()) {
-            data = c.detail<QContactDisplayLabel>().label();
+            data = displayLabel;
         }
     }
 
-    if (preferredDetail == QContactDisplayLabel::Type) {
+    if (m_dlgPreferredDetail == QContactDisplayLabel::Type) {
         // try to use the preferred field data.
-        data = c.detail<QContactDisplayLabel>().label();
+        data = displayLabel;
         // if display label is empty, fall back to name data.
         if (data.isEmpty()) {
-            data = c.detail<QContactName>().firstName();
+            data = firstName;
         }
         if (data.isEmpty()) {
-            data = c.detail<QContactName>().lastName();
+            data = lastName;
         }
     }
 
-    QLocale locale;
     QString group;
-    for (int i = 0; i < m_dlgGenerators.size(); ++i) {
-        if (m_dlgGenerators.at(i)->validForLocale(locale)) {
-            group = m_dlgGenerators.at(i)->displayLabelGroup(data);
-            if (!group.isNull()) {
-                break;
-            }
+    for (int i = 0; i < m_validDlgGenerators.size(); ++i) {
+        group = m_validDlgGenerators.at(i)->displayLabelGroup(data);
+        if (!group.isNull()) {
+            break;
         }
     }
 
@@ -3987,6 +5633,9 @@ QString ContactsDatabase::determineDisplayLabelGroup(const QContact &c, bool *em
 
 QStringList ContactsDatabase::displayLabelGroups() const
 {
+    QMutexLocker locker(accessMutex());
+    initializeDisplayLabelGroupGenerators();
+
     QStringList groups;
     const QLocale locale;
     for (int i = 0; i < m_dlgGenerators.size(); ++i) {
@@ -3998,12 +5647,10 @@ QStringList ContactsDatabase::displayLabelGroups() const
         }
     }
     if (groups.isEmpty()) {
-        for (int i = 0; i < m_dlgGenerators.size(); ++i) {
-            if (m_dlgGenerators.at(i)->validForLocale(locale)) {
-                groups = m_dlgGenerators.at(i)->displayLabelGroups();
-                if (!groups.isEmpty()) {
-                    break;
-                }
+        for (int i = 0; i < m_validDlgGenerators.size(); ++i) {
+            groups = m_validDlgGenerators.at(i)->displayLabelGroups();
+            if (!groups.isEmpty()) {
+                break;
             }
         }
     }
@@ -4016,7 +5663,6 @@ QStringList ContactsDatabase::displayLabelGroups() const
     }
 
     {
-        QMutexLocker locker(accessMutex());
         QSqlQuery selectQuery(m_database);
         selectQuery.setForwardOnly(true);
         const QString statement = QStringLiteral(" SELECT DISTINCT DisplayLabelGroup"
@@ -4055,6 +5701,9 @@ int ContactsDatabase::displayLabelGroupSortValue(const QString &group) const
 {
     static const int maxUnicodeCodePointValue = 1114111; // 0x10FFFF
     static const int nullGroupSortValue = maxUnicodeCodePointValue + 1;
+
+    QMutexLocker locker(accessMutex());
+    initializeDisplayLabelGroupGenerators();
     return m_knownDisplayLabelGroupsSortValues.value(group, nullGroupSortValue);
 }
 
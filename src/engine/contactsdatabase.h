@@ -35,15 +35,22 @@
 
 #include "semaphore_p.h"
 #include "contactstransientstore.h"
+#include "../extensions/contactsnapshot.h"
 #include "../extensions/displaylabelgroupgenerator.h"
 
 #ifdef HAS_MLITE
 #include <mgconfitem.h>
 #endif
 
+#include <QCache>
+#include <QElapsedTimer>
 #include <QHash>
+#include <QMap>
 #include <QMutex>
+#include <QPair>
 #include <QScopedPointer>
+#include <QSet>
+#include <QSharedMemory>
 #include <QSqlDatabase>
 #include <QSqlError>
 #include <QSqlQuery>
@@ -74,20 +81,72 @@ public:
         IsDeleted = 4
     };
 
+    // Durations (in microseconds) spent waiting for, and holding, the write lock.
+    // Histogram bucket i counts durations below lockHistogramBounds[i]; the last
+    // bucket counts all longer durations.
+    enum { LockHistogramBuckets = 8 };
+    struct LockStatistics
+    {
+        quint64 acquisitions = 0;
+        quint64 failures = 0;
+        quint64 timeouts = 0;
+        qint64 totalWait = 0;
+        qint64 maximumWait = 0;
+        qint64 totalHold = 0;
+        qint64 maximumHold = 0;
+        quint64 waitHistogram[LockHistogramBuckets] = {};
+        quint64 holdHistogram[LockHistogramBuckets] = {};
+    };
+    static const qint64 lockHistogramBounds[LockHistogramBuckets - 1];
+
     class ProcessMutex
     {
         Semaphore m_semaphore;
         bool m_initialProcess;
+        QSharedMemory m_queueRegion;
+        bool m_timedOut;
+        QElapsedTimer m_holdTimer;
+        mutable QMutex m_statisticsMutex;
+        LockStatistics m_statistics;
 
     public:
         ProcessMutex(const QString &path);
 
-        bool lock();
+        // Waiters are granted the lock in the order they requested it.
+        // A negative timeout waits indefinitely.
+        bool lock(int timeoutMs = -1);
         bool unlock();
 
         bool isLocked() const;
 
         bool isInitialProcess() const;
+
+        // True if the last lock() failed because its timeout expired
+        bool timedOut() const;
+
+        // True if another connection (in any process) is waiting for the lock
+        bool hasWaiters();
+
+        LockStatistics statistics() const;
+    };
+
+    // SQL generated for a filter and sort order, which is reusable for any
+    // other filter having the same structure but different values
+    struct CompiledFilter
+    {
+        QString join;
+        QString where;
+        QString orderBy;
+        bool transientModifiedRequired = false;
+        bool globalPresenceRequired = false;
+    };
+
+    struct FilterCacheStatistics
+    {
+        quint64 hits = 0;
+        quint64 misses = 0;
+        quint64 uncacheable = 0;
+        int entries = 0;
     };
 
     // This class is required to finish() each query at destruction
@@ -147,6 +206,9 @@ public:
     bool commitTransaction();
     bool rollbackTransaction();
 
+    // True if the last beginTransaction() failed to acquire the write lock before the timeout
+    bool writeLockTimedOut() const;
+
     bool createTemporaryContactIdsTable(const QString &table, const QVariantList &boundIds, int limit = 0);
     bool createTemporaryContactIdsTable(const QString &table, const QString &join, const QString &where, const QString &orderBy, const QVariantList &boundValues, int limit = 0);
     bool createTemporaryContactIdsTable(const QString &table, const QString &join, const QString &where, const QString &orderBy, const QMap<QString, QVariant> &boundValues, int limit = 0);
@@ -156,6 +218,10 @@ public:
     bool createTemporaryValuesTable(const QString &table, const QVariantList &values);
     void clearTemporaryValuesTable(const QString &table);
 
+    // Relationships are identified by their position in the bound lists
+    bool createTemporaryRelationshipsTable(const QString &table, const QVariantList &firstIds, const QVariantList &types, const QVariantList &secondIds);
+    void clearTemporaryRelationshipsTable(const QString &table);
+
     bool createTransientContactIdsTable(const QString &table, const QVariantList &ids, QString *transientTableName);
     void clearTransientContactIdsTable(const QString &table);
 
@@ -172,9 +238,47 @@ public:
     bool removeTransientDetails(quint32 contactId);
     bool removeTransientDetails(const QList<quint32> &contactIds);
 
+    // The snapshot shared between processes is maintained by each writer once it has been populated
+    bool contactSnapshotComplete() const;
+    bool contactSnapshot(QList<QtContactsSqliteExtensions::ContactSnapshot> *snapshots, const QString &managerUri) const;
+    bool populateContactSnapshot();
+
+    // Update the snapshot for a contact when the current transaction is committed, from the
+    // details it was written with; with a detail type mask, only the masked fields are replaced.
+    // Returns false if the summary cannot be built from the contact alone.
+    bool stageContactSnapshotEntry(quint32 contactId, const QContact &contact, const QList<QContactDetail::DetailType> &definitionMask);
+
+    // Update the snapshot for these contacts when the current transaction is committed;
+    // changed contacts which were not staged from their written details are read from the database
+    bool stageContactSnapshotChanges(const QList<quint32> &changedIds, const QList<quint32> &removedIds);
+
+    bool statisticsUpdateDue() const;
+    bool updateStatistics();
+
+    // Duration of each phase of the last open(), in microseconds
+    typedef QList<QPair<QString, qint64> > Timings;
+    const Timings &openTimings() const;
+
+    LockStatistics lockStatistics() const;
+
+    // An empty key denotes a filter whose SQL cannot be reused
+    bool findCompiledFilter(const QString &key, CompiledFilter *compiled);
+    void insertCompiledFilter(const QString &key, const CompiledFilter &compiled);
+    FilterCacheStatistics filterCacheStatistics() const;
+
+    bool integrityCheckDue() const;
+    bool checkIntegrity();
+
+    // Continue data upgrades deferred from open() in bounded chunks; progress is
+    // reported as the number of contacts processed out of the total
+    bool deferredUpgradeDue() const;
+    bool performDeferredUpgrade(int *completed, int *total);
+
     void regenerateDisplayLabelGroups();
     QString displayLabelGroupPreferredProperty() const;
     QString determineDisplayLabelGroup(const QContact &c, bool *emitDisplayLabelGroupChange = Q_NULLPTR);
+    QString determineDisplayLabelGroup(const QString &firstName, const QString &lastName, const QString &displayLabel, bool *emitDisplayLabelGroupChange = Q_NULLPTR);
+    void invalidateDisplayLabelGroupGenerators();
     QStringList displayLabelGroups() const;
     int displayLabelGroupSortValue(const QString &group) const;
 
@@ -185,6 +289,8 @@ public:
     static QString expandQuery(const QString &queryString, const QMap<QString, QVariant> &bindings);
     static QString expandQuery(const QSqlQuery &query);
 
+    static QStringList queryPlan(const QSqlQuery &query);
+
     // Input must be UTC
     static QString dateTimeString(const QDateTime &qdt);
     static QString dateString(const QDateTime &qdt);
@@ -193,18 +299,38 @@ public:
     static QDateTime fromDateTimeString(const QString &s);
 
 private:
+    void initializeDisplayLabelGroupGenerators() const;
+    bool readContactSnapshotEntries(const QList<quint32> *contactIds, ContactsSnapshotStore::Entries *entries);
+
     ContactsEngine *m_engine;
     QSqlDatabase m_database;
     ContactsTransientStore m_transientStore;
+    ContactsSnapshotStore m_snapshotStore;
+    bool m_snapshotMaintained;
+    QMap<quint32, QByteArray> m_stagedSnapshotEntries;
+    QSet<quint32> m_stagedSnapshotRemovals;
     QMutex m_mutex;
     mutable QScopedPointer<ProcessMutex> m_processMutex;
     bool m_nonprivileged;
     bool m_autoTest;
+    bool m_statisticsUpdateDue;
+    int m_transactionsSinceStatisticsUpdate;
+    bool m_integrityCheckDue;
+    bool m_deferredUpgradeDue;
+    int m_deferredUpgradeTotal;
+    int m_deferredUpgradeCompleted;
+    int m_sqliteVersion;
+    Timings m_openTimings;
     QString m_localeName;
-    QHash<QString, QSqlQuery> m_preparedQueries;
-    QVector<QtContactsSqliteExtensions::DisplayLabelGroupGenerator*> m_dlgGenerators;
+    QCache<QString, QSqlQuery> m_preparedQueries;
+    QCache<QString, CompiledFilter> m_compiledFilters;
+    FilterCacheStatistics m_filterCacheStatistics;
+    mutable QVector<QtContactsSqliteExtensions::DisplayLabelGroupGenerator*> m_dlgGenerators;
+    mutable QVector<QtContactsSqliteExtensions::DisplayLabelGroupGenerator*> m_validDlgGenerators;
+    mutable int m_dlgPreferredDetail;
+    mutable int m_dlgPreferredField;
     QScopedPointer<QtContactsSqliteExtensions::DisplayLabelGroupGenerator> m_defaultGenerator;
-    QMap<QString, int> m_knownDisplayLabelGroupsSortValues;
+    mutable QMap<QString, int> m_knownDisplayLabelGroupsSortValues;
 #ifdef HAS_MLITE
     MGConfItem m_groupPropertyConf;
 #endif // HAS_MLITE
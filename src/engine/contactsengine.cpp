@@ -41,6 +41,8 @@
 #include "qtcontacts-extensions.h"
 #include "qtcontacts-extensions_impl.h"
 #include "qcontactdetailfetchrequest_p.h"
+#include "qcontactpagefetchrequest_p.h"
+#include "qcontactcountrequest_p.h"
 #include "qcontactcollectionchangesfetchrequest_p.h"
 #include "qcontactchangesfetchrequest_p.h"
 #include "qcontactchangessaverequest_p.h"
@@ -690,6 +692,135 @@ private:
     const QContactDetail::DetailType m_type;
 };
 
+class PageFetchJob : public TemplateJob<QContactPageFetchRequest>
+{
+public:
+    PageFetchJob(QContactPageFetchRequest *request, QContactPageFetchRequestPrivate *d)
+        : TemplateJob(request)
+        , m_filter(d->filter)
+        , m_fetchHint(d->hint)
+        , m_sorting(d->sorting)
+        , m_cursor(d->cursor)
+        , m_pageSize(d->pageSize)
+        , m_idsOnly(d->idsOnly)
+    {
+    }
+
+    void execute(ContactReader *reader, WriterProxy &) override
+    {
+        if (m_idsOnly) {
+            m_error = reader->readContactIds(
+                    &m_contactIds,
+                    m_filter,
+                    m_sorting,
+                    m_pageSize,
+                    m_cursor,
+                    &m_nextCursor);
+        } else {
+            m_error = reader->readContacts(
+                    QLatin1String("AsynchronousPage"),
+                    &m_contacts,
+                    m_filter,
+                    m_sorting,
+                    m_fetchHint,
+                    m_pageSize,
+                    m_cursor,
+                    &m_nextCursor);
+            foreach (const QContact &contact, m_contacts) {
+                m_contactIds.append(contact.id());
+            }
+        }
+    }
+
+    void updateState(QContactAbstractRequest::State state) override
+    {
+        if (m_request) {
+            QContactPageFetchRequestPrivate * const d = QContactPageFetchRequestPrivate::get(m_request);
+
+            d->contacts = m_contacts;
+            d->contactIds = m_contactIds;
+            d->nextCursor = m_nextCursor;
+            d->error = m_error;
+            d->state = state;
+
+            if (state == QContactAbstractRequest::FinishedState) {
+                emit (m_request->*(d->resultsAvailable))();
+            }
+            emit (m_request->*(d->stateChanged))(state);
+        }
+    }
+
+    QString description() const override
+    {
+        QString s(QLatin1String("Page Fetch"));
+        return s;
+    }
+
+private:
+    const QContactFilter m_filter;
+    const QContactFetchHint m_fetchHint;
+    const QList<QContactSortOrder> m_sorting;
+    const QByteArray m_cursor;
+    const int m_pageSize;
+    const bool m_idsOnly;
+    QList<QContact> m_contacts;
+    QList<QContactId> m_contactIds;
+    QByteArray m_nextCursor;
+};
+
+class CountJob : public TemplateJob<QContactCountRequest>
+{
+public:
+    CountJob(QContactCountRequest *request, QContactCountRequestPrivate *d)
+        : TemplateJob(request)
+        , m_filter(d->filter)
+        , m_countByDisplayLabelGroup(d->countByDisplayLabelGroup)
+        , m_count(0)
+    {
+    }
+
+    void execute(ContactReader *reader, WriterProxy &) override
+    {
+        if (m_countByDisplayLabelGroup) {
+            m_error = reader->readDisplayLabelGroupCounts(&m_displayLabelGroupCounts, m_filter);
+            for (const QPair<QString, int> &groupCount : m_displayLabelGroupCounts) {
+                m_count += groupCount.second;
+            }
+        } else {
+            m_error = reader->readContactCount(&m_count, m_filter);
+        }
+    }
+
+    void updateState(QContactAbstractRequest::State state) override
+    {
+        if (m_request) {
+            QContactCountRequestPrivate * const d = QContactCountRequestPrivate::get(m_request);
+
+            d->count = m_count;
+            d->displayLabelGroupCounts = m_displayLabelGroupCounts;
+            d->error = m_error;
+            d->state = state;
+
+            if (state == QContactAbstractRequest::FinishedState) {
+                emit (m_request->*(d->resultsAvailable))();
+            }
+            emit (m_request->*(d->stateChanged))(state);
+        }
+    }
+
+    QString description() const override
+    {
+        QString s(QLatin1String("Count"));
+        return s;
+    }
+
+private:
+    const QContactFilter m_filter;
+    const bool m_countByDisplayLabelGroup;
+    int m_count;
+    QList<QPair<QString, int> > m_displayLabelGroupCounts;
+};
+
 class CollectionChangesFetchJob : public TemplateJob<QContactCollectionChangesFetchRequest>
 {
 public:
@@ -755,21 +886,73 @@ public:
     ContactChangesFetchJob(QContactChangesFetchRequest *request, QContactChangesFetchRequestPrivate *d)
         : TemplateJob(request)
         , m_collectionId(d->collectionId)
+        , m_unmodifiedContactsPolicy(d->unmodifiedContactsPolicy)
+        , m_pageSize(d->pageSize)
+        , m_continuation(d->pageSize > 0 && d->morePages)
         , m_addedContacts(d->addedContacts)
         , m_modifiedContacts(d->modifiedContacts)
         , m_removedContacts(d->removedContacts)
         , m_unmodifiedContacts(d->unmodifiedContacts)
+        , m_unmodifiedContactIds(d->unmodifiedContactIds)
     {
+        if (m_continuation) {
+            m_pendingAddedContactIds = d->pendingAddedContactIds;
+            m_pendingModifiedContactIds = d->pendingModifiedContactIds;
+            m_pendingRemovedContactIds = d->pendingRemovedContactIds;
+            m_pendingUnmodifiedContactIds = d->pendingUnmodifiedContactIds;
+        }
     }
 
-    void execute(ContactReader *, WriterProxy &writer) override
+    void execute(ContactReader *reader, WriterProxy &writer) override
     {
-        m_error = writer->fetchContactChanges(
-                m_collectionId,
-                &m_addedContacts,
-                &m_modifiedContacts,
-                &m_removedContacts,
-                &m_unmodifiedContacts);
+        if (m_pageSize <= 0) {
+            m_error = writer->fetchContactChanges(
+                    m_collectionId,
+                    &m_addedContacts,
+                    &m_modifiedContacts,
+                    &m_removedContacts,
+                    m_unmodifiedContactsPolicy == QContactChangesFetchRequest::FetchUnmodifiedContacts
+                            ? &m_unmodifiedContacts : nullptr,
+                    m_unmodifiedContactsPolicy == QContactChangesFetchRequest::FetchUnmodifiedContactIds
+                            ? &m_unmodifiedContactIds : nullptr);
+            return;
+        }
+
+        // each page reports only its own contacts
+        m_addedContacts.clear();
+        m_modifiedContacts.clear();
+        m_removedContacts.clear();
+        m_unmodifiedContacts.clear();
+
+        if (!m_continuation) {
+            // the first page determines (and resets) the changes for the whole collection
+            m_unmodifiedContactIds.clear();
+            m_error = writer->fetchContactChangeIds(
+                    m_collectionId,
+                    &m_pendingAddedContactIds,
+                    &m_pendingModifiedContactIds,
+                    &m_pendingRemovedContactIds,
+                    m_unmodifiedContactsPolicy == QContactChangesFetchRequest::IgnoreUnmodifiedContacts
+                            ? nullptr : &m_pendingUnmodifiedContactIds);
+            if (m_unmodifiedContactsPolicy == QContactChangesFetchRequest::FetchUnmodifiedContactIds) {
+                m_unmodifiedContactIds.swap(m_pendingUnmodifiedContactIds);
+            }
+        }
+
+        int remaining = m_pageSize;
+        if (m_error == QContactManager::NoError
+                && fetchPage(reader, &m_pendingRemovedContactIds, &m_removedContacts, &remaining)
+                && fetchPage(reader, &m_pendingAddedContactIds, &m_addedContacts, &remaining)
+                && fetchPage(reader, &m_pendingModifiedContactIds, &m_modifiedContacts, &remaining)) {
+            fetchPage(reader, &m_pendingUnmodifiedContactIds, &m_unmodifiedContacts, &remaining);
+        }
+
+        if (m_error != QContactManager::NoError) {
+            m_pendingAddedContactIds.clear();
+            m_pendingModifiedContactIds.clear();
+            m_pendingRemovedContactIds.clear();
+            m_pendingUnmodifiedContactIds.clear();
+        }
     }
 
     void updateState(QContactAbstractRequest::State state) override
@@ -785,6 +968,15 @@ public:
                 d->modifiedContacts = m_modifiedContacts;
                 d->removedContacts = m_removedContacts;
                 d->unmodifiedContacts = m_unmodifiedContacts;
+                d->unmodifiedContactIds = m_unmodifiedContactIds;
+                d->pendingAddedContactIds = m_pendingAddedContactIds;
+                d->pendingModifiedContactIds = m_pendingModifiedContactIds;
+                d->pendingRemovedContactIds = m_pendingRemovedContactIds;
+                d->pendingUnmodifiedContactIds = m_pendingUnmodifiedContactIds;
+                d->morePages = !m_pendingAddedContactIds.isEmpty()
+                            || !m_pendingModifiedContactIds.isEmpty()
+                            || !m_pendingRemovedContactIds.isEmpty()
+                            || !m_pendingUnmodifiedContactIds.isEmpty();
                 emit (m_request->*(d->resultsAvailable))();
             }
             emit (m_request->*(d->stateChanged))(state);
@@ -798,11 +990,33 @@ public:
     }
 
 private:
+    bool fetchPage(ContactReader *reader, QList<QContactId> *pendingIds, QList<QContact> *contacts, int *remaining)
+    {
+        if (*remaining > 0 && !pendingIds->isEmpty()) {
+            const QList<QContactId> pageIds = pendingIds->mid(0, *remaining);
+            m_error = reader->fetchContacts(pageIds, contacts);
+            if (m_error != QContactManager::NoError) {
+                return false;
+            }
+            pendingIds->erase(pendingIds->begin(), pendingIds->begin() + pageIds.size());
+            *remaining -= pageIds.size();
+        }
+        return true;
+    }
+
     const QContactCollectionId m_collectionId;
+    const QContactChangesFetchRequest::UnmodifiedContactsPolicy m_unmodifiedContactsPolicy;
+    const int m_pageSize;
+    const bool m_continuation;
     QList<QContact> m_addedContacts;
     QList<QContact> m_modifiedContacts;
     QList<QContact> m_removedContacts;
     QList<QContact> m_unmodifiedContacts;
+    QList<QContactId> m_unmodifiedContactIds;
+    QList<QContactId> m_pendingAddedContactIds;
+    QList<QContactId> m_pendingModifiedContactIds;
+    QList<QContactId> m_pendingRemovedContactIds;
+    QList<QContactId> m_pendingUnmodifiedContactIds;
 };
 
 class ContactChangesSaveJob : public TemplateJob<QContactChangesSaveRequest>
@@ -1009,6 +1223,21 @@ public:
         return m_database.isOpen();
     }
 
+    const ContactsDatabase::Timings &databaseTimings() const
+    {
+        return m_database.openTimings();
+    }
+
+    ContactsDatabase::LockStatistics lockStatistics() const
+    {
+        return m_database.lockStatistics();
+    }
+
+    ContactsDatabase::FilterCacheStatistics filterCacheStatistics() const
+    {
+        return m_database.filterCacheStatistics();
+    }
+
     bool nonprivileged() const
     {
         return m_nonprivileged;
@@ -1272,10 +1501,40 @@ void JobThread::run()
     } else {
         ContactNotifier notifier(m_nonprivileged);
         JobContactReader reader(m_database, m_engine->managerUri(), this);
+        reader.setContactCache(m_engine->contactCache());
         Job::WriterProxy writer(*m_engine, m_database, notifier, reader);
 
         while (m_running) {
             if (m_pendingJobs.isEmpty()) {
+                if (m_database.deferredUpgradeDue()) {
+                    // Continue upgrading the data while there is nothing else to do
+                    MutexUnlocker unlocker(locker);
+                    int completed = 0;
+                    int total = 0;
+                    if (m_database.performDeferredUpgrade(&completed, &total) && total > 0) {
+                        if (ContactCache *cache = m_engine->contactCache()) {
+                            // The display label groups of some contacts have been rewritten
+                            cache->clear();
+                        }
+                        notifier.upgradeProgress(QStringLiteral("displayLabelGroups"), completed, total);
+                        if (completed == total) {
+                            notifier.displayLabelGroupsChanged();
+                        }
+                    }
+                    continue;
+                }
+                if (m_database.integrityCheckDue()) {
+                    // Verify the next part of the database while there is nothing else to do
+                    MutexUnlocker unlocker(locker);
+                    m_database.checkIntegrity();
+                    continue;
+                }
+                if (m_database.statisticsUpdateDue()) {
+                    // Refresh the query planner statistics while there is nothing else to do
+                    MutexUnlocker unlocker(locker);
+                    m_database.updateStatistics();
+                    continue;
+                }
                 m_wait.wait(&m_mutex);
             } else {
                 m_currentJob = m_pendingJobs.takeFirst();
@@ -1302,6 +1561,8 @@ void JobThread::run()
 ContactsEngine::ContactsEngine(const QString &name, const QMap<QString, QString> &parameters)
     : m_name(name)
     , m_parameters(parameters)
+    , m_yieldSyncTransactions(false)
+    , m_populateContactSnapshot(false)
 {
     static bool registered = qRegisterMetaType<QList<int> >("QList<int>") &&
                              qRegisterMetaType<QList<QContactDetail::DetailType> >("QList<QContactDetail::DetailType>") &&
@@ -1322,6 +1583,23 @@ ContactsEngine::ContactsEngine(const QString &name, const QMap<QString, QString>
         setMergePresenceChanges(true);
     }
 
+    QString yieldSyncTransactions = m_parameters.value(QString::fromLatin1("yieldSyncTransactions"));
+    if (yieldSyncTransactions.toLower() == QLatin1String("true") ||
+        yieldSyncTransactions.toInt() == 1) {
+        m_yieldSyncTransactions = true;
+    }
+
+    QString contactSnapshot = m_parameters.value(QString::fromLatin1("contactSnapshot"));
+    if (contactSnapshot.toLower() == QLatin1String("true") ||
+        contactSnapshot.toInt() == 1) {
+        m_populateContactSnapshot = true;
+    }
+
+    const int contactCacheSize = m_parameters.value(QString::fromLatin1("contactCacheSize")).toInt();
+    if (contactCacheSize > 0) {
+        m_contactCache.reset(new ContactCache(contactCacheSize));
+    }
+
     QString autoTest = m_parameters.value(QString::fromLatin1("autoTest"));
     if (autoTest.toLower() == QLatin1String("true") ||
         autoTest.toInt() == 1) {
@@ -1361,12 +1639,30 @@ QString ContactsEngine::databaseUuid()
     return m_databaseUuid;
 }
 
+static void appendStartupTimings(ContactsDatabase::Timings *timings, const QString &prefix, const ContactsDatabase::Timings &phases)
+{
+    static const bool debugStartup = !qgetenv("QTCONTACTS_SQLITE_DEBUG_STARTUP").isEmpty();
+
+    for (const QPair<QString, qint64> &phase : phases) {
+        timings->append(qMakePair(prefix + phase.first, phase.second));
+        if (debugStartup) {
+            qDebug().noquote() << QString::fromLatin1("Startup phase %1: %2 us").arg(prefix + phase.first).arg(phase.second);
+        }
+    }
+}
+
 QContactManager::Error ContactsEngine::open()
 {
     // Start the async thread, and wait to see if it can open the database
     if (!m_jobThread) {
+        QElapsedTimer timer;
+        timer.start();
         m_jobThread.reset(new JobThread(this, databaseUuid(), m_nonprivileged, m_autoTest));
 
+        const qint64 elapsed = timer.nsecsElapsed() / 1000;
+        appendStartupTimings(&m_startupTimings, QStringLiteral("async:"), m_jobThread->databaseTimings());
+        appendStartupTimings(&m_startupTimings, QString(), ContactsDatabase::Timings() << qMakePair(QStringLiteral("jobThread"), elapsed));
+
         if (m_jobThread->databaseOpen()) {
             // We may not have got privileged access if we requested it
             setNonprivileged(m_jobThread->nonprivileged());
@@ -1385,6 +1681,7 @@ QContactManager::Error ContactsEngine::open()
                 m_notifier->connect("relationshipsAdded", "au", this, SLOT(_q_relationshipsAdded(QVector<quint32>)));
                 m_notifier->connect("relationshipsRemoved", "au", this, SLOT(_q_relationshipsRemoved(QVector<quint32>)));
                 m_notifier->connect("displayLabelGroupsChanged", "", this, SLOT(_q_displayLabelGroupsChanged()));
+                m_notifier->connect("upgradeProgress", "sii", this, SLOT(_q_upgradeProgress(QString,int,int)));
             }
         } else {
             QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to open asynchronous engine database connection"));
@@ -1404,6 +1701,16 @@ QMap<QString, QString> ContactsEngine::managerParameters() const
     return m_parameters;
 }
 
+bool ContactsEngine::yieldSyncTransactions() const
+{
+    return m_yieldSyncTransactions;
+}
+
+ContactCache *ContactsEngine::contactCache() const
+{
+    return m_contactCache.data();
+}
+
 QMap<QString, QString> ContactsEngine::idInterpretationParameters() const
 {
     const bool nonprivileged = m_parameters.value(QString::fromLatin1("nonprivileged")).compare(QStringLiteral("true"), Qt::CaseInsensitive) == 0
@@ -1781,6 +2088,26 @@ bool ContactsEngine::startRequest(QContactDetailFetchRequest* request)
     return true;
 }
 
+bool ContactsEngine::startRequest(QContactPageFetchRequest* request)
+{
+    Job *job = new PageFetchJob(request, QContactPageFetchRequestPrivate::get(request));
+
+    job->updateState(QContactAbstractRequest::ActiveState);
+    m_jobThread->enqueue(job);
+
+    return true;
+}
+
+bool ContactsEngine::startRequest(QContactCountRequest* request)
+{
+    Job *job = new CountJob(request, QContactCountRequestPrivate::get(request));
+
+    job->updateState(QContactAbstractRequest::ActiveState);
+    m_jobThread->enqueue(job);
+
+    return true;
+}
+
 bool ContactsEngine::startRequest(QContactCollectionChangesFetchRequest* request)
 {
     Job *job = new CollectionChangesFetchJob(request, QContactCollectionChangesFetchRequestPrivate::get(request));
@@ -2134,12 +2461,20 @@ void ContactsEngine::_q_contactsAdded(const QVector<quint32> &contactIds)
 
 void ContactsEngine::_q_contactsChanged(const QVector<quint32> &contactIds)
 {
+    if (m_contactCache) {
+        m_contactCache->remove(contactIds.toList());
+    }
+
     // TODO: also emit the detail types..
     emit contactsChanged(idList(contactIds, m_managerUri), QList<QContactDetail::DetailType>());
 }
 
 void ContactsEngine::_q_contactsPresenceChanged(const QVector<quint32> &contactIds)
 {
+    if (m_contactCache) {
+        m_contactCache->remove(contactIds.toList());
+    }
+
     if (m_mergePresenceChanges) {
         // TODO: also emit the detail types..
         emit contactsChanged(idList(contactIds, m_managerUri), QList<QContactDetail::DetailType>());
@@ -2155,11 +2490,24 @@ void ContactsEngine::_q_collectionContactsChanged(const QVector<quint32> &collec
 
 void ContactsEngine::_q_displayLabelGroupsChanged()
 {
+    if (m_contactCache) {
+        m_contactCache->clear();
+    }
+
     emit displayLabelGroupsChanged(displayLabelGroups());
 }
 
+void ContactsEngine::_q_upgradeProgress(const QString &task, int completed, int total)
+{
+    emit upgradeProgress(task, completed, total);
+}
+
 void ContactsEngine::_q_contactsRemoved(const QVector<quint32> &contactIds)
 {
+    if (m_contactCache) {
+        m_contactCache->removeReferenced(contactIds.toList());
+    }
+
     emit contactsRemoved(idList(contactIds, m_managerUri));
 }
 
@@ -2170,11 +2518,19 @@ void ContactsEngine::_q_selfContactIdChanged(quint32 oldId, quint32 newId)
 
 void ContactsEngine::_q_relationshipsAdded(const QVector<quint32> &contactIds)
 {
+    if (m_contactCache) {
+        m_contactCache->remove(contactIds.toList());
+    }
+
     emit relationshipsAdded(idList(contactIds, m_managerUri));
 }
 
 void ContactsEngine::_q_relationshipsRemoved(const QVector<quint32> &contactIds)
 {
+    if (m_contactCache) {
+        m_contactCache->remove(contactIds.toList());
+    }
+
     emit relationshipsRemoved(idList(contactIds, m_managerUri));
 }
 
@@ -2184,16 +2540,114 @@ ContactsDatabase &ContactsEngine::database()
         QString dbId(QStringLiteral("qtcontacts-sqlite%1-%2"));
         dbId = dbId.arg(m_autoTest ? QStringLiteral("-test") : QString()).arg(databaseUuid());
 
+        QElapsedTimer timer;
+        timer.start();
+
         m_database.reset(new ContactsDatabase(this));
         if (!m_database->open(dbId, m_nonprivileged, m_autoTest, true)) {
             QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to open synchronous engine database connection"));
-        } else if (!m_nonprivileged && !regenerateAggregatesIfNeeded()) {
-            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to regenerate aggregates after schema upgrade"));
+        } else {
+            appendStartupTimings(&m_startupTimings, QStringLiteral("sync:"), m_database->openTimings());
+            timer.restart();
+
+            if (!m_nonprivileged && !regenerateAggregatesIfNeeded()) {
+                QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to regenerate aggregates after schema upgrade"));
+            }
+            appendStartupTimings(&m_startupTimings, QStringLiteral("sync:"),
+                                 ContactsDatabase::Timings() << qMakePair(QStringLiteral("regenerateAggregates"), timer.nsecsElapsed() / 1000));
         }
     }
     return *m_database;
 }
 
+QList<QPair<QString, qint64> > ContactsEngine::startupTimings() const
+{
+    // The synchronous connection is opened on first use, so its phases may not yet be included
+    return m_startupTimings;
+}
+
+static void appendLockStatistics(QList<QPair<QString, qint64> > *statistics, const QString &prefix, const ContactsDatabase::LockStatistics &lock)
+{
+    statistics->append(qMakePair(prefix + QStringLiteral("acquisitions"), qint64(lock.acquisitions)));
+    statistics->append(qMakePair(prefix + QStringLiteral("failures"), qint64(lock.failures)));
+    statistics->append(qMakePair(prefix + QStringLiteral("timeouts"), qint64(lock.timeouts)));
+    statistics->append(qMakePair(prefix + QStringLiteral("waitTotal"), lock.totalWait));
+    statistics->append(qMakePair(prefix + QStringLiteral("waitMaximum"), lock.maximumWait));
+    statistics->append(qMakePair(prefix + QStringLiteral("holdTotal"), lock.totalHold));
+    statistics->append(qMakePair(prefix + QStringLiteral("holdMaximum"), lock.maximumHold));
+
+    for (int i = 0; i < ContactsDatabase::LockHistogramBuckets; ++i) {
+        const QString bucket = (i < ContactsDatabase::LockHistogramBuckets - 1)
+                ? QStringLiteral("<%1").arg(ContactsDatabase::lockHistogramBounds[i])
+                : QStringLiteral(">=%1").arg(ContactsDatabase::lockHistogramBounds[i - 1]);
+        statistics->append(qMakePair(prefix + QStringLiteral("wait") + bucket, qint64(lock.waitHistogram[i])));
+        statistics->append(qMakePair(prefix + QStringLiteral("hold") + bucket, qint64(lock.holdHistogram[i])));
+    }
+}
+
+QList<QPair<QString, qint64> > ContactsEngine::writeLockStatistics() const
+{
+    QList<QPair<QString, qint64> > statistics;
+    if (m_database) {
+        appendLockStatistics(&statistics, QStringLiteral("sync:"), m_database->lockStatistics());
+    }
+    if (m_jobThread) {
+        appendLockStatistics(&statistics, QStringLiteral("async:"), m_jobThread->lockStatistics());
+    }
+    return statistics;
+}
+
+static void appendFilterCacheStatistics(QList<QPair<QString, qint64> > *statistics, const QString &prefix, const ContactsDatabase::FilterCacheStatistics &cache)
+{
+    statistics->append(qMakePair(prefix + QStringLiteral("hits"), qint64(cache.hits)));
+    statistics->append(qMakePair(prefix + QStringLiteral("misses"), qint64(cache.misses)));
+    statistics->append(qMakePair(prefix + QStringLiteral("uncacheable"), qint64(cache.uncacheable)));
+    statistics->append(qMakePair(prefix + QStringLiteral("entries"), qint64(cache.entries)));
+}
+
+QList<QPair<QString, qint64> > ContactsEngine::filterCacheStatistics() const
+{
+    QList<QPair<QString, qint64> > statistics;
+    if (m_database) {
+        appendFilterCacheStatistics(&statistics, QStringLiteral("sync:"), m_database->filterCacheStatistics());
+    }
+    if (m_jobThread) {
+        appendFilterCacheStatistics(&statistics, QStringLiteral("async:"), m_jobThread->filterCacheStatistics());
+    }
+    return statistics;
+}
+
+QList<QPair<QString, qint64> > ContactsEngine::contactCacheStatistics() const
+{
+    QList<QPair<QString, qint64> > statistics;
+    if (m_contactCache) {
+        const ContactCache::Statistics cache(m_contactCache->statistics());
+        statistics.append(qMakePair(QStringLiteral("hits"), cache.hits));
+        statistics.append(qMakePair(QStringLiteral("misses"), cache.misses));
+        statistics.append(qMakePair(QStringLiteral("uncacheable"), cache.uncacheable));
+        statistics.append(qMakePair(QStringLiteral("invalidations"), cache.invalidations));
+        statistics.append(qMakePair(QStringLiteral("entries"), cache.entries));
+    }
+    return statistics;
+}
+
+bool ContactsEngine::fetchContactSnapshots(QList<QtContactsSqliteExtensions::ContactSnapshot> *snapshots)
+{
+    if (database().contactSnapshot(snapshots, m_managerUri)) {
+        return true;
+    }
+    if (!m_populateContactSnapshot) {
+        return false;
+    }
+
+    // Another process may have populated the snapshot in the meantime; that is harmless
+    if (!database().populateContactSnapshot()) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to populate contact snapshot"));
+        return false;
+    }
+    return database().contactSnapshot(snapshots, m_managerUri);
+}
+
 bool ContactsEngine::regenerateAggregatesIfNeeded()
 {
     QContactManager::Error err = QContactManager::NoError;
@@ -2249,6 +2703,7 @@ ContactReader *ContactsEngine::reader() const
 {
     if (!m_synchronousReader) {
         m_synchronousReader.reset(new ContactReader(const_cast<ContactsEngine *>(this)->database(), const_cast<ContactsEngine *>(this)->managerUri()));
+        m_synchronousReader->setContactCache(m_contactCache.data());
     }
     return m_synchronousReader.data();
 }
@@ -42,6 +42,7 @@
 #include <QMap>
 #include <QString>
 
+#include "contactcache.h"
 #include "contactsdatabase.h"
 #include "contactnotifier.h"
 #include "contactreader.h"
@@ -67,6 +68,12 @@ public:
 
     QContactManager::Error open();
 
+    // If set, long sync transactions are committed in chunks when other writers are waiting
+    bool yieldSyncTransactions() const;
+
+    // The cache of contacts fetched by id, if enabled
+    ContactCache *contactCache() const;
+
     QString managerName() const override;
     QMap<QString, QString> managerParameters() const override;
     QMap<QString, QString> idInterpretationParameters() const override;
@@ -141,6 +148,8 @@ public:
     void requestDestroyed(QObject* request) override;
     bool startRequest(QContactAbstractRequest* req) override;
     bool startRequest(QContactDetailFetchRequest* request) override;
+    bool startRequest(QContactPageFetchRequest* request) override;
+    bool startRequest(QContactCountRequest* request) override;
     bool startRequest(QContactCollectionChangesFetchRequest* request) override;
     bool startRequest(QContactChangesFetchRequest* request) override;
     bool startRequest(QContactChangesSaveRequest* request) override;
@@ -195,6 +204,13 @@ public:
 
     QStringList displayLabelGroups() override;
 
+    QList<QPair<QString, qint64> > startupTimings() const override;
+    QList<QPair<QString, qint64> > writeLockStatistics() const override;
+    QList<QPair<QString, qint64> > filterCacheStatistics() const override;
+    QList<QPair<QString, qint64> > contactCacheStatistics() const override;
+
+    bool fetchContactSnapshots(QList<QtContactsSqliteExtensions::ContactSnapshot> *snapshots) override;
+
     QString synthesizedDisplayLabel(const QContact &contact, QContactManager::Error *error) const;
     static bool setContactDisplayLabel(QContact *contact, const QString &label, const QString &group, int sortOrder);
     static QString normalizedPhoneNumber(const QString &input);
@@ -212,6 +228,7 @@ private slots:
     void _q_relationshipsAdded(const QVector<quint32> &contactIds);
     void _q_relationshipsRemoved(const QVector<quint32> &contactIds);
     void _q_displayLabelGroupsChanged();
+    void _q_upgradeProgress(const QString &task, int completed, int total);
 
 private:
     bool regenerateAggregatesIfNeeded();
@@ -224,12 +241,16 @@ private:
     QString m_databaseUuid;
     const QString m_name;
     QMap<QString, QString> m_parameters;
+    bool m_yieldSyncTransactions;
+    bool m_populateContactSnapshot;
     QString m_managerUri;
+    QScopedPointer<ContactCache> m_contactCache;
     QScopedPointer<ContactsDatabase> m_database;
     mutable QScopedPointer<ContactReader> m_synchronousReader;
     QScopedPointer<ContactWriter> m_synchronousWriter;
     QScopedPointer<ContactNotifier> m_notifier;
     QScopedPointer<JobThread> m_jobThread;
+    ContactsDatabase::Timings m_startupTimings;
 
     Q_DISABLE_COPY(ContactsEngine);
 };
@@ -112,7 +112,10 @@ public:
         Function m_release;
     };
 
-    bool open(const QString &identifier, bool createIfNecessary, bool reinitialize);
+    // What size should we use? Using an estimate of 512 bytes per contact, we could store about 2K contacts in a 1M region
+    enum { DefaultRegionSize = 1024 * 1024 };
+
+    bool open(const QString &identifier, bool createIfNecessary, bool reinitialize, int regionSize = DefaultRegionSize);
 
     TableHandle table(const QString &identifier);
     TableHandle reallocateTable(const QString &identifier);
@@ -124,8 +127,9 @@ private:
     // reference the new region.  The key region is updated to refer to the new region.
     struct TableData
     {
-        TableData(QSharedPointer<QSharedMemory> keyRegion, QSharedPointer<SharedMemoryTable> dataTable, quint32 generation)
-            : m_keyRegion(keyRegion)
+        TableData(QSharedPointer<Semaphore> semaphore, QSharedPointer<QSharedMemory> keyRegion, QSharedPointer<SharedMemoryTable> dataTable, quint32 generation)
+            : m_semaphore(semaphore)
+            , m_keyRegion(keyRegion)
             , m_dataTable(dataTable)
             , m_generation(generation)
         {
@@ -134,6 +138,7 @@ private:
         {
         }
 
+        QSharedPointer<Semaphore> m_semaphore;
         QSharedPointer<QSharedMemory> m_keyRegion;
         QSharedPointer<SharedMemoryTable> m_dataTable;
         quint32 m_generation;
@@ -173,20 +178,20 @@ private:
 
     enum { DefaultWaitMs = 5000 };
 
-    Function lockKeyRegion() const;
-    Function lockDataRegion(int waitMs = DefaultWaitMs) const;
+    // Each table has its own semaphores, so that tables can be locked independently
+    Function lockKeyRegion(QSharedPointer<Semaphore> semaphore) const;
+    Function lockDataRegion(QSharedPointer<Semaphore> semaphore, int waitMs = DefaultWaitMs) const;
 
-    Function acquire(int index, int waitMs = DefaultWaitMs) const;
-    void release(int index) const;
+    Function acquire(QSharedPointer<Semaphore> semaphore, int index, int waitMs = DefaultWaitMs) const;
+    void release(QSharedPointer<Semaphore> semaphore, int index) const;
 
     QMap<QString, TableData> m_tables;
-    QScopedPointer<Semaphore> m_semaphore;
     QMutex m_mutex;
 };
 
 Q_GLOBAL_STATIC(SharedMemoryManager, sharedMemory);
 
-bool SharedMemoryManager::open(const QString &identifier, bool createIfNecessary, bool reinitialize)
+bool SharedMemoryManager::open(const QString &identifier, bool createIfNecessary, bool reinitialize, int regionSize)
 {
     QMutexLocker threadLock(&m_mutex);
 
@@ -204,8 +209,8 @@ bool SharedMemoryManager::open(const QString &identifier, bool createIfNecessary
     // Create semaphores to be able to lock the key and data region
     const int initialSemaphoreValues[] = { 1, 1 };
 
-    m_semaphore.reset(new Semaphore(semaphoreToken.toLatin1(), 2, initialSemaphoreValues));
-    if (!m_semaphore) {
+    QSharedPointer<Semaphore> semaphore(new Semaphore(semaphoreToken.toLatin1(), 2, initialSemaphoreValues));
+    if (!semaphore) {
         QTCONTACTS_SQLITE_WARNING(QStringLiteral("Failed to create semaphore for %1")
                 .arg(identifier));
         return false;
@@ -228,7 +233,7 @@ bool SharedMemoryManager::open(const QString &identifier, bool createIfNecessary
     int lockAttempts = 0;
     while (true) {
         // Lock the region, so that only one process can find the region nonexisting
-        SemaphoreLock keyLock(lockKeyRegion());
+        SemaphoreLock keyLock(lockKeyRegion(semaphore));
         if (!keyLock) {
             QTCONTACTS_SQLITE_WARNING(QStringLiteral("Failed to lock key memory region for %1")
                     .arg(identifier));
@@ -271,7 +276,7 @@ bool SharedMemoryManager::open(const QString &identifier, bool createIfNecessary
         }
 
         // We need the data lock in order to validate the data region
-        SemaphoreLock dataLock(lockDataRegion(100));
+        SemaphoreLock dataLock(lockDataRegion(semaphore, 100));
         if (!dataLock) {
             if (++lockAttempts >= 50) {
                 QTCONTACTS_SQLITE_WARNING(QStringLiteral("Failed to lock data memory region during open for %1")
@@ -285,17 +290,14 @@ bool SharedMemoryManager::open(const QString &identifier, bool createIfNecessary
         }
 
         // Try to open the data region
-        // What size should we use? Using an estimate of 512 bytes per contact, we could store about 2K contacts in a 1M region
-        const int memoryRegionSize = 1024 * 1024;
-
-        QSharedPointer<QSharedMemory> dataRegion(getDataRegion(identifier, regionGeneration, true, memoryRegionSize, reinitialize));
+        QSharedPointer<QSharedMemory> dataRegion(getDataRegion(identifier, regionGeneration, true, regionSize, reinitialize));
         if (!dataRegion || !dataRegion->isAttached())
             return false;
 
         QSharedPointer<SharedMemoryTable> dataTable(new SharedMemoryTable(dataRegion));
 
         // Store our handle to this table
-        TableData tableData(keyRegion, dataTable, regionGeneration);
+        TableData tableData(semaphore, keyRegion, dataTable, regionGeneration);
         m_tables.insert(identifier, tableData);
         return true;
     }
@@ -308,29 +310,29 @@ SharedMemoryManager::TableHandle SharedMemoryManager::table(const QString &ident
     // Table reallocation requires the process holding the data lock to acquire the key lock,
     // while we need to acquire the locks in the other order.  To avoid potential deadlock,
     // give up and try again if we can't acquire the data lock while holding the key lock
+    QMap<QString, TableData>::iterator it = m_tables.find(identifier);
+    if (it == m_tables.end()) {
+        QTCONTACTS_SQLITE_WARNING(QStringLiteral("Cannot open unknown shared memory table: %1")
+                .arg(identifier));
+        return TableHandle();
+    }
+
+    TableData &tableData(*it);
+
     int lockAttempts = 0;
     while (true) {
-        SemaphoreLock keyLock(lockKeyRegion());
+        SemaphoreLock keyLock(lockKeyRegion(tableData.m_semaphore));
         if (!keyLock) {
             QTCONTACTS_SQLITE_WARNING(QStringLiteral("Failed to lock key memory region for %1")
                     .arg(identifier));
             return TableHandle();
         }
 
-        QMap<QString, TableData>::iterator it = m_tables.find(identifier);
-        if (it == m_tables.end()) {
-            QTCONTACTS_SQLITE_WARNING(QStringLiteral("Cannot open unknown shared memory table: %1")
-                    .arg(identifier));
-            return TableHandle();
-        }
-
-        TableData &tableData(*it);
-
         // Find the current generation of the table
         quint32 regionGeneration = getRegionGeneration(tableData.m_keyRegion);
 
         // Lock the data region
-        Function dataRelease(lockDataRegion(100));
+        Function dataRelease(lockDataRegion(tableData.m_semaphore, 100));
         if (!dataRelease) {
             if (++lockAttempts >= 50) {
                 QTCONTACTS_SQLITE_WARNING(QStringLiteral("Failed to lock data region for table access for %1")
@@ -388,7 +390,7 @@ SharedMemoryManager::TableHandle SharedMemoryManager::reallocateTable(const QStr
     TableData &tableData(*it);
 
     // We already hold the data lock, we need the key lock also
-    SemaphoreLock keyLock(lockKeyRegion());
+    SemaphoreLock keyLock(lockKeyRegion(tableData.m_semaphore));
     if (!keyLock) {
         QTCONTACTS_SQLITE_WARNING(QStringLiteral("Failed to lock key memory region for %1")
                 .arg(identifier));
@@ -547,32 +549,32 @@ QSharedPointer<QSharedMemory> SharedMemoryManager::getDataRegion(const QString &
     return memoryRegion;
 }
 
-SharedMemoryManager::Function SharedMemoryManager::lockKeyRegion() const
+SharedMemoryManager::Function SharedMemoryManager::lockKeyRegion(QSharedPointer<Semaphore> semaphore) const
 {
-    return acquire(keyIndex);
+    return acquire(semaphore, keyIndex);
 }
 
-SharedMemoryManager::Function SharedMemoryManager::lockDataRegion(int waitMs) const
+SharedMemoryManager::Function SharedMemoryManager::lockDataRegion(QSharedPointer<Semaphore> semaphore, int waitMs) const
 {
-    return acquire(dataIndex, waitMs);
+    return acquire(semaphore, dataIndex, waitMs);
 }
 
-SharedMemoryManager::Function SharedMemoryManager::acquire(int index, int waitMs) const
+SharedMemoryManager::Function SharedMemoryManager::acquire(QSharedPointer<Semaphore> semaphore, int index, int waitMs) const
 {
-    if (m_semaphore) {
-        if (m_semaphore->decrement(index, true, waitMs)) {
-            return std::tr1::bind(&SharedMemoryManager::release, this, index);
+    if (semaphore) {
+        if (semaphore->decrement(index, true, waitMs)) {
+            return std::tr1::bind(&SharedMemoryManager::release, this, semaphore, index);
         }
     }
 
     return Function();
 }
 
-void SharedMemoryManager::release(int index) const
+void SharedMemoryManager::release(QSharedPointer<Semaphore> semaphore, int index) const
 {
-    if (m_semaphore) {
+    if (semaphore) {
         if (index >= keyIndex && index <= dataIndex) {
-            m_semaphore->increment(index);
+            semaphore->increment(index);
         } else {
             QTCONTACTS_SQLITE_WARNING(QStringLiteral("Invalid index to release: %1").arg(index));
         }
@@ -788,3 +790,200 @@ ContactsTransientStore::const_iterator ContactsTransientStore::constEnd(const Da
     return const_iterator(tablePtr, tablePtr->count());
 }
 
+
+namespace {
+
+// The snapshot is complete when it contains the metadata entry, which cannot collide with any contact ID
+const quint32 snapshotMetadataKey = 0;
+const quint32 snapshotFormatVersion = 1;
+
+// The snapshot holds far less data per contact than the transient store
+const int snapshotRegionSize = 64 * 1024;
+
+QByteArray snapshotMetadata()
+{
+    QByteArray data;
+    QDataStream os(&data, QIODevice::WriteOnly);
+    os << snapshotFormatVersion;
+    return data;
+}
+
+bool snapshotComplete(const MemoryTable *table)
+{
+    const QByteArray data(table->value(snapshotMetadataKey));
+    if (data.isEmpty())
+        return false;
+
+    QDataStream is(data);
+    quint32 formatVersion = 0;
+    is >> formatVersion;
+    return formatVersion == snapshotFormatVersion;
+}
+
+void clearTable(MemoryTable *table)
+{
+    QList<quint32> keys;
+    for (size_t i = 0; i < table->count(); ++i) {
+        keys.append(table->keyAt(i));
+    }
+    foreach (quint32 key, keys) {
+        table->remove(key);
+    }
+}
+
+// On failure the table is cleared, since it no longer reflects the database
+bool storeEntries(const QString &identifier, SharedMemoryManager::TableHandle &table, const ContactsSnapshotStore::Entries &entries)
+{
+    // If the table is reallocated, the handle we hold continues to lock the successor
+    QSharedPointer<SharedMemoryManager::TableHandle> reallocated;
+    MemoryTable *target = table.operator->();
+
+    typedef QPair<quint32, QByteArray> Entry;
+    foreach (const Entry &entry, entries) {
+        MemoryTable::Error err = target->insert(entry.first, entry.second);
+        while (err == MemoryTable::InsufficientSpace) {
+            reallocated.reset(new SharedMemoryManager::TableHandle(sharedMemory()->reallocateTable(identifier)));
+            if (!*reallocated) {
+                QTCONTACTS_SQLITE_WARNING(QStringLiteral("Cannot reallocate exhausted contact snapshot: %1")
+                        .arg(identifier));
+                clearTable(target);
+                return false;
+            }
+            target = reallocated->operator->();
+            err = target->insert(entry.first, entry.second);
+        }
+        if (err != MemoryTable::NoError) {
+            QTCONTACTS_SQLITE_WARNING(QStringLiteral("Cannot store contact to snapshot: %1")
+                    .arg(identifier));
+            clearTable(target);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}
+
+ContactsSnapshotStore::ContactsSnapshotStore()
+{
+}
+
+ContactsSnapshotStore::~ContactsSnapshotStore()
+{
+}
+
+bool ContactsSnapshotStore::open(bool nonprivileged, bool autoTest, bool createIfNecessary)
+{
+    const QString identifier(QStringLiteral("qtcontacts-sqlite%1%2-snapshot").arg(nonprivileged ? QStringLiteral("-np") : QString())
+                                                                           .arg(autoTest ? QStringLiteral("-test") : QString()));
+
+    if (!m_identifier.isNull()) {
+        QTCONTACTS_SQLITE_WARNING(QStringLiteral("Cannot re-open active contact snapshot: %1 (%2)")
+                .arg(identifier).arg(m_identifier));
+        return false;
+    }
+
+    if (sharedMemory()->open(identifier, createIfNecessary, false, snapshotRegionSize)) {
+        m_identifier = identifier;
+        return true;
+    }
+
+    return false;
+}
+
+bool ContactsSnapshotStore::isOpen() const
+{
+    return !m_identifier.isNull();
+}
+
+bool ContactsSnapshotStore::isComplete() const
+{
+    if (!isOpen())
+        return false;
+
+    const SharedMemoryManager::TableHandle table(sharedMemory()->table(m_identifier));
+    return table && snapshotComplete(table);
+}
+
+// Readers hold the table lock only while copying the serialized entries, and decode them after
+// it is released.  The table is not readable without the lock: insertions rewrite its index in
+// place, and a writer may move the content to a reallocated region at any time.
+bool ContactsSnapshotStore::entries(Entries *entries) const
+{
+    if (!isOpen())
+        return false;
+
+    const SharedMemoryManager::TableHandle table(sharedMemory()->table(m_identifier));
+    if (!table || !snapshotComplete(table))
+        return false;
+
+    const size_t count = table->count();
+    entries->reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const quint32 key = table->keyAt(i);
+        if (key != snapshotMetadataKey) {
+            entries->append(qMakePair(key, table->valueAt(i)));
+        }
+    }
+    return true;
+}
+
+bool ContactsSnapshotStore::entry(quint32 contactId, QByteArray *data) const
+{
+    if (!isOpen())
+        return false;
+
+    const SharedMemoryManager::TableHandle table(sharedMemory()->table(m_identifier));
+    if (!table || !snapshotComplete(table) || !table->contains(contactId))
+        return false;
+
+    *data = table->value(contactId);
+    return true;
+}
+
+bool ContactsSnapshotStore::reset(const Entries &entries)
+{
+    if (!isOpen())
+        return false;
+
+    SharedMemoryManager::TableHandle table(sharedMemory()->table(m_identifier));
+    if (!table)
+        return false;
+
+    clearTable(table.operator->());
+
+    // Store the metadata last, so that the snapshot is never complete with partial content
+    Entries content(entries);
+    content.append(qMakePair(snapshotMetadataKey, snapshotMetadata()));
+    return storeEntries(m_identifier, table, content);
+}
+
+bool ContactsSnapshotStore::update(const Entries &entries, const QList<quint32> &removedIds)
+{
+    if (!isOpen())
+        return false;
+
+    SharedMemoryManager::TableHandle table(sharedMemory()->table(m_identifier));
+    if (!table || !snapshotComplete(table))
+        return false;
+
+    foreach (quint32 contactId, removedIds) {
+        table->remove(contactId);
+    }
+
+    return storeEntries(m_identifier, table, entries);
+}
+
+bool ContactsSnapshotStore::invalidate()
+{
+    if (!isOpen())
+        return false;
+
+    SharedMemoryManager::TableHandle table(sharedMemory()->table(m_identifier));
+    if (!table)
+        return false;
+
+    clearTable(table.operator->());
+    return true;
+}
@@ -38,6 +38,7 @@
 
 #include <QContactDetail>
 
+#include <QByteArray>
 #include <QDateTime>
 #include <QPair>
 #include <QSharedPointer>
@@ -103,4 +104,38 @@ private:
     QString m_identifier;
 };
 
+// A snapshot of summary data for each contact in the address book, shared between processes.
+// The snapshot is only maintained once some process has populated it completely.
+class ContactsSnapshotStore
+{
+public:
+    typedef QList<QPair<quint32, QByteArray> > Entries;
+
+    ContactsSnapshotStore();
+    ~ContactsSnapshotStore();
+
+    bool open(bool nonprivileged, bool autoTest, bool createIfNecessary);
+
+    bool isOpen() const;
+    bool isComplete() const;
+
+    // Returns false if the snapshot is not complete
+    bool entries(Entries *entries) const;
+
+    // Returns false if the snapshot is not complete or has no entry for the contact
+    bool entry(quint32 contactId, QByteArray *data) const;
+
+    // Replace the content of the snapshot, which is then complete
+    bool reset(const Entries &entries);
+
+    // Apply changes to a complete snapshot
+    bool update(const Entries &entries, const QList<quint32> &removedIds);
+
+    // Discard the snapshot, which must be repopulated before use
+    bool invalidate();
+
+private:
+    QString m_identifier;
+};
+
 #endif
@@ -104,6 +104,9 @@ static const QString wasLocalSyncTarget(QStringLiteral("was_local"));
 static const QString exportSyncTarget(QStringLiteral("export"));
 
 static const QString aggregationIdsTable(QStringLiteral("aggregationIds"));
+static const QString regenerateAggregatesTable(QStringLiteral("regenerateAggregates"));
+static const QString relationshipContactIdsTable(QStringLiteral("relationshipContactIds"));
+static const QString removeRelationshipsTable(QStringLiteral("removeRelationships"));
 static const QString modifiableContactsTable(QStringLiteral("modifiableContacts"));
 static const QString syncConstituentsTable(QStringLiteral("syncConstituents"));
 static const QString syncAggregatesTable(QStringLiteral("syncAggregates"));
@@ -113,6 +116,10 @@ static const QString matchEmailAddressesTable(QStringLiteral("matchEmailAddresse
 static const QString matchPhoneNumbersTable(QStringLiteral("matchPhoneNumbers"));
 static const QString matchOnlineAccountsTable(QStringLiteral("matchOnlineAccounts"));
 
+// The number of contacts saved between opportunities to yield a sync transaction
+static const int syncTransactionChunkSize = 100;
+static const int aggregateRegenerationBatchSize = 250;
+
 ContactWriter::ContactWriter(ContactsEngine &engine, ContactsDatabase &database, ContactNotifier *notifier, ContactReader *reader)
     : m_engine(engine)
     , m_database(database)
@@ -136,12 +143,48 @@ bool ContactWriter::beginTransaction()
 
 bool ContactWriter::commitTransaction()
 {
+    {
+        // Staged changes are published to the snapshot when the transaction commits; any changed
+        // contacts whose summaries were not staged as their details were written are read back
+        QList<quint32> changedIds;
+        foreach (const QContactId &id, m_addedIds + m_changedIds + m_presenceChangedIds) {
+            changedIds.append(ContactId::databaseId(id));
+        }
+        QList<quint32> removedIds;
+        foreach (const QContactId &id, m_removedIds) {
+            removedIds.append(ContactId::databaseId(id));
+        }
+        if (!changedIds.isEmpty() || !removedIds.isEmpty()) {
+            m_database.stageContactSnapshotChanges(changedIds, removedIds);
+        }
+    }
+
     if (!m_database.commitTransaction()) {
         QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Commit error: %1").arg(m_database.lastError().text()));
         rollbackTransaction();
         return false;
     }
 
+    if (ContactCache *cache = m_engine.contactCache()) {
+        // Cached contacts built before this commit are now stale
+        QList<quint32> modifiedIds;
+        foreach (const QContactId &id, m_changedIds + m_presenceChangedIds + m_relationshipsAddedIds + m_relationshipsRemovedIds + m_changeFlagsClearedIds) {
+            modifiedIds.append(ContactId::databaseId(id));
+        }
+        if (!modifiedIds.isEmpty()) {
+            cache->remove(modifiedIds);
+        }
+
+        QList<quint32> removedIds;
+        foreach (const QContactId &id, m_removedIds) {
+            removedIds.append(ContactId::databaseId(id));
+        }
+        if (!removedIds.isEmpty()) {
+            cache->removeReferenced(removedIds);
+        }
+    }
+    m_changeFlagsClearedIds.clear();
+
     if (m_displayLabelGroupsChanged) {
         m_notifier->displayLabelGroupsChanged();
         m_displayLabelGroupsChanged = false;
@@ -166,6 +209,14 @@ bool ContactWriter::commitTransaction()
         m_notifier->contactsPresenceChanged(m_presenceChangedIds.toList());
         m_presenceChangedIds.clear();
     }
+    if (!m_relationshipsAddedIds.isEmpty()) {
+        m_notifier->relationshipsAdded(m_relationshipsAddedIds);
+        m_relationshipsAddedIds.clear();
+    }
+    if (!m_relationshipsRemovedIds.isEmpty()) {
+        m_notifier->relationshipsRemoved(m_relationshipsRemovedIds);
+        m_relationshipsRemovedIds.clear();
+    }
     if (m_suppressedCollectionIds.size()) {
         QSet<QContactCollectionId> collectionContactsChanged = m_collectionContactsChanged;
         Q_FOREACH (const QContactCollectionId &suppressed, m_suppressedCollectionIds) {
@@ -197,6 +248,12 @@ bool ContactWriter::commitTransaction()
     return true;
 }
 
+QContactManager::Error ContactWriter::beginTransactionError() const
+{
+    // Report a write lock timeout distinctly, so that the client may retry later
+    return m_database.writeLockTimedOut() ? QContactManager::LockedError : QContactManager::UnspecifiedError;
+}
+
 void ContactWriter::rollbackTransaction()
 {
     m_database.rollbackTransaction();
@@ -208,6 +265,9 @@ void ContactWriter::rollbackTransaction()
     m_suppressedCollectionIds.clear();
     m_collectionContactsChanged.clear();
     m_presenceChangedIds.clear();
+    m_relationshipsAddedIds.clear();
+    m_relationshipsRemovedIds.clear();
+    m_changeFlagsClearedIds.clear();
     m_changedIds.clear();
     m_addedIds.clear();
     m_displayLabelGroupsChanged = false;
@@ -237,76 +297,6 @@ QContactManager::Error ContactWriter::setIdentity(ContactsDatabase::Identity ide
     }
 }
 
-// This function is currently unused - but the way we currently build up the
-// relationships query is hideously inefficient, so in the future we should
-// rewrite this bindRelationships function and use execBatch().
-/*
-static QContactManager::Error bindRelationships(
-        QSqlQuery *query,
-        const QList<QContactRelationship> &relationships,
-        QMap<int, QContactManager::Error> *errorMap,
-        QSet<QContactLocalId> *contactIds,
-        QMultiMap<QContactLocalId, QPair<QString, QContactLocalId> > *bucketedRelationships,
-        int *removedDuplicatesCount)
-{
-    QVariantList firstIds;
-    QVariantList secondIds;
-    QVariantList types;
-    *removedDuplicatesCount = 0;
-
-    for (int i = 0; i < relationships.count(); ++i) {
-        const QContactRelationship &relationship = relationships.at(i);
-        const QContactLocalId firstId = relationship.first().localId();
-        const QContactLocalId secondId = relationship.second().localId();
-        const QString &type = relationship.relationshipType();
-
-        if (firstId == 0 || secondId == 0) {
-            if (errorMap)
-                errorMap->insert(i, QContactManager::UnspecifiedError);
-        } else if (type.isEmpty()) {
-            if (errorMap)
-                errorMap->insert(i, QContactManager::UnspecifiedError);
-        } else {
-            if (bucketedRelationships->find(firstId, QPair<QString, QContactLocalId>(type, secondId)) != bucketedRelationships->end()) {
-                // this relationship is already represented in our database.
-                // according to the semantics defined in tst_qcontactmanager,
-                // we allow saving duplicates by "overwriting" (with identical values)
-                // which means that we simply "drop" this one from the list
-                // of relationships to add to the database.
-                *removedDuplicatesCount += 1;
-            } else {
-                // this relationships has not yet been represented in our database.
-                firstIds.append(firstId - 1);
-                secondIds.append(secondId - 1);
-                types.append(type);
-
-                contactIds->insert(firstId);
-                contactIds->insert(secondId);
-
-                bucketedRelationships->insert(firstId, QPair<QString, QContactLocalId>(type, secondId));
-            }
-        }
-    }
-
-    if (firstIds.isEmpty() && *removedDuplicatesCount == 0) {
-        // if we "successfully overwrote" some duplicates, it's not an error.
-        return QContactManager::UnspecifiedError;
-    }
-
-    if (firstIds.size() == 1) {
-        query->bindValue(0, firstIds.at(0).toUInt());
-        query->bindValue(1, secondIds.at(0).toUInt());
-        query->bindValue(2, types.at(0).toString());
-    } else if (firstIds.size() > 1) {
-        query->bindValue(0, firstIds);
-        query->bindValue(1, secondIds);
-        query->bindValue(2, types);
-    }
-
-    return QContactManager::NoError;
-}
-*/
-
 QContactManager::Error ContactWriter::save(
         const QList<QContactRelationship> &relationships, QMap<int, QContactManager::Error> *errorMap, bool withinTransaction, bool withinAggregateUpdate)
 {
@@ -317,7 +307,7 @@ QContactManager::Error ContactWriter::save(
 
     if (!withinTransaction && !beginTransaction()) {
         QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to begin database transaction while saving relationships"));
-        return QContactManager::UnspecifiedError;
+        return beginTransactionError();
     }
 
     QContactManager::Error error = saveRelationships(relationships, errorMap, withinAggregateUpdate);
@@ -346,25 +336,28 @@ QString relationshipString(T type)
 QContactManager::Error ContactWriter::saveRelationships(
         const QList<QContactRelationship> &relationships, QMap<int, QContactManager::Error> *errorMap, bool withinAggregateUpdate)
 {
-    // in order to perform duplicate detection we build up the following datastructure.
-    QMultiMap<quint32, QPair<QString, quint32> > bucketedRelationships; // first id to <type, second id>.
+    // Validity and duplicate detection only need the contacts named by these relationships,
+    // which are found via indexed lookups against a temporary table of their ids.
+    QVariantList boundContactIds;
     {
-        const QString existingRelationships(QStringLiteral(
-            " SELECT firstId, secondId, type FROM Relationships"
-        ));
-
-        ContactsDatabase::Query query(m_database.prepare(existingRelationships));
-        if (!ContactsDatabase::execute(query)) {
-            query.reportError("Failed to fetch existing relationships for duplicate detection during insert");
-            return QContactManager::UnspecifiedError;
+        QSet<quint32> contactIds;
+        foreach (const QContactRelationship &relationship, relationships) {
+            const quint32 firstId = ContactId::databaseId(relationship.first());
+            const quint32 secondId = ContactId::databaseId(relationship.second());
+            if (!contactIds.contains(firstId)) {
+                contactIds.insert(firstId);
+                boundContactIds.append(firstId);
+            }
+            if (!contactIds.contains(secondId)) {
+                contactIds.insert(secondId);
+                boundContactIds.append(secondId);
+            }
         }
+    }
 
-        while (query.next()) {
-            quint32 fid = query.value<quint32>(0);
-            quint32 sid = query.value<quint32>(1);
-            QString rt = query.value<QString>(2);
-            bucketedRelationships.insert(fid, qMakePair(rt, sid));
-        }
+    m_database.clearTemporaryContactIdsTable(relationshipContactIdsTable);
+    if (!m_database.createTemporaryContactIdsTable(relationshipContactIdsTable, boundContactIds)) {
+        return QContactManager::UnspecifiedError;
     }
 
     // in order to perform validity detection we build up the following set.
@@ -372,7 +365,9 @@ QContactManager::Error ContactWriter::saveRelationships(
     QSet<quint32> validContactIds;
     {
         const QString existingContactIds(QStringLiteral(
-            " SELECT contactId FROM Contacts WHERE changeFlags < 4" // ChangeFlags::IsDeleted
+            " SELECT Contacts.contactId FROM Contacts"
+            " JOIN temp.relationshipContactIds ON Contacts.contactId = temp.relationshipContactIds.contactId"
+            " WHERE Contacts.changeFlags < 4" // ChangeFlags::IsDeleted
         ));
 
         ContactsDatabase::Query query(m_database.prepare(existingContactIds));
@@ -385,14 +380,34 @@ QContactManager::Error ContactWriter::saveRelationships(
         }
     }
 
-    QList<quint32> firstIdsToBind;
-    QList<quint32> secondIdsToBind;
-    QList<QString> typesToBind;
+    // in order to perform duplicate detection we build up the following datastructure.
+    QMultiMap<quint32, QPair<QString, quint32> > bucketedRelationships; // first id to <type, second id>.
+    {
+        const QString existingRelationships(QStringLiteral(
+            " SELECT Relationships.firstId, Relationships.secondId, Relationships.type FROM Relationships"
+            " JOIN temp.relationshipContactIds ON Relationships.firstId = temp.relationshipContactIds.contactId"
+        ));
+
+        ContactsDatabase::Query query(m_database.prepare(existingRelationships));
+        if (!ContactsDatabase::execute(query)) {
+            query.reportError("Failed to fetch existing relationships for duplicate detection during insert");
+            return QContactManager::UnspecifiedError;
+        }
+
+        while (query.next()) {
+            quint32 fid = query.value<quint32>(0);
+            quint32 sid = query.value<quint32>(1);
+            QString rt = query.value<QString>(2);
+            bucketedRelationships.insert(fid, qMakePair(rt, sid));
+        }
+    }
+
+    QVariantList firstIdsToBind;
+    QVariantList secondIdsToBind;
+    QVariantList typesToBind;
 
     QSet<quint32> aggregatesAffected;
 
-    QSqlQuery multiInsertQuery(m_database);
-    QString queryString = QStringLiteral("INSERT INTO Relationships");
     int realInsertions = 0;
     int invalidInsertions = 0;
     for (int i = 0; i < relationships.size(); ++i) {
@@ -424,19 +439,15 @@ QContactManager::Error ContactWriter::saveRelationships(
             // duplicate, don't insert.
             continue;
         } else {
-            if (realInsertions == 0) {
-                queryString += QStringLiteral("\n SELECT :firstId%1 as firstId, :secondId%1 as secondId, :type%1 as type")
-                                         .arg(QString::number(realInsertions));
-            } else {
-                queryString += QStringLiteral("\n UNION SELECT :firstId%1, :secondId%1, :type%1")
-                                         .arg(QString::number(realInsertions));
-            }
             firstIdsToBind.append(firstId);
             secondIdsToBind.append(secondId);
             typesToBind.append(type);
             bucketedRelationships.insert(firstId, qMakePair(type, secondId));
             realInsertions += 1;
 
+            m_relationshipsAddedIds.insert(ContactId::apiId(firstId, m_managerUri));
+            m_relationshipsAddedIds.insert(ContactId::apiId(secondId, m_managerUri));
+
             if (m_database.aggregating() && (type == relationshipString(QContactRelationship::Aggregates))) {
                 // This aggregate needs to be regenerated
                 aggregatesAffected.insert(firstId);
@@ -444,24 +455,21 @@ QContactManager::Error ContactWriter::saveRelationships(
         }
     }
 
-    if (realInsertions > 0 && !multiInsertQuery.prepare(queryString)) {
-        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to prepare multiple insert relationships query:\n%1\nQuery:\n%2")
-                .arg(multiInsertQuery.lastError().text())
-                .arg(queryString));
-        return QContactManager::UnspecifiedError;
-    }
-
-    for (int i = 0; i < realInsertions; ++i) {
-        multiInsertQuery.bindValue(QStringLiteral(":firstId%1").arg(QString::number(i)), firstIdsToBind.at(i));
-        multiInsertQuery.bindValue(QStringLiteral(":secondId%1").arg(QString::number(i)), secondIdsToBind.at(i));
-        multiInsertQuery.bindValue(QStringLiteral(":type%1").arg(QString::number(i)), typesToBind.at(i));
-    }
+    if (realInsertions > 0) {
+        const QString insertRelationships(QStringLiteral(
+            " INSERT OR IGNORE INTO Relationships (firstId, secondId, type)"
+            " VALUES (:firstId, :secondId, :type)"
+        ));
 
-    if (realInsertions > 0 && !ContactsDatabase::execute(multiInsertQuery)) {
-        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to insert relationships:\n%1\nQuery:\n%2")
-                .arg(multiInsertQuery.lastError().text())
-                .arg(queryString));
-        return QContactManager::UnspecifiedError;
+        // The batch is executed one row at a time, reusing the prepared statement
+        ContactsDatabase::Query query(m_database.prepare(insertRelationships));
+        query.bindValue(QStringLiteral(":firstId"), firstIdsToBind);
+        query.bindValue(QStringLiteral(":secondId"), secondIdsToBind);
+        query.bindValue(QStringLiteral(":type"), typesToBind);
+        if (!ContactsDatabase::executeBatch(query)) {
+            query.reportError("Failed to insert relationships");
+            return QContactManager::UnspecifiedError;
+        }
     }
 
     if (invalidInsertions > 0) {
@@ -488,7 +496,7 @@ QContactManager::Error ContactWriter::remove(
 
     if (!withinTransaction && !beginTransaction()) {
         QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to begin database transaction while removing relationships"));
-        return QContactManager::UnspecifiedError;
+        return beginTransactionError();
     }
 
     QContactManager::Error error = removeRelationships(relationships, errorMap);
@@ -511,77 +519,97 @@ QContactManager::Error ContactWriter::remove(
 QContactManager::Error ContactWriter::removeRelationships(
         const QList<QContactRelationship> &relationships, QMap<int, QContactManager::Error> *errorMap)
 {
-    // in order to perform existence detection we build up the following datastructure.
-    QMultiMap<quint32, QPair<QString, quint32> > bucketedRelationships; // first id to <type, second id>.
+    // The relationships are matched against the existing relationships with a single join,
+    // and all of the matching relationships are removed with a single statement.
+    QVariantList firstIdsToBind;
+    QVariantList typesToBind;
+    QVariantList secondIdsToBind;
+    firstIdsToBind.reserve(relationships.size());
+    typesToBind.reserve(relationships.size());
+    secondIdsToBind.reserve(relationships.size());
+    foreach (const QContactRelationship &relationship, relationships) {
+        firstIdsToBind.append(ContactId::databaseId(relationship.first()));
+        typesToBind.append(relationship.relationshipType());
+        secondIdsToBind.append(ContactId::databaseId(relationship.second()));
+    }
+
+    m_database.clearTemporaryRelationshipsTable(removeRelationshipsTable);
+    if (!m_database.createTemporaryRelationshipsTable(removeRelationshipsTable, firstIdsToBind, typesToBind, secondIdsToBind)) {
+        return QContactManager::UnspecifiedError;
+    }
+
+    // Relationships of deleted contacts are not reported to exist
+    const QString matchingRelationships(QStringLiteral(
+        " FROM temp.removeRelationships"
+        " JOIN RelationshipTypes ON RelationshipTypes.type = temp.removeRelationships.type"
+        " JOIN RelationshipEdges ON RelationshipEdges.firstId = temp.removeRelationships.firstId"
+        "  AND RelationshipEdges.typeId = RelationshipTypes.typeId"
+        "  AND RelationshipEdges.secondId = temp.removeRelationships.secondId"
+        " WHERE temp.removeRelationships.firstId NOT IN (SELECT contactId FROM Contacts WHERE changeFlags >= 4)"
+        "  AND temp.removeRelationships.secondId NOT IN (SELECT contactId FROM Contacts WHERE changeFlags >= 4)" // ChangeFlags::IsDeleted
+    ));
+
+    const QString aggregatesRelationship(relationshipString(QContactRelationship::Aggregates));
+    QSet<int> existingPositions;
+    QSet<quint32> aggregatesAffected;
     {
         const QString existingRelationships(QStringLiteral(
-            " SELECT firstId, secondId, type FROM Relationships"
-            " WHERE firstId NOT IN (SELECT contactId FROM Contacts WHERE changeFlags >= 4)"
-            "  AND secondId NOT IN (SELECT contactId FROM Contacts WHERE changeFlags >= 4)" // ChangeFlags::IsDeleted
-        ));
+            " SELECT temp.removeRelationships.position, temp.removeRelationships.firstId,"
+            " temp.removeRelationships.secondId, temp.removeRelationships.type"
+        ) + matchingRelationships);
 
         ContactsDatabase::Query query(m_database.prepare(existingRelationships));
         if (!ContactsDatabase::execute(query)) {
-            query.reportError("Failed to fetch existing relationships for duplicate detection during insert");
+            query.reportError("Failed to fetch existing relationships for existence detection during removal");
+            m_database.clearTemporaryRelationshipsTable(removeRelationshipsTable);
             return QContactManager::UnspecifiedError;
         }
 
         while (query.next()) {
-            quint32 fid = query.value<quint32>(0);
-            quint32 sid = query.value<quint32>(1);
-            QString rt = query.value<QString>(2);
-            bucketedRelationships.insert(fid, qMakePair(rt, sid));
+            const quint32 firstId = query.value<quint32>(1);
+            const quint32 secondId = query.value<quint32>(2);
+            existingPositions.insert(query.value<int>(0));
+
+            if (m_database.aggregating() && query.value<QString>(3) == aggregatesRelationship) {
+                // This aggregate needs to be regenerated
+                aggregatesAffected.insert(firstId);
+            }
+
+            m_relationshipsRemovedIds.insert(ContactId::apiId(firstId, m_managerUri));
+            m_relationshipsRemovedIds.insert(ContactId::apiId(secondId, m_managerUri));
         }
     }
 
-    QContactManager::Error worstError = QContactManager::NoError;
-    QSet<QContactRelationship> alreadyRemoved;
-    QSet<quint32> aggregatesAffected;
     bool removeInvalid = false;
     for (int i = 0; i < relationships.size(); ++i) {
-        QContactRelationship curr = relationships.at(i);
-        if (alreadyRemoved.contains(curr)) {
-            continue;
-        }
-
-        quint32 currFirst = ContactId::databaseId(curr.first());
-        quint32 currSecond = ContactId::databaseId(curr.second());
-        QString type(curr.relationshipType());
-
-        if (bucketedRelationships.find(currFirst, qMakePair(curr.relationshipType(), currSecond)) == bucketedRelationships.end()) {
+        if (!existingPositions.contains(i)) {
             removeInvalid = true;
             if (errorMap)
                 errorMap->insert(i, QContactManager::DoesNotExistError);
-            continue;
         }
+    }
 
-        if (m_database.aggregating() && (type == relationshipString(QContactRelationship::Aggregates))) {
-            // This aggregate needs to be regenerated
-            aggregatesAffected.insert(currFirst);
-        }
-
-        const QString removeRelationship(QStringLiteral(
-            " DELETE FROM Relationships"
-            " WHERE firstId = :firstId AND secondId = :secondId AND type = :type"
-        ));
-
-        ContactsDatabase::Query query(m_database.prepare(removeRelationship));
-
-        query.bindValue(":firstId", currFirst);
-        query.bindValue(":secondId", currSecond);
-        query.bindValue(":type", type);
+    if (!existingPositions.isEmpty()) {
+        const QString removeRelationships(QStringLiteral(
+            " DELETE FROM RelationshipEdges WHERE rowid IN ("
+            " SELECT RelationshipEdges.rowid"
+        ) + matchingRelationships + QStringLiteral(")"));
 
+        ContactsDatabase::Query query(m_database.prepare(removeRelationships));
         if (!ContactsDatabase::execute(query)) {
-            query.reportError("Failed to remove relationship");
-            worstError = QContactManager::UnspecifiedError;
-            if (errorMap)
-                errorMap->insert(i, worstError);
-            continue;
+            query.reportError("Failed to remove relationships");
+            if (errorMap) {
+                foreach (int position, existingPositions) {
+                    errorMap->insert(position, QContactManager::UnspecifiedError);
+                }
+            }
+            m_database.clearTemporaryRelationshipsTable(removeRelationshipsTable);
+            return QContactManager::UnspecifiedError;
         }
-
-        alreadyRemoved.insert(curr);
     }
 
+    m_database.clearTemporaryRelationshipsTable(removeRelationshipsTable);
+
     if (removeInvalid) {
         return QContactManager::DoesNotExistError;
     }
@@ -651,7 +679,7 @@ QContactManager::Error ContactWriter::save(
     if (!withinTransaction && !beginTransaction()) {
         // if we are not already within a transaction, create a transaction.
         QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to begin database transaction while saving collections"));
-        return QContactManager::UnspecifiedError;
+        return beginTransactionError();
     }
 
     QContactManager::Error ret = QContactManager::NoError;
@@ -784,7 +812,7 @@ QContactManager::Error ContactWriter::remove(
     if (!withinTransaction && !beginTransaction()) {
         // if we are not already within a transaction, create a transaction.
         QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to begin database transaction while removing collections"));
-        return QContactManager::UnspecifiedError;
+        return beginTransactionError();
     }
 
     QContactManager::Error ret = QContactManager::NoError;
@@ -1057,7 +1085,7 @@ QContactManager::Error ContactWriter::remove(const QList<QContactId> &contactIds
         if (!withinTransaction && !beginTransaction()) {
             // if we are not already within a transaction, create a transaction.
             QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to begin database transaction while deleting contacts"));
-            return QContactManager::UnspecifiedError;
+            return beginTransactionError();
         }
         QContactManager::Error removeError = deleteContacts(boundRealRemoveIds, recordUnhandledChangeFlags);
         if (removeError != QContactManager::NoError) {
@@ -1092,10 +1120,10 @@ QContactManager::Error ContactWriter::remove(const QList<QContactId> &contactIds
         return QContactManager::UnspecifiedError;
     } else {
         const QString findAggregateForContactIds(QStringLiteral(
-            " SELECT DISTINCT Relationships.firstId"
-            " FROM Relationships"
-            " JOIN temp.aggregationIds ON Relationships.secondId = temp.aggregationIds.contactId"
-            " WHERE Relationships.type = 'Aggregates'"
+            " SELECT DISTINCT RelationshipEdges.firstId"
+            " FROM RelationshipEdges"
+            " JOIN temp.aggregationIds ON RelationshipEdges.secondId = temp.aggregationIds.contactId"
+            " WHERE RelationshipEdges.typeId = 1" // Aggregates
         ));
 
         ContactsDatabase::Query query(m_database.prepare(findAggregateForContactIds));
@@ -1111,7 +1139,7 @@ QContactManager::Error ContactWriter::remove(const QList<QContactId> &contactIds
     if (!withinTransaction && !beginTransaction()) {
         // only create a transaction if we're not already within one
         QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to begin database transaction while deleting contacts"));
-        return QContactManager::UnspecifiedError;
+        return beginTransactionError();
     }
 
     // remove the non-aggregate contacts which were specified for removal.
@@ -1372,7 +1400,7 @@ QContactManager::Error ContactWriter::clearChangeFlags(const QList<QContactId> &
 
     if (!withinTransaction && !beginTransaction()) {
         QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to begin database transaction while clearing contact change flags"));
-        return QContactManager::UnspecifiedError;
+        return beginTransactionError();
     }
 
     // first, purge any deleted contacts specified in the list.
@@ -1420,6 +1448,11 @@ QContactManager::Error ContactWriter::clearChangeFlags(const QList<QContactId> &
         }
     }
 
+    // The status flags of these contacts have changed, although no change is reported
+    foreach (const QContactId &id, contactIds) {
+        m_changeFlagsClearedIds.insert(id);
+    }
+
     if (!withinTransaction && !commitTransaction()) {
         QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to commit database after clearing contact change flags"));
         return QContactManager::UnspecifiedError;
@@ -1448,7 +1481,7 @@ QContactManager::Error ContactWriter::clearChangeFlags(const QContactCollectionI
 
     if (!withinTransaction && !beginTransaction()) {
         QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to begin database transaction while clearing collection change flags"));
-        return QContactManager::UnspecifiedError;
+        return beginTransactionError();
     }
 
     const QString statement(QStringLiteral("SELECT contactId FROM Contacts WHERE collectionId = :collectionId"));
@@ -1539,7 +1572,8 @@ QContactManager::Error ContactWriter::fetchContactChanges(
         QList<QContact> *addedContacts,
         QList<QContact> *modifiedContacts,
         QList<QContact> *deletedContacts,
-        QList<QContact> *unmodifiedContacts)
+        QList<QContact> *unmodifiedContacts,
+        QList<QContactId> *unmodifiedContactIds)
 {
     QContactManager::Error error = QContactManager::NoError;
     const quint32 dbColId = ContactCollectionId::databaseId(collectionId);
@@ -1548,10 +1582,78 @@ QContactManager::Error ContactWriter::fetchContactChanges(
 
     if (!beginTransaction()) {
         QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to begin database transaction while fetching contact changes"));
+        error = beginTransactionError();
+    }
+
+    if (error == QContactManager::NoError) {
+        error = resetUnhandledChangeFlags(dbColId);
+    }
+
+    if (error == QContactManager::NoError) {
+        // retrieve all contact+detail data.
+        // this fetch should NOT strip out the added/modified/deleted info.
+        error = m_reader->fetchContacts(collectionId, addedContacts, modifiedContacts, deletedContacts, unmodifiedContacts, unmodifiedContactIds);
+        if (error != QContactManager::NoError) {
+            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to fetch contact changes for collection %1").arg(dbColId));
+        }
+    }
+
+    if (error != QContactManager::NoError) {
+        rollbackTransaction();
+    } else if (!commitTransaction()) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to commit database after sync contacts fetch"));
         error = QContactManager::UnspecifiedError;
     }
 
+    return error;
+}
+
+/*
+ As fetchContactChanges(), except that only the ids of the contacts are
+ determined within the transaction.  The contacts themselves can be read
+ afterwards (in pages) via ContactReader::fetchContacts().
+*/
+QContactManager::Error ContactWriter::fetchContactChangeIds(
+        const QContactCollectionId &collectionId,
+        QList<QContactId> *addedContactIds,
+        QList<QContactId> *modifiedContactIds,
+        QList<QContactId> *deletedContactIds,
+        QList<QContactId> *unmodifiedContactIds)
+{
+    QContactManager::Error error = QContactManager::NoError;
+    const quint32 dbColId = ContactCollectionId::databaseId(collectionId);
+
+    QMutexLocker locker(m_database.accessMutex());
+
+    if (!beginTransaction()) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to begin database transaction while fetching contact change ids"));
+        error = beginTransactionError();
+    }
+
     if (error == QContactManager::NoError) {
+        error = resetUnhandledChangeFlags(dbColId);
+    }
+
+    if (error == QContactManager::NoError) {
+        error = m_reader->fetchContactIds(collectionId, addedContactIds, modifiedContactIds, deletedContactIds, unmodifiedContactIds);
+        if (error != QContactManager::NoError) {
+            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to fetch contact change ids for collection %1").arg(dbColId));
+        }
+    }
+
+    if (error != QContactManager::NoError) {
+        rollbackTransaction();
+    } else if (!commitTransaction()) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to commit database after sync contact ids fetch"));
+        error = QContactManager::UnspecifiedError;
+    }
+
+    return error;
+}
+
+QContactManager::Error ContactWriter::resetUnhandledChangeFlags(quint32 collectionId)
+{
+    {
         // set Collection.recordUnhandledChangeFlags = true
         const QString setRecordUnhandledChangeFlags(QStringLiteral(
             " UPDATE Collections SET"
@@ -1560,37 +1662,40 @@ QContactManager::Error ContactWriter::fetchContactChanges(
         ));
 
         ContactsDatabase::Query query(m_database.prepare(setRecordUnhandledChangeFlags));
-        query.bindValue(":collectionId", dbColId);
+        query.bindValue(":collectionId", collectionId);
 
         if (!ContactsDatabase::execute(query)) {
             query.reportError("Failed to set collection.recordUnhandledChangeFlags while fetching contact changes");
-            error = QContactManager::UnspecifiedError;
+            return QContactManager::UnspecifiedError;
         }
     }
 
-    if (error == QContactManager::NoError) {
+    {
         // clear Contact.unhandledChangeFlags
+        // only rows which actually carry unhandled changes need to be rewritten.
         const QString clearUnhandledChangeFlags(QStringLiteral(
             " UPDATE Contacts SET"
             "  unhandledChangeFlags = 0"
             " WHERE collectionId = :collectionId"
+            " AND unhandledChangeFlags != 0"
         ));
 
         ContactsDatabase::Query query(m_database.prepare(clearUnhandledChangeFlags));
-        query.bindValue(":collectionId", dbColId);
+        query.bindValue(":collectionId", collectionId);
 
         if (!ContactsDatabase::execute(query)) {
             query.reportError("Failed to clear contact.unhandledChangeFlags while fetching contact changes");
-            error = QContactManager::UnspecifiedError;
+            return QContactManager::UnspecifiedError;
         }
     }
 
-    if (error == QContactManager::NoError) {
+    {
         // clear Detail.unhandledChangeFlags
         const QString clearUnhandledChangeFlags(QStringLiteral(
             " UPDATE Details SET"
             "  unhandledChangeFlags = 0"
-            " WHERE contactId IN ("
+            " WHERE unhandledChangeFlags != 0"
+            " AND contactId IN ("
             "  SELECT ContactId"
             "  FROM Contacts"
             "  WHERE collectionId = :collectionId"
@@ -1598,31 +1703,15 @@ QContactManager::Error ContactWriter::fetchContactChanges(
         ));
 
         ContactsDatabase::Query query(m_database.prepare(clearUnhandledChangeFlags));
-        query.bindValue(":collectionId", dbColId);
+        query.bindValue(":collectionId", collectionId);
 
         if (!ContactsDatabase::execute(query)) {
             query.reportError("Failed to clear contact.unhandledChangeFlags while fetching contact changes");
-            error = QContactManager::UnspecifiedError;
-        }
-    }
-
-    if (error == QContactManager::NoError) {
-        // retrieve all contact+detail data.
-        // this fetch should NOT strip out the added/modified/deleted info.
-        error = m_reader->fetchContacts(collectionId, addedContacts, modifiedContacts, deletedContacts, unmodifiedContacts);
-        if (error != QContactManager::NoError) {
-            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to fetch contact changes for collection %1").arg(dbColId));
+            return QContactManager::UnspecifiedError;
         }
     }
 
-    if (error != QContactManager::NoError) {
-        rollbackTransaction();
-    } else if (!commitTransaction()) {
-        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to commit database after sync contacts fetch"));
-        error = QContactManager::UnspecifiedError;
-    }
-
-    return error;
+    return QContactManager::NoError;
 }
 
 /*
@@ -1648,12 +1737,51 @@ QContactManager::Error ContactWriter::storeChanges(
 
     if (!beginTransaction()) {
         QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to begin database transaction for store changes"));
-        return QContactManager::UnspecifiedError;
+        return beginTransactionError();
     }
 
     QContactManager::Error error = QContactManager::NoError;
     QList<QContactCollectionId> touchedCollections;
 
+    // If permitted, commit the changes made so far whenever another writer is waiting,
+    // and continue in a new transaction once the waiting writers have been served.
+    // In this case the changes are no longer stored atomically.
+    const bool yieldable = m_engine.yieldSyncTransactions();
+    bool inTransaction = true;
+    auto yieldTransaction = [this, yieldable, &inTransaction]() -> QContactManager::Error {
+        if (!yieldable || !m_database.processMutex()->hasWaiters()) {
+            return QContactManager::NoError;
+        }
+        if (!commitTransaction()) {
+            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to commit database transaction while yielding store changes"));
+            inTransaction = false;
+            return QContactManager::UnspecifiedError;
+        }
+        if (!beginTransaction()) {
+            QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to resume database transaction after yielding store changes"));
+            inTransaction = false;
+            return beginTransactionError();
+        }
+        return QContactManager::NoError;
+    };
+    auto saveContacts = [this, yieldable, &yieldTransaction](QList<QContact> *contacts) -> QContactManager::Error {
+        if (!yieldable || contacts->size() <= syncTransactionChunkSize) {
+            return save(contacts, QList<QContactDetail::DetailType>(), nullptr, nullptr, true, false, true);
+        }
+        for (int offset = 0; offset < contacts->size(); offset += syncTransactionChunkSize) {
+            QList<QContact> chunk(contacts->mid(offset, syncTransactionChunkSize));
+            QContactManager::Error chunkError = save(&chunk, QList<QContactDetail::DetailType>(), nullptr, nullptr, true, false, true);
+            if (chunkError == QContactManager::NoError) {
+                std::copy(chunk.constBegin(), chunk.constEnd(), contacts->begin() + offset);
+                chunkError = yieldTransaction();
+            }
+            if (chunkError != QContactManager::NoError) {
+                return chunkError;
+            }
+        }
+        return QContactManager::NoError;
+    };
+
     // handle additions
     if (addedCollections) {
         QHash<QContactCollection*, QList<QContact> *>::iterator ait = addedCollections->begin(), aend = addedCollections->end();
@@ -1685,12 +1813,17 @@ QContactManager::Error ContactWriter::storeChanges(
                 cit->setCollectionId(collection->id());
             }
 
-            error = save(addedContacts, QList<QContactDetail::DetailType>(), nullptr, nullptr, true, false, true);
+            error = saveContacts(addedContacts);
             if (error != QContactManager::NoError) {
                 QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to save added contacts for added collection %1 within store changes")
                     .arg(collection->metaData(QContactCollection::KeyName).toString()));
                 break;
             }
+
+            error = yieldTransaction();
+            if (error != QContactManager::NoError) {
+                break;
+            }
         }
     }
 
@@ -1752,7 +1885,7 @@ QContactManager::Error ContactWriter::storeChanges(
                 for ( ; cit != cend; ++cit) {
                     cit->setCollectionId(collection->id());
                 }
-                error = save(&addedContacts, QList<QContactDetail::DetailType>(), nullptr, nullptr, true, false, true);
+                error = saveContacts(&addedContacts);
                 if (error != QContactManager::NoError) {
                     QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to save added contacts for modified collection %1 within store changes")
                         .arg(QString::fromLatin1(collection->id().localId())));
@@ -1766,7 +1899,7 @@ QContactManager::Error ContactWriter::storeChanges(
                 for ( ; cit != cend; ++cit) {
                     cit->setCollectionId(collection->id());
                 }
-                error = save(&modifiedContacts, QList<QContactDetail::DetailType>(), nullptr, nullptr, true, false, true);
+                error = saveContacts(&modifiedContacts);
                 if (error != QContactManager::NoError) {
                     QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to save added contacts for modified collection %1 within store changes")
                         .arg(QString::fromLatin1(collection->id().localId())));
@@ -1790,6 +1923,11 @@ QContactManager::Error ContactWriter::storeChanges(
             contacts->append(addedContacts);
             contacts->append(modifiedContacts);
             contacts->append(deletedContacts);
+
+            error = yieldTransaction();
+            if (error != QContactManager::NoError) {
+                break;
+            }
         }
     }
 
@@ -1810,7 +1948,9 @@ QContactManager::Error ContactWriter::storeChanges(
     }
 
     if (error != QContactManager::NoError) {
-        rollbackTransaction();
+        if (inTransaction) {
+            rollbackTransaction();
+        }
     } else if (!commitTransaction()) {
         QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to commit database after store changes"));
         error = QContactManager::UnspecifiedError;
@@ -3524,7 +3664,7 @@ QContactManager::Error ContactWriter::save(
     if (!withinTransaction && !beginTransaction()) {
         // only create a transaction if we're not within one already
         QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Unable to begin database transaction while saving contacts"));
-        return QContactManager::UnspecifiedError;
+        return beginTransactionError();
     }
 
     static const DetailList presenceUpdateDetailTypes(getPresenceUpdateDetailTypes());
@@ -3958,9 +4098,9 @@ QContactManager::Error ContactWriter::updateOrCreateAggregate(QContact *contact,
         " AND contactId > 2" // exclude self contact
         " AND isDeactivated = 0" // exclude deactivated
         " AND contactId NOT IN ("
-            " SELECT secondId FROM Relationships WHERE firstId = :contactId AND type = 'IsNot'"
+            " SELECT secondId FROM RelationshipEdges WHERE firstId = :contactId AND typeId = 2" // IsNot
             " UNION"
-            " SELECT firstId FROM Relationships WHERE secondId = :contactId AND type = 'IsNot'"
+            " SELECT firstId FROM RelationshipEdges WHERE secondId = :contactId AND typeId = 2" // IsNot
         " )"));
 
     // Use a simple match algorithm, looking for exact matches on name fields,
@@ -4124,14 +4264,13 @@ QContactManager::Error ContactWriter::updateOrCreateAggregate(QContact *contact,
         // done above (via the detail promotion and aggregate save).
         // Instead, we simply add the "aggregates" relationship directly.
         const QString insertRelationship(QStringLiteral(
-            " INSERT INTO Relationships (firstId, secondId, type)"
-            " VALUES (:firstId, :secondId, :type)"
+            " INSERT INTO RelationshipEdges (firstId, typeId, secondId)"
+            " VALUES (:firstId, 1, :secondId)" // Aggregates
         ));
 
         ContactsDatabase::Query query(m_database.prepare(insertRelationship));
         query.bindValue(":firstId", ContactId::databaseId(matchingAggregateId));
         query.bindValue(":secondId", ContactId::databaseId(*contact));
-        query.bindValue(":type", relationshipString(QContactRelationship::Aggregates));
         if (!ContactsDatabase::execute(query)) {
             query.reportError("Error inserting Aggregates relationship");
             err = QContactManager::UnspecifiedError;
@@ -4171,6 +4310,41 @@ QContactManager::Error ContactWriter::updateOrCreateAggregate(QContact *contact,
     some stale data.
 */
 QContactManager::Error ContactWriter::regenerateAggregates(const QList<quint32> &aggregateIds, const DetailList &definitionMask, bool withinTransaction)
+{
+    // Aggregates are regenerated in batches: the constituents of every aggregate
+    // in the batch are found with one query and read with one fetch, and the
+    // regenerated aggregates are then saved together.
+    QList<quint32> uniqueAggregateIds;
+    QSet<quint32> seenAggregateIds;
+    uniqueAggregateIds.reserve(aggregateIds.size());
+    foreach (quint32 aggId, aggregateIds) {
+        if (!seenAggregateIds.contains(aggId)) {
+            seenAggregateIds.insert(aggId);
+            uniqueAggregateIds.append(aggId);
+        }
+    }
+
+    QVariantList aggregatesToRemove;
+
+    for (int i = 0; i < uniqueAggregateIds.size(); i += aggregateRegenerationBatchSize) {
+        QContactManager::Error writeError = regenerateAggregateBatch(uniqueAggregateIds.mid(i, aggregateRegenerationBatchSize),
+                                                                     definitionMask, withinTransaction, &aggregatesToRemove);
+        if (writeError != QContactManager::NoError) {
+            return writeError;
+        }
+    }
+
+    if (!aggregatesToRemove.isEmpty()) {
+        QContactManager::Error removeError = removeContacts(aggregatesToRemove);
+        if (removeError != QContactManager::NoError) {
+            return removeError;
+        }
+    }
+
+    return QContactManager::NoError;
+}
+
+QContactManager::Error ContactWriter::regenerateAggregateBatch(const QList<quint32> &aggregateIds, const DetailList &definitionMask, bool withinTransaction, QVariantList *aggregatesToRemove)
 {
     static const DetailList identityDetailTypes(getIdentityDetailTypes());
 
@@ -4180,58 +4354,86 @@ QContactManager::Error ContactWriter::regenerateAggregates(const QList<quint32>
     // 3) append non-unique details
     // In all cases, we "prefer" the 'local' contact's data (if it exists)
 
-    QList<QContact> aggregatesToSave;
-    QSet<QContactId> aggregatesToSaveIds;
-    QVariantList aggregatesToRemove;
-
+    QVariantList boundAggregateIds;
+    boundAggregateIds.reserve(aggregateIds.size());
     foreach (quint32 aggId, aggregateIds) {
-        const QContactId apiId(ContactId::apiId(aggId, m_managerUri));
-        if (aggregatesToSaveIds.contains(apiId)) {
-            continue;
-        }
+        boundAggregateIds.append(aggId);
+    }
 
-        QList<quint32> readIds;
-        readIds.append(aggId);
+    QHash<quint32, QList<quint32> > constituentIds;
+    QList<quint32> readIds(aggregateIds);
 
-        {
-            const QString findConstituentsForAggregate(QStringLiteral(
-                " SELECT secondId FROM Relationships"
-                " WHERE firstId = :aggregateId AND type = 'Aggregates'"
-                " AND secondId NOT IN (SELECT contactId FROM Contacts WHERE changeFlags >= 4)"
-            ));
+    m_database.clearTemporaryContactIdsTable(regenerateAggregatesTable);
+    if (!m_database.createTemporaryContactIdsTable(regenerateAggregatesTable, boundAggregateIds)) {
+        return QContactManager::UnspecifiedError;
+    } else {
+        const QString findConstituentsForAggregates(QStringLiteral(
+            " SELECT RelationshipEdges.firstId, RelationshipEdges.secondId"
+            " FROM RelationshipEdges"
+            " JOIN temp.regenerateAggregates ON RelationshipEdges.firstId = temp.regenerateAggregates.contactId"
+            " WHERE RelationshipEdges.typeId = 1" // Aggregates
+            " AND RelationshipEdges.secondId NOT IN (SELECT contactId FROM Contacts WHERE changeFlags >= 4)"
+            " ORDER BY RelationshipEdges.rowid"
+        ));
 
-            ContactsDatabase::Query query(m_database.prepare(findConstituentsForAggregate));
-            query.bindValue(":aggregateId", aggId);
-            if (!ContactsDatabase::execute(query)) {
-                query.reportError(QStringLiteral("Failed to find constituent contacts for aggregate %1 during regenerate").arg(aggId));
-                return QContactManager::UnspecifiedError;
-            }
-            while (query.next()) {
-                readIds.append(query.value<quint32>(0));
+        ContactsDatabase::Query query(m_database.prepare(findConstituentsForAggregates));
+        if (!ContactsDatabase::execute(query)) {
+            query.reportError(QStringLiteral("Failed to find constituent contacts for %1 aggregates during regenerate").arg(aggregateIds.size()));
+            return QContactManager::UnspecifiedError;
+        }
+        QSet<quint32> seenConstituentIds;
+        while (query.next()) {
+            const quint32 aggId = query.value<quint32>(0);
+            const quint32 constituentId = query.value<quint32>(1);
+            constituentIds[aggId].append(constituentId);
+            if (!seenConstituentIds.contains(constituentId)) {
+                seenConstituentIds.insert(constituentId);
+                readIds.append(constituentId);
             }
         }
+    }
 
-        if (readIds.size() == 1) { // only the aggregate?
+    foreach (quint32 aggId, aggregateIds) {
+        if (!constituentIds.contains(aggId)) { // only the aggregate?
             QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Existing aggregate %1 should already have been removed - aborting regenerate").arg(aggId));
             return QContactManager::UnspecifiedError;
         }
+    }
 
-        QContactFetchHint hint;
-        hint.setOptimizationHints(QContactFetchHint::NoRelationships);
+    QContactFetchHint hint;
+    hint.setOptimizationHints(QContactFetchHint::NoRelationships);
 
-        QList<QContact> readList;
-        QContactManager::Error readError = m_reader->readContacts(QStringLiteral("RegenerateAggregate"), &readList, readIds, hint);
-        if (readError != QContactManager::NoError
-                || readList.size() <= 1
-                || ContactCollectionId::databaseId(readList.at(0).collectionId()) != ContactsDatabase::AggregateAddressbookCollectionId) {
+    QList<QContact> readList;
+    QContactManager::Error readError = m_reader->readContacts(QStringLiteral("RegenerateAggregate"), &readList, readIds, hint);
+    if (readError != QContactManager::NoError || readList.size() != readIds.size()) {
+        QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to read constituent contacts for %1 aggregates during regenerate").arg(aggregateIds.size()));
+        return QContactManager::UnspecifiedError;
+    }
+
+    // the read contacts are in the same order as readIds
+    QHash<quint32, int> readIndexes;
+    readIndexes.reserve(readIds.size());
+    for (int i = 0; i < readIds.size(); ++i) {
+        readIndexes.insert(readIds.at(i), i);
+    }
+
+    QList<QContact> aggregatesToSave;
+
+    foreach (quint32 aggId, aggregateIds) {
+        const QContact &originalAggregateContact(readList.at(readIndexes.value(aggId)));
+        if (ContactCollectionId::databaseId(originalAggregateContact.collectionId()) != ContactsDatabase::AggregateAddressbookCollectionId) {
             QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Failed to read constituent contacts for aggregate %1 during regenerate").arg(aggId));
             return QContactManager::UnspecifiedError;
         }
 
+        QList<QContact> constituents;
+        foreach (quint32 constituentId, constituentIds.value(aggId)) {
+            constituents.append(readList.at(readIndexes.value(constituentId)));
+        }
+
         // See if there are any constituents to aggregate
         bool activeConstituent = false;
-        for (int i = 1; i < readList.size(); ++i) { // start from 1 to skip aggregate
-            const QContact &curr(readList.at(i));
+        foreach (const QContact &curr, constituents) {
             if (curr.details<QContactDeactivated>().count() == 0) {
                 activeConstituent = true;
                 break;
@@ -4239,12 +4441,10 @@ QContactManager::Error ContactWriter::regenerateAggregates(const QList<quint32>
         }
         if (!activeConstituent) {
             // No active constituents - we need to remove this aggregate
-            aggregatesToRemove.append(QVariant(aggId));
+            aggregatesToRemove->append(QVariant(aggId));
             continue;
         }
 
-        QContact originalAggregateContact = readList.at(0);
-
         QContact aggregateContact;
         aggregateContact.setId(originalAggregateContact.id());
         aggregateContact.setCollectionId(originalAggregateContact.collectionId());
@@ -4264,8 +4464,7 @@ QContactManager::Error ContactWriter::regenerateAggregates(const QList<quint32>
 
         // Step two: search for the "local" contacts and promote their details first
         bool foundFirstLocal = false;
-        for (int i = 1; i < readList.size(); ++i) { // start from 1 to skip aggregate
-            QContact curr = readList.at(i);
+        foreach (const QContact &curr, constituents) {
             if (curr.details<QContactDeactivated>().count())
                 continue;
             if (ContactCollectionId::databaseId(curr.collectionId()) != ContactsDatabase::LocalAddressbookCollectionId)
@@ -4287,8 +4486,7 @@ QContactManager::Error ContactWriter::regenerateAggregates(const QList<quint32>
         }
 
         // Step Three: promote data from details of other related contacts
-        for (int i = 1; i < readList.size(); ++i) { // start from 1 to skip aggregate
-            QContact curr = readList.at(i);
+        foreach (const QContact &curr, constituents) {
             if (curr.details<QContactDeactivated>().count())
                 continue;
             if (ContactCollectionId::databaseId(curr.collectionId()) == ContactsDatabase::LocalAddressbookCollectionId) {
@@ -4301,7 +4499,6 @@ QContactManager::Error ContactWriter::regenerateAggregates(const QList<quint32>
 
         // we save the updated aggregates to database all in a batch at the end.
         aggregatesToSave.append(aggregateContact);
-        aggregatesToSaveIds.insert(ContactId::apiId(aggregateContact));
     }
 
     if (!aggregatesToSave.isEmpty()) {
@@ -4312,12 +4509,6 @@ QContactManager::Error ContactWriter::regenerateAggregates(const QList<quint32>
             return writeError;
         }
     }
-    if (!aggregatesToRemove.isEmpty()) {
-        QContactManager::Error removeError = removeContacts(aggregatesToRemove);
-        if (removeError != QContactManager::NoError) {
-            return removeError;
-        }
-    }
 
     return QContactManager::NoError;
 }
@@ -4330,8 +4521,8 @@ QContactManager::Error ContactWriter::removeChildlessAggregates(QList<QContactId
         " SELECT contactId FROM Contacts"
             " WHERE collectionId = 1" // AggregateAddressbookCollectionId
             " AND contactId NOT IN ("
-                " SELECT DISTINCT firstId FROM Relationships"
-                " WHERE type = 'Aggregates'"
+                " SELECT DISTINCT firstId FROM RelationshipEdges"
+                " WHERE typeId = 1" // Aggregates
                 " AND secondId NOT IN ("
                     " SELECT contactId FROM Contacts WHERE changeFlags >= 4" // ChangeFlags::IsDeleted
                 " )"
@@ -4372,7 +4563,7 @@ QContactManager::Error ContactWriter::aggregateOrphanedContacts(bool withinTrans
                     " SELECT collectionId FROM Collections WHERE aggregable = 1"
                 " )"
                 " AND contactId NOT IN ("
-                    " SELECT DISTINCT secondId FROM Relationships WHERE type = 'Aggregates'"
+                    " SELECT DISTINCT secondId FROM RelationshipEdges WHERE typeId = 1" // Aggregates
                 " )"
         ));
 
@@ -4516,6 +4707,7 @@ QContactManager::Error ContactWriter::create(QContact *contact, const DetailList
     if (writeErr == QContactManager::NoError) {
         // successfully saved all data.  Update id.
         contact->setId(ContactId::apiId(contactId, m_managerUri));
+        m_database.stageContactSnapshotEntry(contactId, *contact, definitionMask);
 
         if (m_database.aggregating() && !withinAggregateUpdate) {
             // and either update the aggregate contact (if it exists) or create a new one
@@ -4682,6 +4874,8 @@ QContactManager::Error ContactWriter::update(QContact *contact, const DetailList
             if (!m_database.setTransientDetails(contactId, lastModified, transientDetails)) {
                 QTCONTACTS_SQLITE_WARNING(QString::fromLatin1("Could not perform transient update; fallback to durable update"));
                 transientUpdate = false;
+            } else {
+                m_database.stageContactSnapshotEntry(contactId, *contact, definitionMask);
             }
         }
 
@@ -4709,6 +4903,9 @@ QContactManager::Error ContactWriter::update(QContact *contact, const DetailList
             }
 
             writeError = write(contactId, withinAggregateUpdate ? QContact() : oldContacts.first(), contact, definitionMask, recordUnhandledChangeFlags);
+            if (writeError == QContactManager::NoError) {
+                m_database.stageContactSnapshotEntry(contactId, *contact, definitionMask);
+            }
         }
     }
 
@@ -4722,8 +4919,8 @@ QContactManager::Error ContactWriter::update(QContact *contact, const DetailList
 
             if (aggregable) {
                 const QString findAggregateForContact(QStringLiteral(
-                    " SELECT DISTINCT firstId FROM Relationships"
-                    " WHERE type = 'Aggregates' AND secondId = :localId"
+                    " SELECT DISTINCT firstId FROM RelationshipEdges"
+                    " WHERE typeId = 1 AND secondId = :localId" // Aggregates
                 ));
 
                 ContactsDatabase::Query query(m_database.prepare(findAggregateForContact));
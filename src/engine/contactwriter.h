@@ -131,7 +131,14 @@ public:
             QList<QContact> *addedContacts,
             QList<QContact> *modifiedContacts,
             QList<QContact> *deletedContacts,
-            QList<QContact> *unmodifiedContacts);
+            QList<QContact> *unmodifiedContacts,
+            QList<QContactId> *unmodifiedContactIds = nullptr);
+    QContactManager::Error fetchContactChangeIds(
+            const QContactCollectionId &collectionId,
+            QList<QContactId> *addedContactIds,
+            QList<QContactId> *modifiedContactIds,
+            QList<QContactId> *deletedContactIds,
+            QList<QContactId> *unmodifiedContactIds);
     QContactManager::Error storeChanges(
             QHash<QContactCollection*, QList<QContact> * /* added contacts */> *addedCollections,
             QHash<QContactCollection*, QList<QContact> * /* added/modified/deleted contacts */> *modifiedCollections,
@@ -146,6 +153,9 @@ private:
     bool beginTransaction();
     bool commitTransaction();
     void rollbackTransaction();
+    QContactManager::Error beginTransactionError() const;
+
+    QContactManager::Error resetUnhandledChangeFlags(quint32 collectionId);
 
     QContactManager::Error create(QContact *contact, const DetailList &definitionMask, bool withinTransaction, bool withinAggregateUpdate, bool withinSyncUpdate, bool recordUnhandledChangeFlags);
     QContactManager::Error update(QContact *contact, const DetailList &definitionMask, bool *aggregateUpdated, bool withinTransaction, bool withinAggregateUpdate, bool withinSyncUpdate, bool recordUnhandledChangeFlags, bool transientUpdate);
@@ -168,6 +178,7 @@ private:
     QContactManager::Error updateOrCreateAggregate(QContact *contact, const DetailList &definitionMask, bool withinTransaction, bool withinSyncUpdate, bool createOnly = false, quint32 *aggregateContactId = 0);
 
     QContactManager::Error regenerateAggregates(const QList<quint32> &aggregateIds, const DetailList &definitionMask, bool withinTransaction);
+    QContactManager::Error regenerateAggregateBatch(const QList<quint32> &aggregateIds, const DetailList &definitionMask, bool withinTransaction, QVariantList *aggregatesToRemove);
     QContactManager::Error removeChildlessAggregates(QList<QContactId> *realRemoveIds);
     QContactManager::Error aggregateOrphanedContacts(bool withinTransaction, bool withinSyncUpdate);
 
@@ -211,6 +222,9 @@ private:
     QSet<QContactId> m_removedIds;
     QSet<QContactId> m_changedIds;
     QSet<QContactId> m_presenceChangedIds;
+    QSet<QContactId> m_relationshipsAddedIds;
+    QSet<QContactId> m_relationshipsRemovedIds;
+    QSet<QContactId> m_changeFlagsClearedIds;
     QSet<QContactCollectionId> m_suppressedCollectionIds;
     QSet<QContactCollectionId> m_collectionContactsChanged;
     QSet<QContactCollectionId> m_addedCollectionIds;
@@ -49,13 +49,15 @@ HEADERS += \
         trace_p.h \
         conversion_p.h \
         contactid_p.h \
+        contactcache.h \
         contactsdatabase.h \
         contactsengine.h \
         contactstransientstore.h \
         contactnotifier.h \
         contactreader.h \
         contactwriter.h \
-        ../extensions/contactmanagerengine.h
+        ../extensions/contactmanagerengine.h \
+        ../extensions/contactsnapshot.h
 
 SOURCES += \
         defaultdlggenerator.cpp \
@@ -63,6 +65,7 @@ SOURCES += \
         semaphore_p.cpp \
         conversion.cpp \
         contactid.cpp \
+        contactcache.cpp \
         contactsdatabase.cpp \
         contactsengine.cpp \
         contactstransientstore.cpp \
@@ -115,8 +115,8 @@ bool semaphoreIncrement(int id, size_t index, bool wait, size_t ms, int value)
     }
 
     struct timespec timeout;
-    timeout.tv_sec = 0;
-    timeout.tv_nsec = ms * 1000;
+    timeout.tv_sec = ms / 1000;
+    timeout.tv_nsec = (ms % 1000) * 1000000;
 
     do {
         int rv = ::semtimedop(id, &op, 1, (wait && ms > 0 ? &timeout : 0));
@@ -155,7 +155,8 @@ bool Semaphore::isValid() const
 bool Semaphore::decrement(size_t index, bool wait, size_t timeoutMs)
 {
     if (!semaphoreIncrement(m_id, index, wait, timeoutMs, -1)) {
-        if (errno != EAGAIN || wait) {
+        // EAGAIN is expected if we don't wait, or if the timeout expires
+        if (errno != EAGAIN || (wait && timeoutMs == 0)) {
             error("Unable to decrement semaphore", errno);
         }
         return false;
@@ -166,7 +167,8 @@ bool Semaphore::decrement(size_t index, bool wait, size_t timeoutMs)
 bool Semaphore::increment(size_t index, bool wait, size_t timeoutMs)
 {
     if (!semaphoreIncrement(m_id, index, wait, timeoutMs, 1)) {
-        if (errno != EAGAIN || wait) {
+        // EAGAIN is expected if we don't wait, or if the timeout expires
+        if (errno != EAGAIN || (wait && timeoutMs == 0)) {
             error("Unable to increment semaphore", errno);
         }
         return false;
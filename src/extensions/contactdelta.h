@@ -33,6 +33,7 @@
 #ifndef CONTACTDELTA_H
 #define CONTACTDELTA_H
 
+#include <QByteArray>
 #include <QString>
 #include <QHash>
 #include <QList>
@@ -106,6 +107,17 @@ namespace QtContactsSqliteExtensions {
             const QHash<QContactDetail::DetailType, QSet<int> > &ignorableDetailFields,
             const QSet<int> &ignorableCommonFields,
             bool printDifferences = false);
+
+    // Returns a digest of the content of the contact, ignoring the given
+    // detail types and fields, and the order of its details.  Contacts with
+    // equal fingerprints would be found to be an exact match.  If any detail
+    // cannot be serialized, an empty fingerprint is returned; it matches no
+    // other contact.
+    QByteArray contactContentFingerprint(
+            const QContact &contact,
+            const QSet<QContactDetail::DetailType> &ignorableDetailTypes = defaultIgnorableDetailTypes(),
+            const QHash<QContactDetail::DetailType, QSet<int> > &ignorableDetailFields = defaultIgnorableDetailFields(),
+            const QSet<int> &ignorableCommonFields = defaultIgnorableCommonFields());
 }
 
 #endif // CONTACTDELTA_H
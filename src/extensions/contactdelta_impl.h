@@ -37,8 +37,13 @@
 #include <qtcontacts-extensions.h>
 #include <contactmanagerengine.h>
 
+#include <QCryptographicHash>
+#include <QDataStream>
 #include <QDebug>
 
+#include <algorithm>
+#include <limits>
+
 #define QTCONTACTS_SQLITE_DELTA_DEBUG_LOG(msg)                           \
     do {                                                                 \
         if (Q_UNLIKELY(qtcontacts_sqlite_delta_debug_trace_enabled())) { \
@@ -386,6 +391,67 @@ void constructModification(const QContactDetail &old, QContactDetail *update)
     }
 }
 
+// Given a matrix of costs with no more rows than columns, return the column
+// assigned to each row by an assignment of minimum total cost.
+// This is the Hungarian algorithm, which is O(rows * rows * columns).
+QVector<int> minimumCostAssignment(const QVector<QVector<int> > &costs, int rows, int columns)
+{
+    const int infinity = std::numeric_limits<int>::max();
+
+    // potentials for rows (u) and columns (v); p[j] is the row assigned to column j.
+    // index 0 is a sentinel, rows and columns are numbered from 1.
+    QVector<int> u(rows + 1, 0), v(columns + 1, 0), p(columns + 1, 0), way(columns + 1, 0);
+    for (int i = 1; i <= rows; ++i) {
+        p[0] = i;
+        int j0 = 0;
+        QVector<int> minv(columns + 1, infinity);
+        QVector<bool> used(columns + 1, false);
+        do {
+            used[j0] = true;
+            const int i0 = p[j0];
+            int delta = infinity;
+            int j1 = 0;
+            for (int j = 1; j <= columns; ++j) {
+                if (!used[j]) {
+                    const int current = costs[i0 - 1][j - 1] - u[i0] - v[j];
+                    if (current < minv[j]) {
+                        minv[j] = current;
+                        way[j] = j0;
+                    }
+                    if (minv[j] < delta) {
+                        delta = minv[j];
+                        j1 = j;
+                    }
+                }
+            }
+            for (int j = 0; j <= columns; ++j) {
+                if (used[j]) {
+                    u[p[j]] += delta;
+                    v[j] -= delta;
+                } else {
+                    minv[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while (p[j0] != 0);
+
+        // unwind the augmenting path.
+        do {
+            const int j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        } while (j0 != 0);
+    }
+
+    QVector<int> assignment(rows, -1);
+    for (int j = 1; j <= columns; ++j) {
+        if (p[j] != 0) {
+            assignment[p[j] - 1] = j - 1;
+        }
+    }
+    return assignment;
+}
+
 // Note: this implementation can be overridden if the sync adapter knows
 // more about how to determine modifications (eg persistent detail ids)
 QList<QContactDetail> determineModifications(
@@ -398,67 +464,62 @@ QList<QContactDetail> determineModifications(
     QList<QContactDetail> finalRemovals;
     QList<QContactDetail> finalAdditions;
 
-    QList<QPair<int, int> > permutationsOfIndexes;
-    QHash<int, int> scoresForPermutations;
-
-    QList<int> remainingRemovals;
-    QList<int> remainingAdditions;
-    for (int i = 0; i < additionsOfThisType->size(); ++i) {
-        remainingAdditions.append(i);
+    const int removalCount = removalsOfThisType->size();
+    const int additionCount = additionsOfThisType->size();
+    if (removalCount == 0 || additionCount == 0) {
+        return modifications;
     }
 
     QTCONTACTS_SQLITE_DELTA_DEBUG_LOG("determining modifications from the given list of additions/removals for details of a particular type");
 
     // for each possible permutation, determine its score.
     // lower is a closer match (ie, score == distance).
-    for (int i = 0; i < removalsOfThisType->size(); ++i) {
-        remainingRemovals.append(i);
-        for (int j = 0; j < additionsOfThisType->size(); ++j) {
-            // determine the score for the permutation
-            int score = scoreForDetailPair(removalsOfThisType->at(i),
-                                           additionsOfThisType->at(j),
-                                           ignorableDetailFields,
-                                           ignorableCommonFields);
-            scoresForPermutations.insert(permutationsOfIndexes.size(), score);
-            permutationsOfIndexes.append(QPair<int, int>(i, j));
+    // the assignment is computed over the shorter list, so transpose if necessary.
+    const bool transposed = removalCount > additionCount;
+    const int rows = transposed ? additionCount : removalCount;
+    const int columns = transposed ? removalCount : additionCount;
+    QVector<QVector<int> > scores(rows, QVector<int>(columns));
+    for (int i = 0; i < removalCount; ++i) {
+        for (int j = 0; j < additionCount; ++j) {
+            const int score = scoreForDetailPair(removalsOfThisType->at(i),
+                                                 additionsOfThisType->at(j),
+                                                 ignorableDetailFields,
+                                                 ignorableCommonFields);
+            if (transposed) {
+                scores[j][i] = score;
+            } else {
+                scores[i][j] = score;
+            }
             QTCONTACTS_SQLITE_DELTA_DEBUG_LOG("score for permutation" << i << "," << j << "=" << score);
         }
     }
 
-    while (remainingRemovals.size() > 0 && remainingAdditions.size() > 0) {
-        int lowScore = 1000;
-        int lowScorePermutationIdx = -1;
-
-        foreach (int permutationIdx, scoresForPermutations.keys()) {
-            QPair<int, int> permutation = permutationsOfIndexes.at(permutationIdx);
-            if (remainingRemovals.contains(permutation.first)
-                    && remainingAdditions.contains(permutation.second)) {
-                // this permutation is still "possible".
-                if (scoresForPermutations.value(permutationIdx) < lowScore) {
-                    lowScorePermutationIdx = permutationIdx;
-                    lowScore = scoresForPermutations.value(permutationIdx);
-                }
-            }
-        }
-
-        if (lowScorePermutationIdx != -1) {
-            // we have a valid permutation which should be treated as a modification.
-            QPair<int, int> bestPermutation = permutationsOfIndexes.at(lowScorePermutationIdx);
-            QTCONTACTS_SQLITE_DELTA_DEBUG_LOG("have determined that permutation" << bestPermutation.first << "," << bestPermutation.second << "is a modification");
-            remainingRemovals.removeAll(bestPermutation.first);
-            remainingAdditions.removeAll(bestPermutation.second);
-            const QContactDetail old = removalsOfThisType->at(bestPermutation.first);
-            QContactDetail update = additionsOfThisType->at(bestPermutation.second);
-            constructModification(old, &update);
-            modifications.append(update);
-        }
+    // every detail in the shorter list is paired with one in the longer list,
+    // such that the total distance of all pairs is as small as possible.
+    const QVector<int> assignment = minimumCostAssignment(scores, rows, columns);
+
+    QVector<bool> removalModified(removalCount, false);
+    QVector<bool> additionModified(additionCount, false);
+    for (int row = 0; row < rows; ++row) {
+        const int removalIdx = transposed ? assignment.at(row) : row;
+        const int additionIdx = transposed ? row : assignment.at(row);
+        QTCONTACTS_SQLITE_DELTA_DEBUG_LOG("have determined that permutation" << removalIdx << "," << additionIdx << "is a modification");
+        removalModified[removalIdx] = true;
+        additionModified[additionIdx] = true;
+        QContactDetail update = additionsOfThisType->at(additionIdx);
+        constructModification(removalsOfThisType->at(removalIdx), &update);
+        modifications.append(update);
     }
 
     // rebuild the return values, removing the permutations which were applied as modifications.
-    foreach (int idx, remainingRemovals)
-        finalRemovals.append(removalsOfThisType->at(idx));
-    foreach (int idx, remainingAdditions)
-        finalAdditions.append(additionsOfThisType->at(idx));
+    for (int i = 0; i < removalCount; ++i) {
+        if (!removalModified.at(i))
+            finalRemovals.append(removalsOfThisType->at(i));
+    }
+    for (int j = 0; j < additionCount; ++j) {
+        if (!additionModified.at(j))
+            finalAdditions.append(additionsOfThisType->at(j));
+    }
 
     // and return.
     *removalsOfThisType = finalRemovals;
@@ -582,6 +643,51 @@ static bool detailsEquivalent(const QContactDetail &lhs, const QContactDetail &r
     return detailValuesEqual(lhs, rhs);
 }
 
+bool isEmptyValue(const QVariant &value)
+{
+    // as in detailPairExactlyMatches(), an empty value is equivalent to no value.
+    return value.type() == QVariant::Invalid
+        || (value.type() == QVariant::String && value.toString().isEmpty())
+        || (value.userType() == QMetaType::type("QList<int>") && value.value<QList<int> >().isEmpty());
+}
+
+QByteArray detailContentDigest(
+        const QContactDetail &detail,
+        const QSet<int> &ignorableFields,
+        const QSet<int> &ignorableCommonFields)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << static_cast<qint32>(detail.type());
+
+    const QMap<int, QVariant> values = detail.values();
+    for (QMap<int, QVariant>::const_iterator it = values.constBegin(); it != values.constEnd(); ++it) {
+        if (ignorableCommonFields.contains(it.key())
+                || ignorableFields.contains(it.key())
+                || isEmptyValue(*it)) {
+            continue;
+        }
+
+        stream << static_cast<qint32>(it.key());
+        if (it->type() == QVariant::Url) {
+            // the sync adaptor might provide url data as a string.
+            stream << QVariant(it->toUrl().toString());
+        } else if (it->userType() == QMetaType::type("QList<int>")) {
+            stream << it->value<QList<int> >();
+        } else {
+            stream << *it;
+        }
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        // the content could not be fully serialized, so the digest
+        // would not identify it.  an empty digest never matches.
+        return QByteArray();
+    }
+
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+}
+
 } // namespace
 
 const QSet<QContactDetail::DetailType>& QtContactsSqliteExtensions::defaultIgnorableDetailTypes()
@@ -618,26 +724,69 @@ ContactDetailDelta QtContactsSqliteExtensions::determineContactDetailDelta(
     removeIgnorableDetailsFromList(&odets, ignorableDetailTypes);
     removeIgnorableDetailsFromList(&ndets, ignorableDetailTypes);
 
-    // ignore all exact matches, as they don't form part of the delta
+    // ignore all exact matches, as they don't form part of the delta.
+    // exact duplicates are found by looking up their content digests; only
+    // details without a digest match fall back to comparing field values,
+    // and then only against unmatched new details of the same type.
+    QHash<int, QList<int> > newDetailIndexesOfType;
+    QHash<QByteArray, QList<int> > newDetailIndexesOfDigest;
+    for (int j = 0; j < ndets.size(); ++j) {
+        const QContactDetail::DetailType type = ndets.at(j).type();
+        newDetailIndexesOfType[type].append(j);
+        const QByteArray digest = detailContentDigest(ndets.at(j), ignorableDetailFields.value(type), ignorableCommonFields);
+        if (!digest.isEmpty()) {
+            newDetailIndexesOfDigest[digest].append(j);
+        }
+    }
+
+    QVector<bool> oldMatched(odets.size(), false);
+    QVector<bool> newMatched(ndets.size(), false);
     for (int i = odets.size() - 1; i >= 0; --i) {
-        bool found = false;
-        for (int j = ndets.size() - 1; j >= 0; --j) {
-            if (detailPairExactlyMatches(odets.at(i), ndets.at(j),
-                                         ignorableDetailFields,
-                                         ignorableCommonFields)) {
-                // found an exact match; this detail hasn't changed
-                // or is a duplicate of an existing detail (in the
-                // case where multiple constituents of an aggregate
-                // have some identical details).
-                ndets.removeAt(j);
-                found = true;
+        const QContactDetail &odet(odets.at(i));
+        const QByteArray digest = detailContentDigest(odet, ignorableDetailFields.value(odet.type()), ignorableCommonFields);
+        if (!digest.isEmpty()) {
+            const QList<int> identical = newDetailIndexesOfDigest.take(digest);
+            for (int j : identical) {
+                if (!newMatched.at(j)) {
+                    // found an exact match; this detail hasn't changed
+                    // or is a duplicate of an existing detail (in the
+                    // case where multiple constituents of an aggregate
+                    // have some identical details).
+                    newMatched[j] = true;
+                    oldMatched[i] = true;
+                }
+            }
+            if (oldMatched.at(i)) {
+                continue;
             }
         }
-        if (found) {
-            odets.removeAt(i);
+
+        const QList<int> candidates = newDetailIndexesOfType.value(odet.type());
+        for (int k = candidates.size() - 1; k >= 0; --k) {
+            const int j = candidates.at(k);
+            if (!newMatched.at(j)
+                    && detailPairExactlyMatches(odet, ndets.at(j),
+                                                ignorableDetailFields,
+                                                ignorableCommonFields)) {
+                newMatched[j] = true;
+                oldMatched[i] = true;
+            }
         }
     }
 
+    QList<QContactDetail> unmatchedOdets;
+    QList<QContactDetail> unmatchedNdets;
+    for (int i = 0; i < odets.size(); ++i) {
+        if (!oldMatched.at(i))
+            unmatchedOdets.append(odets.at(i));
+    }
+    for (int j = 0; j < ndets.size(); ++j) {
+        if (!newMatched.at(j))
+            unmatchedNdets.append(ndets.at(j));
+    }
+    odets = unmatchedOdets;
+    ndets = unmatchedNdets;
+
     // determine direct modifications by matching database id
     for (int i = odets.size() - 1; i >= 0; --i) {
         int idx = -1;
@@ -693,5 +842,32 @@ int QtContactsSqliteExtensions::exactContactMatchExistsInList(
     return -1;
 }
 
+QByteArray QtContactsSqliteExtensions::contactContentFingerprint(
+        const QContact &contact,
+        const QSet<QContactDetail::DetailType> &ignorableDetailTypes,
+        const QHash<QContactDetail::DetailType, QSet<int> > &ignorableDetailFields,
+        const QSet<int> &ignorableCommonFields)
+{
+    QList<QByteArray> digests;
+    for (const QContactDetail &detail : contact.details()) {
+        if (!ignorableDetailTypes.contains(detail.type())) {
+            const QByteArray digest = detailContentDigest(detail, ignorableDetailFields.value(detail.type()), ignorableCommonFields);
+            if (digest.isEmpty()) {
+                return QByteArray();
+            }
+            digests.append(digest);
+        }
+    }
+
+    // the order of details is not significant, but duplicates are.
+    std::sort(digests.begin(), digests.end());
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    for (const QByteArray &digest : digests) {
+        hash.addData(digest);
+    }
+    return hash.result();
+}
+
 #endif // CONTACTDELTA_IMPL_H
 
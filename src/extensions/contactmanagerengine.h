@@ -33,10 +33,14 @@
 #ifndef CONTACTMANAGERENGINE_H
 #define CONTACTMANAGERENGINE_H
 
+#include "contactsnapshot.h"
+
 #include <QContactManagerEngine>
 
 QT_BEGIN_NAMESPACE_CONTACTS
 class QContactDetailFetchRequest;
+class QContactPageFetchRequest;
+class QContactCountRequest;
 class QContactChangesFetchRequest;
 class QContactCollectionChangesFetchRequest;
 class QContactChangesSaveRequest;
@@ -58,6 +62,18 @@ namespace QtContactsSqliteExtensions {
  *                           the privileged database will be preferred if accessible.
  *  'autoTest'             - if true, an alternate database path is accessed, separate to the
  *                           path used by non-auto-test applications
+ *  'yieldSyncTransactions' - if true, storeChanges() commits the changes stored so far whenever
+ *                           another writer is waiting for the database, rather than holding the
+ *                           write lock until all changes are stored.  The changes are then not
+ *                           stored atomically.
+ *  'contactCacheSize'     - if set, up to this many contacts fetched by id are retained in memory,
+ *                           and later fetches of the same contacts with the same fetch hint are
+ *                           served without reading the database.  Cached contacts are discarded
+ *                           when changes to them are reported.
+ *  'contactSnapshot'      - if true, the engine populates the snapshot of contact summaries shared
+ *                           between processes when it is not available, so that
+ *                           fetchContactSnapshots() can be served without querying the database.
+ *                           Once populated, the snapshot is maintained by every writer.
  */
 
 class Q_DECL_EXPORT ContactManagerEngine
@@ -121,8 +137,29 @@ public:
 
     virtual QStringList displayLabelGroups() = 0;
 
+    // for diagnostic purposes: the time spent (in microseconds) in each phase of opening the database
+    virtual QList<QPair<QString, qint64> > startupTimings() const = 0;
+
+    // for diagnostic purposes: the number of cross-process write lock acquisitions, and the time
+    // (in microseconds) spent waiting for and holding the lock, with histograms of each
+    virtual QList<QPair<QString, qint64> > writeLockStatistics() const = 0;
+
+    // for diagnostic purposes: the number of filter queries whose SQL was reused, generated,
+    // or could not be cached, and the number of distinct filter shapes retained
+    virtual QList<QPair<QString, qint64> > filterCacheStatistics() const = 0;
+
+    // for diagnostic purposes: the number of contacts fetched by id which were served from
+    // the contact cache or read from the database, and the number of cached contacts
+    virtual QList<QPair<QString, qint64> > contactCacheStatistics() const = 0;
+
+    // summaries of all visible contacts from the shared snapshot; returns false if the snapshot
+    // is not available, and cannot be populated by this engine
+    virtual bool fetchContactSnapshots(QList<ContactSnapshot> *snapshots) = 0;
+
     virtual void requestDestroyed(QObject* request) = 0;
     virtual bool startRequest(QContactDetailFetchRequest* request) = 0;
+    virtual bool startRequest(QContactPageFetchRequest* request) = 0;
+    virtual bool startRequest(QContactCountRequest* request) = 0;
     virtual bool startRequest(QContactCollectionChangesFetchRequest* request) = 0;
     virtual bool startRequest(QContactChangesFetchRequest* request) = 0;
     virtual bool startRequest(QContactChangesSaveRequest* request) = 0;
@@ -134,6 +171,9 @@ Q_SIGNALS:
     void contactsPresenceChanged(const QList<QContactId> &contactsIds);
     void collectionContactsChanged(const QList<QContactCollectionId> &collectionIds);
     void displayLabelGroupsChanged(const QStringList &groups);
+    // Reported while the database is upgraded: 'schema' counts the schema versions applied,
+    // 'displayLabelGroups' counts the contacts whose display label group has been regenerated.
+    void upgradeProgress(const QString &task, int completed, int total);
 
 protected:
     bool m_nonprivileged;
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+
+#ifndef CONTACTSNAPSHOT_H
+#define CONTACTSNAPSHOT_H
+
+#include <QContactId>
+#include <QContactPresence>
+
+#include <QString>
+#include <QStringList>
+
+QTCONTACTS_USE_NAMESPACE
+
+namespace QtContactsSqliteExtensions {
+
+/*
+   A summary of the details of a contact, as held in the contact
+   snapshot shared between processes.  The snapshot holds a summary
+   of each contact which would be returned by an unfiltered fetch.
+
+   The phone numbers and email addresses are in the order of the
+   details of the contact; the avatar URL is that of the first
+   avatar detail.
+*/
+struct ContactSnapshot
+{
+    ContactSnapshot() : presenceState(QContactPresence::PresenceUnknown) {}
+
+    QContactId id;
+    QString displayLabel;
+    QString displayLabelGroup;
+    QString firstName;
+    QString lastName;
+    QStringList phoneNumbers;
+    QStringList emailAddresses;
+    QString avatarUrl;
+    QContactPresence::PresenceState presenceState;
+};
+
+} // namespace QtContactsSqliteExtensions
+
+#endif
@@ -48,6 +48,18 @@ namespace QtContactsSqliteExtensions {
 
    However, for languages other than English, other forms
    of grouping are required.
+
+   Generator plugins should describe themselves in their
+   plugin metadata, e.g.:
+     Q_PLUGIN_METADATA(IID QtContactsSqliteExtensions_DisplayLabelGroupGeneratorInterface_iid FILE "generator.json")
+   where generator.json contains:
+     { "name": "mygenerator", "priority": 2, "locales": [ "zh", "ja_JP" ] }
+   The name and priority must match those reported by the
+   generator.  The locales list (which may be empty, if the
+   generator may be valid for any locale) names the locales or
+   languages for which validForLocale() can return true.
+   Plugins which provide this metadata are only loaded when
+   they are needed.
 */
 
 class DisplayLabelGroupGenerator
@@ -50,12 +50,28 @@ public:
     QContactChangesFetchRequest(QObject *parent = nullptr);
     ~QContactChangesFetchRequest() override;
 
+    enum UnmodifiedContactsPolicy {
+        FetchUnmodifiedContacts = 0,    // report unmodified contacts in full
+        FetchUnmodifiedContactIds,      // report only the ids of unmodified contacts
+        IgnoreUnmodifiedContacts        // report added, modified and removed contacts only
+    };
+
     QContactManager *manager() const;
     void setManager(QContactManager *manager);
 
     QContactCollectionId collectionId() const;
     void setCollectionId(const QContactCollectionId &id);
 
+    UnmodifiedContactsPolicy unmodifiedContactsPolicy() const;
+    void setUnmodifiedContactsPolicy(UnmodifiedContactsPolicy policy);
+
+    // If non-zero, each run of the request reports at most this many contacts.
+    // The request must be started again to retrieve the next page while
+    // hasMorePages() is true; the change flags are only reset by the first page.
+    int pageSize() const;
+    void setPageSize(int size);
+    bool hasMorePages() const;
+
     QContactAbstractRequest::State state() const;
     QContactManager::Error error() const;
 
@@ -63,6 +79,7 @@ public:
     QList<QContact> modifiedContacts() const;
     QList<QContact> removedContacts() const;
     QList<QContact> unmodifiedContacts() const;
+    QList<QContactId> unmodifiedContactIds() const;
 
 public Q_SLOTS:
     bool start();
@@ -69,9 +69,42 @@ QContactCollectionId QContactChangesFetchRequest::collectionId() const
 
 void QContactChangesFetchRequest::setCollectionId(const QContactCollectionId &id)
 {
+    if (d_ptr->collectionId != id) {
+        // any outstanding pages belong to the previous collection
+        d_ptr->pendingAddedContactIds.clear();
+        d_ptr->pendingModifiedContactIds.clear();
+        d_ptr->pendingRemovedContactIds.clear();
+        d_ptr->pendingUnmodifiedContactIds.clear();
+        d_ptr->morePages = false;
+    }
     d_ptr->collectionId = id;
 }
 
+QContactChangesFetchRequest::UnmodifiedContactsPolicy QContactChangesFetchRequest::unmodifiedContactsPolicy() const
+{
+    return d_ptr->unmodifiedContactsPolicy;
+}
+
+void QContactChangesFetchRequest::setUnmodifiedContactsPolicy(UnmodifiedContactsPolicy policy)
+{
+    d_ptr->unmodifiedContactsPolicy = policy;
+}
+
+int QContactChangesFetchRequest::pageSize() const
+{
+    return d_ptr->pageSize;
+}
+
+void QContactChangesFetchRequest::setPageSize(int size)
+{
+    d_ptr->pageSize = qMax(size, 0);
+}
+
+bool QContactChangesFetchRequest::hasMorePages() const
+{
+    return d_ptr->morePages;
+}
+
 QContactAbstractRequest::State QContactChangesFetchRequest::state() const
 {
     return d_ptr->state;
@@ -102,6 +135,11 @@ QList<QContact> QContactChangesFetchRequest::unmodifiedContacts() const
     return d_ptr->unmodifiedContacts;
 }
 
+QList<QContactId> QContactChangesFetchRequest::unmodifiedContactIds() const
+{
+    return d_ptr->unmodifiedContactIds;
+}
+
 bool QContactChangesFetchRequest::start()
 {
     if (d_ptr->state == QContactAbstractRequest::ActiveState) {
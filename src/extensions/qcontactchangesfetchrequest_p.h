@@ -59,12 +59,22 @@ public:
 
     QPointer<QContactManager> manager;
     QContactCollectionId collectionId;
+    QContactChangesFetchRequest::UnmodifiedContactsPolicy unmodifiedContactsPolicy = QContactChangesFetchRequest::FetchUnmodifiedContacts;
+    int pageSize = 0;
     QContactAbstractRequest::State state = QContactAbstractRequest::InactiveState;
     QContactManager::Error error = QContactManager::NoError;
     QList<QContact> addedContacts;
     QList<QContact> modifiedContacts;
     QList<QContact> removedContacts;
     QList<QContact> unmodifiedContacts;
+    QList<QContactId> unmodifiedContactIds;
+
+    // ids of the contacts still to be reported by subsequent pages
+    QList<QContactId> pendingAddedContactIds;
+    QList<QContactId> pendingModifiedContactIds;
+    QList<QContactId> pendingRemovedContactIds;
+    QList<QContactId> pendingUnmodifiedContactIds;
+    bool morePages = false;
 };
 
 QT_END_NAMESPACE_CONTACTS
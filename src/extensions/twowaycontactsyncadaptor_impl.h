@@ -829,23 +829,104 @@ bool TwoWayContactSyncAdaptor::determineRemoteContacts(const QContactCollection
     return false;
 }
 
-static QContact findMatchingContact(const QContact &contact, const QList<QContact> &contacts)
+namespace {
+
+// Indexes a list of contacts by id, GUID and sync target, so that each
+// remote contact can be matched against the local contacts without
+// scanning the whole list.  Matching follows the same rules as a linear
+// scan: by id if the remote contact has one, otherwise the first contact
+// in the list whose GUID or sync target matches.
+class ContactMatchIndex
 {
-    for (const QContact &c : contacts) {
-        if (!contact.id().isNull() && contact.id() == c.id()) {
-            return c;
-        } else if (contact.id().isNull()) {
-            if (!contact.detail<QContactGuid>().guid().isEmpty()
-                    && contact.detail<QContactGuid>().guid() == c.detail<QContactGuid>().guid()) {
-                return c;
-            } else if (!contact.detail<QContactSyncTarget>().syncTarget().isEmpty()
-                    && contact.detail<QContactSyncTarget>().syncTarget() == c.detail<QContactSyncTarget>().syncTarget()) {
-                return c;
+public:
+    explicit ContactMatchIndex(const QList<QContact> &contacts)
+    {
+        m_removed.reserve(contacts.size());
+        for (const QContact &contact : contacts) {
+            append(contact);
+        }
+    }
+
+    void append(const QContact &contact)
+    {
+        const int index = m_removed.size();
+        m_removed.append(false);
+
+        if (!contact.id().isNull()) {
+            m_ids[contact.id()].indexes.append(index);
+        }
+        const QString guid = contact.detail<QContactGuid>().guid();
+        if (!guid.isEmpty()) {
+            m_guids[guid].indexes.append(index);
+        }
+        const QString syncTarget = contact.detail<QContactSyncTarget>().syncTarget();
+        if (!syncTarget.isEmpty()) {
+            m_syncTargets[syncTarget].indexes.append(index);
+        }
+    }
+
+    // Returns the list position of the matching contact, or -1.
+    int indexOf(const QContact &contact)
+    {
+        if (!contact.id().isNull()) {
+            return first(&m_ids, contact.id());
+        }
+
+        int index = -1;
+        const QString guid = contact.detail<QContactGuid>().guid();
+        if (!guid.isEmpty()) {
+            index = first(&m_guids, guid);
+        }
+        const QString syncTarget = contact.detail<QContactSyncTarget>().syncTarget();
+        if (!syncTarget.isEmpty()) {
+            const int syncTargetIndex = first(&m_syncTargets, syncTarget);
+            if (syncTargetIndex != -1 && (index == -1 || syncTargetIndex < index)) {
+                index = syncTargetIndex;
             }
         }
+        return index;
+    }
+
+    // Excludes the contact at the given list position from further matches.
+    void remove(int index)
+    {
+        m_removed[index] = true;
+    }
+
+    bool isRemoved(int index) const
+    {
+        return m_removed.at(index);
+    }
+
+private:
+    struct Positions {
+        QVector<int> indexes;
+        int head = 0;
+    };
+
+    template<typename Key>
+    int first(QHash<Key, Positions> *hash, const Key &key)
+    {
+        typename QHash<Key, Positions>::iterator it = hash->find(key);
+        if (it == hash->end()) {
+            return -1;
+        }
+
+        // removed contacts are skipped once, then never examined again.
+        Positions &positions(*it);
+        while (positions.head < positions.indexes.size()
+                && m_removed.at(positions.indexes.at(positions.head))) {
+            ++positions.head;
+        }
+        return positions.head < positions.indexes.size() ? positions.indexes.at(positions.head) : -1;
     }
 
-    return QContact();
+    QHash<QContactId, Positions> m_ids;
+    QHash<QString, Positions> m_guids;
+    QHash<QString, Positions> m_syncTargets;
+    QVector<bool> m_removed;
+};
+
 }
 
 static QContact contactWithId(const QContact &contact, const QContactId &id)
@@ -878,67 +959,70 @@ void TwoWayContactSyncAdaptor::remoteContactsDetermined(
 
     TwoWayContactSyncAdaptorPrivate::ContactChanges &localChanges(d->m_localContactChanges[collection.id()]);
 
+    const IgnorableDetailsAndFields ignorable = ignorableDetailsAndFields();
+
+    ContactMatchIndex addedIndex(localChanges.addedContacts);
+    ContactMatchIndex removedIndex(localChanges.removedContacts);
+    ContactMatchIndex modifiedIndex(localChanges.modifiedContacts);
+    ContactMatchIndex unmodifiedIndex(localChanges.unmodifiedContacts);
+
     for (const QContact &contact : contacts) {
         bool matchFound = false;
 
         // first, search local additions for a matching contact.
         // this can happen if an error occurred after the local additions were
         // successfully pushed to the server, during the previous sync cycle.
-        QList<QContact>::iterator ait = localChanges.addedContacts.begin(),
-                                 aend = localChanges.addedContacts.end();
-        while (ait != aend && !matchFound) {
-            if (!contact.id().isNull() && contact.id() == ait->id()) {
-                matchFound = true;
-            } else if (contact.id().isNull()) {
-                if (!contact.detail<QContactGuid>().guid().isEmpty()
-                        && contact.detail<QContactGuid>().guid() == ait->detail<QContactGuid>().guid()) {
-                    matchFound = true;
-                } else if (!contact.detail<QContactSyncTarget>().syncTarget().isEmpty()
-                        && contact.detail<QContactSyncTarget>().syncTarget() == ait->detail<QContactSyncTarget>().syncTarget()) {
-                    matchFound = true;
-                }
-            }
-
-            if (matchFound) {
-                // treat the matching local addition as a remote modification instead.
-                // TODO: perform per-detail delta detection, to determine precise changes.
-                handledContactIds.insert(ait->id());
-                localChanges.modifiedContacts.append(*ait);
-                remoteModifications.append(contactWithId(contact, ait->id()));
-                ait = localChanges.addedContacts.erase(ait);
-            } else {
-                ++ait;
-            }
+        const int addedIdx = addedIndex.indexOf(contact);
+        if (addedIdx != -1) {
+            // treat the matching local addition as a remote modification instead.
+            // TODO: perform per-detail delta detection, to determine precise changes.
+            const QContact &added(localChanges.addedContacts.at(addedIdx));
+            matchFound = true;
+            handledContactIds.insert(added.id());
+            localChanges.modifiedContacts.append(added);
+            modifiedIndex.append(added);
+            remoteModifications.append(contactWithId(contact, added.id()));
+            addedIndex.remove(addedIdx);
         }
 
         if (!matchFound) {
-            const QContact c = findMatchingContact(contact, localChanges.removedContacts);
-            if (!c.id().isNull()) {
+            const int idx = removedIndex.indexOf(contact);
+            if (idx != -1) {
                 // this contact will be deleted locally anyway.  treat as remote unmodified.
                 matchFound = true;
-                handledContactIds.insert(c.id());
+                handledContactIds.insert(localChanges.removedContacts.at(idx).id());
             }
         }
 
         if (!matchFound) {
-            const QContact c = findMatchingContact(contact, localChanges.modifiedContacts);
-            if (!c.id().isNull()) {
+            const int idx = modifiedIndex.indexOf(contact);
+            if (idx != -1) {
                 // assume that the remote contact is unmodified, so the local
                 // change will be preserved.
                 // TODO: perform per-detail delta detection, to determine precise changes.
                 matchFound = true;
-                handledContactIds.insert(c.id());
+                handledContactIds.insert(localChanges.modifiedContacts.at(idx).id());
             }
         }
 
         if (!matchFound) {
-            const QContact c = findMatchingContact(contact, localChanges.unmodifiedContacts);
-            if (!c.id().isNull()) {
-                // assume that the remote contact is modified.
-                // TODO: perform per-detail delta detection, to determine precise changes.
+            const int idx = unmodifiedIndex.indexOf(contact);
+            if (idx != -1) {
+                const QContact &local(localChanges.unmodifiedContacts.at(idx));
                 matchFound = true;
-                handledContactIds.insert(c.id());
-                remoteModifications.append(contactWithId(contact, c.id()));
+                handledContactIds.insert(local.id());
+
+                // if the content is identical, the remote contact is unmodified and
+                // needs no further delta detection or storage.  otherwise, assume
+                // that the remote contact is modified.
+                // TODO: perform per-detail delta detection, to determine precise changes.
+                const QByteArray remoteFingerprint = contactContentFingerprint(
+                        contact, ignorable.detailTypes, ignorable.detailFields, ignorable.commonFields);
+                const QByteArray localFingerprint = contactContentFingerprint(
+                        local, ignorable.detailTypes, ignorable.detailFields, ignorable.commonFields);
+                if (remoteFingerprint.isEmpty() || remoteFingerprint != localFingerprint) {
+                    remoteModifications.append(contactWithId(contact, local.id()));
+                }
             }
         }
 
@@ -952,6 +1036,15 @@ void TwoWayContactSyncAdaptor::remoteContactsDetermined(
         }
     }
 
+    // local additions which were matched have been moved to the local modifications.
+    QList<QContact> remainingAdditions;
+    for (int i = 0; i < localChanges.addedContacts.size(); ++i) {
+        if (!addedIndex.isRemoved(i)) {
+            remainingAdditions.append(localChanges.addedContacts.at(i));
+        }
+    }
+    localChanges.addedContacts = remainingAdditions;
+
     // now check the local modified/unmodified contacts:
     // any which we haven't seen, must have been deleted remotely.
     QList<QContact>::iterator it = localChanges.modifiedContacts.begin(),
@@ -1038,26 +1131,25 @@ void TwoWayContactSyncAdaptor::remoteContactChangesDetermined(
         haveLocalChanges = !localChanges.addedContacts.isEmpty()
                         || !localChanges.removedContacts.isEmpty();
         // resolve conflicts between local and remote changes
+        QHash<QContactId, int> remoteModificationIndexes;
+        for (int i = remotelyModifiedContacts.size() - 1; i >= 0; --i) {
+            remoteModificationIndexes.insert(remotelyModifiedContacts.at(i).id(), i);
+        }
         QList<QContact> localModifications;
         for (const QContact &c : localChanges.modifiedContacts) {
-            bool foundMatch = false;
-            for (const QContact &r : remotelyModifiedContacts) {
-                if (c.id() == r.id()) {
-                    bool identical = false;
-                    QContact resolved = resolveConflictingChanges(c, r, &identical);
-                    if (!identical) {
-                        haveLocalChanges = true;
-                        localModifications.append(resolved);
-                        QContact modified = resolved;
-                        setContactChangeFlags(modified, QContactStatusFlags::IsModified);
-                        remoteModifications.append(modified);
-                    }
-                    handledContactIds.insert(c.id());
-                    foundMatch = true;
-                    break;
+            const int remoteIdx = remoteModificationIndexes.value(c.id(), -1);
+            if (remoteIdx != -1) {
+                bool identical = false;
+                QContact resolved = resolveConflictingChanges(c, remotelyModifiedContacts.at(remoteIdx), &identical);
+                if (!identical) {
+                    haveLocalChanges = true;
+                    localModifications.append(resolved);
+                    QContact modified = resolved;
+                    setContactChangeFlags(modified, QContactStatusFlags::IsModified);
+                    remoteModifications.append(modified);
                 }
-            }
-            if (!foundMatch) {
+                handledContactIds.insert(c.id());
+            } else {
                 haveLocalChanges = true;
                 localModifications.append(c);
             }
@@ -1076,23 +1168,24 @@ void TwoWayContactSyncAdaptor::remoteContactChangesDetermined(
         setContactChangeFlags(deleted, QContactStatusFlags::IsDeleted);
         remoteRemovals.append(deleted);
     }
+    const QList<QContact> unmodifiedContacts(d->m_localContactChanges.value(collection.id()).unmodifiedContacts);
+    QHash<QContactId, int> unmodifiedIndexes;
+    for (int i = unmodifiedContacts.size() - 1; i >= 0; --i) {
+        unmodifiedIndexes.insert(unmodifiedContacts.at(i).id(), i);
+    }
     for (const QContact &r : remotelyModifiedContacts) {
         if (!handledContactIds.contains(r.id())) {
-            bool foundMatch = false;
-            for (const QContact &c : d->m_localContactChanges[collection.id()].unmodifiedContacts) {
-                if (c.id() == r.id()) {
-                    foundMatch = true;
-                    handledContactIds.insert(c.id());
-                    bool identical = false;
-                    QContact resolved = resolveConflictingChanges(c, r, &identical);
-                    if (!identical) {
-                        setContactChangeFlags(resolved, QContactStatusFlags::IsModified);
-                        remoteModifications.append(resolved);
-                    }
-                    break;
+            const int localIdx = unmodifiedIndexes.value(r.id(), -1);
+            if (localIdx != -1) {
+                const QContact &c(unmodifiedContacts.at(localIdx));
+                handledContactIds.insert(c.id());
+                bool identical = false;
+                QContact resolved = resolveConflictingChanges(c, r, &identical);
+                if (!identical) {
+                    setContactChangeFlags(resolved, QContactStatusFlags::IsModified);
+                    remoteModifications.append(resolved);
                 }
-            }
-            if (!foundMatch) {
+            } else {
                 QContact modified = r;
                 setContactChangeFlags(modified, QContactStatusFlags::IsModified);
                 remoteModifications.append(modified);
@@ -21,6 +21,14 @@ EXTENSION_REQUESTS = \
     extensions/qcontactdetailfetchrequest.h \
     extensions/qcontactdetailfetchrequest_p.h \
     extensions/qcontactdetailfetchrequest_impl.h \
+    extensions/QContactPageFetchRequest \
+    extensions/qcontactpagefetchrequest.h \
+    extensions/qcontactpagefetchrequest_p.h \
+    extensions/qcontactpagefetchrequest_impl.h \
+    extensions/QContactCountRequest \
+    extensions/qcontactcountrequest.h \
+    extensions/qcontactcountrequest_p.h \
+    extensions/qcontactcountrequest_impl.h \
     extensions/QContactCollectionChangesFetchRequest \
     extensions/qcontactcollectionchangesfetchrequest.h \
     extensions/qcontactcollectionchangesfetchrequest_p.h \
@@ -49,6 +57,7 @@ OTHER_FILES = \
     extensions/contactmanagerengine.h \
     extensions/contactdelta.h \
     extensions/contactdelta_impl.h \
+    extensions/contactsnapshot.h \
     extensions/qtcontacts-extensions.h \
     extensions/qtcontacts-extensions_impl.h \
     extensions/qtcontacts-extensions_manager_impl.h \
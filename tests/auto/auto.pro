@@ -9,5 +9,6 @@ SUBDIRS = \
     database \
     displaylabelgroups \
     detailfetchrequest \
+    pagefetchrequest \
     synctransactions
 
@@ -2,7 +2,7 @@ TARGET = tst_database
 
 include(../../common.pri)
 
-QT += sql
+QT += sql dbus
 
 # copied from src/engine/engine.pro, modified for test db
 DEFINES += 'QTCONTACTS_SQLITE_PRIVILEGED_DIR=\'\"privileged\"\''
@@ -16,6 +16,18 @@ INCLUDEPATH += \
 HEADERS += ../../../src/engine/contactsdatabase.h
 SOURCES += ../../../src/engine/contactsdatabase.cpp
 
+HEADERS += ../../../src/engine/contactreader.h
+SOURCES += ../../../src/engine/contactreader.cpp
+
+HEADERS += ../../../src/engine/contactcache.h
+SOURCES += ../../../src/engine/contactcache.cpp
+
+HEADERS += ../../../src/engine/contactnotifier.h
+SOURCES += ../../../src/engine/contactnotifier.cpp
+
+HEADERS += ../../../src/engine/contactid_p.h
+SOURCES += ../../../src/engine/contactid.cpp
+
 HEADERS += ../../../src/engine/semaphore_p.h
 SOURCES += ../../../src/engine/semaphore_p.cpp
 
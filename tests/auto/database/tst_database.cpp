@@ -33,12 +33,30 @@
 
 #include <QtTest/QtTest>
 #include "../../../src/engine/contactsdatabase.h"
+#include "../../../src/engine/contactreader.h"
+
+#include <QContactDetailFilter>
+#include <QContactDisplayLabel>
+#include <QContactName>
+#include <QContactSortOrder>
+
+#include <QMutex>
+#include <QRegularExpression>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QThread>
+
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 class tst_Database  : public QObject
 {
     Q_OBJECT
 
 protected slots:
+    void initTestCase();
     void init();
     void cleanup();
 
@@ -48,11 +66,31 @@ private slots:
     void fromDateTimeString_speed();
     void fromDateTimeString_tz_speed();
     void fromDateTimeString_isodate_speed();
+    void visibilityQueryPlan_data();
+    void visibilityQueryPlan();
+    void resumeDeferredUpgrade();
+    void contactSnapshotInvalidation();
+    void writeLockTimeout();
+    void writeLockTicketOrder();
+    void writeLockQueueOverflow();
+    void writeLockTerminatedWaiter();
 
 private:
     char *old_TZ;
 };
 
+// The write lock timeout and query plan logging are read once, so they must be set before any
+// transaction begins
+static const int testWriteLockTimeout = 500;
+
+void tst_Database::initTestCase()
+{
+    qputenv("QTCONTACTS_SQLITE_WRITE_LOCK_TIMEOUT", QByteArray::number(testWriteLockTimeout));
+
+    // Query plans are logged as each statement is executed, and collected by visibilityQueryPlan
+    qputenv("QTCONTACTS_SQLITE_DEBUG_QUERY_PLANS", "1");
+}
+
 void tst_Database::init()
 {
     old_TZ = getenv("TZ");
@@ -173,5 +211,431 @@ void tst_Database::fromDateTimeString_isodate_speed()
     }
 }
 
+namespace {
+
+// Collects the plan which the database logs for the reader's contact ID selection
+QtMessageHandler previousMessageHandler = 0;
+bool collectingPlan = false;
+QStringList collectedPlan;
+
+void collectQueryPlan(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    if (type == QtDebugMsg) {
+        if (message.startsWith(QStringLiteral("Query plan for: "))) {
+            collectingPlan = message.contains(QStringLiteral("SELECT DISTINCT Contacts.contactId"));
+            if (collectingPlan) {
+                collectedPlan.clear();
+            }
+            return;
+        }
+        if (message.startsWith(QStringLiteral("    "))) {
+            if (collectingPlan) {
+                collectedPlan.append(message.mid(4));
+            }
+            return;
+        }
+    }
+    previousMessageHandler(type, context, message);
+}
+
+}
+
+void tst_Database::visibilityQueryPlan_data()
+{
+    QTest::addColumn<bool>("aggregating");
+    QTest::addColumn<bool>("sorted");
+    QTest::addColumn<bool>("filtered");
+    QTest::addColumn<QString>("index");
+
+    QTest::newRow("aggregate ids") << true << false << false
+        << QStringLiteral("COVERING INDEX ContactsVisibleAggregatesIndex");
+    QTest::newRow("sorted aggregate ids") << true << true << false
+        << QStringLiteral("COVERING INDEX ContactsVisibleAggregatesIndex");
+    QTest::newRow("filtered aggregate ids") << true << false << true
+        << QStringLiteral("COVERING INDEX ContactsVisibleAggregatesIndex");
+    QTest::newRow("visible ids") << false << false << false
+        << QStringLiteral("COVERING INDEX ContactsVisibleIndex");
+}
+
+void tst_Database::visibilityQueryPlan()
+{
+    QFETCH(bool, aggregating);
+    QFETCH(bool, sorted);
+    QFETCH(bool, filtered);
+    QFETCH(QString, index);
+
+    // The plans depend on the seeded statistics, which SQLite only loads
+    // when a connection is opened; ensure the database exists beforehand
+    {
+        ContactsDatabase creator(0);
+        QVERIFY(creator.open(QStringLiteral("qtcontacts-sqlite-test-queryplan-create"), !aggregating, true));
+    }
+
+    ContactsDatabase database(0);
+    QVERIFY(database.open(QStringLiteral("qtcontacts-sqlite-test-queryplan"), !aggregating, true));
+    QCOMPARE(database.aggregating(), aggregating);
+
+    QContactDetailFilter filter;
+    if (filtered) {
+        filter.setDetailType(QContactName::Type, QContactName::FieldFirstName);
+        filter.setValue(QStringLiteral("Bob"));
+        filter.setMatchFlags(QContactFilter::MatchFixedString);
+    }
+    QList<QContactSortOrder> sorting;
+    if (sorted) {
+        QContactSortOrder displayLabelSort;
+        displayLabelSort.setDetailType(QContactDisplayLabel::Type, QContactDisplayLabel::FieldLabel);
+        sorting.append(displayLabelSort);
+    }
+
+    // Explain the statement which the reader executes, with its bindings
+    ContactReader reader(database, QStringLiteral("qtcontacts:org.nemomobile.contacts.sqlite:"));
+    QList<QContactId> contactIds;
+    collectedPlan.clear();
+    previousMessageHandler = qInstallMessageHandler(collectQueryPlan);
+    const QContactManager::Error error = reader.readContactIds(&contactIds, filtered ? QContactFilter(filter) : QContactFilter(), sorting);
+    qInstallMessageHandler(previousMessageHandler);
+    collectingPlan = false;
+    QCOMPARE(error, QContactManager::NoError);
+
+    const QStringList plan(collectedPlan);
+    QVERIFY(!plan.isEmpty());
+
+    // The visibility constraints must be resolved without visiting the Contacts table
+    const QString contactsStep(plan.filter(QStringLiteral(" Contacts ")).value(0));
+    QVERIFY2(contactsStep.contains(index), qPrintable(plan.join(QStringLiteral("\n"))));
+}
+
+static int queryCount(QSqlDatabase &database, const QString &statement)
+{
+    QSqlQuery query(database);
+    if (!query.exec(statement) || !query.next()) {
+        qWarning() << "Failed to count:" << query.lastError().text() << statement;
+        return -1;
+    }
+    return query.value(0).toInt();
+}
+
+static QString regenerationCursor(QSqlDatabase &database)
+{
+    QSqlQuery query(database);
+    if (!query.exec(QStringLiteral("SELECT Value FROM DbSettings WHERE Name = 'DisplayLabelGroupRegeneration'")) || !query.next()) {
+        return QString();
+    }
+    return query.value(0).toString();
+}
+
+void tst_Database::resumeDeferredUpgrade()
+{
+    const QString connectionName(QStringLiteral("qtcontacts-sqlite-test-deferredupgrade"));
+    const int contactCount = 1200;
+    const int chunkSize = 500;
+    int total = 0;
+
+    // Populate contacts whose display label groups have not been generated, as
+    // after an upgrade from a schema which did not store them
+    {
+        ContactsDatabase database(0);
+        QVERIFY(database.open(connectionName, true, true));
+        QSqlDatabase &db(database);
+
+        QVERIFY(database.beginTransaction());
+        QSqlQuery query(db);
+        QVERIFY(query.exec(QStringLiteral("DELETE FROM Contacts WHERE contactId > 2")));
+        QVERIFY(query.prepare(QStringLiteral("INSERT INTO Contacts (collectionId) VALUES (?)")));
+        QVariantList collectionIds;
+        for (int i = 0; i < contactCount; ++i) {
+            collectionIds.append(2);
+        }
+        query.addBindValue(collectionIds);
+        QVERIFY(query.execBatch());
+        QVERIFY(query.exec(QStringLiteral(
+                "INSERT OR REPLACE INTO DisplayLabels (contactId, displayLabel)"
+                " SELECT contactId, 'Contact ' || contactId FROM Contacts WHERE contactId > 2")));
+        QVERIFY(query.exec(QStringLiteral(
+                "INSERT OR REPLACE INTO DbSettings (Name, Value) VALUES ('DisplayLabelGroupRegeneration', '0')")));
+        QVERIFY(database.commitTransaction());
+
+        total = queryCount(db, QStringLiteral("SELECT COUNT(*) FROM Contacts"));
+        QVERIFY(total > contactCount);
+    }
+
+    // Process a single chunk, then stop as if the process were killed
+    {
+        ContactsDatabase database(0);
+        QVERIFY(database.open(connectionName, true, true));
+        QSqlDatabase &db(database);
+        QVERIFY(database.deferredUpgradeDue());
+
+        int completed = 0;
+        int reportedTotal = 0;
+        QVERIFY(database.performDeferredUpgrade(&completed, &reportedTotal));
+        QCOMPARE(completed, chunkSize);
+        QCOMPARE(reportedTotal, total);
+        QVERIFY(database.deferredUpgradeDue());
+
+        // The progress is stored, and only the contacts after it remain without groups
+        const QString cursor(regenerationCursor(db));
+        QVERIFY(!cursor.isEmpty());
+        QCOMPARE(queryCount(db, QStringLiteral("SELECT COUNT(*) FROM DisplayLabels WHERE displayLabelGroup IS NULL")),
+                 queryCount(db, QStringLiteral("SELECT COUNT(*) FROM DisplayLabels WHERE contactId > %1").arg(cursor)));
+        QCOMPARE(queryCount(db, QStringLiteral("SELECT COUNT(*) FROM DisplayLabels WHERE displayLabelGroup IS NULL AND contactId <= %1").arg(cursor)), 0);
+    }
+
+    // A new connection resumes from the stored progress; each step reports the
+    // progress which the job thread emits via upgradeProgress
+    {
+        ContactsDatabase database(0);
+        QVERIFY(database.open(connectionName, true, true));
+        QSqlDatabase &db(database);
+        QVERIFY(database.deferredUpgradeDue());
+
+        QList<int> progress;
+        while (database.deferredUpgradeDue()) {
+            int completed = 0;
+            int reportedTotal = 0;
+            QVERIFY(database.performDeferredUpgrade(&completed, &reportedTotal));
+            QCOMPARE(reportedTotal, total);
+            progress.append(completed);
+            QVERIFY(progress.count() <= (total / chunkSize) + 1);
+        }
+
+        QList<int> expected;
+        for (int completed = 2 * chunkSize; completed < total; completed += chunkSize) {
+            expected.append(completed);
+        }
+        expected.append(total);
+        QCOMPARE(progress, expected);
+
+        QVERIFY(regenerationCursor(db).isEmpty());
+        QCOMPARE(queryCount(db, QStringLiteral("SELECT COUNT(*) FROM DisplayLabels WHERE displayLabelGroup IS NULL")), 0);
+    }
+
+    // Nothing remains to be done by later connections
+    {
+        ContactsDatabase database(0);
+        QVERIFY(database.open(connectionName, true, true));
+        QVERIFY(!database.deferredUpgradeDue());
+
+        QSqlDatabase &db(database);
+        QVERIFY(database.beginTransaction());
+        QSqlQuery query(db);
+        QVERIFY(query.exec(QStringLiteral("DELETE FROM Contacts WHERE contactId > 2")));
+        QVERIFY(database.commitTransaction());
+    }
+}
+
+void tst_Database::contactSnapshotInvalidation()
+{
+    const QString connectionName(QStringLiteral("qtcontacts-sqlite-test-snapshot"));
+
+    ContactsDatabase database(0);
+    QVERIFY(database.open(connectionName, true, true));
+
+    // The snapshot is shared with every other connection to the database
+    ContactsDatabase other(0);
+    QVERIFY(other.open(connectionName + QStringLiteral("-other"), true, true, true));
+
+    QVERIFY(database.populateContactSnapshot());
+    QVERIFY(database.contactSnapshotComplete());
+    QVERIFY(other.contactSnapshotComplete());
+
+    // Regenerating the display label groups for a different locale invalidates the snapshot
+    const QLocale originalLocale;
+    QLocale::setDefault(QLocale(originalLocale.name() == QStringLiteral("fi_FI") ? QLocale::English : QLocale::Finnish));
+    database.regenerateDisplayLabelGroups();
+    QVERIFY(!database.contactSnapshotComplete());
+    QVERIFY(!other.contactSnapshotComplete());
+
+    // As does a deferred regeneration, continued by another connection
+    QVERIFY(other.populateContactSnapshot());
+    QVERIFY(database.contactSnapshotComplete());
+    {
+        QSqlDatabase &db(database);
+        QVERIFY(database.beginTransaction());
+        QSqlQuery query(db);
+        QVERIFY(query.exec(QStringLiteral(
+                "INSERT OR REPLACE INTO DbSettings (Name, Value) VALUES ('DisplayLabelGroupRegeneration', '0')")));
+        QVERIFY(database.commitTransaction());
+    }
+    int completed = 0;
+    int total = 0;
+    QVERIFY(other.performDeferredUpgrade(&completed, &total));
+    QCOMPARE(completed, total);
+    QVERIFY(!database.contactSnapshotComplete());
+
+    QLocale::setDefault(originalLocale);
+    database.regenerateDisplayLabelGroups();
+}
+
+namespace {
+
+// Waits for the write lock on its own connection, and records when it was granted
+class WriteLockWaiter : public QThread
+{
+public:
+    WriteLockWaiter(const QString &path, int identifier, QList<int> *order, QMutex *orderMutex)
+        : m_path(path), m_identifier(identifier), m_order(order), m_orderMutex(orderMutex), m_locked(false)
+    {
+    }
+
+    bool locked() const { return m_locked; }
+
+protected:
+    void run() override
+    {
+        ContactsDatabase::ProcessMutex mutex(m_path);
+        m_locked = mutex.lock(20000);
+        if (m_locked) {
+            {
+                QMutexLocker locker(m_orderMutex);
+                m_order->append(m_identifier);
+            }
+            QThread::msleep(5);
+            mutex.unlock();
+        }
+    }
+
+private:
+    QString m_path;
+    int m_identifier;
+    QList<int> *m_order;
+    QMutex *m_orderMutex;
+    bool m_locked;
+};
+
+QString writeLockPath(ContactsDatabase &database)
+{
+    return static_cast<QSqlDatabase &>(database).databaseName();
+}
+
+}
+
+void tst_Database::writeLockTimeout()
+{
+    ContactsDatabase holder(0);
+    QVERIFY(holder.open(QStringLiteral("qtcontacts-sqlite-test-writelock-holder"), true, true));
+    ContactsDatabase waiter(0);
+    QVERIFY(waiter.open(QStringLiteral("qtcontacts-sqlite-test-writelock-waiter"), true, true));
+
+    QVERIFY(holder.beginTransaction());
+
+    // The second connection gives up once the timeout expires; the writer
+    // reports this as QContactManager::LockedError
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(!waiter.beginTransaction());
+    QVERIFY(timer.elapsed() >= testWriteLockTimeout - 10);
+    QVERIFY(waiter.writeLockTimedOut());
+    QCOMPARE(waiter.processMutex()->statistics().timeouts, quint64(1));
+
+    // Once the holder finishes, the lock is available again
+    QVERIFY(holder.rollbackTransaction());
+    QVERIFY(waiter.beginTransaction());
+    QVERIFY(!waiter.writeLockTimedOut());
+    QVERIFY(waiter.rollbackTransaction());
+}
+
+void tst_Database::writeLockTicketOrder()
+{
+    ContactsDatabase database(0);
+    QVERIFY(database.open(QStringLiteral("qtcontacts-sqlite-test-writelock"), true, true));
+    const QString path(writeLockPath(database));
+
+    ContactsDatabase::ProcessMutex holder(path);
+    QVERIFY(holder.lock(1000));
+    QVERIFY(!holder.hasWaiters());
+
+    // Queue the waiters one after another, so that their tickets are ordered
+    QList<int> order;
+    QMutex orderMutex;
+    QList<WriteLockWaiter *> waiters;
+    for (int i = 0; i < 4; ++i) {
+        waiters.append(new WriteLockWaiter(path, i, &order, &orderMutex));
+        waiters.last()->start();
+        QThread::msleep(100);
+    }
+    QVERIFY(holder.hasWaiters());
+
+    QVERIFY(holder.unlock());
+    for (WriteLockWaiter *waiter : waiters) {
+        QVERIFY(waiter->wait(30000));
+        QVERIFY(waiter->locked());
+    }
+    qDeleteAll(waiters);
+
+    QCOMPARE(order, (QList<int>() << 0 << 1 << 2 << 3));
+    QVERIFY(!holder.hasWaiters());
+}
+
+void tst_Database::writeLockQueueOverflow()
+{
+    // The capacity of the shared queue of waiters
+    const int maximumWaiters = 64;
+
+    ContactsDatabase database(0);
+    QVERIFY(database.open(QStringLiteral("qtcontacts-sqlite-test-writelock"), true, true));
+    const QString path(writeLockPath(database));
+
+    ContactsDatabase::ProcessMutex holder(path);
+    QVERIFY(holder.lock(1000));
+
+    QList<int> order;
+    QMutex orderMutex;
+    QList<WriteLockWaiter *> waiters;
+    for (int i = 0; i < maximumWaiters; ++i) {
+        waiters.append(new WriteLockWaiter(path, i, &order, &orderMutex));
+        waiters.last()->start();
+    }
+    QThread::msleep(1000);
+
+    // A writer arriving once the queue is full must not overtake the queued writers
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression(QStringLiteral("Write lock queue is full")));
+    waiters.append(new WriteLockWaiter(path, maximumWaiters, &order, &orderMutex));
+    waiters.last()->start();
+    QThread::msleep(200);
+
+    QVERIFY(holder.unlock());
+    for (WriteLockWaiter *waiter : waiters) {
+        QVERIFY(waiter->wait(60000));
+        QVERIFY(waiter->locked());
+    }
+    qDeleteAll(waiters);
+
+    QCOMPARE(order.count(), maximumWaiters + 1);
+    QCOMPARE(order.last(), maximumWaiters);
+}
+
+void tst_Database::writeLockTerminatedWaiter()
+{
+    ContactsDatabase database(0);
+    QVERIFY(database.open(QStringLiteral("qtcontacts-sqlite-test-writelock"), true, true));
+    const QString path(writeLockPath(database));
+
+    ContactsDatabase::ProcessMutex holder(path);
+    QVERIFY(holder.lock(1000));
+
+    // Queue a waiter in another process, which terminates without leaving the queue
+    const pid_t child = ::fork();
+    QVERIFY(child != -1);
+    if (child == 0) {
+        ContactsDatabase::ProcessMutex mutex(path);
+        mutex.lock();
+        ::_exit(0);
+    }
+    QThread::msleep(500);
+    QVERIFY(holder.hasWaiters());
+    QCOMPARE(::kill(child, SIGKILL), 0);
+    int status = 0;
+    QCOMPARE(::waitpid(child, &status, 0), child);
+
+    // The terminated waiter's ticket precedes ours, but must not block us
+    QVERIFY(holder.unlock());
+    ContactsDatabase::ProcessMutex waiter(path);
+    QVERIFY(waiter.lock(testWriteLockTimeout));
+    QVERIFY(!waiter.hasWaiters());
+    QVERIFY(waiter.unlock());
+}
+
 QTEST_GUILESS_MAIN(tst_Database)
 #include "tst_database.moc"
@@ -3,7 +3,8 @@ include (../../../common.pri)
 
 # We need access to the ContactManagerEngine header and moc output
 INCLUDEPATH += ../../../../src/extensions/
-HEADERS += ../../../../src/extensions/contactmanagerengine.h
+HEADERS += ../../../../src/extensions/contactmanagerengine.h \
+           ../../../../src/extensions/qcontactcountrequest.h
 
 SOURCES += tst_displaylabelgroups.cpp
 
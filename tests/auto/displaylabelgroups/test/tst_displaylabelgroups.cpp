@@ -40,11 +40,14 @@
 #include <QContactDisplayLabel>
 #include <QContactPhoneNumber>
 #include <QContactHobby>
+#include <QContactDetailFilter>
 
 #include "contactmanagerengine.h"
 
 #include "qtcontacts-extensions.h"
 #include "qtcontacts-extensions_manager_impl.h"
+#include "qcontactcountrequest.h"
+#include "qcontactcountrequest_impl.h"
 
 QTCONTACTS_USE_NAMESPACE
 
@@ -66,6 +69,7 @@ public slots:
 
 private slots:
     void testDisplayLabelGroups();
+    void testCountRequest();
 
 private:
     QContactManager *m_cm;
@@ -343,5 +347,74 @@ void tst_DisplayLabelGroups::testDisplayLabelGroups()
     QCOMPARE(data.first().value<QStringList>(), expected);
 }
 
+void tst_DisplayLabelGroups::testCountRequest()
+{
+    const char *lastNames[] = { "A", "Aa", "BBBBB", "CCCCCCCC", "DDDDDDD", "EEE", "Eee" };
+    for (const char *lastName : lastNames) {
+        QContactName name;
+        name.setLastName(QString::fromLatin1(lastName));
+        name.setFirstName(QStringLiteral("Test"));
+        name.setMiddleName(QStringLiteral("Counted"));
+
+        QContact contact;
+        contact.saveDetail(&name);
+        QVERIFY(m_cm->saveContact(&contact));
+    }
+
+    QContactDetailFilter filter;
+    filter.setDetailType(QContactName::Type, QContactName::FieldMiddleName);
+    filter.setValue(QStringLiteral("Counted"));
+    filter.setMatchFlags(QContactFilter::MatchExactly);
+
+    // tally the groups of the matching contacts, as the index bar would
+    const QList<QContact> matching = m_cm->contacts(filter);
+    QCOMPARE(matching.count(), 7);
+    QMap<QString, int> expectedGroupCounts;
+    for (const QContact &c : matching) {
+        expectedGroupCounts[c.detail<QContactDisplayLabel>().value(QContactDisplayLabel__FieldLabelGroup).toString()] += 1;
+    }
+
+    QContactCountRequest request;
+    request.setManager(m_cm);
+    request.setFilter(filter);
+    QVERIFY(request.start());
+    QVERIFY(request.waitForFinished(5000));
+    QCOMPARE(request.error(), QContactManager::NoError);
+    QCOMPARE(request.count(), 7);
+    QVERIFY(request.displayLabelGroupCounts().isEmpty());
+
+    request.setCountByDisplayLabelGroup(true);
+    QVERIFY(request.start());
+    QVERIFY(request.waitForFinished(5000));
+    QCOMPARE(request.error(), QContactManager::NoError);
+    QCOMPARE(request.count(), 7);
+
+    // the known groups are reported in the same order as displayLabelGroups()
+    QtContactsSqliteExtensions::ContactManagerEngine *cme =
+        QtContactsSqliteExtensions::contactManagerEngine(*m_cm);
+    const QStringList groups = cme->displayLabelGroups();
+    QMap<QString, int> groupCounts;
+    int previousIndex = -1;
+    for (const QPair<QString, int> &groupCount : request.displayLabelGroupCounts()) {
+        QVERIFY(!groupCounts.contains(groupCount.first));
+        groupCounts.insert(groupCount.first, groupCount.second);
+
+        const int index = groups.indexOf(groupCount.first);
+        if (index != -1) {
+            QVERIFY(index > previousIndex);
+            previousIndex = index;
+        }
+    }
+    QCOMPARE(groupCounts, expectedGroupCounts);
+
+    // the count of all contacts matches the number of ids
+    request.setFilter(QContactFilter());
+    request.setCountByDisplayLabelGroup(false);
+    QVERIFY(request.start());
+    QVERIFY(request.waitForFinished(5000));
+    QCOMPARE(request.error(), QContactManager::NoError);
+    QCOMPARE(request.count(), m_cm->contactIds().count());
+}
+
 QTEST_MAIN(tst_DisplayLabelGroups)
 #include "tst_displaylabelgroups.moc"
@@ -38,7 +38,7 @@
 class TestDlgg : public QObject, QtContactsSqliteExtensions::DisplayLabelGroupGenerator
 {
     Q_OBJECT
-    Q_PLUGIN_METADATA(IID QtContactsSqliteExtensions_DisplayLabelGroupGeneratorInterface_iid)
+    Q_PLUGIN_METADATA(IID QtContactsSqliteExtensions_DisplayLabelGroupGeneratorInterface_iid FILE "testdlggplugin.json")
     Q_INTERFACES(QtContactsSqliteExtensions::DisplayLabelGroupGenerator)
 
 public:
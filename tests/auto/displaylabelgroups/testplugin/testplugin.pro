@@ -4,6 +4,7 @@ INCLUDEPATH    += ../../../../src/extensions/
 QT             -= gui
 HEADERS         = testdlggplugin.h
 SOURCES         = testdlggplugin.cpp
+OTHER_FILES     = testdlggplugin.json
 TARGET          = $$qtLibraryTarget(testdlgg)
 PLUGIN_TYPE     = contacts_dlgg
 DESTDIR         = $${PLUGIN_TYPE}
@@ -0,0 +1,9 @@
+TARGET = tst_pagefetchrequest
+include (../../common.pri)
+
+# We need access to the ContactManagerEngine header and moc output
+INCLUDEPATH += ../../../src/extensions/
+HEADERS += ../../../src/extensions/contactmanagerengine.h \
+           ../../../src/extensions/qcontactpagefetchrequest.h
+
+SOURCES += tst_pagefetchrequest.cpp
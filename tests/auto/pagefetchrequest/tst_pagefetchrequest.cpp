@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include <QtGlobal>
+
+#include <QtTest/QtTest>
+
+#include <QContactManager>
+#include <QContact>
+#include <QContactName>
+#include <QContactGuid>
+#include <QContactDetailFilter>
+
+#include "qtcontacts-extensions.h"
+#include "qtcontacts-extensions_manager_impl.h"
+#include "qcontactpagefetchrequest.h"
+#include "qcontactpagefetchrequest_impl.h"
+
+QTCONTACTS_USE_NAMESPACE
+
+Q_DECLARE_METATYPE(QList<QContactId>)
+
+class tst_PageFetchRequest : public QObject
+{
+    Q_OBJECT
+
+public:
+    tst_PageFetchRequest();
+    ~tst_PageFetchRequest();
+
+public slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+    void cleanup();
+
+private slots:
+    void testPageFetchRequest_data();
+    void testPageFetchRequest();
+    void testMultipleSortValues();
+    void testInvalidCursor();
+
+private:
+    QList<QContactId> fetchPages(const QContactFilter &filter, const QList<QContactSortOrder> &sorting, int pageSize, bool idsOnly, int *pageCount);
+
+    QContactManager *m_cm;
+    QSet<QContactId> m_createdIds;
+};
+
+tst_PageFetchRequest::tst_PageFetchRequest()
+{
+    qRegisterMetaType<QContactId>("QContactId");
+    qRegisterMetaType<QList<QContactId> >("QList<QContactId>");
+
+    QMap<QString, QString> parameters;
+    parameters.insert(QString::fromLatin1("autoTest"), QString::fromLatin1("true"));
+    parameters.insert(QString::fromLatin1("mergePresenceChanges"), QString::fromLatin1("true"));
+    m_cm = new QContactManager(QString::fromLatin1("org.nemomobile.contacts.sqlite"), parameters);
+    QTest::qWait(250); // creating self contact etc will cause some signals to be emitted.  ignore them.
+    connect(m_cm, &QContactManager::contactsAdded, [this] (const QList<QContactId> &ids) {
+        for (const QContactId &id : ids) {
+            this->m_createdIds.insert(id);
+        }
+    });
+}
+
+tst_PageFetchRequest::~tst_PageFetchRequest()
+{
+    QTest::qWait(250); // wait for signals.
+    if (!m_createdIds.isEmpty()) {
+        m_cm->removeContacts(m_createdIds.toList());
+        m_createdIds.clear();
+    }
+    delete m_cm;
+}
+
+void tst_PageFetchRequest::initTestCase()
+{
+}
+
+void tst_PageFetchRequest::init()
+{
+    // Contacts which share a last name, and some without one, so that the
+    // pages must be continued within runs of equal and blank sort values
+    const char *names[][2] = {
+        { "Pager", "Abigail" }, { "Pager", "Bartholomew" }, { "Pager", "Cecily" },
+        { "Pager", "Dominic" }, { "Pager", "Eleanor" }, { "Pager", "Fitzgerald" },
+        { "Paginate", "Gwendolyn" }, { "Paginate", "Horatio" }, { "", "Isadora" },
+        { "", "Jeremiah" }, { "", "Katharine" }
+    };
+
+    for (unsigned i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        QContactName name;
+        name.setLastName(QString::fromLatin1(names[i][0]));
+        name.setFirstName(QString::fromLatin1(names[i][1]));
+        name.setMiddleName(QStringLiteral("Paged"));
+
+        QContact contact;
+        contact.saveDetail(&name);
+        QVERIFY(m_cm->saveContact(&contact));
+    }
+}
+
+void tst_PageFetchRequest::cleanupTestCase()
+{
+    QTest::qWait(250); // wait for signals.
+    if (!m_createdIds.isEmpty()) {
+        m_cm->removeContacts(m_createdIds.toList());
+        m_createdIds.clear();
+    }
+}
+
+void tst_PageFetchRequest::cleanup()
+{
+    QTest::qWait(250); // wait for signals.
+    if (!m_createdIds.isEmpty()) {
+        m_cm->removeContacts(m_createdIds.toList());
+        m_createdIds.clear();
+    }
+}
+
+QList<QContactId> tst_PageFetchRequest::fetchPages(const QContactFilter &filter, const QList<QContactSortOrder> &sorting, int pageSize, bool idsOnly, int *pageCount)
+{
+    QList<QContactId> ids;
+    *pageCount = 0;
+
+    QContactPageFetchRequest request;
+    request.setManager(m_cm);
+    request.setFilter(filter);
+    request.setSorting(sorting);
+    request.setPageSize(pageSize);
+    request.setIdsOnly(idsOnly);
+
+    do {
+        if (!request.start() || !request.waitForFinished(5000)
+                || request.error() != QContactManager::NoError
+                || request.contactIds().count() > pageSize) {
+            return QList<QContactId>();
+        }
+        if (!idsOnly) {
+            for (int i = 0; i < request.contacts().count(); ++i) {
+                if (request.contacts().at(i).id() != request.contactIds().at(i)) {
+                    return QList<QContactId>();
+                }
+            }
+        }
+
+        ids.append(request.contactIds());
+        request.setCursor(request.nextCursor());
+        ++(*pageCount);
+    } while (!request.cursor().isEmpty());
+
+    return ids;
+}
+
+void tst_PageFetchRequest::testPageFetchRequest_data()
+{
+    QTest::addColumn<int>("pageSize");
+    QTest::addColumn<bool>("idsOnly");
+    QTest::addColumn<int>("direction");
+    QTest::addColumn<int>("blankPolicy");
+
+    QTest::newRow("single page") << 20 << false << int(Qt::AscendingOrder) << int(QContactSortOrder::BlanksLast);
+    QTest::newRow("exact pages") << 11 << true << int(Qt::AscendingOrder) << int(QContactSortOrder::BlanksLast);
+    QTest::newRow("ascending") << 4 << false << int(Qt::AscendingOrder) << int(QContactSortOrder::BlanksLast);
+    QTest::newRow("ascending ids") << 3 << true << int(Qt::AscendingOrder) << int(QContactSortOrder::BlanksFirst);
+    QTest::newRow("descending") << 2 << false << int(Qt::DescendingOrder) << int(QContactSortOrder::BlanksLast);
+    QTest::newRow("descending ids") << 1 << true << int(Qt::DescendingOrder) << int(QContactSortOrder::BlanksFirst);
+}
+
+void tst_PageFetchRequest::testPageFetchRequest()
+{
+    QFETCH(int, pageSize);
+    QFETCH(bool, idsOnly);
+    QFETCH(int, direction);
+    QFETCH(int, blankPolicy);
+
+    QContactDetailFilter filter;
+    filter.setDetailType(QContactName::Type, QContactName::FieldMiddleName);
+    filter.setValue(QStringLiteral("Paged"));
+    filter.setMatchFlags(QContactFilter::MatchExactly);
+
+    // Ties in the last name are broken by the first name in the opposite direction
+    QContactSortOrder lastNameSort;
+    lastNameSort.setDetailType(QContactName::Type, QContactName::FieldLastName);
+    lastNameSort.setDirection(Qt::SortOrder(direction));
+    lastNameSort.setBlankPolicy(QContactSortOrder::BlankPolicy(blankPolicy));
+    QContactSortOrder firstNameSort;
+    firstNameSort.setDetailType(QContactName::Type, QContactName::FieldFirstName);
+    firstNameSort.setDirection(direction == Qt::AscendingOrder ? Qt::DescendingOrder : Qt::AscendingOrder);
+    const QList<QContactSortOrder> sorting(QList<QContactSortOrder>() << lastNameSort << firstNameSort);
+
+    const QList<QContactId> expected(m_cm->contactIds(filter, sorting));
+    QCOMPARE(expected.count(), 11);
+
+    int pageCount = 0;
+    const QList<QContactId> paged(fetchPages(filter, sorting, pageSize, idsOnly, &pageCount));
+    QCOMPARE(paged, expected);
+    QCOMPARE(pageCount, (expected.count() + pageSize - 1) / pageSize);
+
+    // Without a sort order, pages follow the contact ids
+    const QList<QContactId> unsorted(fetchPages(filter, QList<QContactSortOrder>(), pageSize, idsOnly, &pageCount));
+    QCOMPARE(unsorted.count(), expected.count());
+    QCOMPARE(unsorted.toSet(), expected.toSet());
+}
+
+void tst_PageFetchRequest::testMultipleSortValues()
+{
+    // Each contact has two GUIDs; a contact is positioned by its lowest GUID
+    // in ascending order, and by its highest in descending order
+    const char *guids[][2] = {
+        { "paged-a", "paged-z" }, { "paged-b", "paged-c" },
+        { "paged-d", "paged-y" }, { "paged-e", "paged-f" }
+    };
+
+    QList<QContactId> ids;
+    for (unsigned i = 0; i < sizeof(guids) / sizeof(guids[0]); ++i) {
+        QContactName name;
+        name.setFirstName(QStringLiteral("Guid%1").arg(i));
+        name.setMiddleName(QStringLiteral("Multiple"));
+
+        QContact contact;
+        contact.saveDetail(&name);
+        for (int j = 0; j < 2; ++j) {
+            QContactGuid guid;
+            guid.setGuid(QString::fromLatin1(guids[i][j]));
+            contact.saveDetail(&guid);
+        }
+        QVERIFY(m_cm->saveContact(&contact));
+        ids.append(contact.id());
+    }
+
+    QContactDetailFilter filter;
+    filter.setDetailType(QContactName::Type, QContactName::FieldMiddleName);
+    filter.setValue(QStringLiteral("Multiple"));
+    filter.setMatchFlags(QContactFilter::MatchExactly);
+
+    QContactSortOrder guidSort;
+    guidSort.setDetailType(QContactGuid::Type, QContactGuid::FieldGuid);
+
+    for (int pageSize = 1; pageSize <= 4; ++pageSize) {
+        int pageCount = 0;
+        guidSort.setDirection(Qt::AscendingOrder);
+        QList<QContactId> paged(fetchPages(filter, QList<QContactSortOrder>() << guidSort, pageSize, true, &pageCount));
+        QCOMPARE(paged, QList<QContactId>() << ids.at(0) << ids.at(1) << ids.at(2) << ids.at(3));
+        QCOMPARE(pageCount, (ids.count() + pageSize - 1) / pageSize);
+
+        guidSort.setDirection(Qt::DescendingOrder);
+        paged = fetchPages(filter, QList<QContactSortOrder>() << guidSort, pageSize, false, &pageCount);
+        QCOMPARE(paged, QList<QContactId>() << ids.at(0) << ids.at(2) << ids.at(3) << ids.at(1));
+        QCOMPARE(pageCount, (ids.count() + pageSize - 1) / pageSize);
+    }
+}
+
+void tst_PageFetchRequest::testInvalidCursor()
+{
+    QContactSortOrder lastNameSort;
+    lastNameSort.setDetailType(QContactName::Type, QContactName::FieldLastName);
+
+    QContactPageFetchRequest request;
+    request.setManager(m_cm);
+    request.setSorting(QList<QContactSortOrder>() << lastNameSort);
+    request.setPageSize(2);
+    QVERIFY(request.start());
+    QVERIFY(request.waitForFinished(5000));
+    QCOMPARE(request.error(), QContactManager::NoError);
+    QVERIFY(!request.nextCursor().isEmpty());
+
+    // A cursor is only valid for the sort order which produced it
+    QContactSortOrder firstNameSort;
+    firstNameSort.setDetailType(QContactName::Type, QContactName::FieldFirstName);
+    request.setSorting(QList<QContactSortOrder>() << firstNameSort);
+    request.setCursor(request.nextCursor());
+    QVERIFY(request.start());
+    QVERIFY(request.waitForFinished(5000));
+    QCOMPARE(request.error(), QContactManager::BadArgumentError);
+
+    request.setCursor(QByteArray("not a cursor"));
+    QVERIFY(request.start());
+    QVERIFY(request.waitForFinished(5000));
+    QCOMPARE(request.error(), QContactManager::BadArgumentError);
+}
+
+QTEST_MAIN(tst_PageFetchRequest)
+#include "tst_pagefetchrequest.moc"
@@ -255,6 +255,10 @@ private slots:
     void invalidManager();
     void changeSet();
     void fetchHint();
+    void contactCache();
+    void contactSnapshot();
+    void removeRelationshipsErrors();
+    void saveRelationshipsErrors();
 #ifdef MUTABLE_SCHEMA_SUPPORTED
     void engineDefaultSchema();
 #endif
@@ -3287,6 +3291,300 @@ void tst_QContactManager::fetchHint()
     QCOMPARE(hint.maxCountHint(), limit);
 }
 
+static qint64 contactCacheStatistic(QContactManager *cm, const QString &name)
+{
+    QtContactsSqliteExtensions::ContactManagerEngine *cme = QtContactsSqliteExtensions::contactManagerEngine(*cm);
+    typedef QPair<QString, qint64> Statistic;
+    foreach (const Statistic &statistic, cme->contactCacheStatistics()) {
+        if (statistic.first == name) {
+            return statistic.second;
+        }
+    }
+    return -1;
+}
+
+void tst_QContactManager::contactCache()
+{
+    QMap<QString, QString> params;
+    params.insert("contactCacheSize", "100");
+    QScopedPointer<QContactManager> cm(newContactManager(params));
+
+    QContact alice;
+    QContactName aliceName;
+    aliceName.setFirstName("Alice");
+    aliceName.setLastName("Cached");
+    alice.saveDetail(&aliceName);
+    QVERIFY(cm->saveContact(&alice));
+
+    QContact bob;
+    QContactName bobName;
+    bobName.setFirstName("Bob");
+    bobName.setLastName("Cached");
+    bob.saveDetail(&bobName);
+    QVERIFY(cm->saveContact(&bob));
+
+    // The first fetch reads the contact, and the repeated fetch is served from the cache
+    QContact fetched = cm->contact(alice.id());
+    QCOMPARE(cm->error(), QContactManager::NoError);
+    const qint64 hits = contactCacheStatistic(cm.data(), QStringLiteral("hits"));
+    QVERIFY(hits >= 0);
+
+    fetched = cm->contact(alice.id());
+    QCOMPARE(cm->error(), QContactManager::NoError);
+    QCOMPARE(contactCacheStatistic(cm.data(), QStringLiteral("hits")), hits + 1);
+    QCOMPARE(fetched.id(), alice.id());
+    QCOMPARE(fetched.detail<QContactName>().firstName(), QStringLiteral("Alice"));
+
+    // A different fetch hint selects different content, which is not yet cached
+    QContactFetchHint nameHint;
+    nameHint.setDetailTypesHint(QList<QContactDetail::DetailType>() << QContactName::Type);
+    QCOMPARE(cm->contact(alice.id(), nameHint).detail<QContactName>().firstName(), QStringLiteral("Alice"));
+    QCOMPARE(contactCacheStatistic(cm.data(), QStringLiteral("hits")), hits + 1);
+
+    // Local writes discard the cached contact
+    aliceName = fetched.detail<QContactName>();
+    aliceName.setFirstName("Alicia");
+    fetched.saveDetail(&aliceName);
+    QVERIFY(cm->saveContact(&fetched));
+    QCOMPARE(cm->contact(alice.id()).detail<QContactName>().firstName(), QStringLiteral("Alicia"));
+    QCOMPARE(cm->contact(alice.id(), nameHint).detail<QContactName>().firstName(), QStringLiteral("Alicia"));
+
+    // Relationship changes discard both participants
+    const QString spouse(relationshipString(QContactRelationship::HasSpouse));
+    QCOMPARE(cm->contact(bob.id()).relationships(spouse).count(), 0);
+    QContactRelationship relationship(makeRelationship(spouse, alice.id(), bob.id()));
+    QVERIFY(cm->saveRelationship(&relationship));
+    QCOMPARE(cm->contact(alice.id()).relationships(spouse).count(), 1);
+    QCOMPARE(cm->contact(bob.id()).relationships(spouse).count(), 1);
+
+    // Removal discards the removed contact, and those related to it
+    QVERIFY(cm->removeContact(alice.id()));
+    cm->contact(alice.id());
+    QCOMPARE(cm->error(), QContactManager::DoesNotExistError);
+    QCOMPARE(cm->contact(bob.id()).relationships(spouse).count(), 0);
+
+    // Clearing change flags discards the cached status flags
+    QVERIFY(cm->contact(bob.id()).detail<QContactStatusFlags>().testFlag(QContactStatusFlags::IsAdded));
+    QVERIFY(cm->contact(bob.id()).detail<QContactStatusFlags>().testFlag(QContactStatusFlags::IsAdded));
+    QContactManager::Error err = QContactManager::NoError;
+    QVERIFY(QtContactsSqliteExtensions::contactManagerEngine(*cm)->clearChangeFlags(QList<QContactId>() << bob.id(), &err));
+    QCOMPARE(err, QContactManager::NoError);
+    QVERIFY(!cm->contact(bob.id()).detail<QContactStatusFlags>().testFlag(QContactStatusFlags::IsAdded));
+
+    QVERIFY(cm->removeContact(bob.id()));
+}
+
+static QtContactsSqliteExtensions::ContactSnapshot contactSnapshot(QContactManager *cm, const QString &firstName, bool *found)
+{
+    QtContactsSqliteExtensions::ContactManagerEngine *cme = QtContactsSqliteExtensions::contactManagerEngine(*cm);
+    QList<QtContactsSqliteExtensions::ContactSnapshot> snapshots;
+    *found = false;
+    if (cme->fetchContactSnapshots(&snapshots)) {
+        foreach (const QtContactsSqliteExtensions::ContactSnapshot &snapshot, snapshots) {
+            if (snapshot.firstName == firstName) {
+                *found = true;
+                return snapshot;
+            }
+        }
+    }
+    return QtContactsSqliteExtensions::ContactSnapshot();
+}
+
+void tst_QContactManager::contactSnapshot()
+{
+    QMap<QString, QString> params;
+    params.insert("contactSnapshot", "true");
+    QScopedPointer<QContactManager> cm(newContactManager(params));
+
+    QList<QtContactsSqliteExtensions::ContactSnapshot> snapshots;
+    QVERIFY(QtContactsSqliteExtensions::contactManagerEngine(*cm)->fetchContactSnapshots(&snapshots));
+
+    QContact carol;
+    QContactName carolName;
+    carolName.setFirstName("Carol");
+    carolName.setLastName("Snapshot");
+    carol.saveDetail(&carolName);
+    QContactPhoneNumber carolPhone;
+    carolPhone.setNumber("5551212");
+    carol.saveDetail(&carolPhone);
+    QContactEmailAddress carolEmail;
+    carolEmail.setEmailAddress("carol@example.com");
+    carol.saveDetail(&carolEmail);
+    QVERIFY(cm->saveContact(&carol));
+
+    // Writes made after the snapshot is populated are applied to it
+    bool found = false;
+    QtContactsSqliteExtensions::ContactSnapshot snapshot(contactSnapshot(cm.data(), QStringLiteral("Carol"), &found));
+    QVERIFY(found);
+    QCOMPARE(snapshot.lastName, QStringLiteral("Snapshot"));
+    QCOMPARE(snapshot.phoneNumbers, QStringList() << QStringLiteral("5551212"));
+    QCOMPARE(snapshot.emailAddresses, QStringList() << QStringLiteral("carol@example.com"));
+    QVERIFY(!snapshot.displayLabel.isEmpty());
+
+    carol = cm->contact(carol.id());
+    carolPhone = carol.detail<QContactPhoneNumber>();
+    carolPhone.setNumber("5553434");
+    carol.saveDetail(&carolPhone);
+    QVERIFY(cm->saveContact(&carol));
+
+    snapshot = contactSnapshot(cm.data(), QStringLiteral("Carol"), &found);
+    QVERIFY(found);
+    QCOMPARE(snapshot.phoneNumbers, QStringList() << QStringLiteral("5553434"));
+
+    // Another manager, which does not populate the snapshot, publishes its changes to it
+    QScopedPointer<QContactManager> other(newContactManager());
+    QContact dave;
+    QContactName daveName;
+    daveName.setFirstName("Dave");
+    daveName.setLastName("Snapshot");
+    dave.saveDetail(&daveName);
+    QContactPhoneNumber davePhone;
+    davePhone.setNumber("5556767");
+    dave.saveDetail(&davePhone);
+    QVERIFY(other->saveContact(&dave));
+
+    snapshot = contactSnapshot(other.data(), QStringLiteral("Dave"), &found);
+    QVERIFY(found);
+    QCOMPARE(snapshot.phoneNumbers, QStringList() << QStringLiteral("5556767"));
+    snapshot = contactSnapshot(cm.data(), QStringLiteral("Dave"), &found);
+    QVERIFY(found);
+    QCOMPARE(snapshot.lastName, QStringLiteral("Snapshot"));
+
+    // A partial update replaces only the fields of the saved detail types
+    dave = other->contact(dave.id());
+    QContactEmailAddress daveEmail;
+    daveEmail.setEmailAddress("dave@example.com");
+    dave.saveDetail(&daveEmail);
+    QList<QContact> saveList;
+    saveList << dave;
+    QVERIFY(other->saveContacts(&saveList, QList<QContactDetail::DetailType>() << QContactEmailAddress::Type));
+
+    snapshot = contactSnapshot(other.data(), QStringLiteral("Dave"), &found);
+    QVERIFY(found);
+    QCOMPARE(snapshot.lastName, QStringLiteral("Snapshot"));
+    QCOMPARE(snapshot.phoneNumbers, QStringList() << QStringLiteral("5556767"));
+    QCOMPARE(snapshot.emailAddresses, QStringList() << QStringLiteral("dave@example.com"));
+
+    QVERIFY(other->removeContact(dave.id()));
+    contactSnapshot(cm.data(), QStringLiteral("Dave"), &found);
+    QVERIFY(!found);
+
+    QVERIFY(cm->removeContact(carol.id()));
+    contactSnapshot(cm.data(), QStringLiteral("Carol"), &found);
+    QVERIFY(!found);
+}
+
+void tst_QContactManager::removeRelationshipsErrors()
+{
+    QScopedPointer<QContactManager> cm(newContactManager());
+
+    QContact alice;
+    QContactName aliceName;
+    aliceName.setFirstName("Alice");
+    aliceName.setLastName("Removal");
+    alice.saveDetail(&aliceName);
+    QContact bob;
+    QContactName bobName;
+    bobName.setFirstName("Bob");
+    bobName.setLastName("Removal");
+    bob.saveDetail(&bobName);
+    QContact carol;
+    QContactName carolName;
+    carolName.setFirstName("Carol");
+    carolName.setLastName("Removal");
+    carol.saveDetail(&carolName);
+    QVERIFY(cm->saveContact(&alice));
+    QVERIFY(cm->saveContact(&bob));
+    QVERIFY(cm->saveContact(&carol));
+
+    const QString spouse(relationshipString(QContactRelationship::HasSpouse));
+    const QString manager(relationshipString(QContactRelationship::HasManager));
+    QList<QContactRelationship> saved;
+    saved << makeRelationship(spouse, alice.id(), bob.id())
+          << makeRelationship(manager, alice.id(), carol.id());
+    QVERIFY(cm->saveRelationships(&saved, nullptr));
+
+    // Duplicated entries each match the existing relationship; only the missing one is reported
+    QList<QContactRelationship> removals;
+    removals << saved.at(0)
+             << saved.at(0)
+             << makeRelationship(spouse, bob.id(), carol.id())
+             << saved.at(1);
+    QMap<int, QContactManager::Error> errorMap;
+    QVERIFY(!cm->removeRelationships(removals, &errorMap));
+    QCOMPARE(cm->error(), QContactManager::DoesNotExistError);
+    QCOMPARE(errorMap.count(), 1);
+    QCOMPARE(errorMap.value(2), QContactManager::DoesNotExistError);
+
+    // Nothing is removed by the failed request
+    QCOMPARE(cm->relationships(spouse, alice.id(), QContactRelationship::First).count(), 1);
+    QCOMPARE(cm->relationships(manager, alice.id(), QContactRelationship::First).count(), 1);
+
+    removals.removeAt(2);
+    errorMap.clear();
+    QVERIFY(cm->removeRelationships(removals, &errorMap));
+    QCOMPARE(errorMap.count(), 0);
+    QCOMPARE(cm->relationships(spouse, alice.id(), QContactRelationship::First).count(), 0);
+    QCOMPARE(cm->relationships(manager, alice.id(), QContactRelationship::First).count(), 0);
+
+    QVERIFY(cm->removeContacts(QList<QContactId>() << alice.id() << bob.id() << carol.id()));
+}
+
+void tst_QContactManager::saveRelationshipsErrors()
+{
+    QScopedPointer<QContactManager> cm(newContactManager());
+
+    QContact alice;
+    QContactName aliceName;
+    aliceName.setFirstName("Alice");
+    aliceName.setLastName("Saving");
+    alice.saveDetail(&aliceName);
+    QContact bob;
+    QContactName bobName;
+    bobName.setFirstName("Bob");
+    bobName.setLastName("Saving");
+    bob.saveDetail(&bobName);
+    QContact carol;
+    QContactName carolName;
+    carolName.setFirstName("Carol");
+    carolName.setLastName("Saving");
+    carol.saveDetail(&carolName);
+    QVERIFY(cm->saveContact(&alice));
+    QVERIFY(cm->saveContact(&bob));
+    QVERIFY(cm->saveContact(&carol));
+
+    const QString spouse(relationshipString(QContactRelationship::HasSpouse));
+    const QString manager(relationshipString(QContactRelationship::HasManager));
+    QContactRelationship relationship(makeRelationship(spouse, alice.id(), bob.id()));
+    QVERIFY(cm->saveRelationship(&relationship));
+
+    // Saving an existing relationship again succeeds, without duplicating it
+    QList<QContactRelationship> saves;
+    saves << relationship
+          << makeRelationship(manager, alice.id(), bob.id())
+          << relationship;
+    QMap<int, QContactManager::Error> errorMap;
+    QVERIFY(cm->saveRelationships(&saves, &errorMap));
+    QCOMPARE(errorMap.count(), 0);
+    QCOMPARE(cm->relationships(spouse, alice.id(), QContactRelationship::First).count(), 1);
+    QCOMPARE(cm->relationships(manager, alice.id(), QContactRelationship::First).count(), 1);
+
+    // A relationship naming a deleted contact is reported at its position
+    const QContactId carolId(carol.id());
+    QVERIFY(cm->removeContact(carolId));
+    saves.clear();
+    saves << makeRelationship(manager, alice.id(), carolId)
+          << makeRelationship(manager, bob.id(), alice.id());
+    errorMap.clear();
+    QVERIFY(!cm->saveRelationships(&saves, &errorMap));
+    QCOMPARE(cm->error(), QContactManager::InvalidRelationshipError);
+    QCOMPARE(errorMap.count(), 1);
+    QCOMPARE(errorMap.value(0), QContactManager::InvalidRelationshipError);
+    QCOMPARE(cm->relationships(manager, carolId, QContactRelationship::Second).count(), 0);
+
+    QVERIFY(cm->removeContacts(QList<QContactId>() << alice.id() << bob.id()));
+}
+
 void tst_QContactManager::selfContactId()
 {
     QFETCH(QString, uri);
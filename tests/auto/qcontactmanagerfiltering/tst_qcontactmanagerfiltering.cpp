@@ -207,6 +207,9 @@ private slots:
 
     void fetchHint_data();
     void fetchHint();
+
+    void filterCacheReuse_data();
+    void filterCacheReuse();
 };
 
 tst_QContactManagerFiltering::tst_QContactManagerFiltering()
@@ -1507,6 +1510,14 @@ void tst_QContactManagerFiltering::unionFiltering_data()
                             << true << QVariant(QString::fromLatin1("Smithee")) << QVariant() << QVariant()
                             << "XY" << "efg";
 
+        // WITH Y AND Z AS DETAIL FILTERS ON THE SAME FIELD (with no overlap between Y(B) and Z(C) results)
+        QTest::newRow("A5") << manager
+                            << true << 1 << detailType<QContactName>() << detailField(QContactName::FieldFirstName)
+                            << true << QVariant(QString::fromLatin1("Bob")) << QVariant() << QVariant()
+                            << true << 1 << detailType<QContactName>() << detailField(QContactName::FieldFirstName)
+                            << true << QVariant(QString::fromLatin1("Boris")) << QVariant() << QVariant()
+                            << "YZ" << "bc";
+
         // WITH Y AS DETAIL RANGE FILTER AND Z AS DETAIL FILTER (with no overlap between Y(AB) and Z(C) results)
         QTest::newRow("B1") << manager
                             << true << 2 << detailType<QContactName>() << detailField(QContactName::FieldFirstName)
@@ -2625,6 +2636,56 @@ void tst_QContactManagerFiltering::fetchHint()
     }
 }
 
+void tst_QContactManagerFiltering::filterCacheReuse_data()
+{
+    QTest::addColumn<QContactManager*>("cm");
+
+    for (int i = 0; i < managers.size(); i++) {
+        QContactManager *manager = managers.at(i);
+        QTest::newRow(manager->managerName().toLatin1().constData()) << manager;
+    }
+}
+
+static qint64 filterCacheHits(QContactManager *cm)
+{
+    qint64 hits = 0;
+    QtContactsSqliteExtensions::ContactManagerEngine *cme = QtContactsSqliteExtensions::contactManagerEngine(*cm);
+    typedef QPair<QString, qint64> Statistic;
+    foreach (const Statistic &statistic, cme->filterCacheStatistics()) {
+        if (statistic.first.endsWith(QStringLiteral("hits"))) {
+            hits += statistic.second;
+        }
+    }
+    return hits;
+}
+
+void tst_QContactManagerFiltering::filterCacheReuse()
+{
+    QFETCH(QContactManager*, cm);
+
+    QList<QContactId> contacts = contactsAddedToManagers.values(cm);
+    const qint64 initialHits = filterCacheHits(cm);
+
+    // Filters differing only in their values share generated SQL, but not results
+    const QStringList names = QStringList() << "Aaron" << "Bob" << "Boris" << "Dennis";
+    const QString expected = QStringLiteral("abcd");
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int i = 0; i < names.count(); ++i) {
+            QContactDetailFilter df;
+            df.setDetailType(detailType<QContactName>(), QContactName::FieldFirstName);
+            df.setMatchFlags(QContactFilter::MatchExactly);
+            df.setValue(names.at(i));
+
+            QList<QContactId> ids = cm->contactIds(df);
+            QString output = convertIds(contacts, ids, 'a', 'k');
+            QCOMPARE(output, expected.mid(i, 1));
+        }
+    }
+
+    // Only the first of those queries needed to generate its SQL
+    QVERIFY(filterCacheHits(cm) - initialHits >= (2 * names.count()) - 1);
+}
+
 
 #if 0
 void tst_QContactManagerFiltering::changelogFiltering_data()
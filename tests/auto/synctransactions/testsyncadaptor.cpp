@@ -256,6 +256,18 @@ QContact TestSyncAdaptor::setRemoteContact(const QString &fname, const QString &
     return newContact;
 }
 
+void TestSyncAdaptor::setRemoteContactContent(const QString &fname, const QString &lname, const QContact &contact)
+{
+    // unlike setRemoteContact(), store the content exactly as given, without a new etag.
+    const QString contactGuidStr(TSA_GUID_STRING(m_accountId, m_applicationName, fname, lname));
+    if (!m_remoteServerContacts.contains(contactGuidStr)) {
+        qWarning() << "Contact:" << contactGuidStr << "doesn't exist remotely!";
+        return;
+    }
+
+    m_remoteServerContacts[contactGuidStr] = contact;
+}
+
 void TestSyncAdaptor::changeRemoteContactPhone(const QString &fname, const QString &lname, const QString &modPhone)
 {
     const QString contactGuidStr(TSA_GUID_STRING(m_accountId, m_applicationName, fname, lname));
@@ -348,11 +360,17 @@ QSet<QContactId> TestSyncAdaptor::modifiedIds() const
     return m_modifiedIds;
 }
 
+QSet<QContactId> TestSyncAdaptor::remotelyModifiedIds() const
+{
+    return m_remotelyModifiedIds;
+}
+
 void TestSyncAdaptor::performTwoWaySync()
 {
     // reset our state.
     m_downsyncWasRequired = false;
     m_upsyncWasRequired = false;
+    m_remotelyModifiedIds.clear();
 
     startSync();
 }
@@ -417,6 +435,20 @@ bool TestSyncAdaptor::determineRemoteContacts(const QContactCollection &collecti
     return true;
 }
 
+void TestSyncAdaptor::remoteContactChangesDetermined(
+        const QContactCollection &collection,
+        const QList<QContact> &remotelyAddedContacts,
+        const QList<QContact> &remotelyModifiedContacts,
+        const QList<QContact> &remotelyRemovedContacts)
+{
+    for (const QContact &c : remotelyModifiedContacts) {
+        m_remotelyModifiedIds.insert(c.id());
+    }
+
+    TwoWayContactSyncAdaptor::remoteContactChangesDetermined(
+            collection, remotelyAddedContacts, remotelyModifiedContacts, remotelyRemovedContacts);
+}
+
 bool TestSyncAdaptor::storeLocalChangesRemotely(
         const QContactCollection &collection,
         const QList<QContact> &addedContacts,
@@ -62,6 +62,7 @@ public:
     void addRemoteContact(const QString &fname, const QString &lname, const QString &phone, PhoneModifiability mod = ImplicitlyModifiable);
     void removeRemoteContact(const QString &fname, const QString &lname);
     QContact setRemoteContact(const QString &fname, const QString &lname, const QContact &contact);
+    void setRemoteContactContent(const QString &fname, const QString &lname, const QContact &contact);
     void changeRemoteContactPhone(const QString &fname, const QString &lname, const QString &modPhone);
     void changeRemoteContactEmail(const QString &fname, const QString &lname, const QString &modEmail);
     void changeRemoteContactName(const QString &fname, const QString &lname, const QString &modfname, const QString &modlname);
@@ -74,6 +75,7 @@ public:
     bool downsyncWasRequired() const;
     QContact remoteContact(const QString &fname, const QString &lname) const;
     QSet<QContactId> modifiedIds() const;
+    QSet<QContactId> remotelyModifiedIds() const;
 
 Q_SIGNALS:
     void finished();
@@ -84,6 +86,11 @@ protected:
     bool determineRemoteCollections();
     bool deleteRemoteCollection(const QContactCollection &collection);
     bool determineRemoteContacts(const QContactCollection &collection);
+    void remoteContactChangesDetermined(
+            const QContactCollection &collection,
+            const QList<QContact> &remotelyAddedContacts,
+            const QList<QContact> &remotelyModifiedContacts,
+            const QList<QContact> &remotelyRemovedContacts);
     bool storeLocalChangesRemotely(
             const QContactCollection &collection,
             const QList<QContact> &addedContacts,
@@ -118,6 +125,7 @@ private:
     mutable QSet<QString> m_remoteModifications; // guids used to lookup into m_remoteServerContacts
     mutable QMap<QString, QContact> m_remoteServerContacts; // guid to contact
     mutable QSet<QContactId> m_modifiedIds;
+    QSet<QContactId> m_remotelyModifiedIds; // ids reported as remotely modified during the last sync cycle
     mutable QMultiMap<QString, QString> m_remoteServerDuplicates; // originalGuid to duplicateGuids.
 };
 
@@ -36,6 +36,7 @@
 #include "../../util.h"
 #include "testsyncadaptor.h"
 #include "qtcontacts-extensions.h"
+#include "contactdelta.h"
 
 #include "qcontactcollectionchangesfetchrequest.h"
 #include "qcontactcollectionchangesfetchrequest_impl.h"
@@ -46,6 +47,9 @@
 #include "qcontactclearchangeflagsrequest.h"
 #include "qcontactclearchangeflagsrequest_impl.h"
 
+#include <QAtomicInt>
+#include <QThread>
+
 class tst_synctransactions : public QObject
 {
     Q_OBJECT
@@ -76,6 +80,12 @@ private slots:
     void twcsa_nodelta();
     void twcsa_delta();
     void twcsa_oneway();
+    void twcsa_unchangedRemoteContacts();
+
+    void contentFingerprint();
+
+    void writeLockTimeout();
+    void yieldSyncTransactions();
 
 private:
     void waitForSignalPropagation();
@@ -95,9 +105,148 @@ private:
     }
 };
 
+// The write lock timeout is read once per process, so it must be set before any transaction begins
+static const int testWriteLockTimeout = 500;
+
+namespace {
+
+QMap<QString, QString> writerParameters(bool yieldSyncTransactions)
+{
+    QMap<QString, QString> parameters;
+    parameters.insert(QString::fromLatin1("autoTest"), QString::fromLatin1("true"));
+    parameters.insert(QString::fromLatin1("mergePresenceChanges"), QString::fromLatin1("true"));
+    parameters.insert(QString::fromLatin1("yieldSyncTransactions"), QString::fromLatin1(yieldSyncTransactions ? "true" : "false"));
+    return parameters;
+}
+
+qint64 lockAcquisitions(QtContactsSqliteExtensions::ContactManagerEngine *cme)
+{
+    for (const QPair<QString, qint64> &statistic : cme->writeLockStatistics()) {
+        if (statistic.first == QStringLiteral("sync:acquisitions")) {
+            return statistic.second;
+        }
+    }
+    return 0;
+}
+
+// Stores a collection of new contacts with storeChanges(), on its own connection
+class StoreChangesThread : public QThread
+{
+public:
+    StoreChangesThread(int contactCount, bool yieldSyncTransactions)
+        : m_contactCount(contactCount), m_yieldSyncTransactions(yieldSyncTransactions)
+    {
+    }
+
+    bool storing() const { return m_storing.loadAcquire() != 0; }
+    bool stored() const { return m_stored.loadAcquire() != 0; }
+    bool succeeded() const { return m_succeeded; }
+    qint64 acquisitions() const { return m_acquisitions; }
+    QContactCollectionId collectionId() const { return m_collectionId; }
+
+protected:
+    void run() override
+    {
+        QContactManager manager(QString::fromLatin1("org.nemomobile.contacts.sqlite"), writerParameters(m_yieldSyncTransactions));
+        QtContactsSqliteExtensions::ContactManagerEngine *cme = QtContactsSqliteExtensions::contactManagerEngine(manager);
+
+        QContactCollection collection;
+        collection.setMetaData(QContactCollection::KeyName, QStringLiteral("writer"));
+        collection.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_APPLICATIONNAME, "tst_synctransactions");
+        collection.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_ACCOUNTID, 6);
+        collection.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_REMOTEPATH, "/addressbooks/writer");
+
+        QList<QContact> contacts;
+        for (int i = 0; i < m_contactCount; ++i) {
+            QContact contact;
+            QContactName name;
+            name.setFirstName(QStringLiteral("Writer%1").arg(i));
+            name.setLastName(QStringLiteral("Lock"));
+            contact.saveDetail(&name);
+            QContactPhoneNumber phone;
+            phone.setNumber(QString::number(5550000 + i));
+            contact.saveDetail(&phone);
+            contacts.append(contact);
+        }
+
+        QHash<QContactCollection*, QList<QContact> *> additions;
+        QHash<QContactCollection*, QList<QContact> *> modifications;
+        additions.insert(&collection, &contacts);
+
+        const qint64 acquisitions = lockAcquisitions(cme);
+        QContactManager::Error error = QContactManager::NoError;
+        m_storing.storeRelease(1);
+        m_succeeded = cme->storeChanges(
+                &additions,
+                &modifications,
+                QList<QContactCollectionId>(),
+                QtContactsSqliteExtensions::ContactManagerEngine::PreserveLocalChanges,
+                true, &error);
+        m_stored.storeRelease(1);
+        m_acquisitions = lockAcquisitions(cme) - acquisitions;
+        m_collectionId = collection.id();
+    }
+
+private:
+    int m_contactCount;
+    bool m_yieldSyncTransactions;
+    QAtomicInt m_storing;
+    QAtomicInt m_stored;
+    bool m_succeeded = false;
+    qint64 m_acquisitions = 0;
+    QContactCollectionId m_collectionId;
+};
+
+// Repeatedly saves a single contact on its own connection, while a store is in progress
+class ContactSaverThread : public QThread
+{
+public:
+    ContactSaverThread(const StoreChangesThread *store)
+        : m_store(store)
+    {
+    }
+
+    int savesDuringStore() const { return m_savesDuringStore; }
+    QContactId contactId() const { return m_contactId; }
+
+protected:
+    void run() override
+    {
+        QContactManager manager(QString::fromLatin1("org.nemomobile.contacts.sqlite"), writerParameters(false));
+
+        QContact contact;
+        QContactName name;
+        name.setFirstName(QStringLiteral("Saver"));
+        name.setLastName(QStringLiteral("Lock"));
+        contact.saveDetail(&name);
+
+        while (!m_store->storing()) {
+            QThread::msleep(1);
+        }
+        for (int i = 0; !m_store->stored(); ++i) {
+            QContactNickname nickname = contact.detail<QContactNickname>();
+            nickname.setNickname(QStringLiteral("Save%1").arg(i));
+            contact.saveDetail(&nickname);
+            if (manager.saveContact(&contact) && !m_store->stored()) {
+                ++m_savesDuringStore;
+            }
+        }
+        m_contactId = contact.id();
+    }
+
+private:
+    const StoreChangesThread *m_store;
+    int m_savesDuringStore = 0;
+    QContactId m_contactId;
+};
+
+}
+
 tst_synctransactions::tst_synctransactions()
     : m_cm(0)
 {
+    qputenv("QTCONTACTS_SQLITE_WRITE_LOCK_TIMEOUT", QByteArray::number(testWriteLockTimeout));
+
     QMap<QString, QString> parameters;
     parameters.insert(QString::fromLatin1("autoTest"), QString::fromLatin1("true"));
     parameters.insert(QString::fromLatin1("mergePresenceChanges"), QString::fromLatin1("true"));
@@ -1310,6 +1459,30 @@ void tst_synctransactions::syncRequests()
         QCOMPARE(cfr->removedContacts().first().id(), bobId);
         QCOMPARE(cfr->unmodifiedContacts().size(), 0);
 
+        // the same changes should be reported one page at a time, if requested.
+        QContactChangesFetchRequest *pcfr = new QContactChangesFetchRequest;
+        pcfr->setManager(m_cm);
+        pcfr->setCollectionId(remoteAddressbookId);
+        pcfr->setUnmodifiedContactsPolicy(QContactChangesFetchRequest::IgnoreUnmodifiedContacts);
+        pcfr->setPageSize(1);
+        QList<QContactId> pagedAddedIds, pagedModifiedIds, pagedRemovedIds;
+        int pageCount = 0;
+        do {
+            pcfr->start();
+            QVERIFY(pcfr->waitForFinished(5000));
+            QCOMPARE(pcfr->error(), QContactManager::NoError);
+            QCOMPARE(pcfr->addedContacts().size() + pcfr->modifiedContacts().size() + pcfr->removedContacts().size(), 1);
+            QCOMPARE(pcfr->unmodifiedContacts().size(), 0);
+            foreach (const QContact &c, pcfr->addedContacts()) pagedAddedIds.append(c.id());
+            foreach (const QContact &c, pcfr->modifiedContacts()) pagedModifiedIds.append(c.id());
+            foreach (const QContact &c, pcfr->removedContacts()) pagedRemovedIds.append(c.id());
+            ++pageCount;
+        } while (pcfr->hasMorePages() && pageCount < 10);
+        QCOMPARE(pageCount, 3);
+        QCOMPARE(pagedAddedIds, QList<QContactId>() << charlieId);
+        QCOMPARE(pagedModifiedIds, QList<QContactId>() << aliceId);
+        QCOMPARE(pagedRemovedIds, QList<QContactId>() << bobId);
+
         // at this point, Bob should have been marked as deleted,
         // and should not be accessible using the normal access API.
         QContact deletedBob = m_cm->contact(bobId);
@@ -1395,6 +1568,20 @@ void tst_synctransactions::syncRequests()
         QCOMPARE(cfr->unmodifiedContacts().size(), 1);
         QCOMPARE(cfr->unmodifiedContacts().first().id(), aliceId);
 
+        // unmodified contacts can be reported by id only.
+        QContactChangesFetchRequest *icfr = new QContactChangesFetchRequest;
+        icfr->setManager(m_cm);
+        icfr->setCollectionId(remoteAddressbookId);
+        icfr->setUnmodifiedContactsPolicy(QContactChangesFetchRequest::FetchUnmodifiedContactIds);
+        icfr->start();
+        QVERIFY(icfr->waitForFinished(5000));
+        QCOMPARE(icfr->error(), QContactManager::NoError);
+        QCOMPARE(icfr->addedContacts().size(), 0);
+        QCOMPARE(icfr->modifiedContacts().size(), 0);
+        QCOMPARE(icfr->removedContacts().size(), 0);
+        QCOMPARE(icfr->unmodifiedContacts().size(), 0);
+        QCOMPARE(icfr->unmodifiedContactIds(), QList<QContactId>() << aliceId);
+
         // third, report remote changes and store locally
         // in this case, we simulate remote deletion of the entire collection.
         QContactChangesSaveRequest *csr = new QContactChangesSaveRequest;
@@ -1707,6 +1894,177 @@ void tst_synctransactions::twcsa_oneway()
     // TODO: a sync plugin which only supports to-device sync.
 }
 
+void tst_synctransactions::twcsa_unchangedRemoteContacts()
+{
+    const int accountId = 4;
+    const QString applicationName = QStringLiteral("tst_synctransactions::twcsa_unchangedRemoteContacts");
+    TestSyncAdaptor tsa(accountId, applicationName, *m_cm);
+    tsa.addRemoteContact("John", "One", "1111111");
+
+    // perform the initial sync cycle.
+    QSignalSpy finishedSpy(&tsa, SIGNAL(finished()));
+    QSignalSpy failedSpy(&tsa, SIGNAL(failed()));
+    tsa.performTwoWaySync();
+    QTRY_COMPARE(failedSpy.count() + finishedSpy.count(), 1);
+    QTRY_COMPARE(finishedSpy.count(), 1);
+
+    QContactCollectionFilter allCollections;
+    QContactId johnId;
+    for (const QContact &c : m_cm->contacts(allCollections)) {
+        const bool isAggregate = c.relatedContacts(QStringLiteral("Aggregates"), QContactRelationship::Second).size() > 0;
+        if (!isAggregate && c.detail<QContactName>().firstName() == QStringLiteral("John")) {
+            johnId = c.id();
+        }
+    }
+    QVERIFY(johnId != QContactId());
+
+    // the server now reports exactly the content which is stored locally.
+    // the remote contact is unchanged, so it should not be treated as modified.
+    tsa.setRemoteContactContent(QStringLiteral("John"), QStringLiteral("One"), m_cm->contact(johnId));
+    tsa.performTwoWaySync();
+    QTRY_COMPARE(failedSpy.count() + finishedSpy.count(), 2);
+    QTRY_COMPARE(finishedSpy.count(), 2);
+    QVERIFY(!tsa.remotelyModifiedIds().contains(johnId));
+    QCOMPARE(m_cm->contact(johnId).detail<QContactPhoneNumber>().number(), QStringLiteral("1111111"));
+
+    // a remote change to the content should still be detected and stored.
+    tsa.changeRemoteContactPhone(QStringLiteral("John"), QStringLiteral("One"), QStringLiteral("1111123"));
+    tsa.performTwoWaySync();
+    QTRY_COMPARE(failedSpy.count() + finishedSpy.count(), 3);
+    QTRY_COMPARE(finishedSpy.count(), 3);
+    QVERIFY(tsa.remotelyModifiedIds().contains(johnId));
+    QCOMPARE(m_cm->contact(johnId).detail<QContactPhoneNumber>().number(), QStringLiteral("1111123"));
+}
+
+void tst_synctransactions::writeLockTimeout()
+{
+    QtContactsSqliteExtensions::ContactManagerEngine *cme = QtContactsSqliteExtensions::contactManagerEngine(*m_cm);
+    QContactManager::Error err = QContactManager::NoError;
+
+    // another connection holds the write lock for the whole of a large store.
+    StoreChangesThread store(5000, false);
+    store.start();
+    QTRY_VERIFY(store.storing());
+    QThread::msleep(100);
+
+    QContact contact;
+    QContactName name;
+    name.setFirstName(QStringLiteral("Waiter"));
+    name.setLastName(QStringLiteral("Lock"));
+    contact.saveDetail(&name);
+    QVERIFY(!m_cm->saveContact(&contact));
+    QVERIFY2(!store.stored(), "The store completed before the write lock timed out");
+    QCOMPARE(m_cm->error(), QContactManager::LockedError);
+
+    // once the holder has committed, the lock can be acquired again.
+    QVERIFY(store.wait(300000));
+    QVERIFY(store.succeeded());
+    QCOMPARE(store.acquisitions(), qint64(1));
+    QVERIFY(m_cm->saveContact(&contact));
+
+    QVERIFY(m_cm->removeContact(contact.id()));
+    cme->clearChangeFlags(QList<QContactId>() << contact.id(), &err);
+    QVERIFY(m_cm->removeCollection(store.collectionId()));
+    cme->clearChangeFlags(store.collectionId(), &err);
+}
+
+void tst_synctransactions::yieldSyncTransactions()
+{
+    QtContactsSqliteExtensions::ContactManagerEngine *cme = QtContactsSqliteExtensions::contactManagerEngine(*m_cm);
+    QContactManager::Error err = QContactManager::NoError;
+
+    // a yieldable store commits between chunks whenever another writer is waiting.
+    const int contactCount = 1000;
+    StoreChangesThread store(contactCount, true);
+    ContactSaverThread saver(&store);
+    saver.start();
+    store.start();
+    QVERIFY(store.wait(300000));
+    QVERIFY(saver.wait(60000));
+    QVERIFY(store.succeeded());
+    QVERIFY(store.acquisitions() > 1);
+    QVERIFY(saver.savesDuringStore() > 0);
+
+    // every contact has been stored, regardless of the yielding.
+    QContactCollectionFilter collectionFilter;
+    collectionFilter.setCollectionId(store.collectionId());
+    const QList<QContact> stored = m_cm->contacts(collectionFilter);
+    QCOMPARE(stored.count(), contactCount);
+    QSet<QString> expectedNames;
+    for (int i = 0; i < contactCount; ++i) {
+        expectedNames.insert(QStringLiteral("Writer%1").arg(i));
+    }
+    QSet<QString> storedNames;
+    for (const QContact &contact : stored) {
+        storedNames.insert(contact.detail<QContactName>().firstName());
+        QCOMPARE(contact.detail<QContactPhoneNumber>().number(),
+                 QString::number(5550000 + contact.detail<QContactName>().firstName().mid(6).toInt()));
+    }
+    QCOMPARE(storedNames, expectedNames);
+
+    QVERIFY(m_cm->removeContact(saver.contactId()));
+    cme->clearChangeFlags(QList<QContactId>() << saver.contactId(), &err);
+    QVERIFY(m_cm->removeCollection(store.collectionId()));
+    cme->clearChangeFlags(store.collectionId(), &err);
+}
+
+void tst_synctransactions::contentFingerprint()
+{
+    QContactName name;
+    name.setFirstName(QStringLiteral("John"));
+    name.setLastName(QStringLiteral("One"));
+    QContactPhoneNumber phone;
+    phone.setNumber(QStringLiteral("1111111"));
+    QContactEmailAddress email;
+    email.setEmailAddress(QStringLiteral("john@one.tld"));
+
+    QContact contact;
+    contact.saveDetail(&name);
+    contact.saveDetail(&phone);
+    contact.saveDetail(&email);
+    const QByteArray fingerprint = QtContactsSqliteExtensions::contactContentFingerprint(contact);
+    QVERIFY(!fingerprint.isEmpty());
+
+    // the order of details is not significant.
+    QContact reordered;
+    reordered.saveDetail(&email);
+    reordered.saveDetail(&phone);
+    reordered.saveDetail(&name);
+    QCOMPARE(QtContactsSqliteExtensions::contactContentFingerprint(reordered), fingerprint);
+
+    // nor are ignorable detail types, ignorable fields or empty values.
+    QContactPhoneNumber ignorablePhone;
+    ignorablePhone.setNumber(QStringLiteral("1111111"));
+    ignorablePhone.setValue(QContactPhoneNumber::FieldNormalizedNumber, QStringLiteral("1111111"));
+    ignorablePhone.setValue(QContactDetail__FieldModifiable, true);
+    ignorablePhone.setSubTypes(QList<int>());
+    QContactStatusFlags flags;
+    flags.setFlag(QContactStatusFlags::IsModified, true);
+    QContact ignorable;
+    ignorable.saveDetail(&name);
+    ignorable.saveDetail(&ignorablePhone);
+    ignorable.saveDetail(&email);
+    ignorable.saveDetail(&flags, QContact::IgnoreAccessConstraints);
+    QCOMPARE(QtContactsSqliteExtensions::contactContentFingerprint(ignorable), fingerprint);
+
+    // but differences in content are.
+    QContactPhoneNumber modifiedPhone;
+    modifiedPhone.setNumber(QStringLiteral("1111123"));
+    QContact modified;
+    modified.saveDetail(&name);
+    modified.saveDetail(&modifiedPhone);
+    modified.saveDetail(&email);
+    QVERIFY(QtContactsSqliteExtensions::contactContentFingerprint(modified) != fingerprint);
+
+    // as are duplicated details.
+    QContactPhoneNumber duplicatePhone;
+    duplicatePhone.setNumber(QStringLiteral("1111111"));
+    QContact duplicated(contact);
+    duplicated.saveDetail(&duplicatePhone);
+    QCOMPARE(duplicated.details<QContactPhoneNumber>().size(), 2);
+    QVERIFY(QtContactsSqliteExtensions::contactContentFingerprint(duplicated) != fingerprint);
+}
+
 
 
 /*
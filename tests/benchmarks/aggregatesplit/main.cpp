@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+
+
+#include <QContactManager>
+#include <QContactCollectionFilter>
+#include <QContactRelationship>
+#include <QContactName>
+#include <QContactPhoneNumber>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSet>
+#include <QtDebug>
+
+#include "qtcontacts-extensions.h"
+#include "qtcontacts-extensions_impl.h"
+#include "qtcontacts-extensions_manager_impl.h"
+#include "contactmanagerengine.h"
+
+QTCONTACTS_USE_NAMESPACE
+
+static const int batchSize = 1000;
+
+static QMap<QString, QString> managerParameters()
+{
+    QMap<QString, QString> parameters;
+    parameters.insert(QString::fromLatin1("autoTest"), QString::fromLatin1("true"));
+    parameters.insert(QString::fromLatin1("mergePresenceChanges"), QString::fromLatin1("false"));
+    return parameters;
+}
+
+static QContactCollectionFilter localContactsFilter(const QContactManager &manager)
+{
+    QContactCollectionFilter filter;
+    filter.setCollectionId(QtContactsSqliteExtensions::localCollectionId(manager.managerUri()));
+    return filter;
+}
+
+// Every contact has a distinct name, so that no two contacts are aggregated together
+static QContact generateContact(int index)
+{
+    QContact contact;
+
+    QContactName name;
+    name.setFirstName(QString::fromLatin1("Split%1").arg(index));
+    name.setLastName(QString::fromLatin1("Benchmark%1").arg(index));
+    contact.saveDetail(&name);
+
+    QContactPhoneNumber phone;
+    phone.setNumber(QString::number(5550000 + index));
+    contact.saveDetail(&phone);
+
+    return contact;
+}
+
+static bool populateDatabase(QContactManager *manager, int numberOfContacts, QList<QContactId> *contactIds)
+{
+    // Start from an empty addressbook, so that the aggregates are not affected by earlier runs
+    const QList<QContactId> existingIds(manager->contactIds(localContactsFilter(*manager)));
+    if (!existingIds.isEmpty() && !manager->removeContacts(existingIds)) {
+        qWarning() << "Failed to clear database:" << manager->error();
+        return false;
+    }
+
+    for (int existing = 0; existing < numberOfContacts; ) {
+        QList<QContact> contacts;
+        const int count = qMin(batchSize, numberOfContacts - existing);
+        for (int i = 0; i < count; ++i) {
+            contacts.append(generateContact(existing + i));
+        }
+        if (!manager->saveContacts(&contacts)) {
+            qWarning() << "Failed to populate database:" << manager->error();
+            return false;
+        }
+        foreach (const QContact &contact, contacts) {
+            contactIds->append(contact.id());
+        }
+        existing += count;
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv);
+
+    const QStringList &args(application.arguments());
+    if (args.contains("--help") || args.contains("-h")) {
+        qDebug() << "usage: aggregatesplit [<number of aggregates>]";
+        qDebug() << "Merges pairs of contacts into the given number of aggregates (default: 1000), then";
+        qDebug() << "splits them all again by removing their aggregation relationships in a single request.";
+        return 0;
+    }
+
+    int numberOfAggregates = 1000;
+    if (args.size() > 1) {
+        bool ok = false;
+        const int size = args.at(1).toInt(&ok);
+        if (ok && size > 0) {
+            numberOfAggregates = size;
+        }
+    }
+
+    QContactManager manager(QString::fromLatin1("org.nemomobile.contacts.sqlite"), managerParameters());
+    const QString aggregatesType(QContactRelationship::Aggregates());
+
+    QList<QContactId> contactIds;
+    if (!populateDatabase(&manager, numberOfAggregates * 2, &contactIds)) {
+        return 1;
+    }
+
+    // Find the aggregate generated for each contact
+    QHash<QContactId, QContactId> aggregateIds;
+    foreach (const QContactRelationship &relationship, manager.relationships(aggregatesType)) {
+        aggregateIds.insert(relationship.second(), relationship.first());
+    }
+
+    // Merge each pair as a manual merge would: link the second contact into the aggregate
+    // of the first, then unlink it from its own aggregate, which is removed once childless
+    QList<QContactRelationship> links;
+    QList<QContactRelationship> unlinks;
+    QSet<QContactId> mergedAggregateIds;
+    for (int i = 0; i < numberOfAggregates; ++i) {
+        const QContactId aggregateId(aggregateIds.value(contactIds.at(2 * i)));
+        const QContactId mergedAggregateId(aggregateIds.value(contactIds.at(2 * i + 1)));
+        if (aggregateId.isNull() || mergedAggregateId.isNull()) {
+            qWarning() << "No aggregate found for contacts:" << contactIds.at(2 * i) << contactIds.at(2 * i + 1);
+            return 1;
+        }
+
+        QContactRelationship relationship;
+        relationship.setRelationshipType(aggregatesType);
+        relationship.setFirst(aggregateId);
+        relationship.setSecond(contactIds.at(2 * i + 1));
+        links.append(relationship);
+
+        relationship.setFirst(mergedAggregateId);
+        unlinks.append(relationship);
+        mergedAggregateIds.insert(mergedAggregateId);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    if (!manager.saveRelationships(&links, nullptr)) {
+        qWarning() << "Failed to link contacts:" << manager.error();
+        return 1;
+    }
+    if (!manager.removeRelationships(unlinks, nullptr)) {
+        qWarning() << "Failed to unlink contacts:" << manager.error();
+        return 1;
+    }
+    qDebug().noquote() << QString::fromLatin1("Merged %1 aggregates in %2 ms").arg(numberOfAggregates).arg(timer.elapsed());
+
+    // Each merged contact's own aggregate is removed
+    if (manager.contactIds().toSet().intersects(mergedAggregateIds)) {
+        qWarning() << "Aggregates of merged contacts were not removed";
+        return 1;
+    }
+
+    // Split every aggregate again; each unlinked contact is orphaned, and given a new aggregate
+    timer.restart();
+    if (!manager.removeRelationships(links, nullptr)) {
+        qWarning() << "Failed to split aggregates:" << manager.error();
+        return 1;
+    }
+    qDebug().noquote() << QString::fromLatin1("Split %1 aggregates in %2 ms").arg(numberOfAggregates).arg(timer.elapsed());
+
+    QHash<QContactId, QContactId> splitAggregateIds;
+    foreach (const QContactRelationship &relationship, manager.relationships(aggregatesType)) {
+        if (contactIds.contains(relationship.second())) {
+            splitAggregateIds.insert(relationship.second(), relationship.first());
+        }
+    }
+    for (int i = 0; i < numberOfAggregates; ++i) {
+        const QContactId aggregateId(splitAggregateIds.value(contactIds.at(2 * i)));
+        const QContactId recreatedId(splitAggregateIds.value(contactIds.at(2 * i + 1)));
+        if (aggregateId != aggregateIds.value(contactIds.at(2 * i))
+                || recreatedId.isNull() || recreatedId == aggregateId
+                || mergedAggregateIds.contains(recreatedId)) {
+            qWarning() << "Aggregate was not re-created for split contact:" << contactIds.at(2 * i + 1);
+            return 1;
+        }
+    }
+
+    manager.removeContacts(contactIds);
+    return 0;
+}
@@ -2,5 +2,10 @@ TEMPLATE = subdirs
 
 SUBDIRS = \
         fetchtimes \
+        contactdelta \
+        startup \
+        scaling \
+        writecontention \
+        aggregatesplit \
         #deltadetection
 
@@ -0,0 +1,14 @@
+include(../../../config.pri)
+
+TEMPLATE = app
+TARGET = contactdelta
+
+QT = \
+    core \
+    testlib
+
+SOURCES = main.cpp
+INCLUDEPATH += $$PWD/../../../src/extensions/
+
+target.path = /opt/tests/qtcontacts-sqlite-qt5
+INSTALLS += target
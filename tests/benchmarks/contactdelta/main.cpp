@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+
+#include <QtTest/QtTest>
+
+#include <QContact>
+#include <QContactEmailAddress>
+#include <QContactName>
+#include <QContactPhoneNumber>
+
+#include "contactdelta_impl.h"
+
+QTCONTACTS_USE_NAMESPACE
+
+// Measures delta detection between two versions of a contact which has
+// many details of the same type, as is common for enterprise contacts.
+class ContactDeltaBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void determineDelta_data();
+    void determineDelta();
+
+private:
+    QContact generateContact(int detailCount, int modifiedCount, bool reversed) const;
+};
+
+QContact ContactDeltaBenchmark::generateContact(int detailCount, int modifiedCount, bool reversed) const
+{
+    QContact contact;
+
+    QContactName name;
+    name.setFirstName(QStringLiteral("Enterprise"));
+    name.setLastName(QStringLiteral("Contact"));
+    contact.saveDetail(&name);
+
+    // half of the details are phone numbers, half are email addresses.
+    // the first modifiedCount of each type differ between versions.
+    for (int n = 0; n < detailCount / 2; ++n) {
+        const int i = reversed ? (detailCount / 2 - 1 - n) : n;
+        const QString suffix = (reversed && i < modifiedCount) ? QStringLiteral("9") : QStringLiteral("0");
+
+        QContactPhoneNumber phone;
+        phone.setNumber(QStringLiteral("+3585%1%2").arg(1000000 + i * 37).arg(suffix));
+        phone.setContexts(i % 2 ? QContactDetail::ContextWork : QContactDetail::ContextHome);
+        phone.setSubTypes(QList<int>() << (i % 3 ? QContactPhoneNumber::SubTypeMobile : QContactPhoneNumber::SubTypeLandline));
+        contact.saveDetail(&phone);
+
+        QContactEmailAddress email;
+        email.setEmailAddress(QStringLiteral("person%1.%2@example.com").arg(i).arg(suffix));
+        email.setContexts(QContactDetail::ContextWork);
+        contact.saveDetail(&email);
+    }
+
+    return contact;
+}
+
+void ContactDeltaBenchmark::determineDelta_data()
+{
+    QTest::addColumn<int>("detailCount");
+    QTest::addColumn<int>("modifiedCount");
+
+    QTest::newRow("10 details, 2 modified") << 10 << 2;
+    QTest::newRow("40 details, 10 modified") << 40 << 10;
+    QTest::newRow("80 details, 40 modified") << 80 << 40;
+    QTest::newRow("160 details, 80 modified") << 160 << 80;
+}
+
+void ContactDeltaBenchmark::determineDelta()
+{
+    QFETCH(int, detailCount);
+    QFETCH(int, modifiedCount);
+
+    // the new version lists its details in the opposite order,
+    // so that matching cannot rely upon the detail positions.
+    const QList<QContactDetail> oldDetails = generateContact(detailCount, modifiedCount, false).details();
+    const QList<QContactDetail> newDetails = generateContact(detailCount, modifiedCount, true).details();
+
+    QtContactsSqliteExtensions::ContactDetailDelta delta;
+    QBENCHMARK {
+        delta = QtContactsSqliteExtensions::determineContactDetailDelta(oldDetails, newDetails);
+    }
+
+    QVERIFY(delta.isValid);
+    QCOMPARE(delta.modifications.size(), 2 * modifiedCount);
+    QCOMPARE(delta.additions.size(), 0);
+    QCOMPARE(delta.deletions.size(), 0);
+}
+
+QTEST_GUILESS_MAIN(ContactDeltaBenchmark)
+#include "main.moc"
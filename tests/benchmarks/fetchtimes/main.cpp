@@ -56,8 +56,15 @@
 #include <QElapsedTimer>
 #include <QDateTime>
 #include <QUuid>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtMath>
 #include <QtDebug>
 
+#include <algorithm>
+
 #include "qtcontacts-extensions.h"
 #include "qtcontacts-extensions_impl.h"
 #include "qtcontacts-extensions_manager_impl.h"
@@ -68,6 +75,194 @@ QTCONTACTS_USE_NAMESPACE
 #include <QContactIdFilter>
 static QContactId retrievalId(const QContact &contact) { return contact.id(); }
 
+// Samples of a single measurement within a benchmark function, collected over
+// all of the timed iterations so that they can be summarised and compared.
+struct Measurement
+{
+    QString scenario;
+    QString name;
+    int datasetSize = 0;
+    int rows = 0;
+    QList<qint64> samples;
+};
+
+static QList<Measurement> measurements;
+static QString currentScenario;
+static bool recordingMeasurements = true;
+
+static void recordMeasurement(const char *name, int datasetSize, int rows, qint64 elapsed)
+{
+    if (!recordingMeasurements) {
+        // warmup iteration.
+        return;
+    }
+
+    const QString measurementName(QString::fromLatin1(name));
+    for (Measurement &measurement : measurements) {
+        if (measurement.scenario == currentScenario
+                && measurement.name == measurementName
+                && measurement.datasetSize == datasetSize) {
+            measurement.rows = rows;
+            measurement.samples.append(elapsed);
+            return;
+        }
+    }
+
+    Measurement measurement;
+    measurement.scenario = currentScenario;
+    measurement.name = measurementName;
+    measurement.datasetSize = datasetSize;
+    measurement.rows = rows;
+    measurement.samples.append(elapsed);
+    measurements.append(measurement);
+}
+
+static QString measurementKey(const QJsonObject &result)
+{
+    return QStringLiteral("%1/%2/%3").arg(result.value(QStringLiteral("scenario")).toString())
+                                     .arg(result.value(QStringLiteral("measurement")).toString())
+                                     .arg(result.value(QStringLiteral("datasetSize")).toInt());
+}
+
+static QJsonObject summariseMeasurement(const Measurement &measurement)
+{
+    QList<qint64> sorted(measurement.samples);
+    std::sort(sorted.begin(), sorted.end());
+
+    const int count = sorted.size();
+    const qint64 median = (count % 2) ? sorted.at(count / 2)
+                                      : (sorted.at(count / 2 - 1) + sorted.at(count / 2)) / 2;
+    const qint64 p95 = sorted.at(qMax(0, qCeil(count * 0.95) - 1));
+
+    QJsonArray samples;
+    for (qint64 sample : measurement.samples) {
+        samples.append(sample);
+    }
+
+    QJsonObject result;
+    result.insert(QStringLiteral("scenario"), measurement.scenario);
+    result.insert(QStringLiteral("measurement"), measurement.name);
+    result.insert(QStringLiteral("datasetSize"), measurement.datasetSize);
+    result.insert(QStringLiteral("rows"), measurement.rows);
+    result.insert(QStringLiteral("samples"), samples);
+    result.insert(QStringLiteral("min"), sorted.first());
+    result.insert(QStringLiteral("median"), median);
+    result.insert(QStringLiteral("p95"), p95);
+    result.insert(QStringLiteral("max"), sorted.last());
+    // elapsed times have millisecond resolution, so treat anything faster as 1ms.
+    result.insert(QStringLiteral("rowsPerSecond"), (1000.0 * measurement.rows) / qMax<qint64>(median, 1));
+    return result;
+}
+
+static bool writeResults(const QString &fileName, int iterations, int warmup, bool quickMode)
+{
+    QJsonArray results;
+    qDebug() << "--------";
+    qDebug() << "Summary over" << iterations << "iterations (" << warmup << "warmup ), milliseconds:";
+    for (const Measurement &measurement : measurements) {
+        const QJsonObject result(summariseMeasurement(measurement));
+        qDebug() << "   " << measurementKey(result)
+                 << "min" << result.value(QStringLiteral("min")).toInt()
+                 << "median" << result.value(QStringLiteral("median")).toInt()
+                 << "p95" << result.value(QStringLiteral("p95")).toInt()
+                 << "max" << result.value(QStringLiteral("max")).toInt()
+                 << "rows/sec" << qRound(result.value(QStringLiteral("rowsPerSecond")).toDouble());
+        results.append(result);
+    }
+
+    if (fileName.isEmpty()) {
+        return true;
+    }
+
+    QJsonObject document;
+    document.insert(QStringLiteral("benchmark"), QStringLiteral("fetchtimes"));
+    document.insert(QStringLiteral("timestamp"), QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    document.insert(QStringLiteral("quick"), quickMode);
+    document.insert(QStringLiteral("iterations"), iterations);
+    document.insert(QStringLiteral("warmup"), warmup);
+    document.insert(QStringLiteral("results"), results);
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Unable to write results to" << fileName << ":" << file.errorString();
+        return false;
+    }
+    file.write(QJsonDocument(document).toJson());
+    qDebug() << "Results written to" << fileName;
+    return true;
+}
+
+static QMap<QString, QJsonObject> readResults(const QString &fileName, bool *ok)
+{
+    QMap<QString, QJsonObject> results;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Unable to read results from" << fileName << ":" << file.errorString();
+        *ok = false;
+        return results;
+    }
+
+    QJsonParseError error;
+    const QJsonDocument document(QJsonDocument::fromJson(file.readAll(), &error));
+    if (error.error != QJsonParseError::NoError || !document.isObject()) {
+        qWarning() << "Unable to parse results from" << fileName << ":" << error.errorString();
+        *ok = false;
+        return results;
+    }
+
+    const QJsonArray array(document.object().value(QStringLiteral("results")).toArray());
+    for (const QJsonValue &value : array) {
+        const QJsonObject result(value.toObject());
+        results.insert(measurementKey(result), result);
+    }
+
+    *ok = true;
+    return results;
+}
+
+// Returns the number of measurements whose median regressed by more than
+// thresholdPercent (and by at least minimumDelta milliseconds, to avoid
+// flagging timer resolution noise), or -1 if either file could not be read.
+static int compareResults(const QString &baselineFileName, const QString &currentFileName, double thresholdPercent, qint64 minimumDelta)
+{
+    bool baselineOk = false, currentOk = false;
+    const QMap<QString, QJsonObject> baseline(readResults(baselineFileName, &baselineOk));
+    const QMap<QString, QJsonObject> current(readResults(currentFileName, &currentOk));
+    if (!baselineOk || !currentOk) {
+        return -1;
+    }
+
+    int regressions = 0;
+    qDebug() << "Comparing medians of" << currentFileName << "against" << baselineFileName
+             << "with threshold" << thresholdPercent << "% and minimum delta" << minimumDelta << "ms";
+    for (QMap<QString, QJsonObject>::const_iterator it = current.constBegin(); it != current.constEnd(); ++it) {
+        if (!baseline.contains(it.key())) {
+            qDebug() << "    new:" << it.key();
+            continue;
+        }
+
+        const qint64 before = baseline.value(it.key()).value(QStringLiteral("median")).toInt();
+        const qint64 after = it.value().value(QStringLiteral("median")).toInt();
+        const double change = (100.0 * (after - before)) / qMax<qint64>(before, 1);
+        const bool regressed = change > thresholdPercent && (after - before) >= minimumDelta;
+        const bool improved = change < -thresholdPercent && (before - after) >= minimumDelta;
+        qDebug() << (regressed ? "    REGRESSION:" : (improved ? "    improvement:" : "    unchanged:"))
+                 << it.key() << before << "->" << after << "ms (" << change << "% )";
+        if (regressed) {
+            ++regressions;
+        }
+    }
+    for (QMap<QString, QJsonObject>::const_iterator it = baseline.constBegin(); it != baseline.constEnd(); ++it) {
+        if (!current.contains(it.key())) {
+            qDebug() << "    missing:" << it.key();
+        }
+    }
+
+    qDebug() << regressions << "regressions found";
+    return regressions;
+}
+
 static QStringList generateNonOverlappingFirstNamesList()
 {
     QStringList retn;
@@ -361,6 +556,7 @@ static qint64 aggregatedPresenceUpdate(QContactManager &manager, bool quickMode)
     int totalAggregatesInDatabase = manager.contactIds().count();
     qDebug() << "    update ( batch of" << contactsToUpdate.size() << ") presence+nick+avatar (with" << totalAggregatesInDatabase << "existing in database, partial overlap):" << presenceElapsed
              << "milliseconds (" << ((1.0 * presenceElapsed) / (1.0 * contactsToUpdate.size())) << " msec per updated contact )";
+    recordMeasurement("updatePresenceNickAvatar", contactsToUpdate.size(), contactsToUpdate.size(), presenceElapsed);
     elapsedTimeTotal += presenceElapsed;
 
     // now test just update the presence status (not nickname or avatar details).
@@ -381,6 +577,7 @@ static qint64 aggregatedPresenceUpdate(QContactManager &manager, bool quickMode)
     totalAggregatesInDatabase = manager.contactIds().count();
     qDebug() << "    update ( batch of" << contactsToUpdate.size() << ") presence only (with" << totalAggregatesInDatabase << "existing in database, partial overlap):" << presenceElapsed
              << "milliseconds (" << ((1.0 * presenceElapsed) / (1.0 * contactsToUpdate.size())) << " msec per updated contact )";
+    recordMeasurement("updatePresenceOnly", contactsToUpdate.size(), contactsToUpdate.size(), presenceElapsed);
     elapsedTimeTotal += presenceElapsed;
 
     // also pass a "detail type mask" to the update.  This allows the backend
@@ -404,6 +601,7 @@ static qint64 aggregatedPresenceUpdate(QContactManager &manager, bool quickMode)
     totalAggregatesInDatabase = manager.contactIds().count();
     qDebug() << "    update ( batch of" << contactsToUpdate.size() << ") masked presence only (with" << totalAggregatesInDatabase << "existing in database, partial overlap):" << presenceElapsed
              << "milliseconds (" << ((1.0 * presenceElapsed) / (1.0 * contactsToUpdate.size())) << " msec per updated contact )";
+    recordMeasurement("updateMaskedPresenceOnly", contactsToUpdate.size(), contactsToUpdate.size(), presenceElapsed);
     elapsedTimeTotal += presenceElapsed;
 
     QContactManager::Error purgeError = QContactManager::NoError;
@@ -504,6 +702,7 @@ static qint64 nonAggregatedPresenceUpdate(QContactManager &manager, bool quickMo
     int totalAggregatesInDatabase = manager.contactIds().count();
     qDebug() << "    update ( batch of" << contactsToUpdate.size() << ") presence+nick+avatar (with" << totalAggregatesInDatabase << "existing in database, no overlap):" << presenceElapsed
              << "milliseconds (" << ((1.0 * presenceElapsed) / (1.0 * contactsToUpdate.size())) << " msec per updated contact )";
+    recordMeasurement("updatePresenceNickAvatar", contactsToUpdate.size(), contactsToUpdate.size(), presenceElapsed);
     elapsedTimeTotal += presenceElapsed;
 
     QContactManager::Error purgeError = QContactManager::NoError;
@@ -588,6 +787,7 @@ static qint64 scalingPresenceUpdate(QContactManager &manager, bool quickMode)
     int totalAggregatesInDatabase = manager.contactIds().count();
     qDebug() << "    update ( batch of" << contactsToUpdate.size() << ") presence+nick+avatar (with" << totalAggregatesInDatabase << "existing in database, all overlap):" << presenceElapsed
              << "milliseconds (" << ((1.0 * presenceElapsed) / (1.0 * contactsToUpdate.size())) << " msec per updated contact )";
+    recordMeasurement("updatePresenceNickAvatar", contactsToUpdate.size(), contactsToUpdate.size(), presenceElapsed);
     elapsedTimeTotal += presenceElapsed;
 
     QContactManager::Error purgeError = QContactManager::NoError;
@@ -669,6 +869,7 @@ static qint64 entireBatchPresenceUpdate(QContactManager &manager, bool quickMode
     int totalAggregatesInDatabase = manager.contactIds().count();
     qDebug() << "    update ( batch of" << contactsToUpdate.size() << ") presence+nick+avatar (with" << totalAggregatesInDatabase << "existing in database, all overlap):" << presenceElapsed
              << "milliseconds (" << ((1.0 * presenceElapsed) / (1.0 * contactsToUpdate.size())) << " msec per updated contact )";
+    recordMeasurement("updatePresenceNickAvatar", contactsToUpdate.size(), contactsToUpdate.size(), presenceElapsed);
     elapsedTimeTotal += presenceElapsed;
 
     QContactManager::Error purgeError = QContactManager::NoError;
@@ -755,6 +956,7 @@ static qint64 smallBatchPresenceUpdate(QContactManager &manager, bool quickMode)
     int totalAggregatesInDatabase = manager.contactIds().count();
     qDebug() << "    update ( batch of" << contactsToUpdate.size() << ") presence+nick+avatar (with" << totalAggregatesInDatabase << "existing in database, all overlap):" << presenceElapsed
              << "milliseconds (" << ((1.0 * presenceElapsed) / (1.0 * contactsToUpdate.size())) << " msec per updated contact )";
+    recordMeasurement("updatePresenceNickAvatar", contactsToUpdate.size(), contactsToUpdate.size(), presenceElapsed);
     elapsedTimeTotal += presenceElapsed;
 
     QContactManager::Error purgeError = QContactManager::NoError;
@@ -834,6 +1036,7 @@ static qint64 aggregationOperations(QContactManager &manager, bool quickMode)
     int totalAggregatesInDatabase = manager.contactIds().count();
     qDebug() << "    average time for aggregation of" << contactsToAggregate.size() << "contacts (with" << totalAggregatesInDatabase << "existing in database):" << aggregationElapsed
              << "milliseconds (" << ((1.0 * aggregationElapsed) / (1.0 * contactsToAggregate.size())) << " msec per aggregated contact )";
+    recordMeasurement("aggregate", contactsToAggregate.size(), contactsToAggregate.size(), aggregationElapsed);
     elapsedTimeTotal += aggregationElapsed;
     for (const QContact &c : contactsToAggregate) {
         deleteIds.append(c.id());
@@ -860,6 +1063,7 @@ static qint64 aggregationOperations(QContactManager &manager, bool quickMode)
     totalAggregatesInDatabase = manager.contactIds().count();
     qDebug() << "    average time for aggregation of" << contactsToAggregate.size() << "contacts (with" << totalAggregatesInDatabase << "existing in database):" << aggregationElapsed
              << "milliseconds (" << ((1.0 * aggregationElapsed) / (1.0 * contactsToAggregate.size())) << " msec per aggregated contact )";
+    recordMeasurement("aggregateWithMoreExisting", contactsToAggregate.size(), contactsToAggregate.size(), aggregationElapsed);
     elapsedTimeTotal += aggregationElapsed;
     for (const QContact &c : contactsToAggregate) {
         deleteIds.append(c.id());
@@ -943,6 +1147,7 @@ static qint64 smallBatchWithExistingData(QContactManager &manager, bool quickMod
         manager.saveContacts(&td);
         ste = syncTimer.elapsed();
         qDebug() << "    saving took" << ste << "milliseconds (" << ((1.0 * ste) / (1.0 * td.size())) << "msec per contact )";
+        recordMeasurement("save", td.size(), td.size(), ste);
         elapsedTimeTotal += ste;
 
         QContactFetchHint fh;
@@ -950,6 +1155,7 @@ static qint64 smallBatchWithExistingData(QContactManager &manager, bool quickMod
         QList<QContact> readContacts = manager.contacts(QContactFilter(), QList<QContactSortOrder>(), fh);
         ste = syncTimer.elapsed();
         qDebug() << "    reading all (" << readContacts.size() << "), all details, took" << ste << "milliseconds";
+        recordMeasurement("readAll", td.size(), readContacts.size(), ste);
         elapsedTimeTotal += ste;
 
         fh.setDetailTypesHint(QList<QContactDetail::DetailType>() << QContactDisplayLabel::Type
@@ -959,6 +1165,7 @@ static qint64 smallBatchWithExistingData(QContactManager &manager, bool quickMod
         readContacts = manager.contacts(QContactFilter(), QList<QContactSortOrder>(), fh);
         ste = syncTimer.elapsed();
         qDebug() << "    reading all, common details, took" << ste << "milliseconds";
+        recordMeasurement("readCommonDetails", td.size(), readContacts.size(), ste);
         elapsedTimeTotal += ste;
 
         fh.setOptimizationHints(QContactFetchHint::NoRelationships);
@@ -967,6 +1174,7 @@ static qint64 smallBatchWithExistingData(QContactManager &manager, bool quickMod
         readContacts = manager.contacts(QContactFilter(), QList<QContactSortOrder>(), fh);
         ste = syncTimer.elapsed();
         qDebug() << "    reading all, no relationships, took" << ste << "milliseconds";
+        recordMeasurement("readNoRelationships", td.size(), readContacts.size(), ste);
         elapsedTimeTotal += ste;
 
         fh.setDetailTypesHint(QList<QContactDetail::DetailType>() << QContactDisplayLabel::Type
@@ -975,6 +1183,7 @@ static qint64 smallBatchWithExistingData(QContactManager &manager, bool quickMod
         readContacts = manager.contacts(QContactFilter(), QList<QContactSortOrder>(), fh);
         ste = syncTimer.elapsed();
         qDebug() << "    reading all, display details + no rels, took" << ste << "milliseconds";
+        recordMeasurement("readDisplayDetails", td.size(), readContacts.size(), ste);
         elapsedTimeTotal += ste;
 
         QContactDetailFilter firstNameStartsA;
@@ -986,6 +1195,7 @@ static qint64 smallBatchWithExistingData(QContactManager &manager, bool quickMod
         readContacts = manager.contacts(firstNameStartsA, QList<QContactSortOrder>(), fh);
         ste = syncTimer.elapsed();
         qDebug() << "    reading filtered (" << readContacts.size() << "), no relationships, took" << ste << "milliseconds";
+        recordMeasurement("readFiltered", td.size(), readContacts.size(), ste);
         elapsedTimeTotal += ste;
 
         QList<QContactId> idsToRemove;
@@ -1000,6 +1210,7 @@ static qint64 smallBatchWithExistingData(QContactManager &manager, bool quickMod
         cme->clearChangeFlags(idsToRemove, &purgeError);
         ste = syncTimer.elapsed();
         qDebug() << "    removing test data took" << ste << "milliseconds (" << ((1.0 * ste) / (1.0 * td.size())) << "msec per contact )";
+        recordMeasurement("remove", td.size(), td.size(), ste);
         elapsedTimeTotal += ste;
     }
 
@@ -1074,6 +1285,7 @@ static qint64 synchronousOperations(QContactManager &manager, bool quickMode)
         manager.saveContacts(&td);
         ste = syncTimer.elapsed();
         qDebug() << "    saving took" << ste << "milliseconds (" << ((1.0 * ste) / (1.0 * td.size())) << "msec per contact )";
+        recordMeasurement("save", td.size(), td.size(), ste);
         elapsedTimeTotal += ste;
 
         QContactCollectionFilter testingFilter;
@@ -1087,6 +1299,7 @@ static qint64 synchronousOperations(QContactManager &manager, bool quickMode)
             qWarning() << "Invalid retrieval count:" << readContacts.size() << "expecting:" << td.size();
         }
         qDebug() << "    reading all (" << readContacts.size() << "), all details, took" << ste << "milliseconds (" << ((1.0 * ste) / (1.0 * td.size())) << "msec per contact )";
+        recordMeasurement("readAll", td.size(), readContacts.size(), ste);
         elapsedTimeTotal += ste;
 
         fh.setDetailTypesHint(QList<QContactDetail::DetailType>() << QContactDisplayLabel::Type
@@ -1099,6 +1312,7 @@ static qint64 synchronousOperations(QContactManager &manager, bool quickMode)
             qWarning() << "Invalid retrieval count:" << readContacts.size() << "expecting:" << td.size();
         }
         qDebug() << "    reading all, common details, took" << ste << "milliseconds (" << ((1.0 * ste) / (1.0 * td.size())) << "msec per contact )";
+        recordMeasurement("readCommonDetails", td.size(), readContacts.size(), ste);
         elapsedTimeTotal += ste;
 
         fh.setOptimizationHints(QContactFetchHint::NoRelationships);
@@ -1110,6 +1324,7 @@ static qint64 synchronousOperations(QContactManager &manager, bool quickMode)
             qWarning() << "Invalid retrieval count:" << readContacts.size() << "expecting:" << td.size();
         }
         qDebug() << "    reading all, no relationships, took" << ste << "milliseconds (" << ((1.0 * ste) / (1.0 * td.size())) << "msec per contact )";
+        recordMeasurement("readNoRelationships", td.size(), readContacts.size(), ste);
         elapsedTimeTotal += ste;
 
         fh.setDetailTypesHint(QList<QContactDetail::DetailType>() << QContactDisplayLabel::Type
@@ -1121,6 +1336,7 @@ static qint64 synchronousOperations(QContactManager &manager, bool quickMode)
             qWarning() << "Invalid retrieval count:" << readContacts.size() << "expecting:" << td.size();
         }
         qDebug() << "    reading all, display details + no rels, took" << ste << "milliseconds (" << ((1.0 * ste) / (1.0 * td.size())) << "msec per contact )";
+        recordMeasurement("readDisplayDetails", td.size(), readContacts.size(), ste);
         elapsedTimeTotal += ste;
 
         // Read the contacts, selected by ID
@@ -1136,6 +1352,7 @@ static qint64 synchronousOperations(QContactManager &manager, bool quickMode)
             qWarning() << "Invalid retrieval count:" << readContacts.size() << "expecting:" << td.size();
         }
         qDebug() << "    reading all by IDs, display details + no rels, took" << ste << "milliseconds (" << ((1.0 * ste) / (1.0 * td.size())) << "msec per contact )";
+        recordMeasurement("readByIds", td.size(), readContacts.size(), ste);
         elapsedTimeTotal += ste;
 
         // Read the same set using ID filtering
@@ -1149,6 +1366,7 @@ static qint64 synchronousOperations(QContactManager &manager, bool quickMode)
             qWarning() << "Invalid retrieval count:" << readContacts.size() << "expecting:" << td.size();
         }
         qDebug() << "    reading all by ID filter, display details + no rels, took" << ste << "milliseconds (" << ((1.0 * ste) / (1.0 * td.size())) << "msec per contact )";
+        recordMeasurement("readByIdFilter", td.size(), readContacts.size(), ste);
         elapsedTimeTotal += ste;
 
         // Read the same set, but filter everything out using syncTarget
@@ -1162,6 +1380,7 @@ static qint64 synchronousOperations(QContactManager &manager, bool quickMode)
             qWarning() << "Invalid retrieval count:" << readContacts.size() << "expecting:" << 0;
         }
         qDebug() << "    reading all by ID filter & aggregate, display details + no rels, took" << ste << "milliseconds (" << ((1.0 * ste) / (1.0 * td.size())) << "msec per contact )";
+        recordMeasurement("readByIdFilterAndAggregate", td.size(), readContacts.size(), ste);
         elapsedTimeTotal += ste;
 
         QContactDetailFilter firstNameStartsA;
@@ -1173,6 +1392,7 @@ static qint64 synchronousOperations(QContactManager &manager, bool quickMode)
         readContacts = manager.contacts(firstNameStartsA, QList<QContactSortOrder>(), fh);
         ste = syncTimer.elapsed();
         qDebug() << "    reading filtered (" << readContacts.size() << "), no relationships, took" << ste << "milliseconds (" << ((1.0 * ste) / (1.0 * td.size())) << "msec per contact )";
+        recordMeasurement("readFiltered", td.size(), readContacts.size(), ste);
         elapsedTimeTotal += ste;
 
         QList<QContactId> idsToRemove;
@@ -1187,6 +1407,7 @@ static qint64 synchronousOperations(QContactManager &manager, bool quickMode)
         cme->clearChangeFlags(idsToRemove, &purgeError);
         ste = syncTimer.elapsed();
         qDebug() << "    removing test data took" << ste << "milliseconds (" << ((1.0 * ste) / (1.0 * td.size())) << "msec per contact )";
+        recordMeasurement("remove", td.size(), td.size(), ste);
         elapsedTimeTotal += ste;
     }
 
@@ -1205,6 +1426,7 @@ static qint64 synchronousOperations(QContactManager &manager, bool quickMode)
 static qint64 performAsynchronousFetch(QContactManager &manager, bool quickMode)
 {
     const int repeatCount = quickMode ? 1 : 3; // test caching effects
+    const int datasetSize = manager.contactIds().count();
     qint64 elapsedTimeTotal = 0;
     QContactFetchRequest request;
     request.setManager(&manager);
@@ -1218,6 +1440,7 @@ static qint64 performAsynchronousFetch(QContactManager &manager, bool quickMode)
 
         qint64 elapsed = timer.elapsed();
         qDebug() << "    " << i << ": Fetch completed in" << elapsed << "ms";
+        recordMeasurement("fetch", datasetSize, request.contacts().count(), elapsed);
         elapsedTimeTotal += elapsed;
     }
 
@@ -1234,6 +1457,7 @@ static qint64 performAsynchronousFetch(QContactManager &manager, bool quickMode)
 
         qint64 elapsed = timer.elapsed();
         qDebug() << "    "  << i << ": No-relationships fetch completed in" << elapsed << "ms";
+        recordMeasurement("fetchNoRelationships", datasetSize, request.contacts().count(), elapsed);
         elapsedTimeTotal += elapsed;
     }
 
@@ -1249,6 +1473,7 @@ static qint64 performAsynchronousFetch(QContactManager &manager, bool quickMode)
 
         qint64 elapsed = timer.elapsed();
         qDebug() << "    "  << i << ": Reduced data fetch completed in" << elapsed << "ms";
+        recordMeasurement("fetchReducedDetails", datasetSize, request.contacts().count(), elapsed);
         elapsedTimeTotal += elapsed;
     }
 
@@ -1264,6 +1489,7 @@ static qint64 performAsynchronousFetch(QContactManager &manager, bool quickMode)
 
         qint64 elapsed = timer.elapsed();
         qDebug() << "    "  << i << ": Max count fetch completed in" << elapsed << "ms";
+        recordMeasurement("fetchMaxCount", datasetSize, request.contacts().count(), elapsed);
         elapsedTimeTotal += elapsed;
     }
 
@@ -1305,6 +1531,7 @@ static qint64 asynchronousOperations(QContactManager &manager, bool quickMode)
     QList<QContact> savedContacts = sreq.contacts();
     qint64 storeTime = storeTimer.elapsed();
     qDebug() << "    saved" << numberContacts << "contacts in" << storeTime << "milliseconds";
+    recordMeasurement("save", numberContacts, numberContacts, storeTime);
 
     qDebug() << "--------";
     qDebug() << "Performing asynchronous fetch with filled database";
@@ -1326,6 +1553,7 @@ static qint64 asynchronousOperations(QContactManager &manager, bool quickMode)
     rreq.waitForFinished();
     qint64 deleteTime = deleteTimer.elapsed();
     qDebug() << "    asynchronous remove request took" << deleteTime << "milliseconds";
+    recordMeasurement("remove", numberContacts, deleteIds.size(), deleteTime);
 
     QContactManager::Error purgeError = QContactManager::NoError;
     QtContactsSqliteExtensions::ContactManagerEngine *cme = QtContactsSqliteExtensions::contactManagerEngine(manager);
@@ -1397,12 +1625,14 @@ qint64 simpleFilterAndSort(QContactManager &manager, bool quickMode)
     }
     qint64 saveTime = syncTimer.elapsed();
     qDebug() << "    stored" << (testData.size()+testData2.size()) << "contacts in" << saveTime << "milliseconds";
+    recordMeasurement("save", prefillCount, testData.size() + testData2.size(), saveTime);
 
     qDebug() << "    retrieving aggregate contacts with filter, sort order, and fetch hint applied";
     syncTimer.start();
     QList<QContact> filteredSorted = manager.contacts(aggregateFilter & phoneFilter, sort, listDisplayFetchHint);
     qint64 fetchTime = syncTimer.elapsed();
     qDebug() << "    retrieved" << filteredSorted.size() << "contacts in" << fetchTime << "milliseconds";
+    recordMeasurement("fetchFilteredSorted", prefillCount, filteredSorted.size(), fetchTime);
 
     QList<QContactId> deleteIds;
     for (const QList<QContact> &chunk : chunks) {
@@ -1423,6 +1653,7 @@ qint64 simpleFilterAndSort(QContactManager &manager, bool quickMode)
     cme->clearChangeFlags(deleteIds, &purgeError);
     qint64 deleteTime = syncTimer.elapsed();
     qDebug() << "    deleted" << deleteIds.size() << "contacts in" << deleteTime << "milliseconds";
+    recordMeasurement("remove", prefillCount, deleteIds.size(), deleteTime);
 
     if (filteredSorted.size() == 0) {
         qWarning() << "Zero aggregate contacts found.  Are you sure you're running with privileged permissions?";
@@ -1782,12 +2013,20 @@ int main(int argc, char  *argv[])
     QStringList functionArgs;
 
     if (args.size() <= 1) {
-        qDebug() << "usage: fetchtimes [--stable] [--quick] --help|--all|--function=<function>";
+        qDebug() << "usage: fetchtimes [--stable] [--quick] [--iterations=<n>] [--warmup=<n>] [--json=<file>] --help|--all|--function=<function>";
+        qDebug() << "       fetchtimes --compare <baseline.json> <current.json> [--threshold=<percent>] [--min-delta=<ms>]";
         return 0;
     } else if (args.contains("--help") || args.contains("-h")) {
-        qDebug() << "usage: fetchtimes [--stable] --help|--all|--quick|<function>";
+        qDebug() << "usage: fetchtimes [--stable] [--iterations=<n>] [--warmup=<n>] [--json=<file>] --help|--all|--quick|<function>";
+        qDebug() << "       fetchtimes --compare <baseline.json> <current.json> [--threshold=<percent>] [--min-delta=<ms>]";
         qDebug() << "If --stable is specified, a stable prng seed will be used.";
         qDebug() << "If --quick is specified, the benchmark will complete more quickly (but results will have higher variance)";
+        qDebug() << "If --iterations is specified, each function is timed that many times (default 1),";
+        qDebug() << "after --warmup untimed iterations (default 0), and min/median/p95/max are reported.";
+        qDebug() << "If --json is specified, the summarised results are written to the given file.";
+        qDebug() << "If --compare is specified, the medians of two result files are compared, and the";
+        qDebug() << "process exits with a non-zero status if any measurement regressed by more than";
+        qDebug() << "--threshold percent (default 10) and --min-delta milliseconds (default 2).";
         qDebug() << "Available functions:";
         qDebug() << "    simpleFilterAndSort";
         qDebug() << "    asynchronousOperations";
@@ -1802,6 +2041,35 @@ int main(int argc, char  *argv[])
         return 0;
     }
 
+    int iterations = 1;
+    int warmup = 0;
+    double threshold = 10.0;
+    qint64 minimumDelta = 2;
+    QString jsonFileName;
+    for (const QString &arg : args) {
+        if (arg.startsWith(QStringLiteral("--iterations="))) {
+            iterations = qMax(1, arg.mid(13).toInt());
+        } else if (arg.startsWith(QStringLiteral("--warmup="))) {
+            warmup = qMax(0, arg.mid(9).toInt());
+        } else if (arg.startsWith(QStringLiteral("--json="))) {
+            jsonFileName = arg.mid(7);
+        } else if (arg.startsWith(QStringLiteral("--threshold="))) {
+            threshold = arg.mid(12).toDouble();
+        } else if (arg.startsWith(QStringLiteral("--min-delta="))) {
+            minimumDelta = arg.mid(12).toLongLong();
+        }
+    }
+
+    const int compareIndex = args.indexOf(QStringLiteral("--compare"));
+    if (compareIndex > 0) {
+        if (args.size() <= compareIndex + 2) {
+            qWarning() << "--compare requires a baseline and a current result file";
+            return 2;
+        }
+        const int regressions = compareResults(args.at(compareIndex + 1), args.at(compareIndex + 2), threshold, minimumDelta);
+        return regressions < 0 ? 2 : (regressions > 0 ? 1 : 0);
+    }
+
     // remember also to set:
     //mcetool --set-never-blank=enabled
     //mcetool --set-cpu-scaling-governor=interactive (automatic/performance)
@@ -1851,16 +2119,42 @@ int main(int argc, char  *argv[])
         elapsedTimeTotal = generateQueryPlanTestData(manager, args.last().toInt());
     } else {
         qsrand(stable ? 42 : QDateTime::currentDateTime().time().second());
-        elapsedTimeTotal += (runAll || functionArgs.contains("simpleFilterAndSort")) ? simpleFilterAndSort(manager, quickMode) : 0;
-        elapsedTimeTotal += (runAll || functionArgs.contains("asynchronousOperations")) ? asynchronousOperations(manager, quickMode) : 0;
-        elapsedTimeTotal += (runAll || functionArgs.contains("synchronousOperations")) ? synchronousOperations(manager, quickMode) : 0;
-        elapsedTimeTotal += (runAll || functionArgs.contains("smallBatchWithExistingData")) ? smallBatchWithExistingData(manager, quickMode) : 0;
-        elapsedTimeTotal += (runAll || functionArgs.contains("aggregationOperations")) ? aggregationOperations(manager, quickMode) : 0;
-        elapsedTimeTotal += (runAll || functionArgs.contains("smallBatchPresenceUpdate")) ? smallBatchPresenceUpdate(manager, quickMode) : 0;
-        elapsedTimeTotal += (runAll || functionArgs.contains("entireBatchPresenceUpdate")) ? entireBatchPresenceUpdate(manager, quickMode) : 0;
-        elapsedTimeTotal += (runAll || functionArgs.contains("scalingPresenceUpdate")) ? scalingPresenceUpdate(manager, quickMode) : 0;
-        elapsedTimeTotal += (runAll || functionArgs.contains("nonAggregatedPresenceUpdate")) ? nonAggregatedPresenceUpdate(manager, quickMode) : 0;
-        elapsedTimeTotal += (runAll || functionArgs.contains("aggregatedPresenceUpdate")) ? aggregatedPresenceUpdate(manager, quickMode) : 0;
+
+        typedef qint64 (*BenchmarkFunction)(QContactManager &, bool);
+        const QList<QPair<QString, BenchmarkFunction> > functions {
+            qMakePair(QStringLiteral("simpleFilterAndSort"), &simpleFilterAndSort),
+            qMakePair(QStringLiteral("asynchronousOperations"), &asynchronousOperations),
+            qMakePair(QStringLiteral("synchronousOperations"), &synchronousOperations),
+            qMakePair(QStringLiteral("smallBatchWithExistingData"), &smallBatchWithExistingData),
+            qMakePair(QStringLiteral("aggregationOperations"), &aggregationOperations),
+            qMakePair(QStringLiteral("smallBatchPresenceUpdate"), &smallBatchPresenceUpdate),
+            qMakePair(QStringLiteral("entireBatchPresenceUpdate"), &entireBatchPresenceUpdate),
+            qMakePair(QStringLiteral("scalingPresenceUpdate"), &scalingPresenceUpdate),
+            qMakePair(QStringLiteral("nonAggregatedPresenceUpdate"), &nonAggregatedPresenceUpdate),
+            qMakePair(QStringLiteral("aggregatedPresenceUpdate"), &aggregatedPresenceUpdate),
+        };
+
+        for (int iteration = 0; iteration < warmup + iterations; ++iteration) {
+            recordingMeasurements = iteration >= warmup;
+            if (warmup + iterations > 1) {
+                qDebug() << "========";
+                qDebug() << (recordingMeasurements ? "Timed iteration" : "Warmup iteration")
+                         << (recordingMeasurements ? iteration - warmup + 1 : iteration + 1);
+            }
+
+            for (const QPair<QString, BenchmarkFunction> &function : functions) {
+                if (runAll || functionArgs.contains(function.first)) {
+                    currentScenario = function.first;
+                    const qint64 elapsed = function.second(manager, quickMode);
+                    recordMeasurement("total", 0, 0, elapsed);
+                    elapsedTimeTotal += recordingMeasurements ? elapsed : 0;
+                }
+            }
+        }
+
+        if (!writeResults(jsonFileName, iterations, warmup, quickMode)) {
+            return 1;
+        }
     }
     clock_t endTicks = clock();
     qDebug() << "\n\nCumulative elapsed time:" << elapsedTimeTotal << "milliseconds, with: " << (endTicks - startTicks) << " clock ticks.";
@@ -0,0 +1,651 @@
+/*
+ * Copyright (c) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+
+#include <QContactManager>
+#include <QContactCollection>
+#include <QContactCollectionFilter>
+#include <QContactDetailFilter>
+#include <QContactIdFilter>
+#include <QContactFetchHint>
+#include <QContactSortOrder>
+#include <QContactDisplayLabel>
+#include <QContactAvatar>
+#include <QContactName>
+#include <QContactNickname>
+#include <QContactPhoneNumber>
+#include <QContactEmailAddress>
+#include <QContactAddress>
+#include <QContactOrganization>
+#include <QContactBirthday>
+#include <QContactNote>
+#include <QContactFavorite>
+#include <QContactOnlineAccount>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QtDebug>
+
+#include <algorithm>
+
+#include "qtcontacts-extensions.h"
+#include "qtcontacts-extensions_impl.h"
+#include "qtcontacts-extensions_manager_impl.h"
+#include "contactmanagerengine.h"
+
+QTCONTACTS_USE_NAMESPACE
+
+namespace {
+
+const int populateBatchSize = 1000;
+const int operationBatchSize = 500;
+
+const char *const seedKey = "scalingBenchmarkSeed";
+
+// Contacts are distributed over several synced addressbooks, roughly as
+// they would be on a device with a few accounts configured.
+struct AddressbookDefinition
+{
+    const char *name;
+    int accountId;
+    int percentage;
+};
+
+const AddressbookDefinition addressbookDefinitions[] = {
+    { "scalingPersonal", 101, 40 },
+    { "scalingExchange", 102, 30 },
+    { "scalingGoogle",   103, 20 },
+    { "scalingSocial",   104, 10 },
+};
+const int addressbookCount = sizeof(addressbookDefinitions) / sizeof(addressbookDefinitions[0]);
+
+const char *const firstNames[] = {
+    "Aaron", "Abigail", "Adam", "Alice", "Amelia", "Andrew", "Anna", "Ben",
+    "Carl", "Charlotte", "Chloe", "Daniel", "David", "Ella", "Emil", "Emma",
+    "Eric", "Eva", "Felix", "Grace", "Hanna", "Harry", "Ida", "Isaac",
+    "Jack", "Jacob", "James", "Jane", "Johan", "John", "Julia", "Karl",
+    "Kate", "Laura", "Leo", "Lily", "Lucas", "Maria", "Mark", "Matthew",
+    "Mia", "Michael", "Nina", "Noah", "Olivia", "Oscar", "Paul", "Peter",
+    "Rachel", "Robert", "Ruby", "Sam", "Sara", "Sofia", "Thomas", "Tom",
+    "Victor", "Vera", "William", "Yusuf", "Zoe", "Zachary", "Alina", "Mikko",
+};
+const int firstNameCount = sizeof(firstNames) / sizeof(firstNames[0]);
+
+const char *const lastNamePrefixes[] = {
+    "Ander", "Berg", "Carl", "Dal", "Eck", "Fair", "Gold", "Hart",
+    "Ing", "Jans", "Kirk", "Lind", "Mar", "Nord", "Ost", "Pet",
+    "Quin", "Ros", "Sand", "Thor", "Ul", "Vest", "Wald", "Yng",
+    "Ash", "Brook", "Clay", "Dun", "El", "Fen", "Glen", "Holm",
+    "Ivar", "Kell", "Lang", "Mor", "New", "Ox", "Pen", "Ram",
+};
+const int lastNamePrefixCount = sizeof(lastNamePrefixes) / sizeof(lastNamePrefixes[0]);
+
+const char *const lastNameSuffixes[] = {
+    "son", "berg", "strom", "dal", "man", "ley", "ford", "wood",
+    "ton", "field", "by", "stein", "gren", "lund", "quist", "hurst",
+    "well", "wick", "more", "ham", "den", "ridge", "shaw", "worth",
+    "ner", "ling", "castle", "brook", "croft", "gate", "holt", "mere",
+    "stead", "thorpe", "vik", "ald", "ens", "ers", "ett", "ow",
+};
+const int lastNameSuffixCount = sizeof(lastNameSuffixes) / sizeof(lastNameSuffixes[0]);
+
+// A small xorshift generator, seeded from the dataset seed and the contact
+// index.  Every contact can therefore be regenerated independently of the
+// others, which allows an existing database to be grown rather than rebuilt.
+class Generator
+{
+public:
+    Generator(quint32 seed, int index)
+        : m_state((Q_UINT64_C(0x9E3779B97F4A7C15) * (seed + 1)) ^ (Q_UINT64_C(0xBF58476D1CE4E5B9) * (quint64(index) + 1)))
+    {
+        next();
+        next();
+    }
+
+    quint32 next()
+    {
+        m_state ^= m_state >> 12;
+        m_state ^= m_state << 25;
+        m_state ^= m_state >> 27;
+        return quint32((m_state * Q_UINT64_C(0x2545F4914F6CDD1D)) >> 32);
+    }
+
+    int bounded(int limit) { return int(next() % quint32(limit)); }
+
+    // Biased towards lower values, so that some names are much more common than others.
+    int skewed(int limit) { return qMin(bounded(limit), bounded(limit)); }
+
+    bool chance(int percentage) { return bounded(100) < percentage; }
+
+    // Returns the index of the bucket selected according to the given weights (summing to 100).
+    int weighted(std::initializer_list<int> weights)
+    {
+        int value = bounded(100);
+        int bucket = 0;
+        for (int weight : weights) {
+            if (value < weight) {
+                return bucket;
+            }
+            value -= weight;
+            ++bucket;
+        }
+        return bucket - 1;
+    }
+
+private:
+    quint64 m_state;
+};
+
+struct GeneratedName
+{
+    QString firstName;
+    QString lastName;
+};
+
+GeneratedName generateName(quint32 seed, int index)
+{
+    Generator generator(seed, index);
+
+    GeneratedName name;
+    name.firstName = QString::fromLatin1(firstNames[generator.skewed(firstNameCount)]);
+    name.lastName = QString::fromLatin1(lastNamePrefixes[generator.skewed(lastNamePrefixCount)])
+                  + QString::fromLatin1(lastNameSuffixes[generator.bounded(lastNameSuffixCount)]);
+    return name;
+}
+
+int addressbookIndex(Generator &generator)
+{
+    int value = generator.bounded(100);
+    for (int i = 0; i < addressbookCount; ++i) {
+        if (value < addressbookDefinitions[i].percentage) {
+            return i;
+        }
+        value -= addressbookDefinitions[i].percentage;
+    }
+    return 0;
+}
+
+QContact generateContact(quint32 seed, int index, const QList<QContactCollection> &addressbooks)
+{
+    // The name is generated from its own stream, so that it can be reproduced
+    // for the contacts which are synced copies of an earlier contact.
+    Generator generator(seed ^ 0x5A5A5A5Au, index);
+
+    const int addressbook = addressbookIndex(generator);
+    const bool personal = (addressbook == 0);
+
+    // A third of the contacts from synced accounts have the same name as an
+    // earlier contact, so that they will be aggregated together.
+    GeneratedName generatedName = (!personal && index > 0 && generator.chance(33))
+                                ? generateName(seed, generator.bounded(index))
+                                : generateName(seed, index);
+
+    QContact contact;
+    contact.setCollectionId(addressbooks.at(addressbook).id());
+
+    QContactName name;
+    name.setFirstName(generatedName.firstName);
+    name.setLastName(generatedName.lastName);
+    contact.saveDetail(&name);
+
+    const int phoneCount = generator.weighted({ 20, 50, 22, 8 });
+    for (int i = 0; i < phoneCount; ++i) {
+        QContactPhoneNumber phone;
+        phone.setNumber(QStringLiteral("+3584%1").arg(generator.bounded(100000000), 8, 10, QLatin1Char('0')));
+        phone.setSubTypes(QList<int>() << (i == 0 ? QContactPhoneNumber::SubTypeMobile : QContactPhoneNumber::SubTypeLandline));
+        contact.saveDetail(&phone);
+    }
+
+    const int emailCount = generator.weighted({ 40, 45, 15 });
+    for (int i = 0; i < emailCount; ++i) {
+        QContactEmailAddress email;
+        email.setEmailAddress(QStringLiteral("%1.%2%3@%4.example.com")
+                                  .arg(generatedName.firstName.toLower())
+                                  .arg(generatedName.lastName.toLower())
+                                  .arg(index)
+                                  .arg(i == 0 ? QStringLiteral("work") : QStringLiteral("home")));
+        contact.saveDetail(&email);
+    }
+
+    if (generator.chance(15)) {
+        QContactAddress address;
+        address.setStreet(QStringLiteral("%1 %2 Street").arg(generator.bounded(200) + 1).arg(QString::fromLatin1(lastNamePrefixes[generator.bounded(lastNamePrefixCount)])));
+        address.setLocality(QStringLiteral("Tampere"));
+        address.setPostcode(QString::number(33000 + generator.bounded(1000)));
+        address.setCountry(QStringLiteral("Finland"));
+        contact.saveDetail(&address);
+    }
+
+    if (!personal && generator.chance(60)) {
+        QContactOrganization organization;
+        organization.setName(QStringLiteral("Company %1").arg(generator.skewed(500)));
+        organization.setTitle(generator.chance(50) ? QStringLiteral("Engineer") : QStringLiteral("Manager"));
+        contact.saveDetail(&organization);
+    }
+
+    if (generator.chance(10)) {
+        QContactNickname nickname;
+        nickname.setNickname(generatedName.firstName.left(3));
+        contact.saveDetail(&nickname);
+    }
+
+    if (generator.chance(25)) {
+        QContactBirthday birthday;
+        birthday.setDate(QDate(1950 + generator.bounded(55), 1 + generator.bounded(12), 1 + generator.bounded(28)));
+        contact.saveDetail(&birthday);
+    }
+
+    if (generator.chance(5)) {
+        QContactNote note;
+        note.setNote(QStringLiteral("Generated note for contact %1").arg(index));
+        contact.saveDetail(&note);
+    }
+
+    if (addressbook == addressbookCount - 1 || generator.chance(5)) {
+        QContactOnlineAccount account;
+        account.setAccountUri(QStringLiteral("contact%1@im.example.com").arg(index));
+        account.setServiceProvider(QStringLiteral("example"));
+        contact.saveDetail(&account);
+    }
+
+    if (generator.chance(3)) {
+        QContactFavorite favorite;
+        favorite.setFavorite(true);
+        contact.saveDetail(&favorite);
+    }
+
+    return contact;
+}
+
+QMap<QString, QString> managerParameters()
+{
+    QMap<QString, QString> parameters;
+    parameters.insert(QString::fromLatin1("autoTest"), QString::fromLatin1("true"));
+    parameters.insert(QString::fromLatin1("mergePresenceChanges"), QString::fromLatin1("false"));
+    return parameters;
+}
+
+QContactCollectionFilter addressbooksFilter(const QList<QContactCollection> &addressbooks)
+{
+    QSet<QContactCollectionId> ids;
+    for (const QContactCollection &addressbook : addressbooks) {
+        ids.insert(addressbook.id());
+    }
+
+    QContactCollectionFilter filter;
+    filter.setCollectionIds(ids);
+    return filter;
+}
+
+QContactCollectionFilter aggregatesFilter(const QContactManager &manager)
+{
+    QContactCollectionFilter filter;
+    filter.setCollectionId(QtContactsSqliteExtensions::aggregateCollectionId(manager.managerUri()));
+    return filter;
+}
+
+void removeContacts(QContactManager &manager, const QList<QContactId> &ids)
+{
+    QContactManager::Error error = QContactManager::NoError;
+    manager.removeContacts(ids);
+    QtContactsSqliteExtensions::contactManagerEngine(manager)->clearChangeFlags(ids, &error);
+}
+
+void removeAddressbooks(QContactManager &manager, const QList<QContactCollection> &addressbooks)
+{
+    QContactManager::Error error = QContactManager::NoError;
+    for (const QContactCollection &addressbook : addressbooks) {
+        manager.removeCollection(addressbook.id());
+        QtContactsSqliteExtensions::contactManagerEngine(manager)->clearChangeFlags(addressbook.id(), &error);
+    }
+}
+
+// Returns the benchmark addressbooks, creating them if necessary.  Any
+// existing addressbooks generated with a different seed are removed first.
+QList<QContactCollection> addressbooks(QContactManager &manager, quint32 seed, bool rebuild)
+{
+    QList<QContactCollection> existing;
+    for (const QContactCollection &collection : manager.collections()) {
+        for (const AddressbookDefinition &definition : addressbookDefinitions) {
+            if (collection.metaData(QContactCollection::KeyName).toString() == QLatin1String(definition.name)) {
+                existing.append(collection);
+            }
+        }
+    }
+
+    bool reuse = !rebuild && existing.size() == addressbookCount;
+    for (const QContactCollection &collection : existing) {
+        if (collection.extendedMetaData(QString::fromLatin1(seedKey)).toUInt() != seed) {
+            reuse = false;
+        }
+    }
+
+    if (reuse) {
+        // return them in definition order.
+        QList<QContactCollection> ordered;
+        for (const AddressbookDefinition &definition : addressbookDefinitions) {
+            for (const QContactCollection &collection : existing) {
+                if (collection.metaData(QContactCollection::KeyName).toString() == QLatin1String(definition.name)) {
+                    ordered.append(collection);
+                }
+            }
+        }
+        return ordered;
+    }
+
+    if (!existing.isEmpty()) {
+        qDebug() << "Removing existing dataset";
+        removeAddressbooks(manager, existing);
+    }
+
+    QList<QContactCollection> created;
+    for (const AddressbookDefinition &definition : addressbookDefinitions) {
+        QContactCollection collection;
+        collection.setMetaData(QContactCollection::KeyName, QString::fromLatin1(definition.name));
+        collection.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_ACCOUNTID, definition.accountId);
+        collection.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_REMOTEPATH, QStringLiteral("/addressbooks/%1").arg(QString::fromLatin1(definition.name)));
+        collection.setExtendedMetaData(QString::fromLatin1(seedKey), seed);
+        if (!manager.saveCollection(&collection)) {
+            qWarning() << "Failed to create addressbook" << definition.name << ":" << manager.error();
+            return QList<QContactCollection>();
+        }
+        created.append(collection);
+    }
+    return created;
+}
+
+// Grows (or, if it is larger, rebuilds) the dataset to contain exactly the
+// given number of contacts.  Since contacts are generated in index order and
+// saved in whole batches, the number of existing contacts is also the index of
+// the next contact to generate.
+bool populate(QContactManager &manager, QList<QContactCollection> *addressbookList, quint32 seed, int size)
+{
+    int existing = manager.contactIds(addressbooksFilter(*addressbookList)).size();
+    if (existing > size) {
+        removeAddressbooks(manager, *addressbookList);
+        *addressbookList = addressbooks(manager, seed, false);
+        if (addressbookList->isEmpty()) {
+            return false;
+        }
+        existing = 0;
+    }
+
+    if (existing == size) {
+        qDebug() << "Reusing existing dataset of" << size << "contacts";
+        return true;
+    }
+
+    qDebug() << "Generating" << (size - existing) << "contacts to grow the dataset from" << existing << "to" << size << "... this will take a while...";
+    QElapsedTimer timer;
+    timer.start();
+    while (existing < size) {
+        QList<QContact> contacts;
+        const int count = qMin(populateBatchSize, size - existing);
+        for (int i = 0; i < count; ++i) {
+            contacts.append(generateContact(seed, existing + i, *addressbookList));
+        }
+        if (!manager.saveContacts(&contacts)) {
+            qWarning() << "Failed to populate dataset:" << manager.error();
+            return false;
+        }
+        existing += count;
+    }
+    qDebug() << "    generated in" << timer.elapsed() << "milliseconds";
+    return true;
+}
+
+qint64 median(QList<qint64> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    const int count = samples.size();
+    return (count % 2) ? samples.at(count / 2) : (samples.at(count / 2 - 1) + samples.at(count / 2)) / 2;
+}
+
+// Median elapsed milliseconds for each measurement, for each dataset size.
+typedef QList<QPair<QString, QMap<int, qint64> > > Results;
+
+void addResult(Results *results, const QString &measurement, int size, const QList<qint64> &samples, int rows)
+{
+    const qint64 elapsed = median(samples);
+    qDebug().noquote() << QStringLiteral("    %1: %2 ms (%3 rows)").arg(measurement, -28).arg(elapsed).arg(rows);
+
+    for (QPair<QString, QMap<int, qint64> > &result : *results) {
+        if (result.first == measurement) {
+            result.second.insert(size, elapsed);
+            return;
+        }
+    }
+    QMap<int, qint64> values;
+    values.insert(size, elapsed);
+    results->append(qMakePair(measurement, values));
+}
+
+template<typename F>
+void measure(Results *results, const QString &measurement, int size, int iterations, F operation)
+{
+    QList<qint64> samples;
+    int rows = 0;
+    for (int i = 0; i < iterations; ++i) {
+        QElapsedTimer timer;
+        timer.start();
+        rows = operation();
+        samples.append(timer.elapsed());
+    }
+    addResult(results, measurement, size, samples, rows);
+}
+
+void runScalingTests(QContactManager &manager, const QList<QContactCollection> &addressbookList, quint32 seed, int size, int iterations, Results *results)
+{
+    qDebug() << "--------";
+    qDebug() << "Performing scaling tests with" << size << "contacts";
+
+    const QContactCollectionFilter aggregates(aggregatesFilter(manager));
+
+    QContactFetchHint listDisplayFetchHint;
+    listDisplayFetchHint.setDetailTypesHint(QList<QContactDetail::DetailType>()
+            << QContactDisplayLabel::Type << QContactName::Type << QContactAvatar::Type);
+    listDisplayFetchHint.setOptimizationHints(QContactFetchHint::NoRelationships);
+
+    measure(results, QStringLiteral("fetch aggregate ids"), size, iterations, [&]() {
+        return manager.contactIds(aggregates).size();
+    });
+
+    measure(results, QStringLiteral("fetch aggregates, all details"), size, iterations, [&]() {
+        return manager.contacts(aggregates).size();
+    });
+
+    measure(results, QStringLiteral("fetch aggregates, list hint"), size, iterations, [&]() {
+        return manager.contacts(aggregates, QList<QContactSortOrder>(), listDisplayFetchHint).size();
+    });
+
+    QContactSortOrder groupSort;
+    groupSort.setDetailType(QContactDisplayLabel::Type, QContactDisplayLabel__FieldLabelGroup);
+    QContactSortOrder lastNameSort;
+    lastNameSort.setDetailType(QContactName::Type, QContactName::FieldLastName);
+    measure(results, QStringLiteral("sort aggregates, list hint"), size, iterations, [&]() {
+        return manager.contacts(aggregates, QList<QContactSortOrder>() << groupSort << lastNameSort, listDisplayFetchHint).size();
+    });
+
+    QContactDetailFilter nameFilter;
+    nameFilter.setDetailType(QContactName::Type, QContactName::FieldFirstName);
+    nameFilter.setValue(QStringLiteral("Ma"));
+    nameFilter.setMatchFlags(QContactFilter::MatchStartsWith);
+    measure(results, QStringLiteral("filter name starts with"), size, iterations, [&]() {
+        return manager.contacts(aggregates & nameFilter, QList<QContactSortOrder>(), listDisplayFetchHint).size();
+    });
+
+    // Find a phone number which is known to exist in the dataset.
+    QString phoneNumber;
+    for (int index = size / 2; phoneNumber.isEmpty() && index < size; ++index) {
+        phoneNumber = generateContact(seed, index, addressbookList).detail<QContactPhoneNumber>().number();
+    }
+    QContactDetailFilter phoneFilter;
+    phoneFilter.setDetailType(QContactPhoneNumber::Type, QContactPhoneNumber::FieldNumber);
+    phoneFilter.setValue(phoneNumber);
+    phoneFilter.setMatchFlags(QContactFilter::MatchPhoneNumber);
+    measure(results, QStringLiteral("filter phone number"), size, iterations, [&]() {
+        return manager.contacts(phoneFilter, QList<QContactSortOrder>(), listDisplayFetchHint).size();
+    });
+
+    QContactCollectionFilter accountFilter;
+    accountFilter.setCollectionId(addressbookList.at(1).id());
+    measure(results, QStringLiteral("filter addressbook"), size, iterations, [&]() {
+        return manager.contacts(accountFilter, QList<QContactSortOrder>(), listDisplayFetchHint).size();
+    });
+
+    QList<QContactId> someIds(manager.contactIds(aggregates));
+    someIds = someIds.mid(someIds.size() / 3, operationBatchSize);
+    QContactIdFilter idFilter;
+    idFilter.setIds(someIds);
+    measure(results, QStringLiteral("filter id list"), size, iterations, [&]() {
+        return manager.contacts(idFilter, QList<QContactSortOrder>(), listDisplayFetchHint).size();
+    });
+
+    // Save, update and remove a batch of additional contacts, leaving the
+    // dataset as it was found.  The additional contacts are generated from
+    // indexes beyond the dataset, so some of them will be aggregated.
+    QList<qint64> saveSamples, updateSamples, removeSamples;
+    for (int i = 0; i < iterations; ++i) {
+        QList<QContact> batch;
+        for (int j = 0; j < operationBatchSize; ++j) {
+            batch.append(generateContact(seed, size + j, addressbookList));
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        manager.saveContacts(&batch);
+        saveSamples.append(timer.elapsed());
+
+        for (QContact &contact : batch) {
+            QContactNickname nickname = contact.detail<QContactNickname>();
+            nickname.setNickname(QStringLiteral("Updated"));
+            contact.saveDetail(&nickname);
+        }
+
+        timer.start();
+        manager.saveContacts(&batch);
+        updateSamples.append(timer.elapsed());
+
+        QList<QContactId> ids;
+        for (const QContact &contact : batch) {
+            ids.append(contact.id());
+        }
+
+        timer.start();
+        removeContacts(manager, ids);
+        removeSamples.append(timer.elapsed());
+    }
+    addResult(results, QStringLiteral("save batch"), size, saveSamples, operationBatchSize);
+    addResult(results, QStringLiteral("update batch"), size, updateSamples, operationBatchSize);
+    addResult(results, QStringLiteral("remove batch"), size, removeSamples, operationBatchSize);
+}
+
+void printResults(const Results &results, const QList<int> &sizes)
+{
+    qDebug() << "--------";
+    qDebug() << "Median milliseconds by dataset size:";
+
+    QString header = QStringLiteral("%1").arg(QString(), -32);
+    for (int size : sizes) {
+        header += QStringLiteral("%1").arg(size, 10);
+    }
+    qDebug().noquote() << header;
+
+    for (const QPair<QString, QMap<int, qint64> > &result : results) {
+        QString line = QStringLiteral("%1").arg(result.first, -32);
+        for (int size : sizes) {
+            line += QStringLiteral("%1").arg(result.second.value(size), 10);
+        }
+        qDebug().noquote() << line;
+    }
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv);
+
+    const QStringList &args(application.arguments());
+    if (args.contains("--help") || args.contains("-h")) {
+        qDebug() << "usage: scaling [--quick] [--seed=<seed>] [--iterations=<n>] [--rebuild] [<number of contacts> ...]";
+        qDebug() << "Generates a deterministic dataset of each size (default: 10000 50000 100000, or 1000 5000 with --quick)";
+        qDebug() << "and measures fetch, filter, sort, save and remove operations against it.";
+        qDebug() << "The dataset depends only upon the seed (default 42), and is kept in the test database so that";
+        qDebug() << "later runs with the same seed reuse it, generating only the additional contacts required.";
+        qDebug() << "If --rebuild is specified, any existing dataset is discarded first.";
+        return 0;
+    }
+
+    quint32 seed = 42;
+    int iterations = 3;
+    QList<int> sizes;
+    for (int i = 1; i < args.size(); ++i) {
+        const QString &arg(args.at(i));
+        if (arg.startsWith(QStringLiteral("--seed="))) {
+            seed = arg.mid(7).toUInt();
+        } else if (arg.startsWith(QStringLiteral("--iterations="))) {
+            iterations = qMax(1, arg.mid(13).toInt());
+        } else {
+            bool ok = false;
+            const int size = arg.toInt(&ok);
+            if (ok && size > 0) {
+                sizes.append(size);
+            }
+        }
+    }
+    if (sizes.isEmpty()) {
+        if (args.contains(QStringLiteral("--quick")) || args.contains(QStringLiteral("-q"))) {
+            sizes << 1000 << 5000;
+        } else {
+            sizes << 10000 << 50000 << 100000;
+        }
+    }
+    // Growing the dataset is much cheaper than shrinking it.
+    std::sort(sizes.begin(), sizes.end());
+
+    QContactManager manager(QString::fromLatin1("org.nemomobile.contacts.sqlite"), managerParameters());
+    QList<QContactCollection> addressbookList(addressbooks(manager, seed, args.contains(QStringLiteral("--rebuild"))));
+    if (addressbookList.isEmpty()) {
+        return 1;
+    }
+
+    Results results;
+    for (int size : sizes) {
+        if (!populate(manager, &addressbookList, seed, size)) {
+            return 1;
+        }
+        runScalingTests(manager, addressbookList, seed, size, iterations, &results);
+    }
+
+    printResults(results, sizes);
+    return 0;
+}
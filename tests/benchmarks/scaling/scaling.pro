@@ -0,0 +1,12 @@
+include(../../../config.pri)
+
+TEMPLATE = app
+TARGET = scaling
+
+QT = core
+
+SOURCES = main.cpp
+INCLUDEPATH += $$PWD/../../../src/extensions/
+
+target.path = /opt/tests/qtcontacts-sqlite-qt5
+INSTALLS += target
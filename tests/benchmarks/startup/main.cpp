@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+
+#include <QContactManager>
+#include <QContactCollectionFilter>
+#include <QContactName>
+#include <QContactPhoneNumber>
+#include <QContactEmailAddress>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QProcess>
+#include <QtDebug>
+
+#include "qtcontacts-extensions.h"
+#include "qtcontacts-extensions_impl.h"
+#include "qtcontacts-extensions_manager_impl.h"
+#include "contactmanagerengine.h"
+
+QTCONTACTS_USE_NAMESPACE
+
+static const int batchSize = 1000;
+
+static QMap<QString, QString> managerParameters()
+{
+    QMap<QString, QString> parameters;
+    parameters.insert(QString::fromLatin1("autoTest"), QString::fromLatin1("true"));
+    parameters.insert(QString::fromLatin1("mergePresenceChanges"), QString::fromLatin1("false"));
+    return parameters;
+}
+
+static QContactCollectionFilter localContactsFilter(const QContactManager &manager)
+{
+    QContactCollectionFilter filter;
+    filter.setCollectionId(QtContactsSqliteExtensions::localCollectionId(manager.managerUri()));
+    return filter;
+}
+
+static QContact generateContact(int index)
+{
+    QContact contact;
+
+    QContactName name;
+    name.setFirstName(QString::fromLatin1("First%1").arg(index));
+    name.setLastName(QString::fromLatin1("Last%1").arg(index % 997));
+    contact.saveDetail(&name);
+
+    if (index % 2) {
+        QContactPhoneNumber phone;
+        phone.setNumber(QString::number(5550000 + index));
+        contact.saveDetail(&phone);
+    }
+    if (index % 3) {
+        QContactEmailAddress email;
+        email.setEmailAddress(QString::fromLatin1("contact%1@example.com").arg(index));
+        contact.saveDetail(&email);
+    }
+
+    return contact;
+}
+
+static bool populateDatabase(int numberOfContacts)
+{
+    QContactManager manager(QString::fromLatin1("org.nemomobile.contacts.sqlite"), managerParameters());
+    const QContactCollectionFilter filter(localContactsFilter(manager));
+
+    int existing = manager.contactIds(filter).size();
+    if (existing > numberOfContacts) {
+        manager.removeContacts(manager.contactIds(filter));
+        existing = 0;
+    }
+
+    while (existing < numberOfContacts) {
+        QList<QContact> contacts;
+        const int count = qMin(batchSize, numberOfContacts - existing);
+        for (int i = 0; i < count; ++i) {
+            contacts.append(generateContact(existing + i));
+        }
+        if (!manager.saveContacts(&contacts)) {
+            qWarning() << "Failed to populate database:" << manager.error();
+            return false;
+        }
+        existing += count;
+    }
+
+    return true;
+}
+
+static void measureOpen(const QString &mode, int numberOfContacts)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QContactManager *manager = new QContactManager(QString::fromLatin1("org.nemomobile.contacts.sqlite"), managerParameters());
+    const qint64 constructed = timer.elapsed();
+
+    // The synchronous connection is opened by the first synchronous operation
+    manager->contactIds(localContactsFilter(*manager));
+    const qint64 firstQuery = timer.elapsed();
+
+    qDebug().noquote() << QString::fromLatin1("%1 open with %2 contacts: manager %3 ms, first query %4 ms")
+                              .arg(mode).arg(numberOfContacts).arg(constructed).arg(firstQuery);
+
+    if (QtContactsSqliteExtensions::ContactManagerEngine *cme = QtContactsSqliteExtensions::contactManagerEngine(*manager)) {
+        const QList<QPair<QString, qint64> > timings = cme->startupTimings();
+        for (const QPair<QString, qint64> &phase : timings) {
+            qDebug().noquote() << QString::fromLatin1("    %1: %2 us").arg(phase.first, -32).arg(phase.second);
+        }
+    }
+
+    delete manager;
+}
+
+static bool measureColdOpen(int numberOfContacts)
+{
+    // Open the database from a fresh process, so that no plugin, connection or
+    // engine state of this process is reused
+    QProcess child;
+    child.setProcessChannelMode(QProcess::ForwardedChannels);
+    child.start(QCoreApplication::applicationFilePath(),
+                QStringList() << QStringLiteral("--cold-open") << QString::number(numberOfContacts));
+    if (!child.waitForFinished(-1) || child.exitStatus() != QProcess::NormalExit || child.exitCode() != 0) {
+        qWarning() << "Failed to measure cold open:" << child.errorString();
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv);
+
+    const QStringList &args(application.arguments());
+    if (args.contains("--help") || args.contains("-h")) {
+        qDebug() << "usage: startup [<number of contacts> ...]";
+        qDebug() << "Measures the time taken to open the contacts database, for each database size (default: 1000 10000 50000).";
+        qDebug() << "A cold open is performed by a new process with no other connection to the database;";
+        qDebug() << "a warm open is performed while another manager holds the database open.";
+        qDebug() << "The database file may still be in the operating system's file cache for a cold open.";
+        return 0;
+    }
+
+    if (args.size() == 3 && args.at(1) == QStringLiteral("--cold-open")) {
+        // Invoked by measureColdOpen() in a child process
+        measureOpen(QStringLiteral("Cold"), args.at(2).toInt());
+        return 0;
+    }
+
+    QList<int> sizes;
+    for (int i = 1; i < args.size(); ++i) {
+        bool ok = false;
+        const int size = args.at(i).toInt(&ok);
+        if (ok && size >= 0) {
+            sizes.append(size);
+        }
+    }
+    if (sizes.isEmpty()) {
+        sizes << 1000 << 10000 << 50000;
+    }
+
+    for (int size : sizes) {
+        if (!populateDatabase(size)) {
+            return 1;
+        }
+
+        if (!measureColdOpen(size)) {
+            return 1;
+        }
+
+        {
+            QContactManager holder(QString::fromLatin1("org.nemomobile.contacts.sqlite"), managerParameters());
+            holder.contactIds(localContactsFilter(holder));
+
+            measureOpen(QStringLiteral("Warm"), size);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+
+#include <QContactManager>
+#include <QContactCollection>
+#include <QContactName>
+#include <QContactNickname>
+#include <QContactPhoneNumber>
+#include <QContactPresence>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QProcess>
+#include <QTextStream>
+#include <QThread>
+#include <QtDebug>
+
+#include <algorithm>
+
+#include "qtcontacts-extensions.h"
+#include "qtcontacts-extensions_impl.h"
+#include "qtcontacts-extensions_manager_impl.h"
+#include "contactmanagerengine.h"
+
+QTCONTACTS_USE_NAMESPACE
+
+namespace {
+
+// The kinds of writer which typically contend for the database on a device:
+// an account sync storing large batches, a messaging service storing frequent
+// presence updates, and the UI storing individual edits made by the user.
+const int syncBatchSize = 200;
+const int presenceBatchSize = 20;
+const int uiThinkTimeMs = 50;
+
+QMap<QString, QString> managerParameters()
+{
+    QMap<QString, QString> parameters;
+    parameters.insert(QString::fromLatin1("autoTest"), QString::fromLatin1("true"));
+    parameters.insert(QString::fromLatin1("mergePresenceChanges"), QString::fromLatin1("false"));
+    return parameters;
+}
+
+QContact generateContact(const QContactCollectionId &collectionId, const QString &prefix, int index)
+{
+    QContact contact;
+    contact.setCollectionId(collectionId);
+
+    QContactName name;
+    name.setFirstName(QStringLiteral("%1%2").arg(prefix).arg(index));
+    name.setLastName(QStringLiteral("Contention"));
+    contact.saveDetail(&name);
+
+    QContactPhoneNumber phone;
+    phone.setNumber(QString::number(5550000 + index));
+    contact.saveDetail(&phone);
+
+    QContactPresence presence;
+    presence.setPresenceState(QContactPresence::PresenceAvailable);
+    contact.saveDetail(&presence);
+
+    return contact;
+}
+
+qint64 percentile(const QList<qint64> &sorted, int percentage)
+{
+    if (sorted.isEmpty()) {
+        return 0;
+    }
+    const int index = qMax(0, (sorted.size() * percentage + 99) / 100 - 1);
+    return sorted.at(qMin(index, sorted.size() - 1));
+}
+
+// Performs write operations of the given role until the duration has elapsed,
+// and reports the latency of each operation along with the lock statistics.
+int runWriter(const QString &role, qint64 startTime, int durationSeconds)
+{
+    QContactManager manager(QString::fromLatin1("org.nemomobile.contacts.sqlite"), managerParameters());
+    QtContactsSqliteExtensions::ContactManagerEngine *cme = QtContactsSqliteExtensions::contactManagerEngine(manager);
+
+    const QString prefix = QStringLiteral("%1%2").arg(role).arg(QCoreApplication::applicationPid());
+
+    QContactCollection collection;
+    collection.setMetaData(QContactCollection::KeyName, QStringLiteral("writecontention-%1").arg(prefix));
+    collection.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_ACCOUNTID, 7);
+    collection.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_REMOTEPATH, QStringLiteral("/addressbooks/writecontention-%1").arg(prefix));
+    if (!manager.saveCollection(&collection)) {
+        qWarning() << "Failed to create collection for writer" << prefix << ":" << manager.error();
+        return 1;
+    }
+
+    // The presence and UI writers update existing contacts.
+    QList<QContact> existing;
+    const int existingCount = (role == QLatin1String("presence")) ? presenceBatchSize : (role == QLatin1String("ui") ? 1 : 0);
+    for (int i = 0; i < existingCount; ++i) {
+        existing.append(generateContact(collection.id(), prefix, i));
+    }
+    if (!existing.isEmpty() && !manager.saveContacts(&existing)) {
+        qWarning() << "Failed to create contacts for writer" << prefix << ":" << manager.error();
+        return 1;
+    }
+
+    const qint64 delay = startTime - QDateTime::currentMSecsSinceEpoch();
+    if (delay > 0) {
+        QThread::msleep(delay);
+    }
+
+    QList<qint64> latencies;
+    QList<QContactId> created;
+    int contacts = 0;
+    int failures = 0;
+
+    QElapsedTimer runTimer;
+    runTimer.start();
+    while (runTimer.elapsed() < durationSeconds * 1000) {
+        QList<QContact> batch;
+        if (role == QLatin1String("sync")) {
+            for (int i = 0; i < syncBatchSize; ++i) {
+                batch.append(generateContact(collection.id(), prefix, created.size() + i));
+            }
+        } else {
+            for (QContact &contact : existing) {
+                QContactPresence presence = contact.detail<QContactPresence>();
+                presence.setPresenceState(static_cast<QContactPresence::PresenceState>((latencies.size() % 4) + 1));
+                contact.saveDetail(&presence);
+                if (role == QLatin1String("ui")) {
+                    QContactNickname nickname = contact.detail<QContactNickname>();
+                    nickname.setNickname(QStringLiteral("Edit%1").arg(latencies.size()));
+                    contact.saveDetail(&nickname);
+                }
+            }
+            batch = existing;
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        const bool saved = manager.saveContacts(&batch);
+        latencies.append(timer.nsecsElapsed() / 1000);
+
+        if (!saved) {
+            ++failures;
+        } else {
+            contacts += batch.size();
+            if (role == QLatin1String("sync")) {
+                for (const QContact &contact : batch) {
+                    created.append(contact.id());
+                }
+            } else {
+                existing = batch;
+            }
+        }
+
+        if (role == QLatin1String("ui")) {
+            QThread::msleep(uiThinkTimeMs);
+        }
+    }
+    const qint64 elapsed = runTimer.elapsed();
+
+    const QList<QPair<QString, qint64> > lockStatistics = cme->writeLockStatistics();
+
+    QContactManager::Error error = QContactManager::NoError;
+    manager.removeCollection(collection.id());
+    cme->clearChangeFlags(collection.id(), &error);
+
+    QList<qint64> sorted(latencies);
+    std::sort(sorted.begin(), sorted.end());
+
+    QTextStream output(stdout);
+    output << "RESULT role=" << role
+           << " operations=" << latencies.size()
+           << " failures=" << failures
+           << " contacts=" << contacts
+           << " elapsed=" << elapsed
+           << " p50=" << percentile(sorted, 50)
+           << " p95=" << percentile(sorted, 95)
+           << " p99=" << percentile(sorted, 99)
+           << " max=" << (sorted.isEmpty() ? 0 : sorted.last());
+    for (const QPair<QString, qint64> &statistic : lockStatistics) {
+        output << " lock:" << statistic.first << "=" << statistic.second;
+    }
+    output << "\n";
+    return 0;
+}
+
+struct RoleResults
+{
+    int writers = 0;
+    qint64 operations = 0;
+    qint64 failures = 0;
+    qint64 contacts = 0;
+    qint64 elapsed = 0;
+    qint64 p50 = 0;
+    qint64 p95 = 0;
+    qint64 p99 = 0;
+    qint64 max = 0;
+};
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv);
+
+    const QStringList &args(application.arguments());
+    if (args.contains("--help") || args.contains("-h")) {
+        qDebug() << "usage: writecontention [--writers=<role>:<count>,...] [--duration=<seconds>]";
+        qDebug() << "Starts concurrent writer processes against the same database, and reports the throughput";
+        qDebug() << "and latency of each role, along with the cross-process write lock statistics.";
+        qDebug() << "Roles are: sync (batches of" << syncBatchSize << "new contacts), presence (updates of"
+                 << presenceBatchSize << "contacts) and ui (single contact edits).";
+        qDebug() << "The default is --writers=sync:1,presence:1,ui:1 --duration=10";
+        return 0;
+    }
+
+    QString writerRole;
+    QString writers = QStringLiteral("sync:1,presence:1,ui:1");
+    qint64 startTime = 0;
+    int duration = 10;
+    for (const QString &arg : args) {
+        if (arg.startsWith(QStringLiteral("--writer="))) {
+            writerRole = arg.mid(9);
+        } else if (arg.startsWith(QStringLiteral("--writers="))) {
+            writers = arg.mid(10);
+        } else if (arg.startsWith(QStringLiteral("--start="))) {
+            startTime = arg.mid(8).toLongLong();
+        } else if (arg.startsWith(QStringLiteral("--duration="))) {
+            duration = qMax(1, arg.mid(11).toInt());
+        }
+    }
+
+    if (!writerRole.isEmpty()) {
+        return runWriter(writerRole, startTime, duration);
+    }
+
+    // Ensure the database exists before the writers start, so that its creation is not measured.
+    {
+        QContactManager manager(QString::fromLatin1("org.nemomobile.contacts.sqlite"), managerParameters());
+        manager.contactIds();
+    }
+
+    // Give every writer time to open the database and prepare its data before starting together.
+    const qint64 start = QDateTime::currentMSecsSinceEpoch() + 3000;
+
+    QList<QProcess *> processes;
+    for (const QString &writer : writers.split(QLatin1Char(','), QString::SkipEmptyParts)) {
+        const QString role = writer.section(QLatin1Char(':'), 0, 0);
+        const int count = qMax(1, writer.section(QLatin1Char(':'), 1, 1).toInt());
+        if (role != QLatin1String("sync") && role != QLatin1String("presence") && role != QLatin1String("ui")) {
+            qWarning() << "Unknown writer role:" << role;
+            return 1;
+        }
+        for (int i = 0; i < count; ++i) {
+            QProcess *process = new QProcess;
+            process->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+            process->start(QCoreApplication::applicationFilePath(), QStringList()
+                    << QStringLiteral("--writer=%1").arg(role)
+                    << QStringLiteral("--start=%1").arg(start)
+                    << QStringLiteral("--duration=%1").arg(duration));
+            processes.append(process);
+        }
+    }
+
+    qDebug() << "Running" << processes.size() << "writers for" << duration << "seconds...";
+
+    QMap<QString, RoleResults> results;
+    QMap<QString, qint64> lockTotals;
+    for (QProcess *process : processes) {
+        if (!process->waitForFinished((duration + 60) * 1000) || process->exitCode() != 0) {
+            qWarning() << "Writer process failed:" << process->errorString();
+            continue;
+        }
+
+        const QStringList lines = QString::fromUtf8(process->readAllStandardOutput()).split(QLatin1Char('\n'));
+        for (const QString &line : lines) {
+            if (!line.startsWith(QStringLiteral("RESULT "))) {
+                continue;
+            }
+
+            QMap<QString, QString> values;
+            for (const QString &field : line.mid(7).split(QLatin1Char(' '), QString::SkipEmptyParts)) {
+                const int separator = field.lastIndexOf(QLatin1Char('='));
+                values.insert(field.left(separator), field.mid(separator + 1));
+            }
+
+            RoleResults &result(results[values.value(QStringLiteral("role"))]);
+            result.writers += 1;
+            result.operations += values.value(QStringLiteral("operations")).toLongLong();
+            result.failures += values.value(QStringLiteral("failures")).toLongLong();
+            result.contacts += values.value(QStringLiteral("contacts")).toLongLong();
+            result.elapsed = qMax(result.elapsed, values.value(QStringLiteral("elapsed")).toLongLong());
+            // Report the worst writer of each role.
+            result.p50 = qMax(result.p50, values.value(QStringLiteral("p50")).toLongLong());
+            result.p95 = qMax(result.p95, values.value(QStringLiteral("p95")).toLongLong());
+            result.p99 = qMax(result.p99, values.value(QStringLiteral("p99")).toLongLong());
+            result.max = qMax(result.max, values.value(QStringLiteral("max")).toLongLong());
+
+            for (QMap<QString, QString>::const_iterator it = values.constBegin(); it != values.constEnd(); ++it) {
+                if (it.key().startsWith(QStringLiteral("lock:"))) {
+                    // Combine the synchronous and asynchronous connections of every writer.
+                    const QString key = it.key().mid(it.key().indexOf(QLatin1Char(':'), 5) + 1);
+                    if (key.endsWith(QStringLiteral("Maximum"))) {
+                        lockTotals[key] = qMax(lockTotals.value(key), it.value().toLongLong());
+                    } else {
+                        lockTotals[key] += it.value().toLongLong();
+                    }
+                }
+            }
+        }
+    }
+    qDeleteAll(processes);
+
+    qDebug() << "--------";
+    qDebug() << "Save latency per role (worst writer of each role), microseconds:";
+    for (QMap<QString, RoleResults>::const_iterator it = results.constBegin(); it != results.constEnd(); ++it) {
+        const RoleResults &result(it.value());
+        const double seconds = qMax<qint64>(result.elapsed, 1) / 1000.0;
+        qDebug().noquote() << QStringLiteral("    %1 x%2: %3 saves/s, %4 contacts/s, %5 failed, p50 %6, p95 %7, p99 %8, max %9")
+                                  .arg(it.key(), -8).arg(result.writers)
+                                  .arg(result.operations / seconds, 0, 'f', 1)
+                                  .arg(result.contacts / seconds, 0, 'f', 1)
+                                  .arg(result.failures)
+                                  .arg(result.p50).arg(result.p95).arg(result.p99).arg(result.max);
+    }
+
+    qDebug() << "--------";
+    qDebug() << "Write lock statistics over all writers, microseconds:";
+    for (QMap<QString, qint64>::const_iterator it = lockTotals.constBegin(); it != lockTotals.constEnd(); ++it) {
+        qDebug().noquote() << QStringLiteral("    %1 %2").arg(it.key(), -16).arg(it.value());
+    }
+
+    return 0;
+}